@@ -0,0 +1,77 @@
+// 测量控制流分析的时间: 读入 Koopa IR (通常由 gen_cfg.py 生成), 对每个函数分别计时
+// 支配树, 后支配树, 循环信息的第一次计算, 以及命中 AnalysisManager 缓存的 1000 次重复查询
+// 用法: bench_analysis <koopa 文件>, 构建方法见 bench_analysis.sh
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "include/analysis.hpp"
+#include "include/ir_util.hpp"
+
+// 执行 f 花费的毫秒数
+template <typename F>
+static double time_ms(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void bench(koopa_raw_function_t func)
+{
+    size_t reachable = 0;
+    size_t loops = 0;
+    double dom = time_ms([&]
+                         { reachable = analysis_manager.dominator_tree(func).rpo().size(); });
+    double post_dom = time_ms([&]
+                              { analysis_manager.post_dominator_tree(func); });
+    double loop_info = time_ms([&]
+                               { loops = analysis_manager.loop_info(func).loops().size(); });
+    double cached = time_ms([&]
+                            {
+                                for (int i = 0; i < 1000; ++i)
+                                {
+                                    analysis_manager.dominator_tree(func);
+                                    analysis_manager.post_dominator_tree(func);
+                                    analysis_manager.loop_info(func);
+                                } });
+    int max_depth = 0;
+    for (auto loop : analysis_manager.loop_info(func).loops())
+    {
+        max_depth = std::max(max_depth, loop->depth);
+    }
+    printf("%-16s %8u %10zu %6zu %6d %9.1f ms %9.1f ms %9.1f ms %9.3f ms\n", func->name + 1, func->bbs.len, reachable, loops, max_depth, dom, post_dom, loop_info, cached);
+}
+
+int main(int argc, const char *argv[])
+{
+    assert(argc == 2);
+    std::ifstream file(argv[1]);
+    assert(file);
+    std::stringstream koopa;
+    koopa << file.rdbuf();
+
+    koopa_program_t program;
+    koopa_error_code_t ret = koopa_parse_from_string(koopa.str().c_str(), &program);
+    assert(ret == KOOPA_EC_SUCCESS);
+    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
+    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
+    koopa_delete_program(program);
+
+    // 和中端一样在拷贝上分析
+    koopa_raw_program_t copied = ir_builder.copy_program(raw);
+    printf("%-16s %8s %10s %6s %6s %12s %12s %12s %12s\n", "function", "blocks", "reachable", "loops", "depth", "dominators", "postdom", "loop info", "cached x1000");
+    for (auto func : get_functions(copied))
+    {
+        if (is_function_defined(func))
+        {
+            bench(func);
+        }
+    }
+    koopa_delete_raw_program_builder(builder);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/bash
+# 测量支配树, 后支配树和循环信息在大控制流图上的计算时间, 用来检查它们随基本块数量线性增长
+# 用法: bench_analysis.sh [基本块数量...]
+# 和 CMakeLists.txt 一样从 CDE_INCLUDE_PATH 和 CDE_LIBRARY_PATH 找 libkoopa
+
+set -e
+SIZES=${@:-25000 100000}
+BENCH_DIR=$(dirname "$(realpath "$0")")
+SRC_DIR="$BENCH_DIR/../src"
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+g++ -std=c++17 -O2 -I"$SRC_DIR" -I"$CDE_INCLUDE_PATH" -o "$WORK_DIR/bench_analysis" \
+  "$BENCH_DIR/bench_analysis.cpp" "$SRC_DIR/analysis.cpp" "$SRC_DIR/ir_util.cpp" "$SRC_DIR/profile.cpp" \
+  -L"$CDE_LIBRARY_PATH/native" -lkoopa -lpthread -ldl
+
+for n in $SIZES; do
+  echo "== $n blocks"
+  python3 "$BENCH_DIR/gen_cfg.py" "$n" > "$WORK_DIR/cfg$n.koopa"
+  "$WORK_DIR/bench_analysis" "$WORK_DIR/cfg$n.koopa"
+done
@@ -0,0 +1,28 @@
+#!/bin/bash
+# 比较 -O0 的直接翻译路径 (抽象语法树 -> RISC-V) 和经过 Koopa IR 的路径 (--passes=, 不做任何优化) 的编译时间
+# 用法: bench_o0.sh <compiler> [函数数量...]
+# 每个输入编译 3 次取平均, 时间包括进程启动
+
+set -e
+COMPILER=$(realpath "$1")
+shift
+SIZES=${@:-250 1000 4000}
+BENCH_DIR=$(dirname "$(realpath "$0")")
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# 3 次编译的平均毫秒数
+time_compile() {
+  local start=$(date +%s%N)
+  for _ in 1 2 3; do
+    "$COMPILER" -riscv "$1" -o /dev/null "${@:2}"
+  done
+  echo $(( ($(date +%s%N) - start) / 3000000 ))
+}
+
+printf "%-10s %10s %14s %14s\n" functions bytes "direct -O0" "Koopa path"
+for n in $SIZES; do
+  input="$WORK_DIR/gen$n.c"
+  python3 "$BENCH_DIR/gen_sysy.py" "$n" > "$input"
+  printf "%-10s %10s %11s ms %11s ms\n" "$n" "$(wc -c < "$input")" "$(time_compile "$input" -O0)" "$(time_compile "$input" --passes=)"
+done
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""生成用于测量控制流分析 (支配树, 后支配树, 循环信息) 速度的 Koopa IR.
+
+用法: gen_cfg.py <基本块数量> > out.koopa
+
+输出四个函数, 每个函数大约有给定数量的基本块, 只有跳转, 分支和返回:
+  @diamonds        if-else 菱形的长链
+  @loops_depth3    嵌套深度为 3 的循环巢, 重复直到基本块数量足够
+  @loops_depth20   嵌套深度为 20 的循环巢
+  @random          随机的控制流图, 有大量不可规约的环和不可达的基本块
+分支条件都是函数参数 %p, 避免被当作常量处理.
+"""
+import random
+import sys
+
+
+class Function:
+    def __init__(self, name):
+        self.name = name
+        self.blocks = []
+
+    def new_block(self):
+        self.blocks.append([f"%b{len(self.blocks)}", None])
+        return len(self.blocks) - 1
+
+    def jump(self, bb, target):
+        self.blocks[bb][1] = f"jump %b{target}"
+
+    def branch(self, bb, true_bb, false_bb):
+        self.blocks[bb][1] = f"br %p, %b{true_bb}, %b{false_bb}"
+
+    def ret(self, bb):
+        self.blocks[bb][1] = "ret"
+
+    def emit(self):
+        lines = [f"fun @{self.name}(%p: i32) {{"]
+        for label, terminator in self.blocks:
+            lines.append(f"{label}:")
+            lines.append(f"  {terminator}")
+        lines.append("}")
+        return "\n".join(lines)
+
+
+def diamonds(n):
+    func = Function("diamonds")
+    cur = func.new_block()
+    while len(func.blocks) + 3 <= n:
+        then_bb, else_bb, join_bb = func.new_block(), func.new_block(), func.new_block()
+        func.branch(cur, then_bb, else_bb)
+        func.jump(then_bb, join_bb)
+        func.jump(else_bb, join_bb)
+        cur = join_bb
+    func.ret(cur)
+    return func
+
+
+def loop_nests(n, depth):
+    # 每层循环有一个循环头和一个 latch, 最内层是一个 if
+    func = Function(f"loops_depth{depth}")
+    cur = func.new_block()
+    while len(func.blocks) + 3 * depth + 2 <= n:
+        headers = []
+        for _ in range(depth):
+            header = func.new_block()
+            func.jump(cur, header)
+            headers.append(header)
+            cur = header
+        body, then_bb, join_bb = func.new_block(), func.new_block(), func.new_block()
+        func.jump(cur, body)
+        func.branch(body, then_bb, join_bb)
+        func.jump(then_bb, join_bb)
+        cur = join_bb
+        for header in reversed(headers):
+            exit_bb = func.new_block()
+            func.branch(cur, header, exit_bb)
+            cur = exit_bb
+    func.ret(cur)
+    return func
+
+
+def random_cfg(n, seed=12345):
+    # 大部分边指向后面不远的基本块, 十分之一的基本块有一条指向任意基本块 (entry 除外) 的边
+    rng = random.Random(seed)
+    func = Function("random")
+    for _ in range(n):
+        func.new_block()
+
+    def near(i):
+        return min(i + 1 + rng.randrange(8), n - 1)
+
+    for i in range(n - 1):
+        if rng.randrange(10) == 0:
+            func.branch(i, near(i), rng.randrange(1, n))
+        elif rng.randrange(2):
+            func.branch(i, near(i), near(i))
+        else:
+            func.jump(i, near(i))
+    func.ret(n - 1)
+    return func
+
+
+def main():
+    n = int(sys.argv[1])
+    funcs = [diamonds(n), loop_nests(n, 3), loop_nests(n, 20), random_cfg(n)]
+    print("\n\n".join(func.emit() for func in funcs))
+
+
+if __name__ == "__main__":
+    main()
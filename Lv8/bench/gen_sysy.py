@@ -0,0 +1,27 @@
+#!/usr/bin/env python3
+"""生成用于测量编译速度的 SysY 程序.
+
+用法: gen_sysy.py <函数数量> > out.c
+
+每个函数包含一个 while 循环, if/else, 短路求值和对全局变量的读取,
+main 依次调用所有函数; 源码大小和函数数量成正比, 约 200 字节/函数.
+"""
+import sys
+
+
+def generate(num_funcs):
+    lines = ["int g0 = 1;"]
+    for f in range(num_funcs):
+        lines.append(
+            f"int f{f}(int a, int b) {{ int s = 0; int i = 0; "
+            f"while (i < a) {{ if (i % 3 == 0 && b > 0 || i == 7) {{ s = s + i * b - g0; }} "
+            f"else {{ s = s - (i / 2); }} i = i + 1; }} return s + a; }}")
+    lines.append("int main() { int s = 0;")
+    for f in range(num_funcs):
+        lines.append(f"  s = s + f{f}({f % 13}, {f % 5});")
+    lines.append("  return s % 256; }")
+    return "\n".join(lines) + "\n"
+
+
+if __name__ == "__main__":
+    sys.stdout.write(generate(int(sys.argv[1])))
@@ -0,0 +1,722 @@
+#include <algorithm>
+#include <climits>
+
+#include "include/analysis.hpp"
+#include "include/ir_util.hpp"
+
+////////////////////////////////////////////////////
+// 支配树和后支配树
+////////////////////////////////////////////////////
+
+void DominanceInfo::build(koopa_raw_basic_block_t root, const std::function<std::vector<koopa_raw_basic_block_t>(koopa_raw_basic_block_t)> &successors)
+{
+    // 非递归 DFS 求后序, 基本块很多的时候递归会爆栈; 结点按发现的顺序编号, 同时记录后继的编号
+    std::unordered_map<koopa_raw_basic_block_t, int> dfs_index;
+    std::vector<koopa_raw_basic_block_t> dfs_nodes;
+    std::vector<std::vector<koopa_raw_basic_block_t>> succs;
+    std::vector<std::vector<int>> succ_ids;
+    std::vector<int> post_order;
+    std::vector<std::pair<int, size_t>> stack;
+    auto discover = [&](koopa_raw_basic_block_t bb)
+    {
+        int id = dfs_nodes.size();
+        dfs_index[bb] = id;
+        dfs_nodes.push_back(bb);
+        succs.push_back(successors(bb));
+        succ_ids.emplace_back();
+        stack.push_back({id, 0});
+        return id;
+    };
+    discover(root);
+    while (!stack.empty())
+    {
+        auto [id, next] = stack.back();
+        if (next < succs[id].size())
+        {
+            ++stack.back().second;
+            koopa_raw_basic_block_t succ = succs[id][next];
+            auto it = dfs_index.find(succ);
+            int succ_id = it == dfs_index.end() ? discover(succ) : it->second;
+            succ_ids[id].push_back(succ_id);
+        }
+        else
+        {
+            post_order.push_back(id);
+            stack.pop_back();
+        }
+    }
+
+    // 按逆后序重新编号
+    size_t n = post_order.size();
+    std::vector<int> order(n);
+    _nodes.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        order[post_order[n - 1 - i]] = i;
+        _nodes[i] = dfs_nodes[post_order[n - 1 - i]];
+    }
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (_nodes[i])
+        {
+            _rpo.push_back(_nodes[i]);
+        }
+    }
+    // 直接复用 DFS 的哈希表, 只改写其中的编号
+    _index = std::move(dfs_index);
+    for (auto &item : _index)
+    {
+        item.second = order[item.second];
+    }
+    _index.erase(nullptr);
+    std::vector<std::vector<int>> preds(n);
+    _preds.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        int from = order[post_order[n - 1 - i]];
+        for (int succ_id : succ_ids[post_order[n - 1 - i]])
+        {
+            int to = order[succ_id];
+            // branch 的两个目标相同时前驱只记录一次
+            if (preds[to].empty() || preds[to].back() != from)
+            {
+                preds[to].push_back(from);
+                _preds[to].push_back(_nodes[from]);
+            }
+        }
+    }
+
+    // Cooper-Harvey-Kennedy: 按逆后序迭代, 直到直接支配者不再变化
+    std::vector<int> idom(n, -1);
+    idom[0] = 0;
+    auto intersect = [&](int a, int b)
+    {
+        while (a != b)
+        {
+            while (a > b)
+            {
+                a = idom[a];
+            }
+            while (b > a)
+            {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < n; ++i)
+        {
+            int new_idom = -1;
+            for (int p : preds[i])
+            {
+                if (idom[p] == -1)
+                {
+                    continue;
+                }
+                new_idom = new_idom == -1 ? p : intersect(p, new_idom);
+            }
+            if (idom[i] != new_idom)
+            {
+                idom[i] = new_idom;
+                changed = true;
+            }
+        }
+    }
+    idom[0] = -1;
+    _idom = idom;
+    _children.resize(n);
+    for (size_t i = 1; i < n; ++i)
+    {
+        _children[idom[i]].push_back(_nodes[i]);
+    }
+
+    // 支配边界: 对每个有多个前驱的结点, 从每个前驱沿支配树向上走到它的直接支配者为止
+    _frontier.resize(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (preds[i].size() < 2)
+        {
+            continue;
+        }
+        for (int runner : preds[i])
+        {
+            while (runner != -1 && runner != idom[i])
+            {
+                auto &frontier = _frontier[runner];
+                if (frontier.empty() || frontier.back() != _nodes[i])
+                {
+                    frontier.push_back(_nodes[i]);
+                }
+                runner = idom[runner];
+            }
+        }
+    }
+
+    // 支配树上的 DFS 时间戳
+    std::vector<std::vector<int>> children(n);
+    for (size_t i = 1; i < n; ++i)
+    {
+        children[idom[i]].push_back(i);
+    }
+    int time = 0;
+    _enter.resize(n);
+    _leave.resize(n);
+    std::vector<std::pair<int, size_t>> dfs_stack;
+    dfs_stack.push_back({0, 0});
+    _enter[0] = time++;
+    while (!dfs_stack.empty())
+    {
+        auto &top = dfs_stack.back();
+        if (top.second < children[top.first].size())
+        {
+            int child = children[top.first][top.second++];
+            _enter[child] = time++;
+            dfs_stack.push_back({child, 0});
+        }
+        else
+        {
+            _leave[top.first] = time++;
+            dfs_stack.pop_back();
+        }
+    }
+}
+
+const std::vector<koopa_raw_basic_block_t> &DominanceInfo::rpo() const
+{
+    return _rpo;
+}
+
+bool DominanceInfo::is_reachable(koopa_raw_basic_block_t bb) const
+{
+    return _index.find(bb) != _index.end();
+}
+
+const std::vector<koopa_raw_basic_block_t> &DominatorTree::predecessors(koopa_raw_basic_block_t bb) const
+{
+    auto it = _index.find(bb);
+    return it == _index.end() ? _empty : _preds[it->second];
+}
+
+koopa_raw_basic_block_t DominanceInfo::idom(koopa_raw_basic_block_t bb) const
+{
+    auto it = _index.find(bb);
+    return it == _index.end() || _idom[it->second] == -1 ? nullptr : _nodes[_idom[it->second]];
+}
+
+const std::vector<koopa_raw_basic_block_t> &DominanceInfo::children(koopa_raw_basic_block_t bb) const
+{
+    auto it = _index.find(bb);
+    return it == _index.end() ? _empty : _children[it->second];
+}
+
+const std::vector<koopa_raw_basic_block_t> &DominanceInfo::frontier(koopa_raw_basic_block_t bb) const
+{
+    auto it = _index.find(bb);
+    return it == _index.end() ? _empty : _frontier[it->second];
+}
+
+bool DominanceInfo::dominates(koopa_raw_basic_block_t a, koopa_raw_basic_block_t b) const
+{
+    auto it_a = _index.find(a), it_b = _index.find(b);
+    if (it_a == _index.end() || it_b == _index.end())
+    {
+        return false;
+    }
+    return _enter[it_a->second] <= _enter[it_b->second] && _leave[it_b->second] <= _leave[it_a->second];
+}
+
+DominatorTree::DominatorTree(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    if (!bbs.empty())
+    {
+        build(bbs[0], get_successors);
+    }
+}
+
+PostDominatorTree::PostDominatorTree(const DominatorTree &dom_tree)
+{
+    // 反向的控制流图: 虚拟出口 (nullptr) 的后继是所有 ret 基本块, 其他基本块的后继是它的前驱; 只考虑从 entry 可达的基本块
+    std::vector<koopa_raw_basic_block_t> exits;
+    for (auto bb : dom_tree.rpo())
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (terminator && terminator->kind.tag == KOOPA_RVT_RETURN)
+        {
+            exits.push_back(bb);
+        }
+    }
+    build(nullptr, [&](koopa_raw_basic_block_t bb)
+          { return bb ? dom_tree.predecessors(bb) : exits; });
+}
+
+////////////////////////////////////////////////////
+// LoopInfo
+////////////////////////////////////////////////////
+
+bool Loop::contains(koopa_raw_basic_block_t bb) const
+{
+    return blocks.count(bb) > 0;
+}
+
+LoopInfo::LoopInfo(const DominatorTree &dom_tree)
+{
+    for (auto header : dom_tree.rpo())
+    {
+        std::vector<koopa_raw_basic_block_t> latches;
+        for (auto pred : dom_tree.predecessors(header))
+        {
+            if (dom_tree.dominates(header, pred) && std::find(latches.begin(), latches.end(), pred) == latches.end())
+            {
+                latches.push_back(pred);
+            }
+        }
+        if (latches.empty())
+        {
+            continue;
+        }
+        // 从 latch 沿前驱反向走到循环头, 经过的基本块都在循环中
+        _loops.emplace_back();
+        Loop &loop = _loops.back();
+        loop.header = header;
+        loop.latches = latches;
+        loop.blocks.insert(header);
+        std::vector<koopa_raw_basic_block_t> worklist;
+        for (auto latch : latches)
+        {
+            if (loop.blocks.insert(latch).second)
+            {
+                worklist.push_back(latch);
+            }
+        }
+        while (!worklist.empty())
+        {
+            koopa_raw_basic_block_t bb = worklist.back();
+            worklist.pop_back();
+            for (auto pred : dom_tree.predecessors(bb))
+            {
+                if (loop.blocks.insert(pred).second)
+                {
+                    worklist.push_back(pred);
+                }
+            }
+        }
+    }
+
+    // 按照基本块数量从小到大排序, 内层循环一定比外层循环小
+    for (auto &loop : _loops)
+    {
+        _inner_to_outer.push_back(&loop);
+    }
+    std::stable_sort(_inner_to_outer.begin(), _inner_to_outer.end(), [](const Loop *a, const Loop *b)
+                     { return a->blocks.size() < b->blocks.size(); });
+
+    // 从外到内 (从大到小) 处理, 处理到一个循环时, 它的循环头所在的最内层循环就是包含它的更大的循环中最小的一个, 即外层循环
+    for (auto it = _inner_to_outer.rbegin(); it != _inner_to_outer.rend(); ++it)
+    {
+        Loop *loop = *it;
+        auto outer = _innermost.find(loop->header);
+        if (outer != _innermost.end())
+        {
+            loop->parent = outer->second;
+        }
+        loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+        for (auto bb : loop->blocks)
+        {
+            _innermost[bb] = loop;
+        }
+    }
+}
+
+const std::vector<Loop *> &LoopInfo::loops() const
+{
+    return _inner_to_outer;
+}
+
+Loop *LoopInfo::loop_of(koopa_raw_basic_block_t bb) const
+{
+    auto it = _innermost.find(bb);
+    return it == _innermost.end() ? nullptr : it->second;
+}
+
+////////////////////////////////////////////////////
+// AnalysisManager
+////////////////////////////////////////////////////
+
+AnalysisManager analysis_manager;
+
+const DominatorTree &AnalysisManager::dominator_tree(koopa_raw_function_t func)
+{
+    auto &analyses = _cache[func];
+    if (!analyses.dom_tree)
+    {
+        analyses.dom_tree = std::make_unique<DominatorTree>(func);
+    }
+    return *analyses.dom_tree;
+}
+
+const PostDominatorTree &AnalysisManager::post_dominator_tree(koopa_raw_function_t func)
+{
+    const DominatorTree &dom_tree = dominator_tree(func);
+    auto &analyses = _cache[func];
+    if (!analyses.post_dom_tree)
+    {
+        analyses.post_dom_tree = std::make_unique<PostDominatorTree>(dom_tree);
+    }
+    return *analyses.post_dom_tree;
+}
+
+const LoopInfo &AnalysisManager::loop_info(koopa_raw_function_t func)
+{
+    const DominatorTree &dom_tree = dominator_tree(func);
+    auto &analyses = _cache[func];
+    if (!analyses.loop_info)
+    {
+        analyses.loop_info = std::make_unique<LoopInfo>(dom_tree);
+    }
+    return *analyses.loop_info;
+}
+
+void AnalysisManager::invalidate(koopa_raw_function_t func)
+{
+    _cache.erase(func);
+}
+
+void AnalysisManager::invalidate_all()
+{
+    _cache.clear();
+}
+
+////////////////////////////////////////////////////
+// 归纳变量
+////////////////////////////////////////////////////
+
+// next 是否是 param + step 的形式
+static bool match_increment(koopa_raw_value_t next, koopa_raw_value_t param, int &step)
+{
+    if (next->kind.tag != KOOPA_RVT_BINARY)
+    {
+        return false;
+    }
+    const auto &binary = next->kind.data.binary;
+    if (binary.op == KOOPA_RBO_ADD && binary.lhs == param && is_integer(binary.rhs))
+    {
+        step = binary.rhs->kind.data.integer.value;
+    }
+    else if (binary.op == KOOPA_RBO_ADD && binary.rhs == param && is_integer(binary.lhs))
+    {
+        step = binary.lhs->kind.data.integer.value;
+    }
+    else if (binary.op == KOOPA_RBO_SUB && binary.lhs == param && is_integer(binary.rhs) && binary.rhs->kind.data.integer.value != INT_MIN)
+    {
+        step = -binary.rhs->kind.data.integer.value;
+    }
+    else
+    {
+        return false;
+    }
+    return step != 0;
+}
+
+std::vector<InductionVariable> find_induction_variables(const Loop &loop)
+{
+    std::vector<koopa_raw_value_t> params = get_values(loop.header->params);
+    std::vector<InductionVariable> ivs;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        InductionVariable iv;
+        iv.index = i;
+        iv.param = params[i];
+        bool matched = true;
+        for (auto latch : loop.latches)
+        {
+            koopa_raw_value_t terminator = get_terminator(latch);
+            std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+            for (size_t k = 0; k < succs.size() && matched; ++k)
+            {
+                if (succs[k] != loop.header)
+                {
+                    continue;
+                }
+                int step = 0;
+                matched = match_increment(get_successor_args(terminator, k)[i], params[i], step) && (iv.step == 0 || iv.step == step);
+                iv.step = step;
+            }
+        }
+        if (matched && iv.step != 0)
+        {
+            ivs.push_back(iv);
+        }
+    }
+    return ivs;
+}
+
+bool analyze_counted_loop(koopa_raw_function_t func, const Loop &loop, const LoopInfo &loop_info, const DominatorTree &dom_tree, CountedLoop &counted)
+{
+    for (auto other : loop_info.loops())
+    {
+        if (other != &loop && loop.contains(other->header))
+        {
+            return false;
+        }
+    }
+    if (loop.latches.size() != 1 || loop.header->params.len == 0)
+    {
+        return false;
+    }
+    counted.loop = &loop;
+    counted.latch = loop.latches[0];
+    koopa_raw_value_t branch = get_terminator(counted.latch);
+    if (branch->kind.tag != KOOPA_RVT_BRANCH)
+    {
+        return false;
+    }
+    std::vector<koopa_raw_basic_block_t> latch_succs = get_successors_of_terminator(branch);
+    size_t back_index = latch_succs[0] == loop.header ? 0 : 1;
+    if (latch_succs[back_index] != loop.header || loop.contains(latch_succs[1 - back_index]))
+    {
+        return false;
+    }
+    counted.exit = latch_succs[1 - back_index];
+    counted.back_args = get_successor_args(branch, back_index);
+    counted.exit_args = get_successor_args(branch, 1 - back_index);
+
+    // 没有其他出口, 也没有 ret
+    for (auto bb : dom_tree.rpo())
+    {
+        if (!loop.contains(bb))
+        {
+            continue;
+        }
+        counted.blocks.push_back(bb);
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (terminator->kind.tag == KOOPA_RVT_RETURN)
+        {
+            return false;
+        }
+        for (auto succ : get_successors_of_terminator(terminator))
+        {
+            if (!loop.contains(succ) && bb != counted.latch)
+            {
+                return false;
+            }
+        }
+        for (auto param : get_values(bb->params))
+        {
+            counted.defined.insert(param);
+        }
+        for (auto inst : get_insts(bb))
+        {
+            counted.defined.insert(inst);
+            counted.size += !is_terminator(inst);
+        }
+    }
+
+    // 循环中的值只能通过出口的实参在循环外使用
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (loop.contains(bb))
+        {
+            continue;
+        }
+        for (auto inst : get_insts(bb))
+        {
+            for (auto operand : get_operands(inst))
+            {
+                if (counted.defined.count(operand))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    for (auto arg : counted.exit_args)
+    {
+        if (counted.defined.count(arg) && std::find(counted.back_args.begin(), counted.back_args.end(), arg) == counted.back_args.end())
+        {
+            return false;
+        }
+    }
+
+    // 退出条件: 一边是某个归纳变量的 iv_next, 另一边是循环不变量
+    koopa_raw_value_t cond = branch->kind.data.branch.cond;
+    if (cond->kind.tag != KOOPA_RVT_BINARY)
+    {
+        return false;
+    }
+    koopa_raw_binary_op_t op = cond->kind.data.binary.op;
+    if (op != KOOPA_RBO_LT && op != KOOPA_RBO_LE && op != KOOPA_RBO_GT && op != KOOPA_RBO_GE)
+    {
+        return false;
+    }
+    koopa_raw_value_t lhs = cond->kind.data.binary.lhs;
+    koopa_raw_value_t rhs = cond->kind.data.binary.rhs;
+    if (counted.defined.count(rhs) && !counted.defined.count(lhs))
+    {
+        std::swap(lhs, rhs);
+        op = swap_comparison(op);
+    }
+    if (counted.defined.count(rhs) || !counted.defined.count(lhs))
+    {
+        return false;
+    }
+    if (back_index == 1)
+    {
+        op = negate_comparison(op);
+    }
+    for (auto &iv : find_induction_variables(loop))
+    {
+        if (counted.back_args[iv.index] != lhs)
+        {
+            continue;
+        }
+        // 步长的方向要和比较的方向一致, 否则循环次数不好计算
+        bool increasing = op == KOOPA_RBO_LT || op == KOOPA_RBO_LE;
+        if ((iv.step > 0) != increasing)
+        {
+            return false;
+        }
+        counted.iv = iv;
+        counted.op = op;
+        counted.bound = rhs;
+        return true;
+    }
+    return false;
+}
+
+////////////////////////////////////////////////////
+// 过程间分析
+////////////////////////////////////////////////////
+
+/**
+ * @brief 计算每个函数直接或者通过调用其他函数间接访问的全局变量
+ * @param[in] program raw program
+ * @param[in] accessed 指令直接访问的全局变量, 不访问时返回 nullptr
+ * @return 函数到全局变量集合的映射
+ */
+static std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> compute_accessed_globals(const koopa_raw_program_t &program, koopa_raw_value_t (*accessed)(koopa_raw_value_t inst))
+{
+    std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> globals;
+    std::unordered_map<koopa_raw_function_t, std::vector<koopa_raw_function_t>> callees;
+    std::vector<koopa_raw_function_t> funcs = get_functions(program);
+    for (auto func : funcs)
+    {
+        globals[func];
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                koopa_raw_value_t global = accessed(inst);
+                if (global && global->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                {
+                    globals[func].insert(global);
+                }
+                else if (inst->kind.tag == KOOPA_RVT_CALL)
+                {
+                    callees[func].push_back(inst->kind.data.call.callee);
+                }
+            }
+        }
+    }
+    // 沿调用图传播直到不动点
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto func : funcs)
+        {
+            for (auto callee : callees[func])
+            {
+                for (auto global : globals[callee])
+                {
+                    if (globals[func].insert(global).second)
+                    {
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+    return globals;
+}
+
+std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> compute_modified_globals(const koopa_raw_program_t &program)
+{
+    return compute_accessed_globals(program, [](koopa_raw_value_t inst)
+                                    { return inst->kind.tag == KOOPA_RVT_STORE ? inst->kind.data.store.dest : nullptr; });
+}
+
+std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> compute_read_globals(const koopa_raw_program_t &program)
+{
+    return compute_accessed_globals(program, [](koopa_raw_value_t inst)
+                                    { return inst->kind.tag == KOOPA_RVT_LOAD ? inst->kind.data.load.src : nullptr; });
+}
+
+std::unordered_set<koopa_raw_function_t> compute_pure_functions(const koopa_raw_program_t &program)
+{
+    // 先找出自身没有副作用的函数: 不 store 全局变量, 没有循环, 记下它调用的函数
+    std::unordered_map<koopa_raw_function_t, std::vector<koopa_raw_function_t>> candidates;
+    for (auto func : get_functions(program))
+    {
+        if (!is_function_defined(func))
+        {
+            continue;
+        }
+        bool pure = true;
+        std::vector<koopa_raw_function_t> callees;
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag == KOOPA_RVT_STORE && inst->kind.data.store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+                {
+                    pure = false;
+                }
+                else if (inst->kind.tag == KOOPA_RVT_CALL)
+                {
+                    callees.push_back(inst->kind.data.call.callee);
+                }
+            }
+        }
+        if (pure)
+        {
+            DominatorTree dom_tree(func);
+            LoopInfo loop_info(dom_tree);
+            pure = loop_info.loops().empty();
+        }
+        if (pure)
+        {
+            candidates[func] = callees;
+        }
+    }
+
+    // 被调用的函数都是纯函数时才是纯函数; 从空集合开始, 递归的函数永远不会加入
+    std::unordered_set<koopa_raw_function_t> pure;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto &item : candidates)
+        {
+            if (pure.count(item.first))
+            {
+                continue;
+            }
+            bool all_pure = true;
+            for (auto callee : item.second)
+            {
+                all_pure = all_pure && pure.count(callee);
+            }
+            if (all_pure)
+            {
+                pure.insert(item.first);
+                changed = true;
+            }
+        }
+    }
+    return pure;
+}
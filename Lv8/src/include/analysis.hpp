@@ -0,0 +1,301 @@
+/**
+ * @file include/analysis.hpp
+ * @brief 中端优化使用的分析, 包括前驱, 支配树, 后支配树, 自然循环和过程间的全局变量读取和修改集合, 以及按函数缓存这些分析的 AnalysisManager
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "koopa.h"
+
+/**
+ * @brief 支配树和后支配树共用的部分: 在一个有根的图上用 Cooper-Harvey-Kennedy 迭代算法计算直接支配者, 支配树和支配边界
+ * @note 只包含从根可达的结点; 构造之后函数的控制流不能再修改, 修改之后需要重新构造 (或者通过 AnalysisManager 使缓存失效)
+ * @date 2026-10-18
+ */
+class DominanceInfo
+{
+protected:
+    // 所有可达结点按逆后序排列, 第一个是根 (可能是虚拟的 nullptr); 下面的数组都用这里的下标
+    std::vector<koopa_raw_basic_block_t> _nodes;
+
+    // 可达的基本块的逆后序, 不包括虚拟的根
+    std::vector<koopa_raw_basic_block_t> _rpo;
+
+    // 基本块在 _nodes 中的下标, 不包括虚拟的根
+    std::unordered_map<koopa_raw_basic_block_t, int> _index;
+
+    // 每个可达结点在图中的可达前驱
+    std::vector<std::vector<koopa_raw_basic_block_t>> _preds;
+
+    // 直接支配者的下标, 根是 -1
+    std::vector<int> _idom;
+
+    // 支配树上的孩子
+    std::vector<std::vector<koopa_raw_basic_block_t>> _children;
+
+    // 支配边界
+    std::vector<std::vector<koopa_raw_basic_block_t>> _frontier;
+
+    // 支配树上的 DFS 进入和离开时间, 用于 O(1) 判断支配关系
+    std::vector<int> _enter, _leave;
+
+    // 空的列表, 查询不可达结点的时候返回
+    const std::vector<koopa_raw_basic_block_t> _empty;
+
+    /**
+     * @brief 从根出发计算支配关系
+     * @note 图只在 DFS 时访问一次, 之后都在下标上计算, 避免大量的哈希表查找
+     * @param[in] root 根结点, 可以是表示虚拟结点的 nullptr
+     * @param[in] successors 图中每个结点的后继
+     * @date 2026-10-18
+     */
+    void build(koopa_raw_basic_block_t root, const std::function<std::vector<koopa_raw_basic_block_t>(koopa_raw_basic_block_t)> &successors);
+
+public:
+    // 可达结点的逆后序, 第一个是根
+    const std::vector<koopa_raw_basic_block_t> &rpo() const;
+
+    // 结点是否从根可达
+    bool is_reachable(koopa_raw_basic_block_t bb) const;
+
+    // 直接支配者, 根和不可达结点返回 nullptr
+    koopa_raw_basic_block_t idom(koopa_raw_basic_block_t bb) const;
+
+    // 支配树上的孩子
+    const std::vector<koopa_raw_basic_block_t> &children(koopa_raw_basic_block_t bb) const;
+
+    // 支配边界
+    const std::vector<koopa_raw_basic_block_t> &frontier(koopa_raw_basic_block_t bb) const;
+
+    // a 是否支配 b, 结点支配自己
+    bool dominates(koopa_raw_basic_block_t a, koopa_raw_basic_block_t b) const;
+};
+
+/**
+ * @brief 一个函数的支配树, 根是 entry, 只包含从 entry 可达的基本块
+ * @date 2026-10-18
+ */
+class DominatorTree : public DominanceInfo
+{
+public:
+    /**
+     * @brief 构造函数, 计算函数的支配树和支配边界
+     * @param[in] func 一个定义过的函数
+     * @date 2026-10-18
+     */
+    DominatorTree(koopa_raw_function_t func);
+
+    // 基本块的可达前驱
+    const std::vector<koopa_raw_basic_block_t> &predecessors(koopa_raw_basic_block_t bb) const;
+};
+
+/**
+ * @brief 一个函数的后支配树, 在反向的控制流图上计算, 根是连接所有 ret 基本块的虚拟出口
+ * @note 虚拟出口不出现在 rpo 中, 直接后支配者是虚拟出口的基本块 (比如 ret 基本块) 的 idom 为 nullptr
+ * @note 只包含能走到 ret 的基本块, 无限循环中的基本块不在后支配树中; 支配边界就是控制依赖: frontier(b) 是 b 控制依赖的分支所在的基本块
+ * @date 2026-10-18
+ */
+class PostDominatorTree : public DominanceInfo
+{
+public:
+    /**
+     * @brief 构造函数, 计算函数的后支配树和后支配边界
+     * @param[in] dom_tree 函数的支配树, 用来找出可达的基本块和它们的前驱
+     * @date 2026-10-18
+     */
+    PostDominatorTree(const DominatorTree &dom_tree);
+};
+
+/**
+ * @brief 一个自然循环, 由所有回边 (latch -> header, header 支配 latch) 共同确定
+ * @date 2026-10-18
+ */
+struct Loop
+{
+    // 循环头, 支配循环中的所有基本块
+    koopa_raw_basic_block_t header = nullptr;
+
+    // 跳回循环头的基本块
+    std::vector<koopa_raw_basic_block_t> latches;
+
+    // 循环中的所有基本块, 包括内层循环的基本块
+    std::unordered_set<koopa_raw_basic_block_t> blocks;
+
+    // 直接包含这个循环的外层循环, 最外层循环为 nullptr
+    Loop *parent = nullptr;
+
+    // 嵌套深度, 最外层循环为 1
+    int depth = 1;
+
+    // 基本块是否在循环中
+    bool contains(koopa_raw_basic_block_t bb) const;
+};
+
+/**
+ * @brief 一个函数中的所有自然循环, 以及它们的嵌套关系
+ * @note 和 DominatorTree 一样, 构造之后函数的控制流不能再修改
+ * @note 循环的 blocks 包括内层循环的基本块, 所以总大小是基本块数量乘以嵌套深度
+ * @date 2026-10-18
+ */
+class LoopInfo
+{
+private:
+    // 所有循环, 存放在 deque 中保证指针不失效
+    std::deque<Loop> _loops;
+
+    // 按照从内到外的顺序排列的循环
+    std::vector<Loop *> _inner_to_outer;
+
+    // 每个基本块所在的最内层循环
+    std::unordered_map<koopa_raw_basic_block_t, Loop *> _innermost;
+
+public:
+    /**
+     * @brief 构造函数, 从回边找出所有自然循环, 同一个循环头的回边合并成一个循环
+     * @param[in] dom_tree 函数的支配树, 用来找出可达的基本块和回边
+     * @date 2026-10-18
+     */
+    LoopInfo(const DominatorTree &dom_tree);
+
+    // 所有循环, 内层循环在外层循环前面
+    const std::vector<Loop *> &loops() const;
+
+    // 基本块所在的最内层循环, 不在循环中时返回 nullptr
+    Loop *loop_of(koopa_raw_basic_block_t bb) const;
+};
+
+/**
+ * @brief 按函数缓存支配树, 后支配树和循环信息, 第一次查询时计算
+ * @note 缓存不会自动失效: 修改了函数控制流 (基本块, jump/branch 的目标) 的优化必须调用 invalidate, 之前拿到的引用也随之失效
+ * @note 只删除不可达的基本块, 或者只修改指令而不修改 jump/branch 的目标时不需要使缓存失效
+ * @date 2026-10-18
+ */
+class AnalysisManager
+{
+private:
+    struct FunctionAnalyses
+    {
+        std::unique_ptr<DominatorTree> dom_tree;
+        std::unique_ptr<PostDominatorTree> post_dom_tree;
+        std::unique_ptr<LoopInfo> loop_info;
+    };
+
+    std::unordered_map<koopa_raw_function_t, FunctionAnalyses> _cache;
+
+public:
+    // 函数的支配树
+    const DominatorTree &dominator_tree(koopa_raw_function_t func);
+
+    // 函数的后支配树, 依赖支配树
+    const PostDominatorTree &post_dominator_tree(koopa_raw_function_t func);
+
+    // 函数的循环信息, 依赖支配树
+    const LoopInfo &loop_info(koopa_raw_function_t func);
+
+    // 函数的控制流改变之后丢弃它的所有分析
+    void invalidate(koopa_raw_function_t func);
+
+    // 丢弃所有函数的分析
+    void invalidate_all();
+};
+
+// 全局共用的分析缓存
+extern AnalysisManager analysis_manager;
+
+/**
+ * @brief 循环头参数上的基本归纳变量 {start, +, step}: 每条回边传回的都是 param + step
+ * @date 2026-10-18
+ */
+struct InductionVariable
+{
+    // 是循环头的第几个参数
+    size_t index = 0;
+    koopa_raw_value_t param = nullptr;
+    int step = 0;
+};
+
+/**
+ * @brief 找出循环的所有基本归纳变量
+ * @param[in] loop 一个循环, 所有 latch 都以 jump/branch 跳回循环头
+ * @return 基本归纳变量, 按照参数下标排列
+ * @date 2026-10-18
+ */
+std::vector<InductionVariable> find_induction_variables(const Loop &loop);
+
+/**
+ * @brief 计数循环: 最内层, 只有一个 latch, 只从 latch 退出, 并且退出条件是归纳变量和循环不变量的比较
+ * @note 循环已经被旋转过, latch 的条件判断的是下一次迭代的归纳变量 `iv_next op bound`, 为真时继续循环
+ * @date 2026-10-18
+ */
+struct CountedLoop
+{
+    const Loop *loop = nullptr;
+
+    // 循环中的基本块, 按照逆后序排列, 第一个是循环头
+    std::vector<koopa_raw_basic_block_t> blocks;
+
+    koopa_raw_basic_block_t latch = nullptr;
+    koopa_raw_basic_block_t exit = nullptr;
+
+    // 跳回循环头和跳到出口的实参; 出口的实参要么在循环外定义, 要么就是跳回循环头的实参
+    std::vector<koopa_raw_value_t> back_args;
+    std::vector<koopa_raw_value_t> exit_args;
+
+    // 控制循环次数的归纳变量
+    InductionVariable iv;
+
+    // 继续循环的条件 `iv_next op bound`, op 是 lt/le/gt/ge 之一, 方向和步长一致
+    koopa_raw_binary_op_t op = KOOPA_RBO_LT;
+    koopa_raw_value_t bound = nullptr;
+
+    // 循环中定义的所有参数和指令
+    std::unordered_set<koopa_raw_value_t> defined;
+
+    // 循环体的指令数量, 不算 jump/branch
+    size_t size = 0;
+};
+
+/**
+ * @brief 识别计数循环, 循环中定义的值只能通过出口的实参在循环外使用
+ * @param[in] func 循环所在的函数
+ * @param[in] loop 一个循环
+ * @param[in] loop_info 这个函数的循环信息
+ * @param[in] dom_tree 这个函数的支配树
+ * @param[out] counted 识别出来的计数循环
+ * @return 是否是计数循环
+ * @date 2026-10-18
+ */
+bool analyze_counted_loop(koopa_raw_function_t func, const Loop &loop, const LoopInfo &loop_info, const DominatorTree &dom_tree, CountedLoop &counted);
+
+/**
+ * @brief 计算每个函数可能修改的全局变量, 包括通过调用其他函数间接修改的
+ * @param[in] program raw program
+ * @return 函数到它可能修改的全局变量集合的映射, 库函数不修改全局变量
+ * @date 2026-10-18
+ */
+std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> compute_modified_globals(const koopa_raw_program_t &program);
+
+/**
+ * @brief 计算每个函数可能读取的全局变量, 包括通过调用其他函数间接读取的
+ * @param[in] program raw program
+ * @return 函数到它可能读取的全局变量集合的映射, 库函数不读取全局变量
+ * @date 2026-10-18
+ */
+std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> compute_read_globals(const koopa_raw_program_t &program);
+
+/**
+ * @brief 计算没有副作用并且一定会返回的函数, 结果没有被使用的调用可以直接删除
+ * @note 要求函数不 store 全局变量, 没有循环, 不递归, 并且只调用这样的函数; 库函数都有副作用
+ * @param[in] program raw program
+ * @return 纯函数的集合
+ * @date 2026-10-18
+ */
+std::unordered_set<koopa_raw_function_t> compute_pure_functions(const koopa_raw_program_t &program);
@@ -0,0 +1,131 @@
+/**
+ * @file include/incremental.hpp
+ * @brief 定义了给编辑器使用的增量前端
+ * @note 源码按顶层的 CompUnit (函数定义或者全局声明) 切分, 每个 CompUnit 保存自己的源码范围, 出现的标识符, 抽象语法树和输出的 Koopa IR
+ * @note 修改源码时只重新切分修改位置附近的源码, 重新词法分析和语法分析受影响的 CompUnit, 然后只重新输出这些 CompUnit, 以及用到了签名发生变化的全局名字的 CompUnit
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "koopa.hpp"
+
+/**
+ * @brief 增量前端, 保存上一次的切分结果和每个 CompUnit 的输出, 每次修改之后给出整个程序的 Koopa IR
+ * @note 标签计数在整个会话中只增不减, 所以重新输出的函数和缓存中的函数不会使用相同的标签
+ * @date 2026-10-18
+ */
+class IncrementalFrontend
+{
+private:
+    /**
+     * @brief 一个顶层的 CompUnit
+     * @date 2026-10-18
+     */
+    struct Unit
+    {
+        // 在源码中的范围 [begin, end)
+        size_t begin = 0;
+        size_t end = 0;
+
+        // 源码中出现的所有标识符, 用来判断这个 CompUnit 是否依赖某个全局名字
+        std::unordered_set<std::string> identifiers;
+
+        // 抽象语法树, 语法错误时为空
+        std::unique_ptr<BaseAST> ast;
+
+        // 是否已经输出过, 以及输出的 Koopa IR 和错误信息
+        bool lowered = false;
+        std::string koopa;
+        std::string error;
+
+        // 向后面的 CompUnit 导出的全局符号, 以及函数名和是否有返回值
+        std::vector<std::pair<std::string, Symbol>> global_symbols;
+        std::vector<std::pair<std::string, bool>> functions;
+
+        // 导出的每个名字和它的签名 (常量的值, 函数的返回值类型和参数数量), 签名变化时用到这个名字的 CompUnit 需要重新输出
+        std::vector<std::pair<std::string, std::string>> exports;
+    };
+
+    std::string _source;
+    std::vector<Unit> _units;
+
+    // 签名发生变化的名字, 输出时用到它们的 CompUnit 需要重新输出
+    std::unordered_set<std::string> _changed_names;
+
+    // 上一次修改中被替换掉的 CompUnit 导出的名字和签名, 以及替换它们的新 CompUnit 在 _units 中的结束下标
+    std::unordered_map<std::string, std::string> _removed_exports;
+    size_t _rescanned_end = 0;
+
+    std::string _library_declarations;
+    int _reparsed_units = 0;
+    int _relowered_units = 0;
+
+    // 跳过 pos 开始的空白和注释, 返回下一个 token 的位置
+    size_t skip_blank(size_t pos) const;
+
+    // 从 pos 开始切分出一个 CompUnit, 记录它的范围和标识符, pos 移动到它的结尾
+    void scan_unit(size_t &pos, Unit &unit) const;
+
+    // 词法分析和语法分析一个 CompUnit 的源码
+    void parse_unit(Unit &unit);
+
+    // 输出一个 CompUnit 的 Koopa IR, 并计算它导出的符号和签名, 签名变化的名字加入 _changed_names
+    void lower_unit(Unit &unit);
+
+    // 把一个没有变化的 CompUnit 导出的符号重新加入上下文
+    void replay_unit(const Unit &unit) const;
+
+    // 按顺序输出需要重新输出的 CompUnit
+    void lower();
+
+public:
+    /**
+     * @brief 设置完整的源码, 解析并输出所有 CompUnit
+     * @param[in] source 源码
+     * @date 2026-10-18
+     */
+    void open(const std::string &source);
+
+    /**
+     * @brief 把源码中 [offset, offset + length) 的部分替换为 text, 然后增量地重新解析和输出
+     * @param[in] offset 修改的起始位置 (字节)
+     * @param[in] length 被替换的字节数
+     * @param[in] text 新的文本
+     * @date 2026-10-18
+     */
+    void edit(size_t offset, size_t length, const std::string &text);
+
+    // 当前的源码
+    const std::string &source() const;
+
+    // 当前整个程序的 Koopa IR, 有错误的 CompUnit 不输出
+    std::string koopa() const;
+
+    // 每个有错误的 CompUnit 的错误信息, 带有它在源码中的起始位置
+    std::vector<std::string> errors() const;
+
+    // 上一次修改重新解析的 CompUnit 数量
+    int reparsed_units() const;
+
+    // 上一次修改重新输出的 CompUnit 数量
+    int relowered_units() const;
+};
+
+/**
+ * @brief 按编辑脚本驱动增量前端, 是 `-incremental` 模式的入口, 也用来检查增量更新的结果和完整编译一致
+ * @param[in] script 编辑脚本, 由若干条命令组成: `open <字节数>` 或者 `edit <起始位置> <被替换的字节数> <字节数>`, 命令行之后紧跟给定字节数的文本和一个换行
+ * @param[out] koopa_stream 执行完所有命令之后整个程序的 Koopa IR
+ * @param[out] log_stream 每条命令重新解析和重新输出的 CompUnit 数量, 以及执行之后的错误信息
+ * @date 2026-10-18
+ */
+void run_edit_script(std::istream &script, std::ostream &koopa_stream, std::ostream &log_stream);
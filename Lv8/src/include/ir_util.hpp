@@ -0,0 +1,170 @@
+/**
+ * @file include/ir_util.hpp
+ * @brief 中端优化使用的 Koopa raw IR 工具, 包括可修改的 raw program 的内存管理, 以及遍历和修改 raw IR 的常用函数
+ * @note libkoopa 生成的 raw program 不允许手动修改, 所以中端优化前先把它完整拷贝一份到 IRBuilder 管理的内存中, 之后所有的优化都修改这份拷贝
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+
+/**
+ * @brief raw IR 构建器, 是全局共用的, 负责中端优化中所有值, 基本块, 函数, slice 和名字的内存
+ * @note 内存都存放在 std::deque 中, 添加新元素不会使已有元素的指针失效, 直到程序结束才统一释放
+ * @date 2026-10-18
+ */
+class IRBuilder
+{
+private:
+    std::deque<koopa_raw_value_data_t> _values;
+    std::deque<koopa_raw_basic_block_data_t> _bbs;
+    std::deque<koopa_raw_function_data_t> _funcs;
+    std::deque<std::vector<const void *>> _buffers;
+    std::deque<std::string> _names;
+
+    // 新建值使用的类型
+    koopa_raw_type_kind_t _i32_type;
+    koopa_raw_type_kind_t _unit_type;
+    koopa_raw_type_kind_t _i32_pointer_type;
+
+public:
+    IRBuilder();
+
+    // 常用类型
+    koopa_raw_type_t i32_type() const;
+    koopa_raw_type_t unit_type() const;
+    koopa_raw_type_t i32_pointer_type() const;
+
+    // 新建一个 slice, 内容是 items 的拷贝
+    koopa_raw_slice_t new_slice(const std::vector<const void *> &items, koopa_raw_slice_item_kind_t kind);
+
+    // 保存一个名字, 返回的指针一直有效, name 为空字符串时返回 nullptr 表示没有名字
+    const char *new_name(const std::string &name);
+
+    // 新建各种值, 新值的 used_by 为空
+    koopa_raw_value_data_t *new_value(koopa_raw_type_t ty, const char *name, koopa_raw_value_tag_t tag);
+    koopa_raw_value_t new_integer(int value);
+    koopa_raw_value_t new_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+    koopa_raw_value_t new_alloc(const std::string &name);
+    koopa_raw_value_t new_load(koopa_raw_value_t src);
+    koopa_raw_value_t new_store(koopa_raw_value_t value, koopa_raw_value_t dest);
+    koopa_raw_value_t new_jump(koopa_raw_basic_block_t target);
+    koopa_raw_value_t new_branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb);
+    koopa_raw_value_t new_call(koopa_raw_function_t callee, const std::vector<koopa_raw_value_t> &args, koopa_raw_type_t ty);
+    koopa_raw_value_t new_return(koopa_raw_value_t value);
+
+    // 新建基本块的第 index 个参数, 调用者负责把它加入基本块的 params
+    koopa_raw_value_t new_block_arg(size_t index, const std::string &name);
+
+    // 新建一个没有指令的基本块, name 需要带 % 前缀, 并且在整个程序中唯一, 因为后端直接用它作为汇编标签
+    koopa_raw_basic_block_data_t *new_basic_block(const std::string &name);
+
+    // 拷贝一个值, 操作数保持不变, 调用者负责修正操作数
+    koopa_raw_value_data_t *clone_value(koopa_raw_value_t value, const char *name);
+
+    /**
+     * @brief 把 libkoopa 生成的 raw program 完整拷贝一份, 拷贝中的函数, 基本块和值都可以修改
+     * @param[in] program libkoopa 生成的 raw program
+     * @return 拷贝得到的 raw program
+     * @date 2026-10-18
+     */
+    koopa_raw_program_t copy_program(const koopa_raw_program_t &program);
+};
+
+// 全局共用的 raw IR 构建器
+extern IRBuilder ir_builder;
+
+// 去掉 const, 只能用于 ir_builder 拷贝或新建的对象
+koopa_raw_value_data_t *as_mutable(koopa_raw_value_t value);
+koopa_raw_basic_block_data_t *as_mutable(koopa_raw_basic_block_t bb);
+koopa_raw_function_data_t *as_mutable(koopa_raw_function_t func);
+
+// 去掉名字的 @ 或 % 前缀, 没有名字时返回空字符串
+std::string strip_prefix(const char *name);
+
+// slice 和 std::vector 的相互转换
+std::vector<koopa_raw_function_t> get_functions(const koopa_raw_program_t &program);
+void set_functions(koopa_raw_program_t &program, const std::vector<koopa_raw_function_t> &funcs);
+std::vector<koopa_raw_basic_block_t> get_basic_blocks(koopa_raw_function_t func);
+void set_basic_blocks(koopa_raw_function_t func, const std::vector<koopa_raw_basic_block_t> &bbs);
+std::vector<koopa_raw_value_t> get_insts(koopa_raw_basic_block_t bb);
+void set_insts(koopa_raw_basic_block_t bb, const std::vector<koopa_raw_value_t> &insts);
+std::vector<koopa_raw_value_t> get_values(const koopa_raw_slice_t &slice);
+
+// 是否是函数定义 (而不是库函数的声明)
+bool is_function_defined(koopa_raw_function_t func);
+
+// 是否是基本块的最后一条指令 (branch, jump, return)
+bool is_terminator(koopa_raw_value_t value);
+
+// 是否是 integer 立即数
+bool is_integer(koopa_raw_value_t value);
+
+// 基本块的最后一条指令, 基本块为空时返回 nullptr
+koopa_raw_value_t get_terminator(koopa_raw_basic_block_t bb);
+
+// 基本块的后继
+std::vector<koopa_raw_basic_block_t> get_successors(koopa_raw_basic_block_t bb);
+
+// jump/branch 的目标基本块, 其他指令返回空
+std::vector<koopa_raw_basic_block_t> get_successors_of_terminator(koopa_raw_value_t terminator);
+
+// 一条指令用到的所有值, 包括 call 的参数和 jump/branch 的基本块参数, 不包括基本块本身
+std::vector<koopa_raw_value_t> get_operands(koopa_raw_value_t value);
+
+// 把 user 中所有等于 from 的操作数替换成 to, 返回替换的次数
+int replace_operand(koopa_raw_value_t user, koopa_raw_value_t from, koopa_raw_value_t to);
+
+// 把函数中所有等于 from 的操作数替换成 to, 返回替换的次数
+int replace_all_uses(koopa_raw_function_t func, koopa_raw_value_t from, koopa_raw_value_t to);
+
+// 把函数中所有在 replacement 中的操作数替换成对应的值, 替换的结果如果也在 replacement 中会继续替换
+void replace_uses_with_map(koopa_raw_function_t func, const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &replacement);
+
+// jump/branch 传给第 index 个目标基本块 (顺序和 get_successors_of_terminator 一致) 的参数
+std::vector<koopa_raw_value_t> get_successor_args(koopa_raw_value_t terminator, size_t index);
+void set_successor_args(koopa_raw_value_t terminator, size_t index, const std::vector<koopa_raw_value_t> &args);
+
+// 删除从 entry 不可达的基本块, 返回删除的数量
+int remove_unreachable_blocks(koopa_raw_function_t func);
+
+// 有 profile 时估计从 preds 进入 bb 的次数 (preds 的计数之和, 不超过 bb 的计数), 用于给插在它们之间的新基本块设置计数; 没有计数时返回 -1
+long long estimate_entry_count(koopa_raw_function_t func, koopa_raw_basic_block_t bb, const std::vector<koopa_raw_basic_block_t> &preds);
+
+/**
+ * @brief 计算两个常量的二元运算, 结果和 RISC-V 指令的行为一致 (溢出回绕, INT_MIN / -1 = INT_MIN)
+ * @param[in] op 二元运算符
+ * @param[in] lhs 左操作数
+ * @param[in] rhs 右操作数
+ * @param[out] result 运算结果
+ * @return 能否计算, 除以 0 和模 0 是未定义行为, 不计算
+ * @date 2026-10-18
+ */
+bool fold_binary(koopa_raw_binary_op_t op, int lhs, int rhs, int &result);
+
+// 是否是比较运算 (eq, ne, lt, le, gt, ge), 结果只可能是 0 或 1
+bool is_comparison(koopa_raw_binary_op_t op);
+
+// a op b 交换操作数之后的比较, 即 b op' a
+koopa_raw_binary_op_t swap_comparison(koopa_raw_binary_op_t op);
+
+// a op b 取反之后的比较, 即 !(a op b) = a op' b
+koopa_raw_binary_op_t negate_comparison(koopa_raw_binary_op_t op);
+
+// 把 jump/branch 的第 index 个目标基本块 (顺序和 get_successors_of_terminator 一致) 改为 bb, 参数不变
+void set_successor(koopa_raw_value_t terminator, size_t index, koopa_raw_basic_block_t bb);
+
+// 把 jump/branch 中所有等于 from 的目标基本块替换成 to
+void replace_successor(koopa_raw_value_t terminator, koopa_raw_basic_block_t from, koopa_raw_basic_block_t to);
+
+// 函数的指令数量
+int count_insts(koopa_raw_function_t func);
+
+// 根据当前的 IR 重新计算所有值和基本块的 used_by, 优化结束之后调用
+void rebuild_used_by(koopa_raw_program_t &program);
@@ -34,6 +34,15 @@ public:
      * @date 2024-10-27
      */
     virtual Result print(std::stringstream &output_stream) const = 0;
+
+    /**
+     * @brief 不经过 Koopa IR, 直接把抽象语法树翻译成 RISC-V 汇编 (-O0 的快速路径)。
+     * @note 表达式的结果是立即数, 或者是 REG 类型, 这时 val 是值所在的栈位置相对 sp 的偏移量。
+     * @param[out] output 追加汇编文本的缓冲区。
+     * @return 翻译的结果, 控制流标志的含义和 print 相同。
+     * @date 2026-10-18
+     */
+    virtual Result emit_riscv(std::string &output) const = 0;
 };
 
 //////////////////////////////////////////
@@ -49,6 +58,7 @@ class ProgramAST : public BaseAST
 public:
     std::deque<std::unique_ptr<BaseAST>> comp_units;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -75,6 +85,7 @@ public:
      * @date 2024-10-27
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -92,6 +103,7 @@ public:
      * @date 2024-10-27
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -104,6 +116,7 @@ public:
     std::optional<std::unique_ptr<BaseAST>> stmt;
     std::optional<std::unique_ptr<BaseAST>> decl;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -140,6 +153,7 @@ public:
      * @date 2024-10-27
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -152,6 +166,7 @@ public:
     std::optional<std::unique_ptr<BaseAST>> const_decl;
     std::optional<std::unique_ptr<BaseAST>> var_decl;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 //////////////////////////////////////////
@@ -167,6 +182,7 @@ class BTypeAST : public BaseAST
 public:
     std::string type;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -178,6 +194,7 @@ class ConstDeclAST : public BaseAST
 public:
     std::deque<std::unique_ptr<BaseAST>> const_defs;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -191,6 +208,7 @@ public:
     std::string const_symbol;
     std::unique_ptr<BaseAST> const_init_val;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -202,6 +220,7 @@ class ConstInitValAST : public BaseAST
 public:
     std::unique_ptr<BaseAST> const_exp;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -213,6 +232,7 @@ class VarDeclAST : public BaseAST
 public:
     std::deque<std::unique_ptr<BaseAST>> var_defs;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -227,6 +247,7 @@ public:
     std::string var_symbol;
     std::optional<std::unique_ptr<BaseAST>> var_init_val;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -238,6 +259,7 @@ class InitValAST : public BaseAST
 public:
     std::unique_ptr<BaseAST> exp;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 //////////////////////////////////////////
@@ -259,6 +281,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -270,6 +293,7 @@ class ConstExpAST : public BaseAST
 public:
     std::unique_ptr<BaseAST> exp;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -281,6 +305,7 @@ class LValAST : public BaseAST
 public:
     std::string left_value_symbol;
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -300,6 +325,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -321,6 +347,7 @@ public:
      * @return 打印操作的结果
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -340,6 +367,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -359,6 +387,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -378,6 +407,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -397,6 +427,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -416,6 +447,7 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
 
 /**
@@ -435,4 +467,15 @@ public:
      * @return 打印操作的结果。
      */
     Result print(std::stringstream &output_stream) const override;
+    Result emit_riscv(std::string &output) const override;
 };
+
+// 全局共用的 Koopa 输出上下文, 定义在 koopa.cpp 中
+extern KoopaContextManager koopa_context_manager;
+
+/**
+ * @brief 输出库函数的声明, 并在上下文中记录它们是否有返回值
+ * @param[in] output_stream 输出流
+ * @date 2026-10-18
+ */
+void print_library_declarations(std::stringstream &output_stream);
@@ -153,4 +153,10 @@ public:
 
     // 判断一个符号在当前层级的符号表中是否被分配
     bool is_symbol_allocated_in_this_level(const std::string &name);
+    // 进入一个新的函数时清空分配记录, 局部变量的 alloc 只在所在的函数中有效
+    void clear_allocated_symbols();
+    // 回到全局作用域, 丢弃局部的符号表和 while 栈, 用于输出某个 CompUnit 失败之后继续输出后面的 CompUnit
+    void leave_local_scopes();
+    // 清空所有符号和函数信息, 从头开始输出一个程序, 但保留标签和寄存器的计数, 这样重新输出的函数不会和之前输出的函数使用相同的标签
+    void reset_symbols();
 };
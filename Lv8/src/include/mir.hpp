@@ -0,0 +1,256 @@
+/**
+ * @file include/mir.hpp
+ * @brief 机器 IR: 指令选择的结果先放在这里, 后面的 pass 可以查看和改写, 最后统一输出成汇编文本
+ * @note 每个基本块的指令连续存放, 指令是定长的小结构, 标签和函数名都换成符号表中的下标, 遍历的时候不需要访问字符串
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 机器指令的操作码, 和输出的 RISC-V (伪) 指令一一对应
+ * @date 2026-10-18
+ */
+enum class MOp : uint8_t
+{
+    // 移动和访存: li rd, imm; mv rd, rs1; la rd, sym; lw/lbu rd, imm(rs1); sw rs2, imm(rs1)
+    LI,
+    MV,
+    LA,
+    LW,
+    LBU,
+    SW,
+    // 双目运算: op rd, rs1, rs2
+    ADD,
+    SUB,
+    MUL,
+    MULH,
+    DIV,
+    REM,
+    AND,
+    OR,
+    XOR,
+    SLL,
+    SRL,
+    SRA,
+    SLT,
+    SGT,
+    // Zicond 扩展: czero.eqz rd, rs1, rs2 在 rs2 为 0 时得到 0, 否则得到 rs1; czero.nez 相反
+    CZERO_EQZ,
+    CZERO_NEZ,
+    // 立即数运算: op rd, rs1, imm
+    ADDI,
+    ANDI,
+    SLLI,
+    SRLI,
+    SRAI,
+    // 单目运算: op rd, rs1
+    SEQZ,
+    SNEZ,
+    NEG,
+    // 控制流: beqz/bnez rs1, sym; j sym; call/tail sym; ret
+    BEQZ,
+    BNEZ,
+    J,
+    CALL,
+    TAIL,
+    RET,
+};
+
+// 寄存器编号: 0 - 31 是物理寄存器 x0 - x31, 从 first_virtual_reg 开始是虚拟寄存器
+using MReg = uint16_t;
+
+// 没有使用的寄存器操作数
+constexpr MReg no_reg = 0xffff;
+
+// 第一个虚拟寄存器的编号
+constexpr MReg first_virtual_reg = 32;
+
+// 是否是虚拟寄存器
+inline bool is_virtual_reg(MReg reg)
+{
+    return reg != no_reg && reg >= first_virtual_reg;
+}
+
+/**
+ * @brief 物理寄存器的名字到编号, 支持 ABI 名字 (t0, a0, s0, sp, ra 等) 和 x0 - x31
+ * @param[in] name 寄存器名字
+ * @return 寄存器编号
+ * @date 2026-10-18
+ */
+MReg reg_from_name(const std::string &name);
+
+/**
+ * @brief 一条机器指令, 操作数的含义由操作码决定, 没有用到的寄存器是 no_reg
+ * @date 2026-10-18
+ */
+struct MInst
+{
+    MOp op;
+    MReg rd = no_reg;
+    MReg rs1 = no_reg;
+    MReg rs2 = no_reg;
+    // 立即数或访存的偏移量
+    int32_t imm = 0;
+    // 跳转目标, 被调用的函数或者 la 的全局变量在符号表中的下标
+    int32_t sym = -1;
+};
+
+/**
+ * @brief 机器基本块, 以一个标签开头; 函数的第一个基本块没有自己的标签, 它从函数名开始执行
+ * @date 2026-10-18
+ */
+struct MBlock
+{
+    // 标签在符号表中的下标, -1 表示没有标签
+    int32_t label = -1;
+    std::vector<MInst> insts;
+};
+
+/**
+ * @brief 机器函数, 基本块按照输出的顺序排列, 可以 fall through 到下一个基本块
+ * @date 2026-10-18
+ */
+struct MFunction
+{
+    // 函数名在符号表中的下标
+    int32_t name = -1;
+    // 是否输出 .globl
+    bool global = true;
+    std::vector<MBlock> blocks;
+    // 已经使用的虚拟寄存器数量
+    int num_virtual_regs = 0;
+
+    // 新建一个虚拟寄存器
+    MReg new_virtual_reg();
+};
+
+/**
+ * @brief 数据段中的一条伪指令
+ * @date 2026-10-18
+ */
+struct MDirective
+{
+    enum Kind : uint8_t
+    {
+        // .globl sym
+        GLOBL,
+        // sym:
+        LABEL,
+        // .word value
+        WORD,
+        // .zero value
+        ZERO,
+        // .asciz sym, 字符串也放在符号表中
+        ASCIZ,
+    };
+    Kind kind;
+    // WORD 和 ZERO 的值, 其他伪指令的符号下标
+    int32_t value = 0;
+};
+
+/**
+ * @brief 一段代码或者数据, 对应汇编中的一个 .text 或 .data
+ * @date 2026-10-18
+ */
+struct MSection
+{
+    bool is_text = true;
+    // is_text 时是这一段的函数
+    MFunction func;
+    // 不是 is_text 时是这一段的伪指令
+    std::vector<MDirective> directives;
+};
+
+/**
+ * @brief 符号表, 把标签, 函数名, 全局变量名和字符串换成下标
+ * @date 2026-10-18
+ */
+class MSymbolTable
+{
+private:
+    std::vector<std::string> _names;
+    std::unordered_map<std::string, int32_t> _index;
+
+public:
+    // 返回 name 的下标, 没有出现过时新建一个
+    int32_t intern(const std::string &name);
+
+    // 下标对应的名字
+    const std::string &name(int32_t index) const;
+};
+
+/**
+ * @brief 整个程序的机器 IR, 段按照输出的顺序排列
+ * @date 2026-10-18
+ */
+struct MModule
+{
+    MSymbolTable symbols;
+    std::vector<MSection> sections;
+};
+
+// 物理寄存器的集合, 第 i 位表示 xi; x0 的值是常数, 永远不在集合中
+using MRegSet = uint32_t;
+
+// 只包含一个寄存器的集合, x0 和 no_reg 是空集
+MRegSet reg_bit(MReg reg);
+
+/**
+ * @brief 一条指令写入和读取的物理寄存器
+ * @note call 读取 a0 - a7 和 sp, 写入所有调用者保存的寄存器; ret 和 tail 读取返回值或参数, 以及必须保留给调用者的 sp, ra 和 s0 - s11
+ * @param[in] inst 指令
+ * @param[out] defs 写入的寄存器
+ * @param[out] uses 读取的寄存器
+ * @date 2026-10-18
+ */
+void get_inst_regs(const MInst &inst, MRegSet &defs, MRegSet &uses);
+
+/**
+ * @brief 机器函数中物理寄存器的活跃性, 基本块中间的 beqz/bnez 也会跳到目标基本块
+ * @note 构造之后函数的基本块和跳转不能再修改; 只修改基本块内部的指令时, 用 live_after 重新计算这个基本块就可以
+ * @date 2026-10-18
+ */
+class MLiveness
+{
+private:
+    const MFunction &_func;
+
+    // 标签到基本块下标的映射
+    std::unordered_map<int32_t, size_t> _label_to_block;
+
+    // 每个基本块开头活跃的寄存器
+    std::vector<MRegSet> _live_in;
+
+    // 指令之前活跃的寄存器, live 是指令之后活跃的寄存器
+    MRegSet _transfer(const MInst &inst, MRegSet live) const;
+
+public:
+    MLiveness(const MFunction &func);
+
+    // 标签所在的基本块下标, 不在这个函数中时返回 -1
+    int block_of_label(int32_t label) const;
+
+    // 基本块开头活跃的寄存器
+    MRegSet live_in(size_t block) const;
+
+    // 基本块末尾 fall through 到下一个基本块时活跃的寄存器
+    MRegSet live_out(size_t block) const;
+
+    // 根据基本块现在的指令, 计算每条指令之后活跃的寄存器; beqz/bnez 之后包括跳转目标开头活跃的寄存器
+    std::vector<MRegSet> live_after(size_t block) const;
+};
+
+/**
+ * @brief 把机器 IR 输出成 RISC-V 汇编文本
+ * @param[in] module 机器 IR
+ * @param[out] out 输出流
+ * @date 2026-10-18
+ */
+void emit_module(const MModule &module, std::ostream &out);
@@ -0,0 +1,288 @@
+/**
+ * @file include/opt.hpp
+ * @brief 定义了中端优化, 所有优化都在 ir_builder 拷贝出来的 raw program 上原地修改
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "koopa.h"
+#include "ir_util.hpp"
+#include "profile.hpp"
+
+// 开启优化统计, 编译结束时输出每个优化的效果 (-stats)
+void enable_opt_statistics();
+
+// 给名为 name 的统计项加上 count
+void add_opt_statistic(const std::string &name, int count);
+
+// 如果开启了优化统计, 按名字顺序输出所有统计项
+void print_opt_statistics(std::ostream &os);
+
+/**
+ * @brief 程序的大小, 用于 pass 的统计
+ * @date 2026-10-18
+ */
+struct IRSize
+{
+    // 指令数量 (中端是 Koopa IR 指令, 后端是机器指令)
+    int insts = 0;
+
+    // 基本块数量
+    int blocks = 0;
+};
+
+/**
+ * @brief pass 管理器, 按名字管理中端和后端的优化, 决定运行哪些优化以及运行的顺序
+ * @note 中端 pass 按流水线中的顺序在 raw program 上运行, 同一个 pass 可以出现多次; 后端 pass (regalloc, layout, peephole) 在后端的固定位置运行, 流水线只决定是否开启
+ * @note 修改控制流的 pass 在修改的地方自己使 analysis_manager 的缓存失效; 每个 pass 结束后, 没有声明保持控制流的 pass 如果改写了程序, 再清空所有缓存
+ * @note 开启 -stats 时记录每个 pass 的运行时间和前后的程序大小
+ * @date 2026-10-18
+ */
+class PassManager
+{
+private:
+    // 一次 pass 运行的记录
+    struct PassRecord
+    {
+        std::string name;
+        double milliseconds;
+        IRSize before;
+        IRSize after;
+    };
+
+    // 中端 pass 的名字, 按运行顺序排列
+    std::vector<std::string> _middle_end;
+
+    // 开启的后端 pass
+    std::unordered_set<std::string> _backend;
+
+    // 按运行顺序排列的记录
+    std::vector<PassRecord> _records;
+
+public:
+    // 默认使用 -O2 的流水线
+    PassManager();
+
+    /**
+     * @brief 使用标准的流水线 (-O<level>)
+     * @note 0: 不做任何优化, 编译最快; 1: 只做开销小的标量优化; 2: 所有优化; s: 不做增大代码的内联, 循环旋转和展开
+     * @param[in] level 0, 1, 2 或者 s
+     * @date 2026-10-18
+     */
+    void set_opt_level(const std::string &level);
+
+    /**
+     * @brief 使用自定义的流水线 (--passes=<pass>,<pass>,...)
+     * @param[in] passes 逗号分隔的 pass 名字, 可以为空
+     * @date 2026-10-18
+     */
+    void set_pipeline(const std::string &passes);
+
+    // 后端 pass 是否开启
+    bool is_enabled(const std::string &name) const;
+
+    // 流水线中是否有中端 pass
+    bool has_middle_end_passes() const;
+
+    /**
+     * @brief 按顺序运行流水线中的中端 pass, 并把每个 pass 的效果加到优化统计中
+     * @param[in,out] program ir_builder 拷贝出来的 raw program
+     * @date 2026-10-18
+     */
+    void run(koopa_raw_program_t &program);
+
+    /**
+     * @brief 运行一个后端阶段, 开启 -stats 时记录时间和前后的大小
+     * @param[in] name 阶段的名字
+     * @param[in] run 阶段本身
+     * @param[in] size 计算当前程序的大小
+     * @date 2026-10-18
+     */
+    void run_timed(const std::string &name, const std::function<void()> &run, const std::function<IRSize()> &size);
+
+    // 按运行顺序输出每个 pass 的时间和前后的大小
+    void print_report(std::ostream &os) const;
+};
+
+// 全局共用的 pass 管理器
+extern PassManager pass_manager;
+
+/**
+ * @brief 中端优化的入口, 运行 pass 管理器的流水线, 最后重新计算 used_by
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @date 2026-10-18
+ */
+void optimize(koopa_raw_program_t &program);
+
+/**
+ * @brief 把 Koopa IR 文本解析成 raw program, 优化之后再输出成 Koopa IR 文本 (-koopa)
+ * @param[in] koopa_str 前端生成的 Koopa IR 文本
+ * @param[out] os 输出优化后的 Koopa IR
+ * @date 2026-10-18
+ */
+void optimize_koopa(const char *koopa_str, std::ostream &os);
+
+/**
+ * @brief 函数内联, 在调用图上按照强连通分量自底向上处理, 递归的函数不会被内联
+ * @note 代价模型: 很小的叶子函数总是内联, 只有一个调用点的函数在不太大时内联, 调用者内联后的大小有上限
+ * @note 有 profile 时, 热的调用边允许内联更大的非叶子函数, 从未执行过的调用边不内联 (除非只有一个调用点, 内联之后函数本身可以删除)
+ * @note 内联之后不再被调用的函数 (main 除外) 会被删除
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被内联的调用点的数量
+ * @date 2026-10-18
+ */
+int inline_functions(koopa_raw_program_t &program);
+
+/**
+ * @brief 尾递归消除, 把 `%r = call @f(...)` 紧跟 `ret %r` 形式的自身调用改写成跳回函数开头的循环
+ * @note 原来的 entry 改名为 `%tre_loop_<函数名>` 作为循环头, 新的 entry 把参数存到 `@tre_<函数名>_arg_<i>` 中, 循环头开头重新读出参数
+ * @note 尾调用处把实参存到这些 alloc 中再跳回循环头, 这样递归不再消耗栈空间
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被消除的尾调用的数量
+ * @date 2026-10-18
+ */
+int eliminate_tail_recursion(koopa_raw_program_t &program);
+
+/**
+ * @brief 循环旋转, 把循环头的条件判断复制到每个跳回循环头的 latch (包括 continue 产生的) 末尾, 原来的循环头变成进入循环前的守卫
+ * @note 旋转之后每次迭代只执行一条条件分支, 不再需要先 jump 回循环头再 br
+ * @note 循环头中在别处被使用的值先降级为 alloc, 需要在 promote_memory_to_register 之前运行
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 旋转的循环数量
+ * @date 2026-10-18
+ */
+int rotate_loops(koopa_raw_program_t &program);
+
+/**
+ * @brief 把只被 load 和 store 使用的局部变量 alloc 提升为 SSA 值, 汇合处的值用基本块参数表示
+ * @note 在迭代支配边界上插入参数, 并且只在变量入口处活跃的基本块上插入 (剪枝 SSA), 然后沿支配树重命名
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被提升的 alloc 的数量
+ * @date 2026-10-18
+ */
+int promote_memory_to_register(koopa_raw_program_t &program);
+
+/**
+ * @brief 稀疏条件常量传播, 在 SSA 值, 基本块参数和分支条件上传播常量, 删除不可达的基本块, 条件为常量的分支改为 jump
+ * @note 从来没有被 store 过的全局变量被当作常量, 读它得到初始值
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 promote_memory_to_register
+ * @return 被替换为常量的值, 被改为 jump 的分支和被删除的基本块的总数
+ * @date 2026-10-18
+ */
+int sparse_conditional_constant_propagation(koopa_raw_program_t &program);
+
+/**
+ * @brief 代数化简和重结合: 常数放到右边, 合并结合律运算链中的常数, 应用单位元和零元等恒等式, 化简 `!` 和短路求值产生的布尔值比较
+ * @note 只有一个前驱的基本块中, 前驱分支的条件 (以及 x == c 中的 x) 是确定的, 在它支配的基本块中替换为常数
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 promote_memory_to_register
+ * @return 应用规则的次数
+ * @date 2026-10-18
+ */
+int simplify_instructions(koopa_raw_program_t &program);
+
+/**
+ * @brief 基于标量演化的闭式替换: 计数循环只是在累加归纳变量的多项式时 (例如 `sum = sum + i` 或者 `sum = sum + i * i`), 把整个循环替换为直接计算结果
+ * @note 多项式最高二次, 三次及以上的累加仍然保留循环
+ * @note 只处理步长为 ±1, 没有 store 和 call 的最内层计数循环, 求和在 32 位回绕下和原来的循环结果相同
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 rotate_loops 和 promote_memory_to_register
+ * @return 被替换的循环数量
+ * @date 2026-10-18
+ */
+int replace_loops_with_closed_forms(koopa_raw_program_t &program);
+
+/**
+ * @brief 归纳变量的强度削减, 把循环中的 `iv * k` 换成每次迭代加上 `step * k` 的新的循环头参数
+ * @note k 是常数 (0, -1 和 2 的幂除外), 或者步长为 ±1 时的循环不变量
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 promote_memory_to_register
+ * @return 被削减的乘法数量
+ * @date 2026-10-18
+ */
+int strength_reduce_induction_variables(koopa_raw_program_t &program);
+
+// 设置部分展开循环的次数 (-funroll-factor=<n>), 1 表示不做部分展开
+void set_unroll_factor(int factor);
+
+/**
+ * @brief 循环展开, 处理 mem2reg 和循环旋转之后的最内层计数循环 `while (i < n) { ...; i = i + c; }`
+ * @note 只处理只有一个 latch, 只从 latch 退出的循环; 有 break 或 return 的循环有其他出口, 不展开
+ * @note 迭代次数是常数并且展开后不太大时完全展开; 否则按照展开次数部分展开, 剩余的迭代由原来的循环处理
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 rotate_loops 和 promote_memory_to_register
+ * @return 展开的循环数量
+ * @date 2026-10-18
+ */
+int unroll_loops(koopa_raw_program_t &program);
+
+/**
+ * @brief 冗余 load 消除和 store 到 load 的转发: 在可用值的前向数据流上, 把读到的值已知的 load 替换成之前 store 进去或者 load 出来的值
+ * @note 汇合处只保留所有前驱上都相同的值; store 只修改它的目标地址, call 只使被调用者 (间接) 修改的全局变量失效, 库函数不修改全局变量
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被替换的 load 的数量
+ * @date 2026-10-18
+ */
+int eliminate_redundant_loads(koopa_raw_program_t &program);
+
+/**
+ * @brief 死 store 删除: 在内存位置 (alloc 和全局变量) 的后向活跃性上, 删除在被读取之前就一定会被覆盖, 或者之后再也不会被读取的 store
+ * @note 活跃性在汇合处取并集, 所以只有所有后继路径上都先被覆盖的 store 才会被删除; call 读取被调用者 (间接) load 的全局变量, 库函数不读取全局变量
+ * @note 返回时 alloc 都不活跃, 全局变量除了在没有被调用的 main 返回时之外都活跃
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被删除的 store 的数量
+ * @date 2026-10-18
+ */
+int eliminate_dead_stores(koopa_raw_program_t &program);
+
+/**
+ * @brief if-conversion, 把两边都是小的无副作用基本块 (或者直接跳到汇合点) 的菱形和三角形改写成无分支的选择
+ * @note 两边的指令搬到分支前面无条件执行, 汇合点的每个不同的实参用 `b ^ ((a ^ b) & -t)` 选择, 后端在支持 Zicond 时把 `& -t` 换成 czero.eqz
+ * @note 按照目标核心的代价表比较分支 (包括预测失败的期望代价, 有 profile 时用分支的实际偏向估计) 和选择序列的代价, 选择不更贵时才改写
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 promote_memory_to_register
+ * @return 改写的分支数量
+ * @date 2026-10-18
+ */
+int convert_branches_to_selects(koopa_raw_program_t &program);
+
+/**
+ * @brief 全局值编号, 沿支配树用作用域哈希表消除重复计算的 binary, 交换律的运算不区分操作数顺序
+ * @note load 由 eliminate_redundant_loads 处理, 这里只处理 binary
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被消除的值的数量
+ * @date 2026-10-18
+ */
+int global_value_numbering(koopa_raw_program_t &program);
+
+/**
+ * @brief 控制流图化简, 反复应用下面的改写直到不动点: 条件为常量 (或者两个目标完全相同) 的 branch 改为 jump, 跳转线程化, 删除不可达的基本块和只有一条 jump 的空基本块, 合并只有一条边相连的基本块
+ * @note 跳转线程化: 只有一条 branch 的基本块, 在某条入边上条件已知 (入边传入常数的参数, 比如短路求值的结果; 或者前驱用同一个条件 branch 过来) 时, 这条入边直接跳到对应的目标
+ * @note 合并: 以 jump 结尾的基本块的目标只有它一个前驱时, 目标的参数替换成实参, 指令接到前驱后面
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 改写的 branch, 入边, 删除和合并的基本块的总数
+ * @date 2026-10-18
+ */
+int simplify_cfg(koopa_raw_program_t &program);
+
+/**
+ * @brief 循环不变量外提, 先从回边找出自然循环并给每个循环插入前置块, 再从内到外把循环不变的计算移到前置块
+ * @note 操作数都在循环外定义的 binary 是不变量; 除法和取模只在每次迭代都会执行时外提
+ * @note 循环中没有 store, 并且循环中调用的函数也不会修改的全局变量, 它的 load 也是不变量
+ * @param[in,out] program ir_builder 拷贝出来的 raw program, 需要先运行 promote_memory_to_register
+ * @return 外提的指令数量
+ * @date 2026-10-18
+ */
+int hoist_loop_invariants(koopa_raw_program_t &program);
+
+/**
+ * @brief 激进的死代码删除, 从有副作用的指令出发沿着 use-def 链标记活跃的值, 没有被标记的都删除
+ * @note 跳转的实参只有在对应的基本块参数活跃时才活跃, 所以循环中互相传递但最终没有被使用的参数也会被删除
+ * @note 地址从来没有被读过的 alloc 上的 store 都是死的, 纯函数的调用结果没有被使用时也是死的; 最后删除不可达的基本块
+ * @param[in,out] program ir_builder 拷贝出来的 raw program
+ * @return 被删除的指令, 基本块参数和基本块的总数
+ * @date 2026-10-18
+ */
+int aggressive_dead_code_elimination(koopa_raw_program_t &program);
@@ -0,0 +1,77 @@
+/**
+ * @file include/profile.hpp
+ * @brief 定义了 profile-guided optimization (PGO) 使用的计数器和 profile 文件读写
+ * @note 插桩模式 (-fprofile-generate): 后端给每个基本块和每条调用边分配一个计数器, 程序从 main 返回时把所有计数器输出到标准输出
+ * @note 使用模式 (-fprofile-use=<file>): 读取插桩程序输出的计数, 供后续的基本块排布, 函数内联和寄存器选择使用
+ * @note 插桩程序不做中端优化, 计数对应前端输出的基本块; 使用模式下中端优化改名或者拷贝基本块时把计数带到新的基本块上
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * @brief profile 管理器, 是全局共用的, 维护插桩计数器的名字, 以及从 profile 文件中读出的计数
+ * @note 计数器的名字形如 `main:while_body_1` (基本块) 或 `main:entry#0->fib` (调用边, #0 表示该基本块中的第 0 条 call 指令)
+ * @note 输出格式为每行一个 `#prof <计数器名字> <计数>`, 用名字而不是下标对应, 这样使用 profile 编译时即使 IR 有少量变化也能对上
+ * @date 2026-10-18
+ */
+class ProfileManager
+{
+public:
+    enum class Mode
+    {
+        NONE,     // 不使用 profile
+        GENERATE, // 插桩模式, 生成带计数器的程序
+        USE       // 使用模式, 读取计数指导优化
+    };
+
+private:
+    Mode mode = Mode::NONE;
+
+    // 插桩模式下, 第 i 个计数器的名字
+    std::vector<std::string> _counter_names;
+
+    // 使用模式下, 计数器名字到计数的映射
+    std::unordered_map<std::string, long long> _counts;
+
+public:
+    // 进入插桩模式
+    void enable_generate();
+
+    // 读取 profile 文件并进入使用模式, 文件中不以 `#prof ` 开头的内容 (比如程序本身的输出) 会被忽略
+    void load_profile(const std::string &path);
+
+    // 是否处于插桩模式
+    bool is_generating() const;
+
+    // 是否读取了 profile
+    bool has_profile() const;
+
+    // 插桩模式下新建一个计数器, 返回计数器的下标
+    int new_counter(const std::string &name);
+
+    // 插桩模式下所有计数器的名字, 下标即计数器的下标
+    const std::vector<std::string> &counter_names() const;
+
+    // 查询一个计数器的计数, 如果 profile 中没有这个计数器则返回 -1 表示未知
+    long long count(const std::string &name) const;
+
+    // 使用模式下设置一个计数器的计数, 用于给优化新建的基本块补上估计的计数
+    void set_count(const std::string &name, long long count);
+
+    // 使用模式下把基本块 from 的计数以及其中调用边的计数乘以 scale 记到基本块 to 上, from 没有计数时什么也不做
+    void copy_block_count(const std::string &from_function, const std::string &from_bb, const std::string &to_function, const std::string &to_bb, double scale = 1.0);
+
+    // 基本块计数器的名字
+    static std::string block_key(const std::string &function_name, const std::string &bb_name);
+
+    // 调用边计数器的名字, index 是这条 call 指令在基本块中是第几条 call 指令
+    static std::string call_edge_key(const std::string &function_name, const std::string &bb_name, int index, const std::string &callee_name);
+};
+
+// 全局共用的 profile 管理器
+extern ProfileManager profile_manager;
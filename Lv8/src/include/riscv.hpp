@@ -7,12 +7,68 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
 
 #include "koopa.h"
 #include "riscv_util.hpp"
+#include "profile.hpp"
+#include "opt.hpp"
+
+/**
+ * @brief 一个核心的指令代价表, 用于决定乘除常数时是否换成其他指令序列, 以及是否把分支换成无分支的选择
+ * @date 2026-10-18
+ */
+struct RISCVCostModel
+{
+    // 核心的名字, 用于 -mtune=<core>
+    const char *name;
+
+    // add, sub, 移位, 逻辑运算和 li 的一条指令的延迟
+    int alu;
+
+    // mul 的延迟
+    int mul;
+
+    // mulh 的延迟
+    int mulh;
+
+    // div 和 rem 的延迟
+    int div;
+
+    // 分支预测失败的代价
+    int branch_miss;
+};
+
+// 所有代码共用的寄存器和栈管理器
+extern RISCVContextManager riscv_context_manager;
+
+// 所有代码共用的 RISC-V 汇编打印器
+extern RISCVPrinter riscv_printer;
+
+/**
+ * @brief 选择目标核心的代价表 (-mtune=<core>), 可选 generic, rocket, sifive-e31, picorv32, 默认是 generic
+ * @param[in] core 核心的名字
+ * @date 2026-10-18
+ */
+void set_target_core(const std::string &core);
+
+// 当前目标核心的代价表
+const RISCVCostModel &get_target_cost_model();
+
+/**
+ * @brief 选择目标指令集 (-march=<isa>), 基础指令集是 rv32im, 可以用 `_` 连接扩展, 目前支持 zicond (例如 rv32im_zicond)
+ * @param[in] arch 指令集字符串
+ * @date 2026-10-18
+ */
+void set_target_arch(const std::string &arch);
+
+// 目标是否支持 Zicond 扩展 (czero.eqz/czero.nez)
+bool target_has_zicond();
 
 /**
  * @brief 后端函数, 使用 koopa.h 将 Koopa IR 转换为内存中的 RISC-V 汇编代码, 然后 DFS 遍历 RISC-V 汇编代码, 将其输出到内存中
@@ -23,6 +79,18 @@
  */
 int backend(const char *koopa_str);
 
+class BaseAST;
+
+/**
+ * @brief -O0 的快速路径: 一次遍历抽象语法树, 直接输出 RISC-V 汇编代码, 不经过 Koopa IR 和 libkoopa
+ * @note 栈帧的约定和不开启寄存器分配时的 backend 相同, 实现在 riscv_direct.cpp 中
+ * @param[in] ast 抽象语法树的根节点
+ * @param[in] out 输出流
+ * @return 0 表示成功, 其他值表示失败
+ * @date 2026-10-18
+ */
+int direct_backend(const BaseAST &ast, std::ostream &out);
+
 /**
  * @brief 进入每一个节点, 如果它包含很多同类型的东西, 比如一个函数有很多的基本块, 一个基本块有很多指令,
  * 那么这一堆基本块或者指令就会存在一个 raw slice 类型中, 所以只需要访问一次 raw slice 即可,
@@ -49,6 +117,17 @@ void visit(const koopa_raw_program_t &program);
  */
 void visit(const koopa_raw_function_t &func);
 
+/**
+ * @brief 决定一个函数的基本块输出顺序, entry 总是第一个
+ * @note 边的权重是估计的执行次数: 有 profile 时用基本块计数, 否则用静态分支概率 (回边, 留在循环中, 不直接返回的边更可能被走) 沿前向边传播频率, 每进入一层循环放大一次
+ * @note 按权重从大到小把边的两端连成链, 链内的边都是 fall through, 回边不合并; entry 所在的链最先, 从未执行过的冷基本块放到函数末尾
+ * @note 排布前后需要的无条件跳转数量记入优化统计 layout.static-jumps-before/after
+ * @param[in] func 内存中的 RISC-V 汇编代码函数
+ * @return 基本块的输出顺序
+ * @date 2026-10-18
+ */
+std::vector<koopa_raw_basic_block_t> layout_basic_blocks(const koopa_raw_function_t &func);
+
 /**
  * @brief 访问 RISC-V 汇编代码的一个基本块
  * @param[in] bb 内存中的 RISC-V 汇编代码基本块
@@ -116,6 +195,16 @@ void visit(const koopa_raw_return_t &ret);
  */
 void visit(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value);
 
+/**
+ * @brief 一个操作数是常数的乘法, 除法和取模, 按照当前核心的代价表换成更便宜的指令序列
+ * @note 乘常数使用常数的非相邻形式做移位加减; 除以 2 的幂用移位并修正负数的舍入; 其他除数用 mulh 乘魔数, 结果和 div/rem 一样向零取整
+ * @param[in] binary 双目运算指令
+ * @param[in] value 这个双目运算指令本身的 value
+ * @return 是否已经输出了这条指令, 没有输出时按照普通的双目运算处理
+ * @date 2026-10-18
+ */
+bool visit_binary_with_constant(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value);
+
 /**
  * @brief 访问 RISC-V 汇编代码的一个分支指令
  * @param[in] branch 内存中的 RISC-V 汇编代码分支指令
@@ -132,3 +221,131 @@ void visit(const koopa_raw_branch_t &branch, const koopa_raw_value_t &value);
  * @date 2024-12-25
  */
 void visit(const koopa_raw_jump_t &jump);
+
+/**
+ * @brief 判断按顺序拷贝一条边上的参数是否会覆盖还没有读取的参数, 这时要通过中转位置拷贝
+ * @param[in] target 目标基本块
+ * @param[in] args 这条边传递的参数
+ * @return 是否需要中转
+ * @date 2026-10-18
+ */
+bool block_args_conflict(const koopa_raw_basic_block_t &target, const std::vector<koopa_raw_value_t> &args);
+
+/**
+ * @brief 输出 jump 或 branch 的一条边上跳转之前的代码: 需要时先建立栈帧, 再拷贝参数
+ * @param[in] target 目标基本块
+ * @param[in] args 这条边传递的参数
+ * @date 2026-10-18
+ */
+void emit_edge(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args);
+
+// 从当前基本块到 target 的边上是否要输出 prologue
+bool edge_needs_prologue(const koopa_raw_basic_block_t &target);
+
+/**
+ * @brief 把 jump 或 branch 的一条边上的参数拷贝到目标基本块的参数中, 需要时通过中转位置实现并行拷贝
+ * @param[in] target 目标基本块
+ * @param[in] args 这条边传递的参数
+ * @date 2026-10-18
+ */
+void emit_block_args(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args);
+
+/**
+ * @brief 判断一条 call 指令是否可以作为尾调用输出
+ * @note 要求 call 紧跟着返回它的结果的 ret, 并且参数都能放在 a0 - a7 中
+ * @param[in] call 要判断的指令
+ * @param[in] ret call 后面的一条指令
+ * @return 是否是尾调用
+ * @date 2026-10-18
+ */
+bool is_tail_call(const koopa_raw_value_t &call, const koopa_raw_value_t &ret);
+
+/**
+ * @brief 输出一个尾调用, 加载参数之后拆掉当前栈帧, 用 tail 跳转到被调用者, 被调用者返回时直接返回到当前函数的调用者
+ * @param[in] call 内存中的 RISC-V 汇编代码 call 指令
+ * @date 2026-10-18
+ */
+void visit_tail_call(const koopa_raw_call_t &call);
+
+/**
+ * @brief 把一个值加载到指定的寄存器中, 值可以是立即数, 函数参数或者任意有返回值的指令的结果
+ * @param[in] value 要加载的值
+ * @param[in] reg 目标寄存器
+ * @date 2026-10-18
+ */
+void load_value_to_reg(const koopa_raw_value_t &value, const std::string &reg);
+
+/**
+ * @brief 把寄存器中的值保存到 value 的位置: 分配了寄存器时 mv 过去, 否则存到栈上
+ * @param[in] value 要保存的值
+ * @param[in] reg 值当前所在的寄存器
+ * @date 2026-10-18
+ */
+void save_value(const koopa_raw_value_t &value, const std::string &reg);
+
+/**
+ * @brief 给值分配整个生命周期都使用的寄存器: 跨过 call 仍然活跃的值使用 callee-saved 寄存器 s0 - s11, 其他的值使用 a0 - a7
+ * @note 先做活跃性分析并建立冲突图, 再按照循环深度加权的使用次数从大到小贪心着色; 每个用到的 callee-saved 寄存器在 prologue 和 epilogue 中各访存一次, 所以权重太小的值不会占用新的寄存器
+ * @note call 的参数不放在 a0 - a7 中, 因为加载参数的时候会按顺序覆盖它们; 前 8 个函数参数放在 a0 - a7 中时就使用到达时所在的寄存器
+ * @param[in] func 一个定义过的函数
+ * @return 值到寄存器名字的映射, 没有出现的值仍然放在栈上
+ * @date 2026-10-18
+ */
+std::unordered_map<koopa_raw_value_t, std::string> allocate_home_registers(const koopa_raw_function_t &func);
+
+/**
+ * @brief 决定当前函数的哪些基本块在建立栈帧之前执行 (shrink-wrapping)
+ * @note 不访问栈, 不使用 callee-saved 寄存器, 也不调用其他函数的基本块不需要栈帧; 这样的基本块如果所有前驱也都不需要栈帧, 就在 prologue 之前执行, prologue 放在从它们进入其他基本块的边上
+ * @param[in] func 当前函数, 栈管理器和寄存器分配都已经完成
+ * @date 2026-10-18
+ */
+void plan_frame(const koopa_raw_function_t &func);
+
+// 基本块是否在建立栈帧之前执行
+bool is_frameless(const koopa_raw_basic_block_t &bb);
+
+/**
+ * @brief 输出当前函数的 prologue: 开辟栈帧, 不是叶子函数时保存 ra, 保存用到的 callee-saved 寄存器, 把前 8 个参数放到它们的位置
+ * @date 2026-10-18
+ */
+void emit_prologue();
+
+/**
+ * @brief 输出拆掉栈帧的代码: 恢复 callee-saved 寄存器和 ra, 恢复 sp, 用于 epilogue 和尾调用
+ * @date 2026-10-18
+ */
+void emit_frame_teardown();
+
+/**
+ * @brief 已经建立栈帧的 ret 跳到当前函数共用的 epilogue
+ * @param[in] fall_through epilogue 是否紧跟在当前位置后面, 这时省略 j 指令
+ * @date 2026-10-18
+ */
+void emit_jump_to_epilogue(bool fall_through);
+
+/**
+ * @brief 在函数末尾输出共用的 epilogue, 没有 ret 跳到这里时不输出
+ * @date 2026-10-18
+ */
+void emit_epilogue();
+
+/**
+ * @brief 插桩模式下, 输出给一个 profile 计数器加一的代码, 使用 t0 和 t1, 所以只能在没有寄存器被占用的时候调用
+ * @param[in] name 计数器的名字
+ * @date 2026-10-18
+ */
+void emit_profile_counter(const std::string &name);
+
+/**
+ * @brief 插桩模式下, 输出所有计数器的存储空间, 以及在 main 返回前调用的 __prof_dump 函数
+ * @date 2026-10-18
+ */
+void emit_profile_runtime();
+
+/**
+ * @brief 在机器 IR 上做窥孔优化: 消除 store 之后的 load, 合并 mv, 把 li 折叠成立即数或 x0, 删除跳到下一条指令的跳转, 反转跳过 j 的分支
+ * @note 规则写在一张表里, 每条规则只看基本块内一个小窗口中的指令, 需要知道寄存器是否死亡时查询函数级的活跃性; 每条规则的命中次数记入优化统计
+ * @param[in,out] module 指令选择得到的机器 IR
+ * @date 2026-10-18
+ */
+void peephole(MModule &module);
@@ -2,8 +2,10 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "koopa.h"
+#include "mir.hpp"
 
 /**
  * @brief 单个函数的栈管理器, 是一个函数使用的, 可以维护值 (比如 `@x`, `%1`) 和栈地址的关系
@@ -22,6 +24,16 @@ private:
     // 值到栈地址的映射, 栈地址的表示方法是 "sp + offset" 中的 int offset
     std::unordered_map<koopa_raw_value_t, int> value_to_stack_offset;
 
+    // 整个生命周期都放在某个寄存器中的值, 这些值没有栈上的位置
+    std::unordered_map<koopa_raw_value_t, std::string> value_to_home_reg;
+
+    // 函数使用的 callee-saved 寄存器, 在 prologue 中依次保存到 callee_saved_offset 开始的位置
+    std::vector<std::string> callee_saved_regs;
+    int callee_saved_offset = 0;
+
+    // 函数是否调用了其他函数, 叶子函数不需要保存 ra
+    bool save_ra = true;
+
 public:
     // 构造函数
     StackManager() : stack_size(0), stack_used_byte(0) {}
@@ -31,6 +43,9 @@ public:
     // 保存一个值到栈中, 然后栈帧使用情况自动增加 4 字节
     void save_value_to_stack(const koopa_raw_value_t &value);
 
+    // 在栈中分配 count 个不对应任何值的中转位置, 返回第一个位置的地址
+    int save_scratch_to_stack(int count);
+
     // 获取栈帧使用情况
     int get_stack_used_byte() const;
 
@@ -39,6 +54,30 @@ public:
 
     // 获取某个值对应的栈地址
     int get_value_stack_offset(const koopa_raw_value_t &value);
+
+    // 把一个值放在寄存器 reg 中, 之后这个值不再分配栈上的位置
+    void assign_home_reg(const koopa_raw_value_t &value, const std::string &reg);
+
+    // 一个值是否放在寄存器中
+    bool has_home_reg(const koopa_raw_value_t &value) const;
+
+    // 获取放着某个值的寄存器
+    std::string get_home_reg(const koopa_raw_value_t &value) const;
+
+    // 在栈中分配保存 regs 的位置, regs 是函数使用的所有 callee-saved 寄存器
+    void save_callee_saved_regs(const std::vector<std::string> &regs);
+
+    // 函数使用的 callee-saved 寄存器
+    const std::vector<std::string> &get_callee_saved_regs() const;
+
+    // 第 index 个 callee-saved 寄存器保存在栈上的位置
+    int get_callee_saved_offset(int index) const;
+
+    // 设置 prologue 是否需要保存 ra
+    void set_save_ra(bool save);
+
+    // prologue 是否需要保存 ra, ra 保存在栈帧的最上面
+    bool get_save_ra() const;
 };
 
 /**
@@ -150,6 +189,14 @@ public:
      */
     std::string new_temp_reg();
 
+    /**
+     * @brief 设置一个寄存器是否被整个函数占用, 被占用的寄存器不会再分配给临时值
+     * @param[in] reg 寄存器名称
+     * @param[in] reserved 是否占用
+     * @date 2026-10-18
+     */
+    void set_reg_reserved(const std::string &reg, bool reserved);
+
     /**
      * @brief 找出这个值占用哪个寄存器, 用于输出 RISC-V 汇编代码
      * @param[in] value 值
@@ -176,31 +223,70 @@ public:
      * @date 2024-12-22
      */
     void init_stack_manager_for_one_function(const std::string &function_name, int stack_size, int num_args_on_stack);
+
+    /**
+     * @brief 获取当前正在处理的函数的函数名
+     * @return 函数名
+     * @date 2026-10-18
+     */
+    std::string get_current_function_name() const;
 };
 
 /**
- * @brief RISC-V 汇编打印器, 可以帮助打印 RISC-V 汇编代码
+ * @brief RISC-V 汇编打印器, 指令选择通过它输出指令; 指令先追加到机器 IR 中, 所有函数处理完之后再统一输出成汇编文本
  * @author Yutong Liang
  * @date 2024-11-28
  */
 class RISCVPrinter
 {
+private:
+    // 输出的机器 IR
+    MModule _module;
+
+    // 当前函数正在追加指令的基本块
+    MBlock &_current_block();
+
+    // 在当前基本块末尾追加一条指令
+    void _append(MOp op, MReg rd, MReg rs1, MReg rs2, int32_t imm = 0, int32_t sym = -1);
+
+    // 追加 op rd, rs1, rs2 形式的指令
+    void _binary(MOp op, const std::string &rd, const std::string &rs1, const std::string &rs2);
+
+    // 追加 op rd, rs1, imm 形式的指令
+    void _binary_imm(MOp op, const std::string &rd, const std::string &rs1, int32_t imm);
+
+    // 追加 op rd, rs1 形式的指令
+    void _unary(MOp op, const std::string &rd, const std::string &rs1);
+
 public:
     // RISCV 语句
     void data();
-    void text();
     void globl(const std::string &name);
     void word(const int &value);
     void zero(const int &len);
     void label(const std::string &name);
+    void asciz(const std::string &str);
+
+    /**
+     * @brief 开始一个新的函数, 之后的指令都追加到这个函数中, 第一个 label 之前的指令属于函数的第一个基本块
+     * @param[in] name 函数名
+     * @param[in] global 是否输出 .globl
+     * @date 2026-10-18
+     */
+    void begin_function(const std::string &name, bool global = true);
+
+    // 输出的机器 IR, 后面的 pass 可以直接修改
+    MModule &module();
 
     // 调用和返回
     void call(const std::string &func_name);
+    void tail(const std::string &func_name);
     void ret();
 
     // 单目运算
     void seqz(const std::string &rd, const std::string &rs1);
     void snez(const std::string &rd, const std::string &rs1);
+    void neg(const std::string &rd, const std::string &rs1);
 
     // 双目运算
     void or_(const std::string &rd, const std::string &rs1, const std::string &rs2);
@@ -212,6 +298,14 @@ public:
     void mul(const std::string &rd, const std::string &rs1, const std::string &rs2);
     void div(const std::string &rd, const std::string &rs1, const std::string &rs2);
     void rem(const std::string &rd, const std::string &rs1, const std::string &rs2);
+    void sll(const std::string &rd, const std::string &rs1, const std::string &rs2);
+    void srl(const std::string &rd, const std::string &rs1, const std::string &rs2);
+    void sra(const std::string &rd, const std::string &rs1, const std::string &rs2);
+    void mulh(const std::string &rd, const std::string &rs1, const std::string &rs2);
+    void andi(const std::string &rd, const std::string &rs1, const int &imm);
+    void slli(const std::string &rd, const std::string &rs1, const int &shamt);
+    void srli(const std::string &rd, const std::string &rs1, const int &shamt);
+    void srai(const std::string &rd, const std::string &rs1, const int &shamt);
     void sgt(const std::string &rd, const std::string &rs1, const std::string &rs2);
     void slt(const std::string &rd, const std::string &rs1, const std::string &rs2);
 
@@ -220,6 +314,7 @@ public:
     void mv(const std::string &rd, const std::string &rs1);
     void la(const std::string &rd, const std::string &rs1);
     void lw(const std::string &rd, const std::string &base, const int &bias, RISCVContextManager &context_manager);
+    void lbu(const std::string &rd, const std::string &base, const int &bias);
     void sw(const std::string &rs1, const std::string &base, const int &bias, RISCVContextManager &context_manager);
 
     // 分支
@@ -0,0 +1,417 @@
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#include "include/incremental.hpp"
+
+// Bison 生成的语法分析器和 Flex 生成的词法分析器, 参见 main.cpp
+extern FILE *yyin;
+extern int yyparse(std::unique_ptr<BaseAST> &ast);
+extern void yyrestart(FILE *input_file);
+
+size_t IncrementalFrontend::skip_blank(size_t pos) const
+{
+    while (pos < _source.size())
+    {
+        if (std::isspace((unsigned char)_source[pos]))
+        {
+            ++pos;
+        }
+        else if (_source.compare(pos, 2, "//") == 0)
+        {
+            size_t newline = _source.find('\n', pos);
+            pos = newline == std::string::npos ? _source.size() : newline + 1;
+        }
+        else if (_source.compare(pos, 2, "/*") == 0)
+        {
+            // 没有结束的块注释一直延续到文件末尾
+            size_t close = _source.find("*/", pos + 2);
+            pos = close == std::string::npos ? _source.size() : close + 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return pos;
+}
+
+void IncrementalFrontend::scan_unit(size_t &pos, Unit &unit) const
+{
+    // 声明在大括号外的分号处结束, 函数定义在回到最外层的右大括号处结束
+    unit.begin = pos;
+    int depth = 0;
+    while (pos < _source.size())
+    {
+        size_t next = skip_blank(pos);
+        if (next != pos)
+        {
+            pos = next;
+            continue;
+        }
+        char c = _source[pos];
+        if (std::isalpha((unsigned char)c) || c == '_')
+        {
+            size_t start = pos;
+            while (pos < _source.size() && (std::isalnum((unsigned char)_source[pos]) || _source[pos] == '_'))
+            {
+                ++pos;
+            }
+            unit.identifiers.insert(_source.substr(start, pos - start));
+            continue;
+        }
+        if (std::isdigit((unsigned char)c))
+        {
+            while (pos < _source.size() && std::isalnum((unsigned char)_source[pos]))
+            {
+                ++pos;
+            }
+            continue;
+        }
+        ++pos;
+        if (c == '{')
+        {
+            ++depth;
+        }
+        else if ((c == '}' && --depth <= 0) || (c == ';' && depth == 0))
+        {
+            break;
+        }
+    }
+    unit.end = pos;
+}
+
+void IncrementalFrontend::parse_unit(Unit &unit)
+{
+    ++_reparsed_units;
+    unit.ast.reset();
+    unit.lowered = false;
+    unit.error.clear();
+
+    // 一个 CompUnit 的源码本身就是只有一个 CompUnit 的程序
+    std::string text = _source.substr(unit.begin, unit.end - unit.begin);
+    FILE *input = fmemopen(text.data(), text.size(), "r");
+    if (!input)
+    {
+        throw std::runtime_error("IncrementalFrontend::parse_unit: failed to open the source of a unit");
+    }
+    yyrestart(input);
+    std::unique_ptr<BaseAST> ast;
+    int ret = yyparse(ast);
+    fclose(input);
+
+    auto program = dynamic_cast<ProgramAST *>(ast.get());
+    if (ret != 0 || !program || program->comp_units.size() != 1)
+    {
+        unit.error = "syntax error";
+        return;
+    }
+    unit.ast = std::move(program->comp_units.front());
+}
+
+void IncrementalFrontend::lower_unit(Unit &unit)
+{
+    ++_relowered_units;
+    std::unordered_map<std::string, std::string> before(unit.exports.begin(), unit.exports.end());
+    unit.lowered = true;
+    unit.koopa.clear();
+    unit.global_symbols.clear();
+    unit.functions.clear();
+    unit.exports.clear();
+
+    if (unit.ast)
+    {
+        std::stringstream output_stream;
+        try
+        {
+            unit.error.clear();
+            unit.ast->print(output_stream);
+            unit.koopa = output_stream.str();
+        }
+        catch (const std::runtime_error &e)
+        {
+            koopa_context_manager.leave_local_scopes();
+            unit.error = e.what();
+        }
+    }
+
+    // 有错误的 CompUnit 不导出任何名字
+    if (unit.error.empty())
+    {
+        if (auto func_def = dynamic_cast<const FuncDefAST *>(unit.ast.get()))
+        {
+            bool has_return_value = func_def->func_type == FuncDefAST::FuncType::INT;
+            unit.functions.emplace_back(func_def->ident, has_return_value);
+            unit.exports.emplace_back(func_def->ident, std::string(has_return_value ? "fun i32/" : "fun/") + std::to_string(func_def->func_formal_params->size()));
+        }
+        else if (auto decl = dynamic_cast<const DeclAST *>(unit.ast.get()))
+        {
+            std::vector<std::string> names;
+            if (decl->const_decl)
+            {
+                for (const auto &item : ((ConstDeclAST *)(*decl->const_decl).get())->const_defs)
+                {
+                    names.push_back(((ConstDefAST *)item.get())->const_symbol);
+                }
+            }
+            else if (decl->var_decl)
+            {
+                for (const auto &item : ((VarDeclAST *)(*decl->var_decl).get())->var_defs)
+                {
+                    names.push_back(((VarDefAST *)item.get())->var_symbol);
+                }
+            }
+            for (const auto &name : names)
+            {
+                Symbol symbol = koopa_context_manager.name_to_symbol(name);
+                unit.global_symbols.emplace_back(name, symbol);
+                unit.exports.emplace_back(name, symbol.type == Symbol::Type::VAL ? "const " + std::to_string(symbol.val) : "var");
+            }
+        }
+    }
+
+    // 新的签名和这个 CompUnit 之前的签名比较; 新解析的 CompUnit 和它替换掉的 CompUnit 的签名比较
+    for (const auto &[name, signature] : unit.exports)
+    {
+        // 对应上的旧名字从 before 或者 _removed_exports 中删除, 剩下的就是不再导出的名字
+        auto &old_exports = before.count(name) ? before : _removed_exports;
+        auto it = old_exports.find(name);
+        if (it == old_exports.end() || it->second != signature)
+        {
+            _changed_names.insert(name);
+        }
+        if (it != old_exports.end())
+        {
+            old_exports.erase(it);
+        }
+    }
+    for (const auto &item : before)
+    {
+        _changed_names.insert(item.first);
+    }
+}
+
+void IncrementalFrontend::replay_unit(const Unit &unit) const
+{
+    for (const auto &[name, symbol] : unit.global_symbols)
+    {
+        koopa_context_manager.insert_symbol(name, symbol);
+    }
+    for (const auto &[name, has_return_value] : unit.functions)
+    {
+        koopa_context_manager.func_has_return_value[name] = has_return_value;
+    }
+}
+
+void IncrementalFrontend::lower()
+{
+    _relowered_units = 0;
+    koopa_context_manager.reset_symbols();
+    std::stringstream library;
+    print_library_declarations(library);
+    _library_declarations = library.str();
+
+    for (size_t i = 0; i < _units.size(); ++i)
+    {
+        // 新解析的 CompUnit 之后, 被替换掉而没有重新出现的名字都算作变化了
+        if (i == _rescanned_end)
+        {
+            for (const auto &item : _removed_exports)
+            {
+                _changed_names.insert(item.first);
+            }
+            _removed_exports.clear();
+        }
+        Unit &unit = _units[i];
+        bool dirty = !unit.lowered;
+        for (auto it = _changed_names.begin(); !dirty && it != _changed_names.end(); ++it)
+        {
+            dirty = unit.identifiers.count(*it) > 0;
+        }
+        if (dirty)
+        {
+            lower_unit(unit);
+        }
+        else
+        {
+            replay_unit(unit);
+        }
+    }
+    _removed_exports.clear();
+    _changed_names.clear();
+}
+
+void IncrementalFrontend::open(const std::string &source)
+{
+    _source.clear();
+    _units.clear();
+    edit(0, 0, source);
+}
+
+void IncrementalFrontend::edit(size_t offset, size_t length, const std::string &text)
+{
+    if (offset > _source.size() || length > _source.size() - offset)
+    {
+        throw std::runtime_error("IncrementalFrontend::edit: edit range is out of the source");
+    }
+    _reparsed_units = 0;
+    size_t old_size = _source.size();
+    _source.replace(offset, length, text);
+
+    // 在修改位置之前结束的 CompUnit 不受影响, 在被替换的部分之后开始的 CompUnit 只是平移
+    // 没有结束就到了文件末尾的 CompUnit (比如缺少右大括号) 会吞掉追加在文件末尾的文本, 所以结束在文件末尾的 CompUnit 总是重新切分
+    size_t first = 0;
+    while (first < _units.size() && (_units[first].end < offset || (_units[first].end == offset && offset < old_size)))
+    {
+        ++first;
+    }
+    size_t resume = first;
+    while (resume < _units.size() && _units[resume].begin < offset + length)
+    {
+        ++resume;
+    }
+    auto shifted = [&](size_t pos)
+    {
+        return pos - length + text.size();
+    };
+
+    // 从上一个不受影响的 CompUnit 的结尾开始重新切分, 直到某个 CompUnit 的开头和平移之后的旧 CompUnit 重合, 之后的切分和原来相同
+    std::vector<Unit> rescanned;
+    size_t pos = skip_blank(first > 0 ? _units[first - 1].end : 0);
+    while (pos < _source.size())
+    {
+        while (resume < _units.size() && shifted(_units[resume].begin) < pos)
+        {
+            ++resume;
+        }
+        if (resume < _units.size() && shifted(_units[resume].begin) == pos)
+        {
+            break;
+        }
+        Unit unit;
+        scan_unit(pos, unit);
+        parse_unit(unit);
+        rescanned.push_back(std::move(unit));
+        pos = skip_blank(pos);
+    }
+    if (pos >= _source.size())
+    {
+        resume = _units.size();
+    }
+
+    for (size_t i = first; i < resume; ++i)
+    {
+        for (const auto &item : _units[i].exports)
+        {
+            _removed_exports[item.first] = item.second;
+        }
+    }
+    std::vector<Unit> units;
+    for (size_t i = 0; i < first; ++i)
+    {
+        units.push_back(std::move(_units[i]));
+    }
+    for (auto &unit : rescanned)
+    {
+        units.push_back(std::move(unit));
+    }
+    _rescanned_end = units.size();
+    for (size_t i = resume; i < _units.size(); ++i)
+    {
+        _units[i].begin = shifted(_units[i].begin);
+        _units[i].end = shifted(_units[i].end);
+        units.push_back(std::move(_units[i]));
+    }
+    _units = std::move(units);
+    lower();
+}
+
+const std::string &IncrementalFrontend::source() const
+{
+    return _source;
+}
+
+std::string IncrementalFrontend::koopa() const
+{
+    std::string koopa = _library_declarations;
+    for (const auto &unit : _units)
+    {
+        koopa += unit.koopa;
+    }
+    return koopa;
+}
+
+std::vector<std::string> IncrementalFrontend::errors() const
+{
+    std::vector<std::string> errors;
+    for (const auto &unit : _units)
+    {
+        if (!unit.error.empty())
+        {
+            errors.push_back(std::to_string(unit.begin) + ": " + unit.error);
+        }
+    }
+    return errors;
+}
+
+int IncrementalFrontend::reparsed_units() const
+{
+    return _reparsed_units;
+}
+
+int IncrementalFrontend::relowered_units() const
+{
+    return _relowered_units;
+}
+
+void run_edit_script(std::istream &script, std::ostream &koopa_stream, std::ostream &log_stream)
+{
+    IncrementalFrontend frontend;
+    std::string line;
+    for (int index = 0; std::getline(script, line); ++index)
+    {
+        std::istringstream command_stream(line);
+        std::string command;
+        size_t offset = 0, length = 0, size = 0;
+        command_stream >> command;
+        if (command == "open")
+        {
+            command_stream >> size;
+        }
+        else if (command == "edit")
+        {
+            command_stream >> offset >> length >> size;
+        }
+        else
+        {
+            throw std::runtime_error("run_edit_script: unknown command `" + line + "`");
+        }
+        if (!command_stream)
+        {
+            throw std::runtime_error("run_edit_script: malformed command `" + line + "`");
+        }
+
+        // 文本之后的换行只是分隔符, 不属于文本
+        std::string text(size, '\0');
+        if (!script.read(text.data(), size) || script.get() != '\n')
+        {
+            throw std::runtime_error("run_edit_script: text of command " + std::to_string(index) + " is truncated");
+        }
+        if (command == "open")
+        {
+            frontend.open(text);
+        }
+        else
+        {
+            frontend.edit(offset, length, text);
+        }
+
+        log_stream << command << " " << index << ": reparsed " << frontend.reparsed_units() << ", relowered " << frontend.relowered_units() << std::endl;
+        for (const auto &error : frontend.errors())
+        {
+            log_stream << "  error at " << error << std::endl;
+        }
+    }
+    koopa_stream << frontend.koopa();
+}
@@ -0,0 +1,922 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "include/ir_util.hpp"
+#include "include/profile.hpp"
+
+IRBuilder ir_builder;
+
+////////////////////////////////////////////////////
+// IRBuilder
+////////////////////////////////////////////////////
+
+IRBuilder::IRBuilder()
+{
+    _i32_type.tag = KOOPA_RTT_INT32;
+    _unit_type.tag = KOOPA_RTT_UNIT;
+    _i32_pointer_type.tag = KOOPA_RTT_POINTER;
+    _i32_pointer_type.data.pointer.base = &_i32_type;
+}
+
+koopa_raw_type_t IRBuilder::i32_type() const
+{
+    return &_i32_type;
+}
+
+koopa_raw_type_t IRBuilder::unit_type() const
+{
+    return &_unit_type;
+}
+
+koopa_raw_type_t IRBuilder::i32_pointer_type() const
+{
+    return &_i32_pointer_type;
+}
+
+koopa_raw_slice_t IRBuilder::new_slice(const std::vector<const void *> &items, koopa_raw_slice_item_kind_t kind)
+{
+    _buffers.push_back(items);
+    koopa_raw_slice_t slice;
+    slice.buffer = _buffers.back().data();
+    slice.len = items.size();
+    slice.kind = kind;
+    return slice;
+}
+
+const char *IRBuilder::new_name(const std::string &name)
+{
+    if (name.empty())
+    {
+        return nullptr;
+    }
+    _names.push_back(name);
+    return _names.back().c_str();
+}
+
+koopa_raw_value_data_t *IRBuilder::new_value(koopa_raw_type_t ty, const char *name, koopa_raw_value_tag_t tag)
+{
+    _values.emplace_back();
+    koopa_raw_value_data_t *value = &_values.back();
+    value->ty = ty;
+    value->name = name;
+    value->used_by = new_slice({}, KOOPA_RSIK_VALUE);
+    value->kind.tag = tag;
+    return value;
+}
+
+koopa_raw_value_t IRBuilder::new_integer(int value)
+{
+    koopa_raw_value_data_t *integer = new_value(i32_type(), nullptr, KOOPA_RVT_INTEGER);
+    integer->kind.data.integer.value = value;
+    return integer;
+}
+
+koopa_raw_value_t IRBuilder::new_binary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs)
+{
+    koopa_raw_value_data_t *binary = new_value(i32_type(), nullptr, KOOPA_RVT_BINARY);
+    binary->kind.data.binary.op = op;
+    binary->kind.data.binary.lhs = lhs;
+    binary->kind.data.binary.rhs = rhs;
+    return binary;
+}
+
+koopa_raw_value_t IRBuilder::new_alloc(const std::string &name)
+{
+    return new_value(i32_pointer_type(), new_name(name), KOOPA_RVT_ALLOC);
+}
+
+koopa_raw_value_t IRBuilder::new_load(koopa_raw_value_t src)
+{
+    koopa_raw_value_data_t *load = new_value(i32_type(), nullptr, KOOPA_RVT_LOAD);
+    load->kind.data.load.src = src;
+    return load;
+}
+
+koopa_raw_value_t IRBuilder::new_store(koopa_raw_value_t value, koopa_raw_value_t dest)
+{
+    koopa_raw_value_data_t *store = new_value(unit_type(), nullptr, KOOPA_RVT_STORE);
+    store->kind.data.store.value = value;
+    store->kind.data.store.dest = dest;
+    return store;
+}
+
+koopa_raw_value_t IRBuilder::new_jump(koopa_raw_basic_block_t target)
+{
+    koopa_raw_value_data_t *jump = new_value(unit_type(), nullptr, KOOPA_RVT_JUMP);
+    jump->kind.data.jump.target = target;
+    jump->kind.data.jump.args = new_slice({}, KOOPA_RSIK_VALUE);
+    return jump;
+}
+
+koopa_raw_value_t IRBuilder::new_branch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb, koopa_raw_basic_block_t false_bb)
+{
+    koopa_raw_value_data_t *branch = new_value(unit_type(), nullptr, KOOPA_RVT_BRANCH);
+    branch->kind.data.branch.cond = cond;
+    branch->kind.data.branch.true_bb = true_bb;
+    branch->kind.data.branch.false_bb = false_bb;
+    branch->kind.data.branch.true_args = new_slice({}, KOOPA_RSIK_VALUE);
+    branch->kind.data.branch.false_args = new_slice({}, KOOPA_RSIK_VALUE);
+    return branch;
+}
+
+koopa_raw_value_t IRBuilder::new_call(koopa_raw_function_t callee, const std::vector<koopa_raw_value_t> &args, koopa_raw_type_t ty)
+{
+    koopa_raw_value_data_t *call = new_value(ty, nullptr, KOOPA_RVT_CALL);
+    call->kind.data.call.callee = callee;
+    call->kind.data.call.args = new_slice(std::vector<const void *>(args.begin(), args.end()), KOOPA_RSIK_VALUE);
+    return call;
+}
+
+koopa_raw_value_t IRBuilder::new_return(koopa_raw_value_t value)
+{
+    koopa_raw_value_data_t *ret = new_value(unit_type(), nullptr, KOOPA_RVT_RETURN);
+    ret->kind.data.ret.value = value;
+    return ret;
+}
+
+koopa_raw_value_t IRBuilder::new_block_arg(size_t index, const std::string &name)
+{
+    koopa_raw_value_data_t *arg = new_value(i32_type(), new_name(name), KOOPA_RVT_BLOCK_ARG_REF);
+    arg->kind.data.block_arg_ref.index = index;
+    return arg;
+}
+
+koopa_raw_basic_block_data_t *IRBuilder::new_basic_block(const std::string &name)
+{
+    _bbs.emplace_back();
+    koopa_raw_basic_block_data_t *bb = &_bbs.back();
+    bb->name = new_name(name);
+    bb->params = new_slice({}, KOOPA_RSIK_VALUE);
+    bb->used_by = new_slice({}, KOOPA_RSIK_VALUE);
+    bb->insts = new_slice({}, KOOPA_RSIK_VALUE);
+    return bb;
+}
+
+koopa_raw_value_data_t *IRBuilder::clone_value(koopa_raw_value_t value, const char *name)
+{
+    koopa_raw_value_data_t *clone = new_value(value->ty, name, value->kind.tag);
+    clone->kind = value->kind;
+    // slice 需要深拷贝, 否则修改拷贝的参数会同时修改原来的值
+    auto copy_slice = [&](koopa_raw_slice_t &slice)
+    {
+        slice = new_slice(std::vector<const void *>(slice.buffer, slice.buffer + slice.len), slice.kind);
+    };
+    switch (clone->kind.tag)
+    {
+    case KOOPA_RVT_AGGREGATE:
+        copy_slice(clone->kind.data.aggregate.elems);
+        break;
+    case KOOPA_RVT_BRANCH:
+        copy_slice(clone->kind.data.branch.true_args);
+        copy_slice(clone->kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        copy_slice(clone->kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        copy_slice(clone->kind.data.call.args);
+        break;
+    default:
+        break;
+    }
+    return clone;
+}
+
+koopa_raw_program_t IRBuilder::copy_program(const koopa_raw_program_t &program)
+{
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> bb_map;
+    std::unordered_map<koopa_raw_function_t, koopa_raw_function_t> func_map;
+
+    // 立即数之类的常量操作数没有出现在任何指令列表中, 遇到的时候再拷贝
+    std::function<void(koopa_raw_value_t)> copy_constant = [&](koopa_raw_value_t value)
+    {
+        if (value && value_map.find(value) == value_map.end())
+        {
+            koopa_raw_value_t new_value = clone_value(value, new_name(value->name ? value->name : ""));
+            value_map[value] = new_value;
+            // aggregate 的元素也是常量
+            for (auto elem : get_operands(value))
+            {
+                copy_constant(elem);
+                replace_operand(new_value, elem, value_map[elem]);
+            }
+        }
+    };
+
+    // 第一遍: 拷贝所有函数, 全局变量, 基本块和指令的外壳, 这样前向引用也能找到对应的拷贝
+    std::vector<koopa_raw_value_t> globals = get_values(program.values);
+    std::vector<koopa_raw_value_t> new_globals;
+    for (auto global : globals)
+    {
+        koopa_raw_value_data_t *new_global = clone_value(global, new_name(global->name ? global->name : ""));
+        value_map[global] = new_global;
+        new_globals.push_back(new_global);
+    }
+    std::vector<koopa_raw_function_t> funcs = get_functions(program);
+    std::vector<koopa_raw_value_t> all_insts;
+    for (auto func : funcs)
+    {
+        _funcs.emplace_back();
+        koopa_raw_function_data_t *new_func = &_funcs.back();
+        new_func->ty = func->ty;
+        new_func->name = new_name(func->name);
+        func_map[func] = new_func;
+
+        std::vector<const void *> new_params;
+        for (auto param : get_values(func->params))
+        {
+            koopa_raw_value_t new_param = clone_value(param, new_name(param->name ? param->name : ""));
+            value_map[param] = new_param;
+            new_params.push_back(new_param);
+        }
+        new_func->params = new_slice(new_params, KOOPA_RSIK_VALUE);
+
+        std::vector<const void *> new_bbs;
+        for (auto bb : get_basic_blocks(func))
+        {
+            koopa_raw_basic_block_data_t *new_bb = new_basic_block(bb->name ? bb->name : "");
+            bb_map[bb] = new_bb;
+            new_bbs.push_back(new_bb);
+
+            std::vector<const void *> new_bb_params;
+            for (auto param : get_values(bb->params))
+            {
+                koopa_raw_value_t new_param = clone_value(param, new_name(param->name ? param->name : ""));
+                value_map[param] = new_param;
+                new_bb_params.push_back(new_param);
+            }
+            new_bb->params = new_slice(new_bb_params, KOOPA_RSIK_VALUE);
+
+            std::vector<const void *> new_insts;
+            for (auto inst : get_insts(bb))
+            {
+                koopa_raw_value_t new_inst = clone_value(inst, new_name(inst->name ? inst->name : ""));
+                value_map[inst] = new_inst;
+                new_insts.push_back(new_inst);
+                all_insts.push_back(inst);
+            }
+            new_bb->insts = new_slice(new_insts, KOOPA_RSIK_VALUE);
+        }
+        new_func->bbs = new_slice(new_bbs, KOOPA_RSIK_BASIC_BLOCK);
+    }
+
+    // 第二遍: 把拷贝中的操作数, 目标基本块和被调用函数替换成对应的拷贝
+    for (auto global : globals)
+    {
+        koopa_raw_value_data_t *new_global = as_mutable(value_map[global]);
+        copy_constant(global->kind.data.global_alloc.init);
+        new_global->kind.data.global_alloc.init = value_map[global->kind.data.global_alloc.init];
+    }
+    for (auto inst : all_insts)
+    {
+        koopa_raw_value_t new_inst = value_map[inst];
+        for (auto operand : get_operands(inst))
+        {
+            copy_constant(operand);
+            replace_operand(new_inst, operand, value_map[operand]);
+        }
+        for (auto succ : get_successors_of_terminator(inst))
+        {
+            replace_successor(new_inst, succ, bb_map[succ]);
+        }
+        if (inst->kind.tag == KOOPA_RVT_CALL)
+        {
+            as_mutable(new_inst)->kind.data.call.callee = func_map[inst->kind.data.call.callee];
+        }
+    }
+
+    koopa_raw_program_t new_program;
+    new_program.values = new_slice(std::vector<const void *>(new_globals.begin(), new_globals.end()), KOOPA_RSIK_VALUE);
+    std::vector<koopa_raw_function_t> new_funcs;
+    for (auto func : funcs)
+    {
+        new_funcs.push_back(func_map[func]);
+    }
+    set_functions(new_program, new_funcs);
+    rebuild_used_by(new_program);
+    return new_program;
+}
+
+////////////////////////////////////////////////////
+// raw IR 遍历和修改
+////////////////////////////////////////////////////
+
+koopa_raw_value_data_t *as_mutable(koopa_raw_value_t value)
+{
+    return const_cast<koopa_raw_value_data_t *>(value);
+}
+
+koopa_raw_basic_block_data_t *as_mutable(koopa_raw_basic_block_t bb)
+{
+    return const_cast<koopa_raw_basic_block_data_t *>(bb);
+}
+
+koopa_raw_function_data_t *as_mutable(koopa_raw_function_t func)
+{
+    return const_cast<koopa_raw_function_data_t *>(func);
+}
+
+std::string strip_prefix(const char *name)
+{
+    return name ? std::string(name + 1) : std::string();
+}
+
+std::vector<koopa_raw_function_t> get_functions(const koopa_raw_program_t &program)
+{
+    std::vector<koopa_raw_function_t> funcs;
+    for (size_t i = 0; i < program.funcs.len; ++i)
+    {
+        funcs.push_back(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+    }
+    return funcs;
+}
+
+void set_functions(koopa_raw_program_t &program, const std::vector<koopa_raw_function_t> &funcs)
+{
+    program.funcs = ir_builder.new_slice(std::vector<const void *>(funcs.begin(), funcs.end()), KOOPA_RSIK_FUNCTION);
+}
+
+std::vector<koopa_raw_basic_block_t> get_basic_blocks(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs;
+    for (size_t i = 0; i < func->bbs.len; ++i)
+    {
+        bbs.push_back(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]));
+    }
+    return bbs;
+}
+
+void set_basic_blocks(koopa_raw_function_t func, const std::vector<koopa_raw_basic_block_t> &bbs)
+{
+    as_mutable(func)->bbs = ir_builder.new_slice(std::vector<const void *>(bbs.begin(), bbs.end()), KOOPA_RSIK_BASIC_BLOCK);
+}
+
+std::vector<koopa_raw_value_t> get_insts(koopa_raw_basic_block_t bb)
+{
+    return get_values(bb->insts);
+}
+
+void set_insts(koopa_raw_basic_block_t bb, const std::vector<koopa_raw_value_t> &insts)
+{
+    as_mutable(bb)->insts = ir_builder.new_slice(std::vector<const void *>(insts.begin(), insts.end()), KOOPA_RSIK_VALUE);
+}
+
+std::vector<koopa_raw_value_t> get_values(const koopa_raw_slice_t &slice)
+{
+    std::vector<koopa_raw_value_t> values;
+    for (size_t i = 0; i < slice.len; ++i)
+    {
+        values.push_back(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+    }
+    return values;
+}
+
+bool is_function_defined(koopa_raw_function_t func)
+{
+    return func->bbs.len > 0;
+}
+
+bool is_terminator(koopa_raw_value_t value)
+{
+    return value->kind.tag == KOOPA_RVT_BRANCH || value->kind.tag == KOOPA_RVT_JUMP || value->kind.tag == KOOPA_RVT_RETURN;
+}
+
+bool is_integer(koopa_raw_value_t value)
+{
+    return value->kind.tag == KOOPA_RVT_INTEGER;
+}
+
+koopa_raw_value_t get_terminator(koopa_raw_basic_block_t bb)
+{
+    if (bb->insts.len == 0)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+}
+
+std::vector<koopa_raw_basic_block_t> get_successors_of_terminator(koopa_raw_value_t terminator)
+{
+    if (terminator->kind.tag == KOOPA_RVT_BRANCH)
+    {
+        return {terminator->kind.data.branch.true_bb, terminator->kind.data.branch.false_bb};
+    }
+    if (terminator->kind.tag == KOOPA_RVT_JUMP)
+    {
+        return {terminator->kind.data.jump.target};
+    }
+    return {};
+}
+
+std::vector<koopa_raw_basic_block_t> get_successors(koopa_raw_basic_block_t bb)
+{
+    koopa_raw_value_t terminator = get_terminator(bb);
+    if (!terminator)
+    {
+        return {};
+    }
+    return get_successors_of_terminator(terminator);
+}
+
+std::vector<koopa_raw_value_t> get_operands(koopa_raw_value_t value)
+{
+    const auto &kind = value->kind;
+    std::vector<koopa_raw_value_t> operands;
+    auto add_slice = [&](const koopa_raw_slice_t &slice)
+    {
+        for (auto item : get_values(slice))
+        {
+            operands.push_back(item);
+        }
+    };
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_AGGREGATE:
+        add_slice(kind.data.aggregate.elems);
+        break;
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        operands.push_back(kind.data.global_alloc.init);
+        break;
+    case KOOPA_RVT_LOAD:
+        operands.push_back(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        operands.push_back(kind.data.store.value);
+        operands.push_back(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        operands.push_back(kind.data.get_ptr.src);
+        operands.push_back(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        operands.push_back(kind.data.get_elem_ptr.src);
+        operands.push_back(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        operands.push_back(kind.data.binary.lhs);
+        operands.push_back(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        operands.push_back(kind.data.branch.cond);
+        add_slice(kind.data.branch.true_args);
+        add_slice(kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        add_slice(kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        add_slice(kind.data.call.args);
+        break;
+    case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value)
+        {
+            operands.push_back(kind.data.ret.value);
+        }
+        break;
+    default:
+        break;
+    }
+    return operands;
+}
+
+int replace_operand(koopa_raw_value_t user, koopa_raw_value_t from, koopa_raw_value_t to)
+{
+    auto &kind = as_mutable(user)->kind;
+    int count = 0;
+    auto replace = [&](koopa_raw_value_t &operand)
+    {
+        if (operand == from)
+        {
+            operand = to;
+            count++;
+        }
+    };
+    // slice 的内存由 ir_builder 管理, 可以直接原地修改
+    auto replace_slice = [&](koopa_raw_slice_t &slice)
+    {
+        for (size_t i = 0; i < slice.len; ++i)
+        {
+            if (slice.buffer[i] == from)
+            {
+                slice.buffer[i] = to;
+                count++;
+            }
+        }
+    };
+    switch (kind.tag)
+    {
+    case KOOPA_RVT_AGGREGATE:
+        replace_slice(kind.data.aggregate.elems);
+        break;
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        replace(kind.data.global_alloc.init);
+        break;
+    case KOOPA_RVT_LOAD:
+        replace(kind.data.load.src);
+        break;
+    case KOOPA_RVT_STORE:
+        replace(kind.data.store.value);
+        replace(kind.data.store.dest);
+        break;
+    case KOOPA_RVT_GET_PTR:
+        replace(kind.data.get_ptr.src);
+        replace(kind.data.get_ptr.index);
+        break;
+    case KOOPA_RVT_GET_ELEM_PTR:
+        replace(kind.data.get_elem_ptr.src);
+        replace(kind.data.get_elem_ptr.index);
+        break;
+    case KOOPA_RVT_BINARY:
+        replace(kind.data.binary.lhs);
+        replace(kind.data.binary.rhs);
+        break;
+    case KOOPA_RVT_BRANCH:
+        replace(kind.data.branch.cond);
+        replace_slice(kind.data.branch.true_args);
+        replace_slice(kind.data.branch.false_args);
+        break;
+    case KOOPA_RVT_JUMP:
+        replace_slice(kind.data.jump.args);
+        break;
+    case KOOPA_RVT_CALL:
+        replace_slice(kind.data.call.args);
+        break;
+    case KOOPA_RVT_RETURN:
+        replace(kind.data.ret.value);
+        break;
+    default:
+        break;
+    }
+    return count;
+}
+
+int replace_all_uses(koopa_raw_function_t func, koopa_raw_value_t from, koopa_raw_value_t to)
+{
+    int count = 0;
+    for (auto bb : get_basic_blocks(func))
+    {
+        for (auto inst : get_insts(bb))
+        {
+            count += replace_operand(inst, from, to);
+        }
+    }
+    return count;
+}
+
+void replace_uses_with_map(koopa_raw_function_t func, const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &replacement)
+{
+    if (replacement.empty())
+    {
+        return;
+    }
+    auto resolve = [&](koopa_raw_value_t value)
+    {
+        auto it = replacement.find(value);
+        while (it != replacement.end())
+        {
+            value = it->second;
+            it = replacement.find(value);
+        }
+        return value;
+    };
+    for (auto bb : get_basic_blocks(func))
+    {
+        for (auto inst : get_insts(bb))
+        {
+            for (auto operand : get_operands(inst))
+            {
+                koopa_raw_value_t to = resolve(operand);
+                if (to != operand)
+                {
+                    replace_operand(inst, operand, to);
+                }
+            }
+        }
+    }
+}
+
+std::vector<koopa_raw_value_t> get_successor_args(koopa_raw_value_t terminator, size_t index)
+{
+    if (terminator->kind.tag == KOOPA_RVT_JUMP)
+    {
+        return get_values(terminator->kind.data.jump.args);
+    }
+    if (terminator->kind.tag == KOOPA_RVT_BRANCH)
+    {
+        return get_values(index == 0 ? terminator->kind.data.branch.true_args : terminator->kind.data.branch.false_args);
+    }
+    return {};
+}
+
+void set_successor_args(koopa_raw_value_t terminator, size_t index, const std::vector<koopa_raw_value_t> &args)
+{
+    auto &kind = as_mutable(terminator)->kind;
+    koopa_raw_slice_t slice = ir_builder.new_slice(std::vector<const void *>(args.begin(), args.end()), KOOPA_RSIK_VALUE);
+    if (kind.tag == KOOPA_RVT_JUMP)
+    {
+        kind.data.jump.args = slice;
+    }
+    else if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        (index == 0 ? kind.data.branch.true_args : kind.data.branch.false_args) = slice;
+    }
+}
+
+int remove_unreachable_blocks(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    if (bbs.empty())
+    {
+        return 0;
+    }
+    std::unordered_map<koopa_raw_basic_block_t, bool> reachable;
+    std::vector<koopa_raw_basic_block_t> worklist = {bbs[0]};
+    reachable[bbs[0]] = true;
+    while (!worklist.empty())
+    {
+        koopa_raw_basic_block_t bb = worklist.back();
+        worklist.pop_back();
+        for (auto succ : get_successors(bb))
+        {
+            if (!reachable[succ])
+            {
+                reachable[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+    std::vector<koopa_raw_basic_block_t> kept;
+    for (auto bb : bbs)
+    {
+        if (reachable[bb])
+        {
+            kept.push_back(bb);
+        }
+    }
+    if (kept.size() == bbs.size())
+    {
+        return 0;
+    }
+    set_basic_blocks(func, kept);
+    return bbs.size() - kept.size();
+}
+
+long long estimate_entry_count(koopa_raw_function_t func, koopa_raw_basic_block_t bb, const std::vector<koopa_raw_basic_block_t> &preds)
+{
+    std::string function_name = func->name + 1;
+    long long bb_count = profile_manager.count(ProfileManager::block_key(function_name, bb->name + 1));
+    if (bb_count < 0)
+    {
+        return -1;
+    }
+    // 前驱可能还跳到别的基本块, 所以只是上界
+    long long sum = 0;
+    for (auto pred : preds)
+    {
+        long long pred_count = profile_manager.count(ProfileManager::block_key(function_name, pred->name + 1));
+        if (pred_count < 0)
+        {
+            return bb_count;
+        }
+        sum += pred_count;
+    }
+    return std::min(sum, bb_count);
+}
+
+bool fold_binary(koopa_raw_binary_op_t op, int lhs, int rhs, int &result)
+{
+    // 用无符号数计算加减乘和移位, 溢出时回绕, 和 RISC-V 一致
+    uint32_t ul = lhs, ur = rhs;
+    switch (op)
+    {
+    case KOOPA_RBO_NOT_EQ:
+        result = lhs != rhs;
+        return true;
+    case KOOPA_RBO_EQ:
+        result = lhs == rhs;
+        return true;
+    case KOOPA_RBO_GT:
+        result = lhs > rhs;
+        return true;
+    case KOOPA_RBO_LT:
+        result = lhs < rhs;
+        return true;
+    case KOOPA_RBO_GE:
+        result = lhs >= rhs;
+        return true;
+    case KOOPA_RBO_LE:
+        result = lhs <= rhs;
+        return true;
+    case KOOPA_RBO_ADD:
+        result = (int)(ul + ur);
+        return true;
+    case KOOPA_RBO_SUB:
+        result = (int)(ul - ur);
+        return true;
+    case KOOPA_RBO_MUL:
+        result = (int)(ul * ur);
+        return true;
+    case KOOPA_RBO_DIV:
+        if (rhs == 0)
+        {
+            return false;
+        }
+        result = (lhs == INT32_MIN && rhs == -1) ? INT32_MIN : lhs / rhs;
+        return true;
+    case KOOPA_RBO_MOD:
+        if (rhs == 0)
+        {
+            return false;
+        }
+        result = (lhs == INT32_MIN && rhs == -1) ? 0 : lhs % rhs;
+        return true;
+    case KOOPA_RBO_AND:
+        result = lhs & rhs;
+        return true;
+    case KOOPA_RBO_OR:
+        result = lhs | rhs;
+        return true;
+    case KOOPA_RBO_XOR:
+        result = lhs ^ rhs;
+        return true;
+    case KOOPA_RBO_SHL:
+        result = (int)(ul << (ur & 31));
+        return true;
+    case KOOPA_RBO_SHR:
+        result = (int)(ul >> (ur & 31));
+        return true;
+    case KOOPA_RBO_SAR:
+        result = lhs >> (rhs & 31);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_comparison(koopa_raw_binary_op_t op)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_EQ:
+    case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_LT:
+    case KOOPA_RBO_LE:
+    case KOOPA_RBO_GT:
+    case KOOPA_RBO_GE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+koopa_raw_binary_op_t swap_comparison(koopa_raw_binary_op_t op)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_LT:
+        return KOOPA_RBO_GT;
+    case KOOPA_RBO_LE:
+        return KOOPA_RBO_GE;
+    case KOOPA_RBO_GT:
+        return KOOPA_RBO_LT;
+    case KOOPA_RBO_GE:
+        return KOOPA_RBO_LE;
+    default:
+        return op;
+    }
+}
+
+koopa_raw_binary_op_t negate_comparison(koopa_raw_binary_op_t op)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_EQ:
+        return KOOPA_RBO_NOT_EQ;
+    case KOOPA_RBO_NOT_EQ:
+        return KOOPA_RBO_EQ;
+    case KOOPA_RBO_LT:
+        return KOOPA_RBO_GE;
+    case KOOPA_RBO_LE:
+        return KOOPA_RBO_GT;
+    case KOOPA_RBO_GT:
+        return KOOPA_RBO_LE;
+    case KOOPA_RBO_GE:
+        return KOOPA_RBO_LT;
+    default:
+        throw std::runtime_error("negate_comparison: not a comparison");
+    }
+}
+
+void set_successor(koopa_raw_value_t terminator, size_t index, koopa_raw_basic_block_t bb)
+{
+    auto &kind = as_mutable(terminator)->kind;
+    if (kind.tag == KOOPA_RVT_JUMP)
+    {
+        kind.data.jump.target = bb;
+    }
+    else if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        (index == 0 ? kind.data.branch.true_bb : kind.data.branch.false_bb) = bb;
+    }
+}
+
+void replace_successor(koopa_raw_value_t terminator, koopa_raw_basic_block_t from, koopa_raw_basic_block_t to)
+{
+    auto &kind = as_mutable(terminator)->kind;
+    if (kind.tag == KOOPA_RVT_BRANCH)
+    {
+        if (kind.data.branch.true_bb == from)
+        {
+            kind.data.branch.true_bb = to;
+        }
+        if (kind.data.branch.false_bb == from)
+        {
+            kind.data.branch.false_bb = to;
+        }
+    }
+    else if (kind.tag == KOOPA_RVT_JUMP)
+    {
+        if (kind.data.jump.target == from)
+        {
+            kind.data.jump.target = to;
+        }
+    }
+}
+
+int count_insts(koopa_raw_function_t func)
+{
+    int count = 0;
+    for (auto bb : get_basic_blocks(func))
+    {
+        count += bb->insts.len;
+    }
+    return count;
+}
+
+void rebuild_used_by(koopa_raw_program_t &program)
+{
+    std::unordered_map<const void *, std::vector<const void *>> used_by;
+    // 立即数之类的常量不在任何列表中, 在遍历操作数的时候记录下来
+    std::vector<koopa_raw_value_t> all_values;
+    std::vector<koopa_raw_basic_block_t> all_bbs;
+    auto add_uses = [&](koopa_raw_value_t user)
+    {
+        for (auto operand : get_operands(user))
+        {
+            if (used_by.find(operand) == used_by.end())
+            {
+                all_values.push_back(operand);
+            }
+            used_by[operand].push_back(user);
+        }
+        for (auto succ : get_successors_of_terminator(user))
+        {
+            used_by[succ].push_back(user);
+        }
+    };
+    auto add_value = [&](koopa_raw_value_t value)
+    {
+        if (used_by.find(value) == used_by.end())
+        {
+            used_by[value] = {};
+            all_values.push_back(value);
+        }
+    };
+    for (auto global : get_values(program.values))
+    {
+        add_value(global);
+        add_uses(global);
+    }
+    for (auto func : get_functions(program))
+    {
+        for (auto param : get_values(func->params))
+        {
+            add_value(param);
+        }
+        for (auto bb : get_basic_blocks(func))
+        {
+            all_bbs.push_back(bb);
+            for (auto param : get_values(bb->params))
+            {
+                add_value(param);
+            }
+            for (auto inst : get_insts(bb))
+            {
+                add_value(inst);
+                add_uses(inst);
+            }
+        }
+    }
+    for (auto value : all_values)
+    {
+        as_mutable(value)->used_by = ir_builder.new_slice(used_by[value], KOOPA_RSIK_VALUE);
+    }
+    for (auto bb : all_bbs)
+    {
+        as_mutable(bb)->used_by = ir_builder.new_slice(used_by[bb], KOOPA_RSIK_VALUE);
+    }
+}
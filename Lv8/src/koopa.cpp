@@ -10,9 +10,8 @@ KoopaContextManager koopa_context_manager;
 // Program Unit
 //////////////////////////////////////////
 
-Result ProgramAST::print(std::stringstream &output_stream) const
+void print_library_declarations(std::stringstream &output_stream)
 {
-    // 声明库函数
     output_stream << "decl @getint(): i32" << std::endl;
     output_stream << "decl @getch(): i32" << std::endl;
     output_stream << "decl @getarray(*i32): i32" << std::endl;
@@ -32,6 +31,12 @@ Result ProgramAST::print(std::stringstream &output_stream) const
     koopa_context_manager.func_has_return_value["starttime"] = false;
     koopa_context_manager.func_has_return_value["stoptime"] = false;
     output_stream << std::endl;
+}
+
+Result ProgramAST::print(std::stringstream &output_stream) const
+{
+    // 声明库函数
+    print_library_declarations(output_stream);
 
     // 打印每个 CompUnit
     for (auto &comp_unit : comp_units)
@@ -64,6 +69,7 @@ Result FuncDefAST::print(std::stringstream &output_stream) const
 
     // 保存当前需要被初始化的函数参数
     koopa_context_manager.func_formal_params = func_formal_params;
+    koopa_context_manager.clear_allocated_symbols();
 
     // 打印函数返回值类型
 
@@ -67,3 +67,23 @@ bool KoopaContextManager::is_symbol_allocated_in_this_level(const std::string &n
 {
     return _is_symbol_allocated_in_this_level[std::make_pair(name, symbol_tables.size())];
 }
+
+void KoopaContextManager::clear_allocated_symbols()
+{
+    _is_symbol_allocated_in_this_level.clear();
+}
+
+void KoopaContextManager::leave_local_scopes()
+{
+    symbol_tables.resize(1);
+    func_formal_params = nullptr;
+    while_statement_stack = std::stack<int>();
+    _is_symbol_allocated_in_this_level.clear();
+}
+
+void KoopaContextManager::reset_symbols()
+{
+    leave_local_scopes();
+    symbol_tables[0].clear();
+    func_has_return_value.clear();
+}
@@ -1,11 +1,14 @@
 #include <cassert>
 #include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 
 #include "include/koopa.hpp"
+#include "include/incremental.hpp"
 #include "include/riscv.hpp"
+#include "include/profile.hpp"
 
 using namespace std;
 
@@ -20,11 +23,88 @@ extern int yyparse(unique_ptr<BaseAST> &ast);
 int main(int argc, const char *argv[])
 {
   // parse command line arguments
-  assert(argc == 5);
+  // compiler <mode> <input> -o <output> [options...]
+  assert(argc >= 5);
   auto mode = argv[1];
   auto input = argv[2];
   auto output = argv[4];
 
+  // -O0 时跳过 Koopa IR 直接从抽象语法树生成汇编, 以最后一个优化选项为准
+  bool direct_riscv = false;
+
+  // parse options
+  for (int i = 5; i < argc; i++)
+  {
+    std::string option = argv[i];
+    // 选项的值不合法 (比如 -O3, 不存在的 pass, 读不到的 profile 文件) 时和未知选项一样报错退出
+    try
+    {
+      if (option == "-fprofile-generate")
+      {
+        profile_manager.enable_generate();
+      }
+      else if (option.rfind("-fprofile-use=", 0) == 0)
+      {
+        profile_manager.load_profile(option.substr(std::string("-fprofile-use=").size()));
+      }
+      else if (option.rfind("-funroll-factor=", 0) == 0)
+      {
+        set_unroll_factor(std::stoi(option.substr(std::string("-funroll-factor=").size())));
+      }
+      else if (option.rfind("-mtune=", 0) == 0)
+      {
+        set_target_core(option.substr(std::string("-mtune=").size()));
+      }
+      else if (option.rfind("-march=", 0) == 0)
+      {
+        set_target_arch(option.substr(std::string("-march=").size()));
+      }
+      else if (option.rfind("-O", 0) == 0)
+      {
+        pass_manager.set_opt_level(option.substr(2));
+        direct_riscv = option == "-O0";
+      }
+      else if (option.rfind("--passes=", 0) == 0)
+      {
+        pass_manager.set_pipeline(option.substr(std::string("--passes=").size()));
+        direct_riscv = false;
+      }
+      else if (option == "-stats")
+      {
+        enable_opt_statistics();
+      }
+      else
+      {
+        std::cerr << "unknown option: " << option << std::endl;
+        return 1;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      std::cerr << "invalid option: " << option << ": " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // 增量前端: 输入是编辑脚本 (格式见 run_edit_script), 输出执行完之后的 Koopa IR, 每条命令的统计和错误信息输出到标准错误
+  if (std::string(mode) == "-incremental")
+  {
+    std::ifstream script(input, std::ios::binary);
+    assert(script);
+    freopen(output, "w", stdout);
+    try
+    {
+      run_edit_script(script, std::cout, std::cerr);
+    }
+    catch (const std::runtime_error &e)
+    {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    fclose(stdout);
+    return 0;
+  }
+
   // open input file, and specify lexer to read this file
   yyin = fopen(input, "r");
   assert(yyin);
@@ -40,7 +120,21 @@ int main(int argc, const char *argv[])
   if (std::string(mode) == "-koopa")
   {
     ast->print(koopa);
-    std::cout << koopa.str();
+    // 输出优化之后的 Koopa IR; 不做中端优化时直接输出前端的结果
+    if (pass_manager.has_middle_end_passes())
+    {
+      optimize_koopa(koopa.str().c_str(), std::cout);
+    }
+    else
+    {
+      std::cout << koopa.str();
+    }
+    print_opt_statistics(std::cerr);
+  }
+  else if (std::string(mode) == "-riscv" && direct_riscv && !profile_manager.is_generating())
+  {
+    // 插桩需要 Koopa IR 中的基本块, 所以生成 profile 时仍然走完整的路径
+    direct_backend(*ast, std::cout);
   }
   else if (std::string(mode) == "-riscv")
   {
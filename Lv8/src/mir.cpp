@@ -0,0 +1,452 @@
+#include <stdexcept>
+
+#include "include/mir.hpp"
+
+// 物理寄存器的 ABI 名字, 下标是寄存器编号; x0 沿用原来输出的写法
+static const char *const reg_names[32] = {
+    "x0", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+MReg reg_from_name(const std::string &name)
+{
+    if (name.size() >= 2 && name.find_first_not_of("0123456789", 1) == std::string::npos)
+    {
+        int n = std::stoi(name.substr(1));
+        switch (name[0])
+        {
+        case 't':
+            if (n >= 0 && n <= 6)
+            {
+                return n <= 2 ? 5 + n : 25 + n;
+            }
+            break;
+        case 'a':
+            if (n >= 0 && n <= 7)
+            {
+                return 10 + n;
+            }
+            break;
+        case 's':
+            if (n >= 0 && n <= 11)
+            {
+                return n <= 1 ? 8 + n : 16 + n;
+            }
+            break;
+        case 'x':
+            if (n >= 0 && n <= 31)
+            {
+                return n;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    for (int i = 0; i < 32; ++i)
+    {
+        if (name == reg_names[i])
+        {
+            return i;
+        }
+    }
+    if (name == "zero")
+    {
+        return 0;
+    }
+    throw std::runtime_error("reg_from_name: unknown register " + name);
+}
+
+MReg MFunction::new_virtual_reg()
+{
+    return first_virtual_reg + num_virtual_regs++;
+}
+
+int32_t MSymbolTable::intern(const std::string &name)
+{
+    auto it = _index.find(name);
+    if (it != _index.end())
+    {
+        return it->second;
+    }
+    _names.push_back(name);
+    _index[name] = _names.size() - 1;
+    return _names.size() - 1;
+}
+
+const std::string &MSymbolTable::name(int32_t index) const
+{
+    return _names.at(index);
+}
+
+MRegSet reg_bit(MReg reg)
+{
+    if (reg == no_reg || reg == 0 || is_virtual_reg(reg))
+    {
+        return 0;
+    }
+    return (MRegSet)1 << reg;
+}
+
+// a0 - a7
+static const MRegSet arg_regs = 0xffu << 10;
+
+// 调用者保存的寄存器: ra, t0 - t6, a0 - a7
+static const MRegSet caller_saved_regs = (1u << 1) | (0x7u << 5) | arg_regs | (0xfu << 28);
+
+// 函数退出时必须有正确值的寄存器: ra, sp, s0 - s11
+static const MRegSet exit_regs = (1u << 1) | (1u << 2) | (0x3u << 8) | (0x3ffu << 18);
+
+void get_inst_regs(const MInst &inst, MRegSet &defs, MRegSet &uses)
+{
+    switch (inst.op)
+    {
+    case MOp::CALL:
+        defs = caller_saved_regs;
+        uses = arg_regs | reg_bit(2);
+        return;
+    case MOp::TAIL:
+        defs = 0;
+        uses = arg_regs | exit_regs;
+        return;
+    case MOp::RET:
+        defs = 0;
+        uses = reg_bit(10) | exit_regs;
+        return;
+    default:
+        defs = reg_bit(inst.rd);
+        uses = reg_bit(inst.rs1) | reg_bit(inst.rs2);
+        return;
+    }
+}
+
+MLiveness::MLiveness(const MFunction &func) : _func(func), _live_in(func.blocks.size(), 0)
+{
+    for (size_t i = 0; i < func.blocks.size(); ++i)
+    {
+        if (func.blocks[i].label >= 0)
+        {
+            _label_to_block[func.blocks[i].label] = i;
+        }
+    }
+    // 倒序迭代到不动点, 大部分跳转都是向后的, 通常几轮就收敛
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = func.blocks.size(); i-- > 0;)
+        {
+            MRegSet live = live_out(i);
+            const std::vector<MInst> &insts = func.blocks[i].insts;
+            for (size_t j = insts.size(); j-- > 0;)
+            {
+                live = _transfer(insts[j], live);
+            }
+            if (live != _live_in[i])
+            {
+                _live_in[i] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+MRegSet MLiveness::_transfer(const MInst &inst, MRegSet live) const
+{
+    MRegSet defs, uses;
+    get_inst_regs(inst, defs, uses);
+    switch (inst.op)
+    {
+    case MOp::J:
+        return block_of_label(inst.sym) >= 0 ? _live_in[block_of_label(inst.sym)] : 0;
+    case MOp::RET:
+    case MOp::TAIL:
+        return uses;
+    case MOp::BEQZ:
+    case MOp::BNEZ:
+        return live | (block_of_label(inst.sym) >= 0 ? _live_in[block_of_label(inst.sym)] : 0) | uses;
+    default:
+        return (live & ~defs) | uses;
+    }
+}
+
+int MLiveness::block_of_label(int32_t label) const
+{
+    auto it = _label_to_block.find(label);
+    return it == _label_to_block.end() ? -1 : (int)it->second;
+}
+
+MRegSet MLiveness::live_in(size_t block) const
+{
+    return _live_in[block];
+}
+
+MRegSet MLiveness::live_out(size_t block) const
+{
+    const std::vector<MInst> &insts = _func.blocks[block].insts;
+    if (!insts.empty() && (insts.back().op == MOp::J || insts.back().op == MOp::RET || insts.back().op == MOp::TAIL))
+    {
+        return 0;
+    }
+    return block + 1 < _func.blocks.size() ? _live_in[block + 1] : 0;
+}
+
+std::vector<MRegSet> MLiveness::live_after(size_t block) const
+{
+    const std::vector<MInst> &insts = _func.blocks[block].insts;
+    std::vector<MRegSet> after(insts.size());
+    MRegSet live = live_out(block);
+    for (size_t j = insts.size(); j-- > 0;)
+    {
+        // 条件跳转之后的两条路径上活跃的寄存器都算
+        after[j] = live;
+        if ((insts[j].op == MOp::BEQZ || insts[j].op == MOp::BNEZ) && block_of_label(insts[j].sym) >= 0)
+        {
+            after[j] |= _live_in[block_of_label(insts[j].sym)];
+        }
+        live = _transfer(insts[j], live);
+    }
+    return after;
+}
+
+// 输出一个寄存器, 虚拟寄存器输出成 v0, v1, ..., 只用于调试
+static void emit_reg(MReg reg, std::ostream &out)
+{
+    if (reg == no_reg)
+    {
+        throw std::runtime_error("emit_reg: missing register operand");
+    }
+    if (is_virtual_reg(reg))
+    {
+        out << "v" << reg - first_virtual_reg;
+        return;
+    }
+    out << reg_names[reg];
+}
+
+// 操作码的助记符
+static const char *mnemonic(MOp op)
+{
+    switch (op)
+    {
+    case MOp::LI:
+        return "li";
+    case MOp::MV:
+        return "mv";
+    case MOp::LA:
+        return "la";
+    case MOp::LW:
+        return "lw";
+    case MOp::LBU:
+        return "lbu";
+    case MOp::SW:
+        return "sw";
+    case MOp::ADD:
+        return "add";
+    case MOp::SUB:
+        return "sub";
+    case MOp::MUL:
+        return "mul";
+    case MOp::MULH:
+        return "mulh";
+    case MOp::DIV:
+        return "div";
+    case MOp::REM:
+        return "rem";
+    case MOp::AND:
+        return "and";
+    case MOp::OR:
+        return "or";
+    case MOp::XOR:
+        return "xor";
+    case MOp::SLL:
+        return "sll";
+    case MOp::SRL:
+        return "srl";
+    case MOp::SRA:
+        return "sra";
+    case MOp::SLT:
+        return "slt";
+    case MOp::SGT:
+        return "sgt";
+    case MOp::CZERO_EQZ:
+        return "czero.eqz";
+    case MOp::CZERO_NEZ:
+        return "czero.nez";
+    case MOp::ADDI:
+        return "addi";
+    case MOp::ANDI:
+        return "andi";
+    case MOp::SLLI:
+        return "slli";
+    case MOp::SRLI:
+        return "srli";
+    case MOp::SRAI:
+        return "srai";
+    case MOp::SEQZ:
+        return "seqz";
+    case MOp::SNEZ:
+        return "snez";
+    case MOp::NEG:
+        return "neg";
+    case MOp::BEQZ:
+        return "beqz";
+    case MOp::BNEZ:
+        return "bnez";
+    case MOp::J:
+        return "j";
+    case MOp::CALL:
+        return "call";
+    case MOp::TAIL:
+        return "tail";
+    case MOp::RET:
+        return "ret";
+    }
+    throw std::runtime_error("mnemonic: invalid opcode");
+}
+
+// 输出一条指令
+static void emit_inst(const MInst &inst, const MSymbolTable &symbols, std::ostream &out)
+{
+    out << "\t" << mnemonic(inst.op);
+    switch (inst.op)
+    {
+    case MOp::LI:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", " << inst.imm;
+        break;
+    case MOp::LA:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", " << symbols.name(inst.sym);
+        break;
+    case MOp::LW:
+    case MOp::LBU:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", " << inst.imm << "(";
+        emit_reg(inst.rs1, out);
+        out << ")";
+        break;
+    case MOp::SW:
+        out << " ";
+        emit_reg(inst.rs2, out);
+        out << ", " << inst.imm << "(";
+        emit_reg(inst.rs1, out);
+        out << ")";
+        break;
+    case MOp::ADD:
+    case MOp::SUB:
+    case MOp::MUL:
+    case MOp::MULH:
+    case MOp::DIV:
+    case MOp::REM:
+    case MOp::AND:
+    case MOp::OR:
+    case MOp::XOR:
+    case MOp::SLL:
+    case MOp::SRL:
+    case MOp::SRA:
+    case MOp::SLT:
+    case MOp::SGT:
+    case MOp::CZERO_EQZ:
+    case MOp::CZERO_NEZ:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", ";
+        emit_reg(inst.rs1, out);
+        out << ", ";
+        emit_reg(inst.rs2, out);
+        break;
+    case MOp::ADDI:
+    case MOp::ANDI:
+    case MOp::SLLI:
+    case MOp::SRLI:
+    case MOp::SRAI:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", ";
+        emit_reg(inst.rs1, out);
+        out << ", " << inst.imm;
+        break;
+    case MOp::MV:
+    case MOp::SEQZ:
+    case MOp::SNEZ:
+    case MOp::NEG:
+        out << " ";
+        emit_reg(inst.rd, out);
+        out << ", ";
+        emit_reg(inst.rs1, out);
+        break;
+    case MOp::BEQZ:
+    case MOp::BNEZ:
+        out << " ";
+        emit_reg(inst.rs1, out);
+        out << ", " << symbols.name(inst.sym);
+        break;
+    case MOp::J:
+    case MOp::CALL:
+    case MOp::TAIL:
+        out << " " << symbols.name(inst.sym);
+        break;
+    case MOp::RET:
+        break;
+    }
+    out << "\n";
+}
+
+void emit_module(const MModule &module, std::ostream &out)
+{
+    const MSymbolTable &symbols = module.symbols;
+    for (const auto &section : module.sections)
+    {
+        if (!section.is_text)
+        {
+            out << "\n\t.data\n";
+            for (const auto &directive : section.directives)
+            {
+                switch (directive.kind)
+                {
+                case MDirective::GLOBL:
+                    out << "\t.globl " << symbols.name(directive.value) << "\n";
+                    break;
+                case MDirective::LABEL:
+                    out << symbols.name(directive.value) << ":\n";
+                    break;
+                case MDirective::WORD:
+                    out << "\t.word " << directive.value << "\n";
+                    break;
+                case MDirective::ZERO:
+                    out << "\t.zero " << directive.value << "\n";
+                    break;
+                case MDirective::ASCIZ:
+                    // 调用者保证字符串中没有需要转义的字符
+                    out << "\t.asciz \"" << symbols.name(directive.value) << "\"\n";
+                    break;
+                }
+            }
+            continue;
+        }
+        const MFunction &func = section.func;
+        out << "\n\t.text\n";
+        if (func.global)
+        {
+            out << "\t.globl " << symbols.name(func.name) << "\n";
+        }
+        out << symbols.name(func.name) << ":\n";
+        for (const auto &block : func.blocks)
+        {
+            if (block.label >= 0)
+            {
+                out << symbols.name(block.label) << ":\n";
+            }
+            for (const auto &inst : block.insts)
+            {
+                emit_inst(inst, symbols, out);
+            }
+        }
+    }
+    out.flush();
+}
@@ -0,0 +1,269 @@
+#include <cassert>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    /**
+     * @brief 一个中端 pass
+     * @date 2026-10-18
+     */
+    struct MiddleEndPass
+    {
+        // --passes= 中使用的名字
+        const char *name;
+
+        // 返回值加到这个统计项上
+        const char *statistic;
+
+        int (*run)(koopa_raw_program_t &program);
+
+        // 是否保持控制流不变 (只修改指令和基本块参数), 保持时不需要使分析的缓存失效
+        bool preserves_cfg;
+    };
+
+    // 所有中端 pass
+    const MiddleEndPass middle_end_passes[] = {
+        {"tail", "tail-recursion.eliminated", eliminate_tail_recursion, false},
+        {"inline", "inline.call-sites", inline_functions, false},
+        {"rotate", "rotate.rotated", rotate_loops, false},
+        {"mem2reg", "mem2reg.promoted", promote_memory_to_register, true},
+        {"sccp", "sccp.changed", sparse_conditional_constant_propagation, false},
+        {"simplify", "simplify.changed", simplify_instructions, true},
+        {"simplify-cfg", "simplify-cfg.changed", simplify_cfg, false},
+        {"scev", "scev.closed-form", replace_loops_with_closed_forms, false},
+        {"scev-sr", "scev.strength-reduced", strength_reduce_induction_variables, true},
+        {"unroll", "unroll.unrolled", unroll_loops, false},
+        {"memdep", "memdep.loads-eliminated", eliminate_redundant_loads, true},
+        {"dse", "dse.removed", eliminate_dead_stores, true},
+        {"ifconv", "ifconv.converted", convert_branches_to_selects, false},
+        {"gvn", "gvn.eliminated", global_value_numbering, true},
+        {"licm", "licm.hoisted", hoist_loop_invariants, false},
+        {"dce", "dce.removed", aggressive_dead_code_elimination, false},
+    };
+
+    // 所有后端 pass: 寄存器分配 (不开启时所有值都放在栈上), 基本块排布 (不开启时按原来的顺序输出) 和窥孔优化
+    const char *const backend_passes[] = {"regalloc", "layout", "peephole"};
+
+    // 标准流水线
+    const std::map<std::string, std::string> opt_level_pipelines = {
+        {"0", ""},
+        {"1", "mem2reg,sccp,simplify,simplify-cfg,memdep,dse,gvn,dce,simplify-cfg,"
+              "regalloc,layout,peephole"},
+        // 先消除尾递归, 改写之后不再递归的函数就可以被内联; 完全展开之后归纳变量变成常数, 闭式的边界也可能是常数, 再做一次常量传播;
+        // 最后的 simplify-cfg 处理死代码删除之后留下的空基本块和条件为常量的分支
+        {"2", "tail,inline,rotate,mem2reg,sccp,simplify,simplify-cfg,scev,scev-sr,unroll,sccp,"
+              "memdep,dse,ifconv,gvn,licm,dce,simplify-cfg,"
+              "regalloc,layout,peephole"},
+        {"s", "tail,mem2reg,sccp,simplify,simplify-cfg,memdep,dse,gvn,licm,dce,simplify-cfg,"
+              "regalloc,layout,peephole"},
+    };
+
+    const MiddleEndPass *find_middle_end_pass(const std::string &name)
+    {
+        for (const auto &pass : middle_end_passes)
+        {
+            if (name == pass.name)
+            {
+                return &pass;
+            }
+        }
+        return nullptr;
+    }
+
+    IRSize program_size(const koopa_raw_program_t &program)
+    {
+        IRSize size;
+        for (auto func : get_functions(program))
+        {
+            size.insts += count_insts(func);
+            size.blocks += func->bbs.len;
+        }
+        return size;
+    }
+}
+
+// 是否开启优化统计
+static bool opt_statistics_enabled = false;
+
+// 统计项的名字到数量的映射, 按名字排序输出
+static std::map<std::string, int> opt_statistics;
+
+PassManager pass_manager;
+
+void enable_opt_statistics()
+{
+    opt_statistics_enabled = true;
+}
+
+void add_opt_statistic(const std::string &name, int count)
+{
+    opt_statistics[name] += count;
+}
+
+void print_opt_statistics(std::ostream &os)
+{
+    if (!opt_statistics_enabled)
+    {
+        return;
+    }
+    pass_manager.print_report(os);
+    for (auto &item : opt_statistics)
+    {
+        os << item.first << ": " << item.second << std::endl;
+    }
+}
+
+PassManager::PassManager()
+{
+    set_opt_level("2");
+}
+
+void PassManager::set_opt_level(const std::string &level)
+{
+    auto it = opt_level_pipelines.find(level);
+    if (it == opt_level_pipelines.end())
+    {
+        throw std::runtime_error("PassManager::set_opt_level: unknown optimization level -O" + level);
+    }
+    set_pipeline(it->second);
+}
+
+void PassManager::set_pipeline(const std::string &passes)
+{
+    _middle_end.clear();
+    _backend.clear();
+    size_t start = 0;
+    while (start < passes.size())
+    {
+        size_t end = passes.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = passes.size();
+        }
+        std::string name = passes.substr(start, end - start);
+        start = end + 1;
+        if (name.empty())
+        {
+            continue;
+        }
+        if (find_middle_end_pass(name))
+        {
+            _middle_end.push_back(name);
+            continue;
+        }
+        bool is_backend = false;
+        for (auto backend_pass : backend_passes)
+        {
+            is_backend = is_backend || name == backend_pass;
+        }
+        if (!is_backend)
+        {
+            throw std::runtime_error("PassManager::set_pipeline: unknown pass " + name);
+        }
+        _backend.insert(name);
+    }
+}
+
+bool PassManager::is_enabled(const std::string &name) const
+{
+    return _backend.count(name);
+}
+
+bool PassManager::has_middle_end_passes() const
+{
+    return !_middle_end.empty();
+}
+
+void PassManager::run(koopa_raw_program_t &program)
+{
+    // 上一次编译或者 pass 之外的修改可能留下过时的分析
+    analysis_manager.invalidate_all();
+    for (const auto &name : _middle_end)
+    {
+        const MiddleEndPass *pass = find_middle_end_pass(name);
+        assert(pass);
+        run_timed(
+            name, [&]()
+            {
+                int changed = pass->run(program);
+                add_opt_statistic(pass->statistic, changed);
+                if (changed > 0 && !pass->preserves_cfg)
+                {
+                    analysis_manager.invalidate_all();
+                } },
+            [&]()
+            { return program_size(program); });
+    }
+}
+
+void PassManager::run_timed(const std::string &name, const std::function<void()> &run, const std::function<IRSize()> &size)
+{
+    if (!opt_statistics_enabled)
+    {
+        run();
+        return;
+    }
+    PassRecord record;
+    record.name = name;
+    record.before = size();
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    record.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    record.after = size();
+    _records.push_back(record);
+}
+
+void PassManager::print_report(std::ostream &os) const
+{
+    for (const auto &record : _records)
+    {
+        os << "pass " << record.name << ": " << record.milliseconds << " ms, insts " << record.before.insts << " -> " << record.after.insts
+           << ", blocks " << record.before.blocks << " -> " << record.after.blocks << std::endl;
+    }
+}
+
+void optimize(koopa_raw_program_t &program)
+{
+    // 插桩模式下不做会改变基本块的优化, 保证计数器的名字和使用 profile 编译时的原始 IR 对应
+    if (!profile_manager.is_generating())
+    {
+        pass_manager.run(program);
+    }
+
+    // 优化结束, 重新计算 used_by
+    rebuild_used_by(program);
+}
+
+void optimize_koopa(const char *koopa_str, std::ostream &os)
+{
+    koopa_program_t program;
+    koopa_error_code_t ret = koopa_parse_from_string(koopa_str, &program);
+    assert(ret == KOOPA_EC_SUCCESS);
+    koopa_raw_program_builder_t builder = koopa_new_raw_program_builder();
+    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
+    koopa_delete_program(program);
+
+    // 和后端一样在拷贝上优化, 然后把拷贝转换回 Koopa IR 程序输出
+    koopa_raw_program_t optimized = ir_builder.copy_program(raw);
+    optimize(optimized);
+    koopa_program_t result;
+    ret = koopa_generate_raw_to_koopa(&optimized, &result);
+    assert(ret == KOOPA_EC_SUCCESS);
+    // 先查询长度, 长度不包括结尾的 '\0'
+    size_t len = 0;
+    koopa_dump_to_string(result, nullptr, &len);
+    std::vector<char> buffer(len + 1);
+    len = buffer.size();
+    ret = koopa_dump_to_string(result, buffer.data(), &len);
+    assert(ret == KOOPA_EC_SUCCESS);
+    os << buffer.data();
+    koopa_delete_program(result);
+
+    koopa_delete_raw_program_builder(builder);
+}
@@ -0,0 +1,347 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 每个基本块的前驱 (有重复, 两个目标相同的 branch 算两次)
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>> compute_predecessors(const std::vector<koopa_raw_basic_block_t> &bbs)
+    {
+        std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>> preds;
+        for (auto bb : bbs)
+        {
+            for (auto succ : get_successors(bb))
+            {
+                preds[succ].push_back(bb);
+            }
+        }
+        return preds;
+    }
+
+    // 把 values 中的基本块参数换成前驱传入的实参
+    std::vector<koopa_raw_value_t> substitute_params(koopa_raw_basic_block_t bb, const std::vector<koopa_raw_value_t> &values, const std::vector<koopa_raw_value_t> &args)
+    {
+        std::vector<koopa_raw_value_t> params = get_values(bb->params);
+        std::vector<koopa_raw_value_t> result;
+        for (auto value : values)
+        {
+            size_t i = 0;
+            while (i < params.size() && params[i] != value)
+            {
+                ++i;
+            }
+            result.push_back(i < params.size() ? args[i] : value);
+        }
+        return result;
+    }
+}
+
+// 条件是常量, 或者两个目标和实参都相同的 branch 改为 jump, 返回改写的数量
+static int fold_constant_branches(koopa_raw_function_t func)
+{
+    int folded = 0;
+    for (auto bb : get_basic_blocks(func))
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (!terminator || terminator->kind.tag != KOOPA_RVT_BRANCH)
+        {
+            continue;
+        }
+        const koopa_raw_branch_t &branch = terminator->kind.data.branch;
+        size_t index;
+        if (is_integer(branch.cond))
+        {
+            index = branch.cond->kind.data.integer.value != 0 ? 0 : 1;
+        }
+        else if (branch.true_bb == branch.false_bb && get_successor_args(terminator, 0) == get_successor_args(terminator, 1))
+        {
+            index = 0;
+        }
+        else
+        {
+            continue;
+        }
+        koopa_raw_value_t jump = ir_builder.new_jump(get_successors_of_terminator(terminator)[index]);
+        set_successor_args(jump, 0, get_successor_args(terminator, index));
+        std::vector<koopa_raw_value_t> insts = get_insts(bb);
+        insts.back() = jump;
+        set_insts(bb, insts);
+        ++folded;
+    }
+    return folded;
+}
+
+/**
+ * @brief 跳转线程化: 只有一条 branch 的基本块, 如果在某条入边上条件已知, 这条入边直接跳到 branch 的对应目标
+ * @note 条件已知的情况: 条件是基本块参数, 入边传入的是常数 (短路求值的结果); 或者前驱用同一个条件 branch 到这个基本块
+ * @note 基本块参数只在 branch 中使用时才处理, 否则绕过之后其他基本块就看不到参数了
+ * @param[in] func 函数
+ * @return 改写的入边数量
+ */
+static int thread_jumps(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    // 在所在基本块的 terminator 以外被使用的值
+    std::unordered_set<koopa_raw_value_t> used_elsewhere;
+    for (auto bb : bbs)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst == get_terminator(bb))
+            {
+                continue;
+            }
+            for (auto operand : get_operands(inst))
+            {
+                used_elsewhere.insert(operand);
+            }
+        }
+    }
+    std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> param_block;
+    for (auto bb : bbs)
+    {
+        for (auto param : get_values(bb->params))
+        {
+            param_block[param] = bb;
+        }
+    }
+    for (auto bb : bbs)
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        for (auto operand : get_operands(terminator))
+        {
+            auto it = param_block.find(operand);
+            if (it != param_block.end() && it->second != bb)
+            {
+                used_elsewhere.insert(operand);
+            }
+        }
+    }
+
+    int threaded = 0;
+    for (auto pred : bbs)
+    {
+        koopa_raw_value_t pred_terminator = get_terminator(pred);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(pred_terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            koopa_raw_basic_block_t bb = succs[k];
+            koopa_raw_value_t branch = get_terminator(bb);
+            if (bb == pred || bb->insts.len != 1 || branch->kind.tag != KOOPA_RVT_BRANCH)
+            {
+                continue;
+            }
+            bool params_local = true;
+            for (auto param : get_values(bb->params))
+            {
+                params_local = params_local && !used_elsewhere.count(param);
+            }
+            if (!params_local)
+            {
+                continue;
+            }
+
+            // 这条入边上的条件
+            std::vector<koopa_raw_value_t> args = get_successor_args(pred_terminator, k);
+            koopa_raw_value_t cond = substitute_params(bb, {branch->kind.data.branch.cond}, args)[0];
+            size_t index;
+            if (is_integer(cond))
+            {
+                index = cond->kind.data.integer.value != 0 ? 0 : 1;
+            }
+            else if (pred_terminator->kind.tag == KOOPA_RVT_BRANCH && pred_terminator->kind.data.branch.cond == cond && succs[0] != succs[1])
+            {
+                index = k;
+            }
+            else
+            {
+                continue;
+            }
+            koopa_raw_basic_block_t target = get_successors_of_terminator(branch)[index];
+            if (target == bb)
+            {
+                continue;
+            }
+            set_successor(pred_terminator, k, target);
+            set_successor_args(pred_terminator, k, substitute_params(bb, get_successor_args(branch, index), args));
+            succs[k] = target;
+            ++threaded;
+        }
+    }
+    return threaded;
+}
+
+// 删除只有一条 jump 的空基本块, 前驱直接跳转到它的目标, 返回删除的数量
+static int remove_empty_blocks(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    // 空基本块 -> 它跳转的 jump
+    std::unordered_map<koopa_raw_basic_block_t, koopa_raw_value_t> forward;
+    for (size_t i = 1; i < bbs.size(); ++i)
+    {
+        koopa_raw_basic_block_t bb = bbs[i];
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (bb->insts.len == 1 && bb->params.len == 0 && terminator->kind.tag == KOOPA_RVT_JUMP && terminator->kind.data.jump.target != bb)
+        {
+            forward[bb] = terminator;
+        }
+    }
+    if (forward.empty())
+    {
+        return 0;
+    }
+
+    // 沿着空基本块的链找到最终的目标, 遇到环就停下, 环上的空基本块保留
+    std::unordered_set<koopa_raw_basic_block_t> kept_empty;
+    auto final_target = [&](koopa_raw_basic_block_t bb, std::vector<koopa_raw_value_t> &args)
+    {
+        std::unordered_set<koopa_raw_basic_block_t> seen;
+        while (forward.count(bb) && !kept_empty.count(bb))
+        {
+            if (!seen.insert(bb).second)
+            {
+                kept_empty.insert(bb);
+                break;
+            }
+            koopa_raw_value_t jump = forward[bb];
+            // 空基本块没有参数, 所以它传出的实参在前驱中同样可用; 链上后面的实参覆盖前面的
+            args = get_successor_args(jump, 0);
+            bb = jump->kind.data.jump.target;
+        }
+        return bb;
+    };
+
+    for (auto bb : bbs)
+    {
+        if (forward.count(bb))
+        {
+            continue;
+        }
+        koopa_raw_value_t terminator = get_terminator(bb);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            if (!forward.count(succs[k]))
+            {
+                continue;
+            }
+            std::vector<koopa_raw_value_t> args;
+            koopa_raw_basic_block_t target = final_target(succs[k], args);
+            if (target == succs[k])
+            {
+                continue;
+            }
+            // branch 的两个目标相同时 replace_successor 会同时替换, 所以按下标逐个修改
+            set_successor(terminator, k, target);
+            set_successor_args(terminator, k, args);
+        }
+    }
+    return remove_unreachable_blocks(func);
+}
+
+// 以 jump 结尾的基本块和它唯一的后继 (后继也只有这一个前驱) 合并成一个, 返回合并的数量
+static int merge_straight_line_blocks(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    auto preds = compute_predecessors(bbs);
+    std::unordered_set<koopa_raw_basic_block_t> merged;
+    for (auto bb : bbs)
+    {
+        // 被合并掉的基本块的指令已经搬到了前驱中, 从前驱继续往后合并
+        if (merged.count(bb))
+        {
+            continue;
+        }
+        while (true)
+        {
+            koopa_raw_value_t jump = get_terminator(bb);
+            if (jump->kind.tag != KOOPA_RVT_JUMP)
+            {
+                break;
+            }
+            koopa_raw_basic_block_t succ = jump->kind.data.jump.target;
+            if (succ == bb || succ == bbs[0] || preds[succ].size() != 1)
+            {
+                break;
+            }
+            // 后继的参数只有一个来源, 直接替换成实参
+            std::vector<koopa_raw_value_t> params = get_values(succ->params);
+            std::vector<koopa_raw_value_t> args = get_successor_args(jump, 0);
+            for (size_t i = 0; i < params.size(); ++i)
+            {
+                replace_all_uses(func, params[i], args[i]);
+            }
+            std::vector<koopa_raw_value_t> insts = get_insts(bb);
+            insts.pop_back();
+            for (auto inst : get_insts(succ))
+            {
+                insts.push_back(inst);
+            }
+            set_insts(bb, insts);
+            set_insts(succ, {});
+            merged.insert(succ);
+            // 后继的后继现在的前驱是 bb
+            for (auto next : get_successors(bb))
+            {
+                for (auto &pred : preds[next])
+                {
+                    if (pred == succ)
+                    {
+                        pred = bb;
+                    }
+                }
+            }
+        }
+    }
+    if (merged.empty())
+    {
+        return 0;
+    }
+    std::vector<koopa_raw_basic_block_t> kept;
+    for (auto bb : bbs)
+    {
+        if (!merged.count(bb))
+        {
+            kept.push_back(bb);
+        }
+    }
+    set_basic_blocks(func, kept);
+    return merged.size();
+}
+
+// 对一个函数化简控制流图直到不动点, 返回所有改写的总数
+static int simplify_cfg(koopa_raw_function_t func)
+{
+    int total = 0;
+    int changed = 1;
+    while (changed > 0)
+    {
+        changed = fold_constant_branches(func);
+        changed += thread_jumps(func);
+        changed += remove_unreachable_blocks(func);
+        changed += remove_empty_blocks(func);
+        changed += merge_straight_line_blocks(func);
+        total += changed;
+    }
+    if (total > 0)
+    {
+        analysis_manager.invalidate(func);
+    }
+    return total;
+}
+
+int simplify_cfg(koopa_raw_program_t &program)
+{
+    int changed = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            changed += simplify_cfg(func);
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,218 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 删除没有被使用的基本块参数, 同时删除所有跳转中对应的实参
+static int remove_dead_block_params(koopa_raw_function_t func, const std::unordered_set<koopa_raw_value_t> &live)
+{
+    int removed = 0;
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    // 每个基本块中需要保留的参数下标
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<size_t>> kept_indices;
+    for (auto bb : bbs)
+    {
+        std::vector<koopa_raw_value_t> params = get_values(bb->params);
+        std::vector<koopa_raw_value_t> kept;
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            if (live.count(params[i]))
+            {
+                kept_indices[bb].push_back(i);
+                // 参数的下标也要跟着变
+                as_mutable(params[i])->kind.data.block_arg_ref.index = kept.size();
+                kept.push_back(params[i]);
+            }
+        }
+        if (kept.size() != params.size())
+        {
+            removed += params.size() - kept.size();
+            as_mutable(bb)->params = ir_builder.new_slice(std::vector<const void *>(kept.begin(), kept.end()), KOOPA_RSIK_VALUE);
+        }
+    }
+    if (removed == 0)
+    {
+        return 0;
+    }
+    for (auto bb : bbs)
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (!terminator)
+        {
+            continue;
+        }
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+            if (args.empty())
+            {
+                continue;
+            }
+            std::vector<koopa_raw_value_t> kept;
+            for (auto index : kept_indices[succs[k]])
+            {
+                kept.push_back(args[index]);
+            }
+            if (kept.size() != args.size())
+            {
+                set_successor_args(terminator, k, kept);
+            }
+        }
+    }
+    return removed;
+}
+
+// 对一个函数做激进的死代码删除, 返回删除的指令, 参数和基本块的数量
+static int aggressive_dead_code_elimination(koopa_raw_function_t func, const std::unordered_set<koopa_raw_function_t> &pure_functions)
+{
+    int removed = remove_unreachable_blocks(func);
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+
+    // 只被 store 的 alloc: 地址没有被读过, 也没有被当作值使用, 对它的 store 都是死的
+    std::unordered_set<koopa_raw_value_t> write_only_allocs;
+    for (auto bb : bbs)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+            {
+                write_only_allocs.insert(inst);
+            }
+        }
+    }
+    for (auto bb : bbs)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            for (auto operand : get_operands(inst))
+            {
+                if (inst->kind.tag == KOOPA_RVT_STORE && operand == inst->kind.data.store.dest && operand != inst->kind.data.store.value)
+                {
+                    continue;
+                }
+                write_only_allocs.erase(operand);
+            }
+        }
+    }
+
+    // 每个基本块参数的所有实参, 参数活跃时它们才活跃
+    std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> param_args;
+    for (auto bb : bbs)
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            std::vector<koopa_raw_value_t> params = get_values(succs[k]->params);
+            std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+            for (size_t i = 0; i < params.size() && i < args.size(); ++i)
+            {
+                param_args[params[i]].push_back(args[i]);
+            }
+        }
+    }
+
+    // 标记: 有副作用的指令是根, 沿着 use-def 链标记活跃的值; jump/branch 的实参不直接活跃, 只通过参数活跃
+    std::unordered_set<koopa_raw_value_t> live;
+    std::vector<koopa_raw_value_t> worklist;
+    auto mark = [&](koopa_raw_value_t value)
+    {
+        if (live.insert(value).second)
+        {
+            worklist.push_back(value);
+        }
+    };
+    for (auto bb : bbs)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            switch (inst->kind.tag)
+            {
+            case KOOPA_RVT_STORE:
+                if (!write_only_allocs.count(inst->kind.data.store.dest))
+                {
+                    mark(inst);
+                }
+                break;
+            case KOOPA_RVT_CALL:
+                // 纯函数的调用只有结果被使用时才活跃
+                if (!pure_functions.count(inst->kind.data.call.callee))
+                {
+                    mark(inst);
+                }
+                break;
+            case KOOPA_RVT_RETURN:
+            case KOOPA_RVT_BRANCH:
+            case KOOPA_RVT_JUMP:
+                mark(inst);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    while (!worklist.empty())
+    {
+        koopa_raw_value_t value = worklist.back();
+        worklist.pop_back();
+        if (value->kind.tag == KOOPA_RVT_BLOCK_ARG_REF)
+        {
+            for (auto arg : param_args[value])
+            {
+                mark(arg);
+            }
+            continue;
+        }
+        if (value->kind.tag == KOOPA_RVT_JUMP)
+        {
+            continue;
+        }
+        if (value->kind.tag == KOOPA_RVT_BRANCH)
+        {
+            mark(value->kind.data.branch.cond);
+            continue;
+        }
+        for (auto operand : get_operands(value))
+        {
+            mark(operand);
+        }
+    }
+
+    // 清除: 删除不活跃的指令和参数
+    for (auto bb : bbs)
+    {
+        std::vector<koopa_raw_value_t> kept;
+        for (auto inst : get_insts(bb))
+        {
+            if (live.count(inst))
+            {
+                kept.push_back(inst);
+            }
+        }
+        removed += bb->insts.len - kept.size();
+        if (kept.size() != bb->insts.len)
+        {
+            set_insts(bb, kept);
+        }
+    }
+    removed += remove_dead_block_params(func, live);
+    removed += remove_unreachable_blocks(func);
+    return removed;
+}
+
+int aggressive_dead_code_elimination(koopa_raw_program_t &program)
+{
+    std::unordered_set<koopa_raw_function_t> pure_functions = compute_pure_functions(program);
+    int removed = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            removed += aggressive_dead_code_elimination(func, pure_functions);
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,176 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 活跃的内存位置 (alloc 或全局变量): 之后可能在被覆盖之前被读取
+    using LiveLocations = std::unordered_set<koopa_raw_value_t>;
+
+    // 删除死 store 需要的过程间信息
+    struct DeadStoreContext
+    {
+        // 每个函数 (间接) 读取的全局变量
+        std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> read_globals;
+
+        // 所有全局变量
+        std::vector<koopa_raw_value_t> globals;
+
+        // main 是否被其他函数调用, 没有时 main 返回就是程序结束, 全局变量在返回时都不再活跃
+        bool main_called = false;
+    };
+}
+
+/**
+ * @brief 在一个基本块中从后往前传递活跃的内存位置
+ * @param[in] bb 基本块
+ * @param[in,out] live 离开基本块时活跃的位置, 返回时是进入基本块时活跃的位置
+ * @param[in] globals_live_at_exit 函数返回时全局变量是否活跃
+ * @param[in] ctx 过程间信息
+ * @param[out] dead 非空时记录写入的位置不再活跃的 store
+ */
+static void transfer(koopa_raw_basic_block_t bb, LiveLocations &live, bool globals_live_at_exit, const DeadStoreContext &ctx, std::unordered_set<koopa_raw_value_t> *dead)
+{
+    std::vector<koopa_raw_value_t> insts = get_insts(bb);
+    for (size_t i = insts.size(); i-- > 0;)
+    {
+        koopa_raw_value_t inst = insts[i];
+        const auto &kind = inst->kind;
+        switch (kind.tag)
+        {
+        case KOOPA_RVT_RETURN:
+            // 返回之后 alloc 都不存在了, 全局变量还可能被调用者读取
+            live.clear();
+            if (globals_live_at_exit)
+            {
+                live.insert(ctx.globals.begin(), ctx.globals.end());
+            }
+            break;
+        case KOOPA_RVT_LOAD:
+            live.insert(kind.data.load.src);
+            break;
+        case KOOPA_RVT_STORE:
+            // 没有指针运算, store 只写它的目标地址, 之前写入的值被完全覆盖
+            if (!live.count(kind.data.store.dest) && dead)
+            {
+                dead->insert(inst);
+            }
+            live.erase(kind.data.store.dest);
+            break;
+        case KOOPA_RVT_CALL:
+        {
+            // 被调用者看不到调用者的 alloc, 只会读取它 (间接) load 过的全局变量
+            auto it = ctx.read_globals.find(kind.data.call.callee);
+            if (it != ctx.read_globals.end())
+            {
+                live.insert(it->second.begin(), it->second.end());
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// 对一个函数删除死 store, 返回删除的数量
+static int eliminate_dead_stores(koopa_raw_function_t func, const DeadStoreContext &ctx)
+{
+    bool globals_live_at_exit = std::string(func->name) != "@main" || ctx.main_called;
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+
+    // 内存位置的活跃性, 后向数据流, 汇合处取并集; 在所有后继路径上都先被覆盖的位置不活跃
+    std::unordered_map<koopa_raw_basic_block_t, LiveLocations> live_at_start;
+    auto live_at_end = [&](koopa_raw_basic_block_t bb)
+    {
+        LiveLocations live;
+        for (auto succ : get_successors(bb))
+        {
+            const LiveLocations &succ_live = live_at_start[succ];
+            live.insert(succ_live.begin(), succ_live.end());
+        }
+        return live;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = bbs.size(); i-- > 0;)
+        {
+            LiveLocations live = live_at_end(bbs[i]);
+            transfer(bbs[i], live, globals_live_at_exit, ctx, nullptr);
+            LiveLocations &old = live_at_start[bbs[i]];
+            if (old != live)
+            {
+                old = std::move(live);
+                changed = true;
+            }
+        }
+    }
+
+    std::unordered_set<koopa_raw_value_t> dead;
+    for (auto bb : bbs)
+    {
+        LiveLocations live = live_at_end(bb);
+        transfer(bb, live, globals_live_at_exit, ctx, &dead);
+    }
+    if (dead.empty())
+    {
+        return 0;
+    }
+    for (auto bb : bbs)
+    {
+        std::vector<koopa_raw_value_t> kept;
+        for (auto inst : get_insts(bb))
+        {
+            if (!dead.count(inst))
+            {
+                kept.push_back(inst);
+            }
+        }
+        set_insts(bb, kept);
+    }
+    return dead.size();
+}
+
+int eliminate_dead_stores(koopa_raw_program_t &program)
+{
+    DeadStoreContext ctx;
+    ctx.read_globals = compute_read_globals(program);
+    for (auto global : get_values(program.values))
+    {
+        if (global->kind.tag == KOOPA_RVT_GLOBAL_ALLOC)
+        {
+            ctx.globals.push_back(global);
+        }
+    }
+    std::vector<koopa_raw_function_t> funcs = get_functions(program);
+    for (auto func : funcs)
+    {
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag == KOOPA_RVT_CALL && std::string(inst->kind.data.call.callee->name) == "@main")
+                {
+                    ctx.main_called = true;
+                }
+            }
+        }
+    }
+
+    int removed = 0;
+    for (auto func : funcs)
+    {
+        if (is_function_defined(func))
+        {
+            removed += eliminate_dead_stores(func, ctx);
+        }
+    }
+    return removed;
+}
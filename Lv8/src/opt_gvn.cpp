@@ -0,0 +1,151 @@
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 值编号的操作数: 立即数按数值比较, 其他值按指针比较
+    using OperandKey = std::pair<bool, int64_t>;
+
+    // binary 的值编号: (运算符, 左操作数, 右操作数)
+    using ExprKey = std::tuple<int, OperandKey, OperandKey>;
+
+    OperandKey operand_key(koopa_raw_value_t value)
+    {
+        if (is_integer(value))
+        {
+            return {true, value->kind.data.integer.value};
+        }
+        return {false, (int64_t)(intptr_t)value};
+    }
+
+    bool is_commutative(koopa_raw_binary_op_t op)
+    {
+        switch (op)
+        {
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_MUL:
+        case KOOPA_RBO_EQ:
+        case KOOPA_RBO_NOT_EQ:
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    ExprKey expr_key(const koopa_raw_binary_t &binary)
+    {
+        OperandKey lhs = operand_key(binary.lhs);
+        OperandKey rhs = operand_key(binary.rhs);
+        // 交换律的运算把操作数排好序, 这样 a * b 和 b * a 得到同一个编号
+        if (is_commutative(binary.op) && rhs < lhs)
+        {
+            std::swap(lhs, rhs);
+        }
+        return ExprKey(binary.op, lhs, rhs);
+    }
+}
+
+// 对一个函数做 GVN, 返回被消除的值的数量
+static int global_value_numbering(koopa_raw_function_t func)
+{
+    const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+    if (dom_tree.rpo().empty())
+    {
+        return 0;
+    }
+
+    // 沿支配树的作用域哈希表: 支配者中计算过的 binary 在被支配的基本块中都可以直接使用
+    std::map<ExprKey, koopa_raw_value_t> available;
+    std::vector<ExprKey> undo_log;
+
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replacement;
+    auto resolve = [&](koopa_raw_value_t value)
+    {
+        auto it = replacement.find(value);
+        while (it != replacement.end())
+        {
+            value = it->second;
+            it = replacement.find(value);
+        }
+        return value;
+    };
+
+    std::vector<std::pair<koopa_raw_basic_block_t, size_t>> stack;
+    std::vector<size_t> undo_mark;
+    auto enter = [&](koopa_raw_basic_block_t bb)
+    {
+        undo_mark.push_back(undo_log.size());
+
+        std::vector<koopa_raw_value_t> kept;
+        for (auto inst : get_insts(bb))
+        {
+            const auto &kind = inst->kind;
+            if (kind.tag == KOOPA_RVT_BINARY)
+            {
+                // 操作数可能已经被替换, 先按替换之后的操作数计算编号
+                koopa_raw_binary_t binary = kind.data.binary;
+                binary.lhs = resolve(binary.lhs);
+                binary.rhs = resolve(binary.rhs);
+                ExprKey key = expr_key(binary);
+                auto it = available.find(key);
+                if (it != available.end())
+                {
+                    replacement[inst] = it->second;
+                    continue;
+                }
+                available[key] = inst;
+                undo_log.push_back(key);
+            }
+            kept.push_back(inst);
+        }
+        set_insts(bb, kept);
+        stack.push_back({bb, 0});
+    };
+
+    enter(dom_tree.rpo()[0]);
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        const auto &children = dom_tree.children(top.first);
+        if (top.second < children.size())
+        {
+            enter(children[top.second++]);
+        }
+        else
+        {
+            stack.pop_back();
+            size_t mark = undo_mark.back();
+            undo_mark.pop_back();
+            while (undo_log.size() > mark)
+            {
+                available.erase(undo_log.back());
+                undo_log.pop_back();
+            }
+        }
+    }
+
+    replace_uses_with_map(func, replacement);
+    return replacement.size();
+}
+
+int global_value_numbering(koopa_raw_program_t &program)
+{
+    int eliminated = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            eliminated += global_value_numbering(func);
+        }
+    }
+    return eliminated;
+}
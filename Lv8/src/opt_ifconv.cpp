@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+#include "include/riscv.hpp"
+
+namespace
+{
+    // 一边最多搬到分支前面的指令数量
+    const size_t max_arm_insts = 4;
+
+    // 没有 profile 时, 依赖数据的分支预测失败的概率
+    const double default_miss_rate = 0.5;
+
+    /**
+     * @brief 分支的一边: 直接跳到汇合点, 或者经过一个只能从分支进入的小基本块再跳到汇合点
+     * @date 2026-10-18
+     */
+    struct Arm
+    {
+        // 经过的基本块, 直接跳到汇合点时为 nullptr
+        koopa_raw_basic_block_t bb = nullptr;
+
+        // 基本块中除了 jump 之外的指令
+        std::vector<koopa_raw_value_t> insts;
+
+        // 传给汇合点的实参
+        std::vector<koopa_raw_value_t> args;
+
+        koopa_raw_basic_block_t join = nullptr;
+    };
+
+    // 可以提前无条件执行的指令: 没有副作用, 也不会因为提前执行而改变结果
+    bool is_speculatable(koopa_raw_value_t inst)
+    {
+        if (inst->kind.tag == KOOPA_RVT_LOAD)
+        {
+            return true;
+        }
+        if (inst->kind.tag != KOOPA_RVT_BINARY)
+        {
+            return false;
+        }
+        // 除法很慢, 提前执行总是不划算
+        koopa_raw_binary_op_t op = inst->kind.data.binary.op;
+        return op != KOOPA_RBO_DIV && op != KOOPA_RBO_MOD;
+    }
+
+    int inst_cost(koopa_raw_value_t inst, const RISCVCostModel &model)
+    {
+        if (inst->kind.tag == KOOPA_RVT_BINARY && inst->kind.data.binary.op == KOOPA_RBO_MUL)
+        {
+            return model.mul;
+        }
+        return model.alu;
+    }
+}
+
+// 分析分支的第 index 个目标
+static Arm analyze_arm(koopa_raw_basic_block_t bb, koopa_raw_value_t branch, size_t index, const DominatorTree &dom_tree)
+{
+    Arm arm;
+    koopa_raw_basic_block_t succ = get_successors_of_terminator(branch)[index];
+    arm.args = get_successor_args(branch, index);
+    arm.join = succ;
+    const auto &preds = dom_tree.predecessors(succ);
+    if (succ == bb || preds.size() != 1 || succ->params.len != 0)
+    {
+        return arm;
+    }
+    std::vector<koopa_raw_value_t> insts = get_insts(succ);
+    koopa_raw_value_t terminator = insts.back();
+    if (terminator->kind.tag != KOOPA_RVT_JUMP || terminator->kind.data.jump.target == succ || insts.size() - 1 > max_arm_insts)
+    {
+        return arm;
+    }
+    for (size_t i = 0; i + 1 < insts.size(); ++i)
+    {
+        if (!is_speculatable(insts[i]))
+        {
+            return arm;
+        }
+    }
+    arm.bb = succ;
+    arm.insts.assign(insts.begin(), insts.end() - 1);
+    arm.args = get_successor_args(terminator, 0);
+    arm.join = terminator->kind.data.jump.target;
+    return arm;
+}
+
+// 分支走向 true 一边的概率, 没有 profile 时返回负数
+static double true_probability(koopa_raw_function_t func, koopa_raw_basic_block_t bb, const Arm &true_arm, const Arm &false_arm)
+{
+    if (!profile_manager.has_profile())
+    {
+        return -1;
+    }
+    std::string func_name = func->name + 1;
+    long long total = profile_manager.count(ProfileManager::block_key(func_name, bb->name + 1));
+    if (total <= 0)
+    {
+        return -1;
+    }
+    if (true_arm.bb)
+    {
+        long long count = profile_manager.count(ProfileManager::block_key(func_name, true_arm.bb->name + 1));
+        return count < 0 ? -1 : std::min(1.0, (double)count / total);
+    }
+    if (false_arm.bb)
+    {
+        long long count = profile_manager.count(ProfileManager::block_key(func_name, false_arm.bb->name + 1));
+        return count < 0 ? -1 : std::max(0.0, 1.0 - (double)count / total);
+    }
+    return -1;
+}
+
+/**
+ * @brief 尝试把以 branch 结尾的基本块 bb 改写成无分支的选择
+ * @param[in] func bb 所在的函数
+ * @param[in] bb 基本块
+ * @param[in] dom_tree 这一轮开始时的支配树, 只用到前驱
+ * @param[in,out] touched 这一轮中控制流已经改变的基本块, 涉及它们的分支留到下一轮再处理
+ * @return 是否改写了
+ */
+static bool convert_branch(koopa_raw_function_t func, koopa_raw_basic_block_t bb, const DominatorTree &dom_tree, std::unordered_set<koopa_raw_basic_block_t> &touched)
+{
+    koopa_raw_value_t branch = get_terminator(bb);
+    if (!branch || branch->kind.tag != KOOPA_RVT_BRANCH)
+    {
+        return false;
+    }
+    const koopa_raw_branch_t &data = branch->kind.data.branch;
+    if (data.true_bb == data.false_bb || is_integer(data.cond))
+    {
+        return false;
+    }
+    Arm arms[2] = {analyze_arm(bb, branch, 0, dom_tree), analyze_arm(bb, branch, 1, dom_tree)};
+    koopa_raw_basic_block_t join = arms[0].join;
+    if (join != arms[1].join || join == bb || arms[0].args.size() != join->params.len || arms[1].args.size() != join->params.len)
+    {
+        return false;
+    }
+    if (touched.count(bb) || touched.count(join) || touched.count(data.true_bb) || touched.count(data.false_bb))
+    {
+        return false;
+    }
+
+    // 代价模型: 分支的代价是分支本身, 走过的一边的指令和 jump, 以及预测失败的期望代价; 选择的代价是两边的指令都执行, 再加上每个不同的值的选择序列
+    const RISCVCostModel &model = get_target_cost_model();
+    bool boolean_cond = data.cond->kind.tag == KOOPA_RVT_BINARY && is_comparison(data.cond->kind.data.binary.op);
+    double p = true_probability(func, bb, arms[0], arms[1]);
+    double miss_rate = p < 0 ? default_miss_rate : std::min(p, 1 - p);
+    double probs[2] = {p < 0 ? 0.5 : p, p < 0 ? 0.5 : 1 - p};
+    double branch_cost = model.alu + miss_rate * model.branch_miss;
+    double select_cost = 0;
+    for (int k = 0; k < 2; ++k)
+    {
+        int arm_cost = arms[k].bb ? model.alu : 0;
+        for (auto inst : arms[k].insts)
+        {
+            arm_cost += inst_cost(inst, model);
+        }
+        branch_cost += probs[k] * arm_cost;
+        select_cost += arm_cost - (arms[k].bb ? model.alu : 0);
+    }
+    // xor, neg, and, xor; Zicond 时 neg 和 and 合成一条 czero.eqz
+    int select_ops = target_has_zicond() ? 3 : 4;
+    bool needs_select = false;
+    for (size_t i = 0; i < join->params.len; ++i)
+    {
+        if (arms[0].args[i] != arms[1].args[i])
+        {
+            select_cost += select_ops * model.alu;
+            needs_select = true;
+        }
+    }
+    if (needs_select && !boolean_cond)
+    {
+        select_cost += model.alu;
+    }
+    if (select_cost > branch_cost)
+    {
+        return false;
+    }
+
+    // 两边的指令搬到分支前面, 分支换成直接跳到汇合点
+    std::vector<koopa_raw_value_t> insts = get_insts(bb);
+    insts.pop_back();
+    for (const auto &arm : arms)
+    {
+        insts.insert(insts.end(), arm.insts.begin(), arm.insts.end());
+    }
+    koopa_raw_value_t t = nullptr;
+    auto condition = [&]()
+    {
+        if (!t)
+        {
+            t = boolean_cond ? data.cond : ir_builder.new_binary(KOOPA_RBO_NOT_EQ, data.cond, ir_builder.new_integer(0));
+            if (t != data.cond)
+            {
+                insts.push_back(t);
+            }
+        }
+        return t;
+    };
+    std::vector<koopa_raw_value_t> args;
+    for (size_t i = 0; i < join->params.len; ++i)
+    {
+        koopa_raw_value_t a = arms[0].args[i], b = arms[1].args[i];
+        if (a == b)
+        {
+            args.push_back(a);
+            continue;
+        }
+        if (is_integer(a) && is_integer(b) && a->kind.data.integer.value == 1 && b->kind.data.integer.value == 0)
+        {
+            args.push_back(condition());
+            continue;
+        }
+        // b ^ ((a ^ b) & -t): t 为 1 时得到 a, 为 0 时得到 b
+        koopa_raw_value_t diff = ir_builder.new_binary(KOOPA_RBO_XOR, a, b);
+        koopa_raw_value_t mask = ir_builder.new_binary(KOOPA_RBO_SUB, ir_builder.new_integer(0), condition());
+        koopa_raw_value_t masked = ir_builder.new_binary(KOOPA_RBO_AND, diff, mask);
+        koopa_raw_value_t select = ir_builder.new_binary(KOOPA_RBO_XOR, b, masked);
+        insts.insert(insts.end(), {diff, mask, masked, select});
+        args.push_back(select);
+    }
+    koopa_raw_value_t jump = ir_builder.new_jump(join);
+    set_successor_args(jump, 0, args);
+    insts.push_back(jump);
+    set_insts(bb, insts);
+    touched.insert({bb, join, data.true_bb, data.false_bb});
+    return true;
+}
+
+// 对一个函数做 if-conversion, 返回改写的分支数量
+static int convert_branches_to_selects(koopa_raw_function_t func)
+{
+    int converted = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+        std::unordered_set<koopa_raw_basic_block_t> touched;
+        // 后序访问, 内层的菱形先被改写, 下一轮外层的一边就可能变成只有 jump 的小基本块
+        const std::vector<koopa_raw_basic_block_t> &rpo = dom_tree.rpo();
+        for (auto it = rpo.rbegin(); it != rpo.rend(); ++it)
+        {
+            if (convert_branch(func, *it, dom_tree, touched))
+            {
+                ++converted;
+                changed = true;
+            }
+        }
+        if (changed)
+        {
+            analysis_manager.invalidate(func);
+            remove_unreachable_blocks(func);
+        }
+    }
+    return converted;
+}
+
+int convert_branches_to_selects(koopa_raw_program_t &program)
+{
+    int converted = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            converted += convert_branches_to_selects(func);
+        }
+    }
+    return converted;
+}
@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 不超过这个指令数的叶子函数总是内联
+static const int TINY_LEAF_LIMIT = 20;
+
+// 只有一个调用点的函数, 不超过这个指令数时内联
+static const int SINGLE_CALL_SITE_LIMIT = 300;
+
+// 热的调用边 (profile 计数不小于 HOT_CALL_COUNT) 上, 不超过这个指令数的函数 (可以不是叶子函数) 也内联
+static const int HOT_CALL_LIMIT = 60;
+static const long long HOT_CALL_COUNT = 1000;
+
+// 调用者内联之后的指令数上限, 防止代码膨胀
+static const int CALLER_SIZE_LIMIT = 3000;
+
+// 内联次数, 用于给拷贝出来的基本块和变量起唯一的名字
+static int inline_counter = 0;
+
+// 找出调用图中的递归函数: 所在强连通分量大于 1, 或者直接调用自己; 同时返回自底向上 (被调用者在前) 的函数顺序
+static void analyze_call_graph(const std::vector<koopa_raw_function_t> &funcs, std::unordered_set<koopa_raw_function_t> &recursive, std::vector<koopa_raw_function_t> &bottom_up)
+{
+    std::unordered_map<koopa_raw_function_t, std::vector<koopa_raw_function_t>> callees;
+    for (auto func : funcs)
+    {
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag == KOOPA_RVT_CALL && is_function_defined(inst->kind.data.call.callee))
+                {
+                    callees[func].push_back(inst->kind.data.call.callee);
+                    if (inst->kind.data.call.callee == func)
+                    {
+                        recursive.insert(func);
+                    }
+                }
+            }
+        }
+    }
+
+    // Tarjan 算法, 强连通分量按照逆拓扑序产生, 也就是被调用者先产生
+    std::unordered_map<koopa_raw_function_t, int> index, low;
+    std::unordered_set<koopa_raw_function_t> on_stack;
+    std::vector<koopa_raw_function_t> stack;
+    int next_index = 0;
+    std::function<void(koopa_raw_function_t)> strong_connect = [&](koopa_raw_function_t func)
+    {
+        index[func] = low[func] = next_index++;
+        stack.push_back(func);
+        on_stack.insert(func);
+        for (auto callee : callees[func])
+        {
+            if (index.find(callee) == index.end())
+            {
+                strong_connect(callee);
+                low[func] = std::min(low[func], low[callee]);
+            }
+            else if (on_stack.count(callee))
+            {
+                low[func] = std::min(low[func], index[callee]);
+            }
+        }
+        if (low[func] == index[func])
+        {
+            std::vector<koopa_raw_function_t> scc;
+            koopa_raw_function_t member;
+            do
+            {
+                member = stack.back();
+                stack.pop_back();
+                on_stack.erase(member);
+                scc.push_back(member);
+            } while (member != func);
+            if (scc.size() > 1)
+            {
+                recursive.insert(scc.begin(), scc.end());
+            }
+            bottom_up.insert(bottom_up.end(), scc.begin(), scc.end());
+        }
+    };
+    for (auto func : funcs)
+    {
+        if (index.find(func) == index.end())
+        {
+            strong_connect(func);
+        }
+    }
+}
+
+// 函数中是否调用了其他定义过的函数
+static bool is_leaf(koopa_raw_function_t func)
+{
+    for (auto bb : get_basic_blocks(func))
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_CALL && is_function_defined(inst->kind.data.call.callee))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// 函数中是否有带参数的基本块, 前端不会生成, 内联时不处理
+static bool has_block_params(koopa_raw_function_t func)
+{
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (bb->params.len > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 把 caller 中 bbs[bb_index] 的第 inst_index 条指令 (一条 call) 内联
+ * @note 调用点所在的基本块在 call 处拆开, 前半部分跳转到被调用者入口的拷贝, 后半部分成为新的汇合基本块 `%inline_<N>_end`
+ * @note 被调用者只有一条 ret 时直接用返回值替换 call 的所有使用, 否则在 caller 的 entry 中分配 `@inline_<N>_ret`, 每条 ret 存储返回值后跳转到汇合基本块, 汇合基本块开头再读出来
+ * @return 汇合基本块在 bbs 中的下标, 从这里继续扫描, 拷贝出来的基本块不再扫描
+ */
+static size_t inline_call(koopa_raw_function_t caller, std::vector<koopa_raw_basic_block_t> &bbs, size_t bb_index, size_t inst_index)
+{
+    koopa_raw_basic_block_t bb = bbs[bb_index];
+    std::vector<koopa_raw_value_t> insts = get_insts(bb);
+    koopa_raw_value_t call = insts[inst_index];
+    koopa_raw_function_t callee = call->kind.data.call.callee;
+    std::string prefix = "inline_" + std::to_string(inline_counter++) + "_";
+
+    // 被调用者的参数映射为调用的实参
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    std::vector<koopa_raw_value_t> params = get_values(callee->params);
+    std::vector<koopa_raw_value_t> args = get_values(call->kind.data.call.args);
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        value_map[params[i]] = args[i];
+    }
+
+    // 拷贝基本块, 名字加上前缀保证在整个程序中唯一
+    std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> bb_map;
+    std::vector<koopa_raw_basic_block_t> callee_bbs = get_basic_blocks(callee);
+    std::vector<koopa_raw_basic_block_t> cloned_bbs;
+    for (auto callee_bb : callee_bbs)
+    {
+        koopa_raw_basic_block_t cloned_bb = ir_builder.new_basic_block("%" + prefix + strip_prefix(callee_bb->name));
+        bb_map[callee_bb] = cloned_bb;
+        cloned_bbs.push_back(cloned_bb);
+    }
+
+    // 拷贝指令, alloc 改名之后统一放到 caller 的 entry 中, 其他值不需要名字
+    std::vector<koopa_raw_value_t> cloned_allocs;
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_value_t>> cloned_insts;
+    std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>> cloned_pairs;
+    for (auto callee_bb : callee_bbs)
+    {
+        for (auto inst : get_insts(callee_bb))
+        {
+            koopa_raw_value_t cloned;
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+            {
+                cloned = ir_builder.new_alloc("@" + prefix + strip_prefix(inst->name));
+                cloned_allocs.push_back(cloned);
+            }
+            else
+            {
+                cloned = ir_builder.clone_value(inst, nullptr);
+                cloned_insts[bb_map[callee_bb]].push_back(cloned);
+            }
+            value_map[inst] = cloned;
+            cloned_pairs.push_back({inst, cloned});
+        }
+    }
+    for (auto &pair : cloned_pairs)
+    {
+        for (auto operand : get_operands(pair.first))
+        {
+            auto it = value_map.find(operand);
+            if (it != value_map.end())
+            {
+                replace_operand(pair.second, operand, it->second);
+            }
+        }
+        for (auto succ : get_successors_of_terminator(pair.first))
+        {
+            replace_successor(pair.second, succ, bb_map[succ]);
+        }
+    }
+
+    // 拆开调用点所在的基本块
+    koopa_raw_basic_block_t join_bb = ir_builder.new_basic_block("%" + prefix + "end");
+    std::vector<koopa_raw_value_t> head_insts(insts.begin(), insts.begin() + inst_index);
+    std::vector<koopa_raw_value_t> join_insts;
+    head_insts.push_back(ir_builder.new_jump(cloned_bbs[0]));
+
+    // 找出所有 ret 的拷贝
+    std::vector<std::pair<koopa_raw_basic_block_t, size_t>> rets;
+    for (auto cloned_bb : cloned_bbs)
+    {
+        auto &block_insts = cloned_insts[cloned_bb];
+        for (size_t i = 0; i < block_insts.size(); ++i)
+        {
+            if (block_insts[i]->kind.tag == KOOPA_RVT_RETURN)
+            {
+                rets.push_back({cloned_bb, i});
+            }
+        }
+    }
+
+    // ret 改为跳转到汇合基本块, 有返回值时把返回值传给 call 的使用者
+    bool has_result = call->ty->tag != KOOPA_RTT_UNIT;
+    koopa_raw_value_t result = nullptr;
+    koopa_raw_value_t result_slot = nullptr;
+    if (has_result && rets.size() > 1)
+    {
+        result_slot = ir_builder.new_alloc("@" + prefix + "ret");
+        cloned_allocs.push_back(result_slot);
+        result = ir_builder.new_load(result_slot);
+        join_insts.push_back(result);
+    }
+    for (auto &ret : rets)
+    {
+        auto &block_insts = cloned_insts[ret.first];
+        koopa_raw_value_t ret_value = block_insts[ret.second]->kind.data.ret.value;
+        if (has_result && !ret_value)
+        {
+            ret_value = ir_builder.new_integer(0);
+        }
+        block_insts.erase(block_insts.begin() + ret.second);
+        if (has_result && result_slot)
+        {
+            block_insts.push_back(ir_builder.new_store(ret_value, result_slot));
+        }
+        else if (has_result)
+        {
+            result = ret_value;
+        }
+        block_insts.push_back(ir_builder.new_jump(join_bb));
+    }
+    join_insts.insert(join_insts.end(), insts.begin() + inst_index + 1, insts.end());
+
+    // 有 profile 时, 拷贝的基本块按调用点和被调用者入口的计数之比分到被调用者的计数, 汇合基本块继承调用点所在基本块的计数和后半部分的调用边
+    std::string caller_name = strip_prefix(caller->name);
+    std::string callee_name = strip_prefix(callee->name);
+    long long site_count = profile_manager.count(ProfileManager::block_key(caller_name, strip_prefix(bb->name)));
+    long long callee_count = profile_manager.count(ProfileManager::block_key(callee_name, strip_prefix(callee_bbs[0]->name)));
+    if (site_count >= 0 && callee_count >= 0)
+    {
+        double scale = callee_count > 0 ? (double)site_count / callee_count : 0.0;
+        for (size_t i = 0; i < callee_bbs.size(); ++i)
+        {
+            profile_manager.copy_block_count(callee_name, strip_prefix(callee_bbs[i]->name), caller_name, strip_prefix(cloned_bbs[i]->name), scale);
+        }
+    }
+    if (site_count >= 0)
+    {
+        profile_manager.set_count(ProfileManager::block_key(caller_name, strip_prefix(join_bb->name)), site_count);
+        int call_index = 0;
+        int join_index = 0;
+        for (size_t i = 0; i < insts.size(); ++i)
+        {
+            if (insts[i]->kind.tag != KOOPA_RVT_CALL)
+            {
+                continue;
+            }
+            if (i > inst_index)
+            {
+                std::string target = strip_prefix(insts[i]->kind.data.call.callee->name);
+                long long count = profile_manager.count(ProfileManager::call_edge_key(caller_name, strip_prefix(bb->name), call_index, target));
+                if (count >= 0)
+                {
+                    profile_manager.set_count(ProfileManager::call_edge_key(caller_name, strip_prefix(join_bb->name), join_index, target), count);
+                }
+                join_index++;
+            }
+            call_index++;
+        }
+    }
+
+    set_insts(bb, head_insts);
+    set_insts(join_bb, join_insts);
+    for (auto cloned_bb : cloned_bbs)
+    {
+        set_insts(cloned_bb, cloned_insts[cloned_bb]);
+    }
+
+    // 拷贝和汇合基本块放在调用点所在的基本块后面
+    bbs.insert(bbs.begin() + bb_index + 1, cloned_bbs.begin(), cloned_bbs.end());
+    bbs.insert(bbs.begin() + bb_index + 1 + cloned_bbs.size(), join_bb);
+
+    // alloc 放在 caller 的 entry 开头
+    std::vector<koopa_raw_value_t> entry_insts = get_insts(bbs[0]);
+    entry_insts.insert(entry_insts.begin(), cloned_allocs.begin(), cloned_allocs.end());
+    set_insts(bbs[0], entry_insts);
+
+    set_basic_blocks(caller, bbs);
+    analysis_manager.invalidate(caller);
+    if (has_result && result)
+    {
+        replace_all_uses(caller, call, result);
+    }
+    return bb_index + 1 + cloned_bbs.size();
+}
+
+int inline_functions(koopa_raw_program_t &program)
+{
+    std::vector<koopa_raw_function_t> funcs;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            funcs.push_back(func);
+        }
+    }
+
+    std::unordered_set<koopa_raw_function_t> recursive;
+    std::vector<koopa_raw_function_t> bottom_up;
+    analyze_call_graph(funcs, recursive, bottom_up);
+
+    // 每个函数的调用点数量和指令数, 以及原始 IR 中每条调用边的 profile 计数
+    std::unordered_map<koopa_raw_function_t, int> call_sites;
+    std::unordered_map<koopa_raw_function_t, int> size;
+    std::unordered_map<koopa_raw_value_t, long long> edge_count;
+    for (auto func : funcs)
+    {
+        size[func] = count_insts(func);
+        for (auto bb : get_basic_blocks(func))
+        {
+            int call_index = 0;
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag != KOOPA_RVT_CALL)
+                {
+                    continue;
+                }
+                koopa_raw_function_t callee = inst->kind.data.call.callee;
+                call_sites[callee]++;
+                if (profile_manager.has_profile())
+                {
+                    std::string key = ProfileManager::call_edge_key(strip_prefix(func->name), strip_prefix(bb->name), call_index, strip_prefix(callee->name));
+                    edge_count[inst] = profile_manager.count(key);
+                }
+                call_index++;
+            }
+        }
+    }
+
+    auto should_inline = [&](koopa_raw_function_t caller, koopa_raw_value_t call)
+    {
+        koopa_raw_function_t callee = call->kind.data.call.callee;
+        if (!is_function_defined(callee) || callee == caller || recursive.count(callee) || has_block_params(callee))
+        {
+            return false;
+        }
+        if (size[caller] + size[callee] > CALLER_SIZE_LIMIT)
+        {
+            return false;
+        }
+        bool single_call_site = call_sites[callee] == 1;
+        long long count = edge_count.count(call) ? edge_count[call] : -1;
+        // 从未执行过的调用边, 内联只会增大代码
+        if (count == 0 && !single_call_site)
+        {
+            return false;
+        }
+        if (single_call_site && size[callee] <= SINGLE_CALL_SITE_LIMIT)
+        {
+            return true;
+        }
+        if (count >= HOT_CALL_COUNT && size[callee] <= HOT_CALL_LIMIT)
+        {
+            return true;
+        }
+        return is_leaf(callee) && size[callee] <= TINY_LEAF_LIMIT;
+    };
+
+    int inlined = 0;
+    for (auto caller : bottom_up)
+    {
+        std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(caller);
+        size_t bb_index = 0;
+        while (bb_index < bbs.size())
+        {
+            std::vector<koopa_raw_value_t> insts = get_insts(bbs[bb_index]);
+            bool split = false;
+            for (size_t i = 0; i < insts.size(); ++i)
+            {
+                if (insts[i]->kind.tag != KOOPA_RVT_CALL || !should_inline(caller, insts[i]))
+                {
+                    continue;
+                }
+                koopa_raw_function_t callee = insts[i]->kind.data.call.callee;
+                // 拷贝出来的调用也是新的调用点
+                for (auto callee_bb : get_basic_blocks(callee))
+                {
+                    for (auto inst : get_insts(callee_bb))
+                    {
+                        if (inst->kind.tag == KOOPA_RVT_CALL)
+                        {
+                            call_sites[inst->kind.data.call.callee]++;
+                        }
+                    }
+                }
+                call_sites[callee]--;
+                size[caller] += size[callee];
+                bb_index = inline_call(caller, bbs, bb_index, i);
+                inlined++;
+                split = true;
+                break;
+            }
+            if (!split)
+            {
+                bb_index++;
+            }
+        }
+    }
+
+    // 删除不再被调用的函数, 从 main 出发沿着调用图能到达的函数都要保留, 库函数的声明也保留
+    std::unordered_set<koopa_raw_function_t> reachable;
+    std::vector<koopa_raw_function_t> worklist;
+    for (auto func : funcs)
+    {
+        if (std::string(func->name) == "@main")
+        {
+            reachable.insert(func);
+            worklist.push_back(func);
+        }
+    }
+    while (!worklist.empty())
+    {
+        koopa_raw_function_t func = worklist.back();
+        worklist.pop_back();
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag == KOOPA_RVT_CALL && !reachable.count(inst->kind.data.call.callee))
+                {
+                    reachable.insert(inst->kind.data.call.callee);
+                    worklist.push_back(inst->kind.data.call.callee);
+                }
+            }
+        }
+    }
+    if (reachable.empty())
+    {
+        return inlined;
+    }
+    std::vector<koopa_raw_function_t> kept;
+    for (auto func : get_functions(program))
+    {
+        if (!is_function_defined(func) || reachable.count(func))
+        {
+            kept.push_back(func);
+        }
+    }
+    set_functions(program, kept);
+
+    return inlined;
+}
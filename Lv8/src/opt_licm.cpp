@@ -0,0 +1,274 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 给循环插入前置块: 循环外的前驱都改为跳转到前置块, 前置块再跳转到循环头, 已经有前置块时不做修改
+static void insert_preheader(koopa_raw_function_t func, const Loop &loop, const DominatorTree &dom_tree)
+{
+    koopa_raw_basic_block_t header = loop.header;
+    std::vector<koopa_raw_basic_block_t> outside_preds;
+    for (auto pred : dom_tree.predecessors(header))
+    {
+        if (!loop.contains(pred))
+        {
+            outside_preds.push_back(pred);
+        }
+    }
+    // 只有一个循环外的前驱, 并且它只跳转到循环头时, 它本身就是前置块
+    if (outside_preds.size() == 1 && get_terminator(outside_preds[0])->kind.tag == KOOPA_RVT_JUMP)
+    {
+        return;
+    }
+
+    koopa_raw_basic_block_data_t *preheader = ir_builder.new_basic_block("%" + strip_prefix(header->name) + "_preheader");
+    // 循环头有参数时, 前置块接收同样的参数并原样传给循环头
+    std::vector<koopa_raw_value_t> params;
+    for (size_t i = 0; i < header->params.len; ++i)
+    {
+        params.push_back(ir_builder.new_block_arg(i, "%" + strip_prefix(preheader->name) + "_" + std::to_string(i)));
+    }
+    preheader->params = ir_builder.new_slice(std::vector<const void *>(params.begin(), params.end()), KOOPA_RSIK_VALUE);
+    koopa_raw_value_t jump = ir_builder.new_jump(header);
+    set_successor_args(jump, 0, params);
+    set_insts(preheader, {jump});
+
+    // 有 profile 时前置块的计数是进入循环的次数
+    long long entry_count = estimate_entry_count(func, header, outside_preds);
+    if (entry_count >= 0)
+    {
+        profile_manager.set_count(ProfileManager::block_key(strip_prefix(func->name), strip_prefix(preheader->name)), entry_count);
+    }
+
+    for (auto pred : outside_preds)
+    {
+        koopa_raw_value_t terminator = get_terminator(pred);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            if (succs[k] == header)
+            {
+                set_successor(terminator, k, preheader);
+            }
+        }
+    }
+
+    // 前置块放在循环头前面
+    std::vector<koopa_raw_basic_block_t> bbs;
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (bb == header)
+        {
+            bbs.push_back(preheader);
+        }
+        bbs.push_back(bb);
+    }
+    set_basic_blocks(func, bbs);
+}
+
+// 循环中被 store 的全局变量, 包括循环中调用的函数可能修改的
+static std::unordered_set<koopa_raw_value_t> clobbered_globals(const Loop &loop, const std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> &modified_globals)
+{
+    std::unordered_set<koopa_raw_value_t> clobbered;
+    for (auto bb : loop.blocks)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                clobbered.insert(inst->kind.data.store.dest);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                auto it = modified_globals.find(inst->kind.data.call.callee);
+                if (it != modified_globals.end())
+                {
+                    clobbered.insert(it->second.begin(), it->second.end());
+                }
+            }
+        }
+    }
+    return clobbered;
+}
+
+// 指令在循环中是否不变: 操作数都在循环外定义的 binary, 或者循环中没有被修改的全局变量的 load
+static bool is_loop_invariant(koopa_raw_value_t inst, const Loop &loop, const std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> &defined_in, const std::unordered_set<koopa_raw_value_t> &clobbered)
+{
+    auto defined_outside = [&](koopa_raw_value_t value)
+    {
+        auto it = defined_in.find(value);
+        return it == defined_in.end() || !loop.contains(it->second);
+    };
+    const auto &kind = inst->kind;
+    if (kind.tag == KOOPA_RVT_BINARY)
+    {
+        return defined_outside(kind.data.binary.lhs) && defined_outside(kind.data.binary.rhs);
+    }
+    if (kind.tag == KOOPA_RVT_LOAD)
+    {
+        // 局部变量已经被 mem2reg 提升, 这里只外提全局变量的 load
+        koopa_raw_value_t src = kind.data.load.src;
+        return src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC && !clobbered.count(src);
+    }
+    return false;
+}
+
+// 每个参数和指令所在的基本块
+static std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> compute_defined_in(const DominatorTree &dom_tree)
+{
+    std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> defined_in;
+    for (auto bb : dom_tree.rpo())
+    {
+        for (auto param : get_values(bb->params))
+        {
+            defined_in[param] = bb;
+        }
+        for (auto inst : get_insts(bb))
+        {
+            defined_in[inst] = bb;
+        }
+    }
+    return defined_in;
+}
+
+// 对一个函数做循环不变量外提, 返回外提的指令数量
+static int hoist_loop_invariants(koopa_raw_function_t func, const std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> &modified_globals)
+{
+    remove_unreachable_blocks(func);
+
+    // 先给有不变量的循环插入前置块, 控制流改变之后重新计算支配树和循环
+    // 循环头有参数时前置块也需要参数, 会多一次拷贝, 所以没有东西可以外提的循环不插入
+    {
+        const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> defined_in = compute_defined_in(dom_tree);
+        bool has_invariant = false;
+        for (auto loop : loop_info.loops())
+        {
+            std::unordered_set<koopa_raw_value_t> clobbered = clobbered_globals(*loop, modified_globals);
+            bool found = false;
+            for (auto bb : loop->blocks)
+            {
+                for (auto inst : get_insts(bb))
+                {
+                    found = found || is_loop_invariant(inst, *loop, defined_in, clobbered);
+                }
+            }
+            if (found)
+            {
+                insert_preheader(func, *loop, dom_tree);
+                has_invariant = true;
+            }
+        }
+        if (!has_invariant)
+        {
+            return 0;
+        }
+    }
+    analysis_manager.invalidate(func);
+    const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+    const LoopInfo &loop_info = analysis_manager.loop_info(func);
+
+    // 外提之后随之更新
+    std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> defined_in = compute_defined_in(dom_tree);
+
+    int hoisted = 0;
+    // 从内到外处理, 内层循环外提到的前置块属于外层循环, 可以继续外提
+    for (auto loop : loop_info.loops())
+    {
+        // 只有一个循环外的前驱, 并且以 jump 结束时才是前置块
+        koopa_raw_basic_block_t preheader = nullptr;
+        int outside_preds = 0;
+        for (auto pred : dom_tree.predecessors(loop->header))
+        {
+            if (!loop->contains(pred))
+            {
+                preheader = pred;
+                ++outside_preds;
+            }
+        }
+        if (outside_preds != 1 || get_terminator(preheader)->kind.tag != KOOPA_RVT_JUMP)
+        {
+            continue;
+        }
+        std::unordered_set<koopa_raw_value_t> clobbered = clobbered_globals(*loop, modified_globals);
+
+        // 每次迭代都会执行的基本块: 支配所有 latch
+        auto executes_every_iteration = [&](koopa_raw_basic_block_t bb)
+        {
+            for (auto latch : loop->latches)
+            {
+                if (!dom_tree.dominates(bb, latch))
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::vector<koopa_raw_value_t> moved;
+        // 逆后序保证操作数的定义先被处理
+        for (auto bb : dom_tree.rpo())
+        {
+            if (!loop->contains(bb))
+            {
+                continue;
+            }
+            std::vector<koopa_raw_value_t> kept;
+            for (auto inst : get_insts(bb))
+            {
+                const auto &kind = inst->kind;
+                bool hoist = is_loop_invariant(inst, *loop, defined_in, clobbered);
+                // RISC-V 的除法不会触发异常, 外提总是安全的, 但除法很慢, 只外提每次迭代都会执行的
+                if (hoist && kind.tag == KOOPA_RVT_BINARY && (kind.data.binary.op == KOOPA_RBO_DIV || kind.data.binary.op == KOOPA_RBO_MOD))
+                {
+                    hoist = executes_every_iteration(bb);
+                }
+                if (hoist)
+                {
+                    moved.push_back(inst);
+                    defined_in[inst] = preheader;
+                }
+                else
+                {
+                    kept.push_back(inst);
+                }
+            }
+            if (kept.size() != bb->insts.len)
+            {
+                set_insts(bb, kept);
+            }
+        }
+        if (moved.empty())
+        {
+            continue;
+        }
+
+        // 放在前置块的 jump 前面
+        std::vector<koopa_raw_value_t> insts = get_insts(preheader);
+        koopa_raw_value_t terminator = insts.back();
+        insts.pop_back();
+        insts.insert(insts.end(), moved.begin(), moved.end());
+        insts.push_back(terminator);
+        set_insts(preheader, insts);
+        hoisted += moved.size();
+    }
+    return hoisted;
+}
+
+int hoist_loop_invariants(koopa_raw_program_t &program)
+{
+    auto modified_globals = compute_modified_globals(program);
+    int hoisted = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            hoisted += hoist_loop_invariants(func, modified_globals);
+        }
+    }
+    return hoisted;
+}
@@ -0,0 +1,272 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 新建的基本块参数的数量, 用于给参数起唯一的名字
+static int block_arg_counter = 0;
+
+// 找出可以提升的 alloc: 类型是 *i32, 并且只被 load 读或者被 store 写, 地址没有被当作值使用
+static std::vector<koopa_raw_value_t> find_promotable_allocs(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_value_t> allocs;
+    std::unordered_set<koopa_raw_value_t> escaped;
+    for (auto bb : get_basic_blocks(func))
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+            {
+                if (inst->ty->tag == KOOPA_RTT_POINTER && inst->ty->data.pointer.base->tag == KOOPA_RTT_INT32)
+                {
+                    allocs.push_back(inst);
+                }
+                continue;
+            }
+            if (inst->kind.tag == KOOPA_RVT_LOAD)
+            {
+                continue;
+            }
+            if (inst->kind.tag == KOOPA_RVT_STORE)
+            {
+                escaped.insert(inst->kind.data.store.value);
+                continue;
+            }
+            for (auto operand : get_operands(inst))
+            {
+                escaped.insert(operand);
+            }
+        }
+    }
+    std::vector<koopa_raw_value_t> promotable;
+    for (auto alloc : allocs)
+    {
+        if (!escaped.count(alloc))
+        {
+            promotable.push_back(alloc);
+        }
+    }
+    return promotable;
+}
+
+// 把一个函数中可以提升的 alloc 提升为 SSA 值, 返回提升的 alloc 数量
+static int promote_memory_to_register(koopa_raw_function_t func)
+{
+    // 不可达的基本块不在支配树中, 先删掉
+    remove_unreachable_blocks(func);
+    std::vector<koopa_raw_value_t> allocs = find_promotable_allocs(func);
+    if (allocs.empty())
+    {
+        return 0;
+    }
+    std::unordered_map<koopa_raw_value_t, size_t> alloc_index;
+    for (size_t i = 0; i < allocs.size(); ++i)
+    {
+        alloc_index[allocs[i]] = i;
+    }
+
+    const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+
+    // 每个 alloc 被 store 的基本块, 以及在 store 之前就被 load 的基本块 (向上暴露的使用)
+    std::vector<std::vector<koopa_raw_basic_block_t>> def_blocks(allocs.size());
+    std::vector<std::vector<koopa_raw_basic_block_t>> use_blocks(allocs.size());
+    std::vector<std::unordered_set<koopa_raw_basic_block_t>> def_block_set(allocs.size());
+    for (auto bb : bbs)
+    {
+        std::unordered_set<size_t> stored;
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_STORE && alloc_index.count(inst->kind.data.store.dest))
+            {
+                size_t index = alloc_index[inst->kind.data.store.dest];
+                if (stored.insert(index).second)
+                {
+                    def_blocks[index].push_back(bb);
+                    def_block_set[index].insert(bb);
+                }
+            }
+            else if (inst->kind.tag == KOOPA_RVT_LOAD && alloc_index.count(inst->kind.data.load.src))
+            {
+                size_t index = alloc_index[inst->kind.data.load.src];
+                if (!stored.count(index))
+                {
+                    use_blocks[index].push_back(bb);
+                }
+            }
+        }
+    }
+
+    // 对每个 alloc, 在迭代支配边界中并且入口处活跃的基本块上添加参数 (剪枝 SSA)
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<size_t>> block_param_allocs;
+    for (size_t i = 0; i < allocs.size(); ++i)
+    {
+        // 入口处活跃的基本块: 从向上暴露的使用出发沿前驱反向传播, 遇到 store 的基本块停止
+        std::unordered_set<koopa_raw_basic_block_t> live_in(use_blocks[i].begin(), use_blocks[i].end());
+        std::vector<koopa_raw_basic_block_t> worklist(use_blocks[i].begin(), use_blocks[i].end());
+        while (!worklist.empty())
+        {
+            koopa_raw_basic_block_t bb = worklist.back();
+            worklist.pop_back();
+            for (auto pred : dom_tree.predecessors(bb))
+            {
+                if (!def_block_set[i].count(pred) && live_in.insert(pred).second)
+                {
+                    worklist.push_back(pred);
+                }
+            }
+        }
+
+        std::unordered_set<koopa_raw_basic_block_t> has_param;
+        worklist = def_blocks[i];
+        std::unordered_set<koopa_raw_basic_block_t> queued(worklist.begin(), worklist.end());
+        while (!worklist.empty())
+        {
+            koopa_raw_basic_block_t bb = worklist.back();
+            worklist.pop_back();
+            for (auto frontier : dom_tree.frontier(bb))
+            {
+                if (!live_in.count(frontier) || !has_param.insert(frontier).second)
+                {
+                    continue;
+                }
+                block_param_allocs[frontier].push_back(i);
+                // 新的参数也是一次定义
+                if (queued.insert(frontier).second)
+                {
+                    worklist.push_back(frontier);
+                }
+            }
+        }
+    }
+
+    // 新建基本块参数, 接在已有参数后面; 按基本块在函数中的顺序编号, 保证输出的名字和指针地址无关
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_value_t>> block_params;
+    for (auto bb : bbs)
+    {
+        auto it = block_param_allocs.find(bb);
+        if (it == block_param_allocs.end())
+        {
+            continue;
+        }
+        std::vector<koopa_raw_value_t> params = get_values(bb->params);
+        for (auto index : it->second)
+        {
+            std::string name = "%" + strip_prefix(allocs[index]->name) + "_" + std::to_string(block_arg_counter++);
+            koopa_raw_value_t param = ir_builder.new_block_arg(params.size(), name);
+            params.push_back(param);
+            block_params[bb].push_back(param);
+        }
+        as_mutable(bb)->params = ir_builder.new_slice(std::vector<const void *>(params.begin(), params.end()), KOOPA_RSIK_VALUE);
+    }
+
+    // 沿支配树重命名: 记录每个 alloc 当前的值, load 替换为当前的值, store 更新当前的值, 跳转时把当前的值作为参数传给后继
+    koopa_raw_value_t undefined = ir_builder.new_integer(0);
+    std::vector<koopa_raw_value_t> current(allocs.size(), undefined);
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replacement;
+    std::unordered_set<koopa_raw_value_t> removed(allocs.begin(), allocs.end());
+    // 撤销记录, 离开一个基本块时恢复进入之前的值
+    std::vector<std::pair<size_t, koopa_raw_value_t>> undo_log;
+    std::vector<std::pair<koopa_raw_basic_block_t, size_t>> stack;
+    std::vector<size_t> undo_mark;
+    auto enter = [&](koopa_raw_basic_block_t bb)
+    {
+        undo_mark.push_back(undo_log.size());
+        auto set_current = [&](size_t index, koopa_raw_value_t value)
+        {
+            undo_log.push_back({index, current[index]});
+            current[index] = value;
+        };
+        auto it = block_param_allocs.find(bb);
+        if (it != block_param_allocs.end())
+        {
+            for (size_t i = 0; i < it->second.size(); ++i)
+            {
+                set_current(it->second[i], block_params[bb][i]);
+            }
+        }
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_LOAD && alloc_index.count(inst->kind.data.load.src))
+            {
+                replacement[inst] = current[alloc_index[inst->kind.data.load.src]];
+                removed.insert(inst);
+            }
+            else if (inst->kind.tag == KOOPA_RVT_STORE && alloc_index.count(inst->kind.data.store.dest))
+            {
+                set_current(alloc_index[inst->kind.data.store.dest], inst->kind.data.store.value);
+                removed.insert(inst);
+            }
+        }
+        koopa_raw_value_t terminator = get_terminator(bb);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            auto param_it = block_param_allocs.find(succs[k]);
+            if (param_it == block_param_allocs.end())
+            {
+                continue;
+            }
+            std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+            for (auto index : param_it->second)
+            {
+                args.push_back(current[index]);
+            }
+            set_successor_args(terminator, k, args);
+        }
+        stack.push_back({bb, 0});
+    };
+    enter(bbs[0]);
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        const auto &children = dom_tree.children(top.first);
+        if (top.second < children.size())
+        {
+            enter(children[top.second++]);
+        }
+        else
+        {
+            stack.pop_back();
+            size_t mark = undo_mark.back();
+            undo_mark.pop_back();
+            while (undo_log.size() > mark)
+            {
+                current[undo_log.back().first] = undo_log.back().second;
+                undo_log.pop_back();
+            }
+        }
+    }
+
+    // 删除被提升的 alloc 和它们的 load, store, 然后替换 load 的使用
+    for (auto bb : bbs)
+    {
+        std::vector<koopa_raw_value_t> kept;
+        for (auto inst : get_insts(bb))
+        {
+            if (!removed.count(inst))
+            {
+                kept.push_back(inst);
+            }
+        }
+        set_insts(bb, kept);
+    }
+    replace_uses_with_map(func, replacement);
+    return allocs.size();
+}
+
+int promote_memory_to_register(koopa_raw_program_t &program)
+{
+    int promoted = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            promoted += promote_memory_to_register(func);
+        }
+    }
+    return promoted;
+}
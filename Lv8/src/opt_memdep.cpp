@@ -0,0 +1,172 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 地址 (alloc 或全局变量) -> 当前保存在这个地址中的值
+    using AvailableValues = std::unordered_map<koopa_raw_value_t, koopa_raw_value_t>;
+
+    // 只保留两个集合中地址和值都相同的项
+    void intersect(AvailableValues &into, const AvailableValues &other)
+    {
+        for (auto it = into.begin(); it != into.end();)
+        {
+            auto found = other.find(it->first);
+            if (found == other.end() || found->second != it->second)
+            {
+                it = into.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 在一个基本块中传递可用的值
+ * @param[in] bb 基本块
+ * @param[in,out] available 进入基本块时可用的值, 返回时是离开基本块时可用的值
+ * @param[in] modified_globals 每个函数可能修改的全局变量
+ * @param[out] replacement 非空时记录可以被替换掉的 load
+ */
+static void transfer(koopa_raw_basic_block_t bb, AvailableValues &available, const std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> &modified_globals, std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> *replacement)
+{
+    for (auto inst : get_insts(bb))
+    {
+        const auto &kind = inst->kind;
+        if (kind.tag == KOOPA_RVT_LOAD)
+        {
+            auto it = available.find(kind.data.load.src);
+            if (it == available.end())
+            {
+                available[kind.data.load.src] = inst;
+            }
+            else if (replacement)
+            {
+                (*replacement)[inst] = it->second;
+            }
+        }
+        else if (kind.tag == KOOPA_RVT_STORE)
+        {
+            // 没有指针运算, 一个 store 只会修改它的目标地址, 之后读到的就是存进去的值
+            available[kind.data.store.dest] = kind.data.store.value;
+        }
+        else if (kind.tag == KOOPA_RVT_CALL)
+        {
+            // 被调用者看不到调用者的 alloc, 只会修改它 (间接) store 过的全局变量; 库函数不修改全局变量
+            auto it = modified_globals.find(kind.data.call.callee);
+            if (it == modified_globals.end())
+            {
+                continue;
+            }
+            for (auto global : it->second)
+            {
+                available.erase(global);
+            }
+        }
+    }
+}
+
+// 对一个函数做 load 消除, 返回被替换的 load 的数量
+static int eliminate_redundant_loads(koopa_raw_function_t func, const std::unordered_map<koopa_raw_function_t, std::unordered_set<koopa_raw_value_t>> &modified_globals)
+{
+    const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+    const std::vector<koopa_raw_basic_block_t> &rpo = dom_tree.rpo();
+    if (rpo.empty())
+    {
+        return 0;
+    }
+
+    // 可用值的前向数据流, 汇合处取交集; 还没有计算过的前驱 (回边) 视为全集, 迭代到不动点
+    std::unordered_map<koopa_raw_basic_block_t, AvailableValues> available_at_end;
+    auto available_at_start = [&](koopa_raw_basic_block_t bb)
+    {
+        AvailableValues available;
+        if (bb == rpo[0])
+        {
+            return available;
+        }
+        bool first = true;
+        for (auto pred : dom_tree.predecessors(bb))
+        {
+            auto it = available_at_end.find(pred);
+            if (it == available_at_end.end())
+            {
+                continue;
+            }
+            if (first)
+            {
+                available = it->second;
+                first = false;
+            }
+            else
+            {
+                intersect(available, it->second);
+            }
+        }
+        return available;
+    };
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto bb : rpo)
+        {
+            AvailableValues available = available_at_start(bb);
+            transfer(bb, available, modified_globals, nullptr);
+            auto it = available_at_end.find(bb);
+            if (it == available_at_end.end() || it->second != available)
+            {
+                available_at_end[bb] = std::move(available);
+                changed = true;
+            }
+        }
+    }
+
+    // 所有路径上都可用的值在每条路径上都定义过, 所以它支配这个 load, 可以直接替换
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replacement;
+    for (auto bb : rpo)
+    {
+        AvailableValues available = available_at_start(bb);
+        transfer(bb, available, modified_globals, &replacement);
+    }
+    if (replacement.empty())
+    {
+        return 0;
+    }
+    for (auto bb : rpo)
+    {
+        std::vector<koopa_raw_value_t> kept;
+        for (auto inst : get_insts(bb))
+        {
+            if (!replacement.count(inst))
+            {
+                kept.push_back(inst);
+            }
+        }
+        set_insts(bb, kept);
+    }
+    replace_uses_with_map(func, replacement);
+    return replacement.size();
+}
+
+int eliminate_redundant_loads(koopa_raw_program_t &program)
+{
+    auto modified_globals = compute_modified_globals(program);
+    int eliminated = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            eliminated += eliminate_redundant_loads(func, modified_globals);
+        }
+    }
+    return eliminated;
+}
@@ -0,0 +1,221 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 循环头中最多复制多少条指令 (不算 alloc)
+static const size_t max_rotated_header_size = 16;
+
+// 新建的 alloc 的数量, 用于给 alloc 起唯一的名字
+static int rotate_slot_counter = 0;
+
+// 循环头中定义, 但在循环头之外使用的值, 先降级为内存中的变量, 这样复制循环头之后两份定义都能被后面的使用看到, 之后由 mem2reg 重新提升
+static void demote_escaping_values(koopa_raw_function_t func, koopa_raw_basic_block_t header)
+{
+    std::vector<koopa_raw_value_t> header_insts = get_insts(header);
+    std::unordered_set<koopa_raw_value_t> defined;
+    for (auto inst : header_insts)
+    {
+        if (inst->kind.tag != KOOPA_RVT_ALLOC)
+        {
+            defined.insert(inst);
+        }
+    }
+
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> slots;
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    for (auto bb : bbs)
+    {
+        if (bb == header)
+        {
+            continue;
+        }
+        std::vector<koopa_raw_value_t> insts;
+        bool changed = false;
+        for (auto inst : get_insts(bb))
+        {
+            for (auto operand : get_operands(inst))
+            {
+                if (!defined.count(operand))
+                {
+                    continue;
+                }
+                if (!slots.count(operand))
+                {
+                    slots[operand] = ir_builder.new_alloc("@rotate_slot_" + std::to_string(rotate_slot_counter++));
+                }
+                koopa_raw_value_t load = ir_builder.new_load(slots[operand]);
+                insts.push_back(load);
+                replace_operand(inst, operand, load);
+                changed = true;
+            }
+            insts.push_back(inst);
+        }
+        if (changed)
+        {
+            set_insts(bb, insts);
+        }
+    }
+    if (slots.empty())
+    {
+        return;
+    }
+
+    // 定义之后立刻存到 alloc 中
+    std::vector<koopa_raw_value_t> insts;
+    for (auto inst : header_insts)
+    {
+        insts.push_back(inst);
+        auto it = slots.find(inst);
+        if (it != slots.end())
+        {
+            insts.push_back(ir_builder.new_store(inst, it->second));
+        }
+    }
+    set_insts(header, insts);
+
+    // alloc 放在 entry 的开头
+    std::vector<koopa_raw_value_t> entry_insts;
+    for (auto &item : slots)
+    {
+        entry_insts.push_back(item.second);
+    }
+    std::vector<koopa_raw_value_t> old_entry_insts = get_insts(bbs[0]);
+    entry_insts.insert(entry_insts.end(), old_entry_insts.begin(), old_entry_insts.end());
+    set_insts(bbs[0], entry_insts);
+}
+
+// 旋转一个循环: 循环头的条件判断复制到每个以 jump 跳回循环头的 latch (包括 continue) 的末尾, 原来的循环头只在进入循环时执行一次
+static bool rotate_loop(koopa_raw_function_t func, const Loop &loop)
+{
+    koopa_raw_basic_block_t header = loop.header;
+    if (header == get_basic_blocks(func)[0] || header->params.len > 0)
+    {
+        return false;
+    }
+    if (get_terminator(header)->kind.tag != KOOPA_RVT_BRANCH)
+    {
+        return false;
+    }
+    size_t size = 0;
+    for (auto inst : get_insts(header))
+    {
+        if (inst->kind.tag == KOOPA_RVT_CALL)
+        {
+            return false;
+        }
+        size += inst->kind.tag != KOOPA_RVT_ALLOC;
+    }
+    if (size > max_rotated_header_size)
+    {
+        return false;
+    }
+    std::vector<koopa_raw_basic_block_t> latches;
+    for (auto latch : loop.latches)
+    {
+        if (get_terminator(latch)->kind.tag == KOOPA_RVT_JUMP)
+        {
+            latches.push_back(latch);
+        }
+    }
+    if (latches.empty())
+    {
+        return false;
+    }
+
+    demote_escaping_values(func, header);
+    std::vector<koopa_raw_value_t> header_insts = get_insts(header);
+    for (auto latch : latches)
+    {
+        std::vector<koopa_raw_value_t> insts = get_insts(latch);
+        insts.pop_back();
+        // alloc 不复制, 副本中对它的使用仍然指向原来的 alloc
+        std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+        for (auto inst : header_insts)
+        {
+            if (inst->kind.tag == KOOPA_RVT_ALLOC)
+            {
+                continue;
+            }
+            koopa_raw_value_t cloned = ir_builder.clone_value(inst, nullptr);
+            for (auto operand : get_operands(inst))
+            {
+                auto it = value_map.find(operand);
+                if (it != value_map.end())
+                {
+                    replace_operand(cloned, operand, it->second);
+                }
+            }
+            value_map[inst] = cloned;
+            insts.push_back(cloned);
+        }
+        set_insts(latch, insts);
+    }
+    return true;
+}
+
+// 对一个函数做循环旋转, 返回旋转的循环数量
+static int rotate_loops(koopa_raw_function_t func)
+{
+    remove_unreachable_blocks(func);
+    for (auto bb : get_basic_blocks(func))
+    {
+        // 需要在 mem2reg 之前运行, 这时还没有基本块参数
+        if (bb->params.len > 0)
+        {
+            return 0;
+        }
+    }
+
+    // 旋转一个循环之后控制流改变, 重新计算循环; 每个原来的循环头只处理一次
+    std::unordered_set<koopa_raw_basic_block_t> candidates;
+    {
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            candidates.insert(loop->header);
+        }
+    }
+    int rotated = 0;
+    bool changed = true;
+    while (changed && !candidates.empty())
+    {
+        changed = false;
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            if (!candidates.count(loop->header))
+            {
+                continue;
+            }
+            candidates.erase(loop->header);
+            if (rotate_loop(func, *loop))
+            {
+                ++rotated;
+                changed = true;
+                break;
+            }
+        }
+        if (changed)
+        {
+            analysis_manager.invalidate(func);
+        }
+    }
+    return rotated;
+}
+
+int rotate_loops(koopa_raw_program_t &program)
+{
+    int rotated = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            rotated += rotate_loops(func);
+        }
+    }
+    return rotated;
+}
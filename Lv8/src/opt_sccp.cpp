@@ -0,0 +1,425 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    /**
+     * @brief SCCP 的格, 每个值从 UNDEFINED 开始, 只能向下变成 CONSTANT 再变成 OVERDEFINED
+     * @date 2026-10-18
+     */
+    struct LatticeValue
+    {
+        enum class State
+        {
+            UNDEFINED,  // 还没有被证明可以取任何值
+            CONSTANT,   // 总是等于 constant
+            OVERDEFINED // 可能取不同的值
+        };
+        State state = State::UNDEFINED;
+        int constant = 0;
+    };
+
+    /**
+     * @brief 单个函数的稀疏条件常量传播 (Wegman-Zadeck)
+     * @note 控制流边和 SSA 边各有一个工作表, 只有可执行的边才参与基本块参数的计算, 条件为常量的分支只有一条边可执行
+     * @date 2026-10-18
+     */
+    class SCCPSolver
+    {
+    private:
+        koopa_raw_function_t func;
+
+        // 从来没有被 store 过的全局变量, 读它总是得到初始值
+        const std::unordered_map<koopa_raw_value_t, int> &constant_globals;
+
+        std::unordered_map<koopa_raw_value_t, LatticeValue> lattice;
+
+        // 每个值的使用者, 以及每条指令所在的基本块
+        std::unordered_map<koopa_raw_value_t, std::vector<koopa_raw_value_t>> users;
+        std::unordered_map<koopa_raw_value_t, koopa_raw_basic_block_t> inst_block;
+
+        // 每个基本块的入边, (前驱, 这条边是前驱 terminator 的第几个后继)
+        std::unordered_map<koopa_raw_basic_block_t, std::vector<std::pair<koopa_raw_basic_block_t, size_t>>> in_edges;
+
+        std::unordered_set<koopa_raw_basic_block_t> executable_blocks;
+        std::unordered_set<koopa_raw_value_t> executable_edges_by_terminator[2];
+
+        std::vector<std::pair<koopa_raw_basic_block_t, size_t>> edge_worklist;
+        std::vector<koopa_raw_value_t> value_worklist;
+
+        bool is_edge_executable(koopa_raw_basic_block_t pred, size_t index) const
+        {
+            return executable_edges_by_terminator[index].count(get_terminator(pred)) > 0;
+        }
+
+        void mark_overdefined(koopa_raw_value_t value)
+        {
+            LatticeValue &lv = lattice[value];
+            if (lv.state != LatticeValue::State::OVERDEFINED)
+            {
+                lv.state = LatticeValue::State::OVERDEFINED;
+                value_worklist.push_back(value);
+            }
+        }
+
+        void mark_constant(koopa_raw_value_t value, int constant)
+        {
+            LatticeValue &lv = lattice[value];
+            if (lv.state == LatticeValue::State::UNDEFINED)
+            {
+                lv.state = LatticeValue::State::CONSTANT;
+                lv.constant = constant;
+                value_worklist.push_back(value);
+            }
+            else if (lv.state == LatticeValue::State::CONSTANT && lv.constant != constant)
+            {
+                mark_overdefined(value);
+            }
+        }
+
+        void merge(koopa_raw_value_t value, const LatticeValue &incoming)
+        {
+            if (incoming.state == LatticeValue::State::CONSTANT)
+            {
+                mark_constant(value, incoming.constant);
+            }
+            else if (incoming.state == LatticeValue::State::OVERDEFINED)
+            {
+                mark_overdefined(value);
+            }
+        }
+
+        void add_edge(koopa_raw_basic_block_t bb, size_t index)
+        {
+            if (executable_edges_by_terminator[index].insert(get_terminator(bb)).second)
+            {
+                edge_worklist.push_back({bb, index});
+            }
+        }
+
+        // 根据所有可执行的入边重新计算基本块参数
+        void visit_block_params(koopa_raw_basic_block_t bb)
+        {
+            std::vector<koopa_raw_value_t> params = get_values(bb->params);
+            for (auto &edge : in_edges[bb])
+            {
+                if (!is_edge_executable(edge.first, edge.second))
+                {
+                    continue;
+                }
+                std::vector<koopa_raw_value_t> args = get_successor_args(get_terminator(edge.first), edge.second);
+                for (size_t i = 0; i < params.size() && i < args.size(); ++i)
+                {
+                    merge(params[i], get(args[i]));
+                }
+            }
+        }
+
+        void visit_inst(koopa_raw_value_t inst)
+        {
+            const auto &kind = inst->kind;
+            switch (kind.tag)
+            {
+            case KOOPA_RVT_BINARY:
+            {
+                LatticeValue lhs = get(kind.data.binary.lhs);
+                LatticeValue rhs = get(kind.data.binary.rhs);
+                if (lhs.state == LatticeValue::State::OVERDEFINED || rhs.state == LatticeValue::State::OVERDEFINED)
+                {
+                    mark_overdefined(inst);
+                }
+                else if (lhs.state == LatticeValue::State::CONSTANT && rhs.state == LatticeValue::State::CONSTANT)
+                {
+                    int result;
+                    if (fold_binary(kind.data.binary.op, lhs.constant, rhs.constant, result))
+                    {
+                        mark_constant(inst, result);
+                    }
+                    else
+                    {
+                        mark_overdefined(inst);
+                    }
+                }
+                break;
+            }
+            case KOOPA_RVT_LOAD:
+            {
+                auto it = constant_globals.find(kind.data.load.src);
+                if (it != constant_globals.end())
+                {
+                    mark_constant(inst, it->second);
+                }
+                else
+                {
+                    mark_overdefined(inst);
+                }
+                break;
+            }
+            case KOOPA_RVT_BRANCH:
+            {
+                LatticeValue cond = get(kind.data.branch.cond);
+                if (cond.state == LatticeValue::State::OVERDEFINED)
+                {
+                    add_edge(inst_block[inst], 0);
+                    add_edge(inst_block[inst], 1);
+                }
+                else if (cond.state == LatticeValue::State::CONSTANT)
+                {
+                    add_edge(inst_block[inst], cond.constant != 0 ? 0 : 1);
+                }
+                break;
+            }
+            case KOOPA_RVT_JUMP:
+                add_edge(inst_block[inst], 0);
+                break;
+            case KOOPA_RVT_STORE:
+            case KOOPA_RVT_RETURN:
+            case KOOPA_RVT_ALLOC:
+                break;
+            default:
+                // call 等其他有返回值的指令都无法确定
+                if (inst->ty->tag != KOOPA_RTT_UNIT)
+                {
+                    mark_overdefined(inst);
+                }
+                break;
+            }
+            // 跳转参数的值变化时, 需要重新计算可执行的后继的参数
+            if (is_terminator(inst))
+            {
+                std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(inst);
+                for (size_t k = 0; k < succs.size(); ++k)
+                {
+                    if (executable_edges_by_terminator[k].count(inst))
+                    {
+                        visit_block_params(succs[k]);
+                    }
+                }
+            }
+        }
+
+    public:
+        SCCPSolver(koopa_raw_function_t func, const std::unordered_map<koopa_raw_value_t, int> &constant_globals)
+            : func(func), constant_globals(constant_globals)
+        {
+            for (auto bb : get_basic_blocks(func))
+            {
+                for (auto inst : get_insts(bb))
+                {
+                    inst_block[inst] = bb;
+                    for (auto operand : get_operands(inst))
+                    {
+                        users[operand].push_back(inst);
+                    }
+                }
+                koopa_raw_value_t terminator = get_terminator(bb);
+                if (terminator)
+                {
+                    std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+                    for (size_t k = 0; k < succs.size(); ++k)
+                    {
+                        in_edges[succs[k]].push_back({bb, k});
+                    }
+                }
+            }
+            for (auto param : get_values(func->params))
+            {
+                lattice[param].state = LatticeValue::State::OVERDEFINED;
+            }
+        }
+
+        // 查询一个值的格
+        LatticeValue get(koopa_raw_value_t value)
+        {
+            if (value->kind.tag == KOOPA_RVT_INTEGER)
+            {
+                LatticeValue lv;
+                lv.state = LatticeValue::State::CONSTANT;
+                lv.constant = value->kind.data.integer.value;
+                return lv;
+            }
+            if (value->kind.tag == KOOPA_RVT_UNDEF)
+            {
+                return LatticeValue();
+            }
+            auto it = lattice.find(value);
+            return it == lattice.end() ? LatticeValue() : it->second;
+        }
+
+        bool is_block_executable(koopa_raw_basic_block_t bb) const
+        {
+            return executable_blocks.count(bb) > 0;
+        }
+
+        // branch 的第 index 条边是否可执行
+        bool is_branch_edge_executable(koopa_raw_value_t branch, size_t index) const
+        {
+            return executable_edges_by_terminator[index].count(branch) > 0;
+        }
+
+        void solve()
+        {
+            std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+            auto visit_block = [&](koopa_raw_basic_block_t bb)
+            {
+                if (!executable_blocks.insert(bb).second)
+                {
+                    // 已经访问过了, 只有新的入边可能改变参数
+                    visit_block_params(bb);
+                    return;
+                }
+                visit_block_params(bb);
+                for (auto inst : get_insts(bb))
+                {
+                    visit_inst(inst);
+                }
+            };
+            visit_block(bbs[0]);
+            while (!edge_worklist.empty() || !value_worklist.empty())
+            {
+                while (!value_worklist.empty())
+                {
+                    koopa_raw_value_t value = value_worklist.back();
+                    value_worklist.pop_back();
+                    for (auto user : users[value])
+                    {
+                        if (executable_blocks.count(inst_block[user]))
+                        {
+                            visit_inst(user);
+                        }
+                    }
+                }
+                if (!edge_worklist.empty())
+                {
+                    auto edge = edge_worklist.back();
+                    edge_worklist.pop_back();
+                    visit_block(get_successors(edge.first)[edge.second]);
+                }
+            }
+        }
+    };
+}
+
+// 对一个函数做 SCCP 并改写, 返回被替换为常量的值和被删除的基本块的数量
+static int sparse_conditional_constant_propagation(koopa_raw_function_t func, const std::unordered_map<koopa_raw_value_t, int> &constant_globals)
+{
+    SCCPSolver solver(func, constant_globals);
+    solver.solve();
+
+    int changed = 0;
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replacement;
+    auto constant_of = [&](koopa_raw_value_t value, koopa_raw_value_t &constant)
+    {
+        LatticeValue lv = solver.get(value);
+        if (lv.state != LatticeValue::State::CONSTANT)
+        {
+            return false;
+        }
+        constant = ir_builder.new_integer(lv.constant);
+        return true;
+    };
+
+    std::vector<koopa_raw_basic_block_t> kept_bbs;
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (!solver.is_block_executable(bb))
+        {
+            changed++;
+            continue;
+        }
+        kept_bbs.push_back(bb);
+        for (auto param : get_values(bb->params))
+        {
+            koopa_raw_value_t constant;
+            if (constant_of(param, constant))
+            {
+                replacement[param] = constant;
+                changed++;
+            }
+        }
+        std::vector<koopa_raw_value_t> kept_insts;
+        for (auto inst : get_insts(bb))
+        {
+            koopa_raw_value_t constant;
+            // 常量的 binary 和 load 没有副作用, 可以直接删掉
+            if ((inst->kind.tag == KOOPA_RVT_BINARY || inst->kind.tag == KOOPA_RVT_LOAD) && constant_of(inst, constant))
+            {
+                replacement[inst] = constant;
+                changed++;
+                continue;
+            }
+            // 只有一条边可执行的分支改为 jump
+            if (inst->kind.tag == KOOPA_RVT_BRANCH)
+            {
+                bool true_executable = solver.is_branch_edge_executable(inst, 0);
+                bool false_executable = solver.is_branch_edge_executable(inst, 1);
+                if (true_executable != false_executable)
+                {
+                    size_t index = true_executable ? 0 : 1;
+                    koopa_raw_value_t jump = ir_builder.new_jump(get_successors_of_terminator(inst)[index]);
+                    set_successor_args(jump, 0, get_successor_args(inst, index));
+                    kept_insts.push_back(jump);
+                    analysis_manager.invalidate(func);
+                    changed++;
+                    continue;
+                }
+            }
+            kept_insts.push_back(inst);
+        }
+        set_insts(bb, kept_insts);
+    }
+    set_basic_blocks(func, kept_bbs);
+    replace_uses_with_map(func, replacement);
+    return changed;
+}
+
+int sparse_conditional_constant_propagation(koopa_raw_program_t &program)
+{
+    // 从来没有被 store 过的全局变量相当于常量, 比如只在定义时初始化的配置变量
+    std::unordered_set<koopa_raw_value_t> stored_globals;
+    for (auto func : get_functions(program))
+    {
+        for (auto bb : get_basic_blocks(func))
+        {
+            for (auto inst : get_insts(bb))
+            {
+                if (inst->kind.tag == KOOPA_RVT_STORE)
+                {
+                    stored_globals.insert(inst->kind.data.store.dest);
+                }
+            }
+        }
+    }
+    std::unordered_map<koopa_raw_value_t, int> constant_globals;
+    for (auto global : get_values(program.values))
+    {
+        if (global->kind.tag != KOOPA_RVT_GLOBAL_ALLOC || stored_globals.count(global))
+        {
+            continue;
+        }
+        auto init = global->kind.data.global_alloc.init;
+        if (init->kind.tag == KOOPA_RVT_INTEGER)
+        {
+            constant_globals[global] = init->kind.data.integer.value;
+        }
+        else if (init->kind.tag == KOOPA_RVT_ZERO_INIT && init->ty->tag == KOOPA_RTT_INT32)
+        {
+            constant_globals[global] = 0;
+        }
+    }
+
+    int changed = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            changed += sparse_conditional_constant_propagation(func, constant_globals);
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,571 @@
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 新建的基本块和参数的数量, 用于起唯一的名字
+static int scev_counter = 0;
+
+namespace
+{
+    /**
+     * @brief 循环中的值关于归纳变量的多项式表示 c * iv * iv + a * iv + b, 最高二次, 系数都是常数, 按照 32 位回绕计算
+     * @date 2026-10-18
+     */
+    struct Polynomial
+    {
+        uint32_t c = 0;
+        uint32_t a = 0;
+        uint32_t b = 0;
+
+        // 累加变量自身的系数, 累加的表达式形如 s + c * iv * iv + a * iv + b
+        uint32_t s = 0;
+
+        // 是否含有归纳变量或者累加变量
+        bool is_constant() const
+        {
+            return c == 0 && a == 0 && s == 0;
+        }
+    };
+
+    /**
+     * @brief 生成指令的辅助类, 两边都是立即数时直接折叠, 乘 0, 乘 1 和加 0 直接化简
+     * @date 2026-10-18
+     */
+    class Emitter
+    {
+    private:
+        std::vector<koopa_raw_value_t> &_insts;
+
+    public:
+        Emitter(std::vector<koopa_raw_value_t> &insts) : _insts(insts) {}
+
+        koopa_raw_value_t integer(uint32_t value)
+        {
+            return ir_builder.new_integer((int32_t)value);
+        }
+
+        koopa_raw_value_t emit(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs)
+        {
+            int result;
+            if (is_integer(lhs) && is_integer(rhs) && fold_binary(op, lhs->kind.data.integer.value, rhs->kind.data.integer.value, result))
+            {
+                return ir_builder.new_integer(result);
+            }
+            auto is_constant = [](koopa_raw_value_t value, int constant)
+            {
+                return is_integer(value) && value->kind.data.integer.value == constant;
+            };
+            if ((op == KOOPA_RBO_ADD || op == KOOPA_RBO_SUB) && is_constant(rhs, 0))
+            {
+                return lhs;
+            }
+            if (op == KOOPA_RBO_ADD && is_constant(lhs, 0))
+            {
+                return rhs;
+            }
+            if (op == KOOPA_RBO_MUL && (is_constant(lhs, 0) || is_constant(rhs, 0)))
+            {
+                return integer(0);
+            }
+            if (op == KOOPA_RBO_MUL && is_constant(rhs, 1))
+            {
+                return lhs;
+            }
+            if (op == KOOPA_RBO_MUL && is_constant(lhs, 1))
+            {
+                return rhs;
+            }
+            koopa_raw_value_t binary = ir_builder.new_binary(op, lhs, rhs);
+            _insts.push_back(binary);
+            return binary;
+        }
+    };
+}
+
+// 求 value 关于归纳变量和累加变量 accumulator 的多项式表示, 只认识它们, 立即数, 以及它们的加减乘; 累加变量只能乘常数, 归纳变量最高二次
+static bool as_polynomial(koopa_raw_value_t value, const CountedLoop &counted, koopa_raw_value_t accumulator, Polynomial &poly, int depth = 0)
+{
+    poly = Polynomial();
+    if (is_integer(value))
+    {
+        poly.b = value->kind.data.integer.value;
+        return true;
+    }
+    if (value == counted.iv.param)
+    {
+        poly.a = 1;
+        return true;
+    }
+    if (value == accumulator)
+    {
+        poly.s = 1;
+        return true;
+    }
+    if (depth > 16 || value->kind.tag != KOOPA_RVT_BINARY || !counted.defined.count(value))
+    {
+        return false;
+    }
+    const auto &binary = value->kind.data.binary;
+    Polynomial lhs, rhs;
+    if (!as_polynomial(binary.lhs, counted, accumulator, lhs, depth + 1) || !as_polynomial(binary.rhs, counted, accumulator, rhs, depth + 1))
+    {
+        return false;
+    }
+    switch (binary.op)
+    {
+    case KOOPA_RBO_ADD:
+        poly = {lhs.c + rhs.c, lhs.a + rhs.a, lhs.b + rhs.b, lhs.s + rhs.s};
+        return true;
+    case KOOPA_RBO_SUB:
+        poly = {lhs.c - rhs.c, lhs.a - rhs.a, lhs.b - rhs.b, lhs.s - rhs.s};
+        return true;
+    case KOOPA_RBO_MUL:
+        // 一边是常数, 或者两边都是归纳变量的一次式 (得到二次式)
+        if (!lhs.is_constant() && !rhs.is_constant() && (lhs.c != 0 || lhs.s != 0 || rhs.c != 0 || rhs.s != 0))
+        {
+            return false;
+        }
+        poly = {lhs.c * rhs.b + rhs.c * lhs.b + lhs.a * rhs.a, lhs.a * rhs.b + rhs.a * lhs.b, lhs.b * rhs.b, lhs.s * rhs.b + rhs.s * lhs.b};
+        return true;
+    default:
+        return false;
+    }
+}
+
+// 一个循环头参数在循环结束时的值
+struct ClosedForm
+{
+    enum class Kind
+    {
+        INDUCTION,   // 控制循环次数的归纳变量
+        ACCUMULATOR, // s = s + c * iv * iv + a * iv + b
+        UNCHANGED,   // 每次都传回自己
+        INVARIANT,   // 每次都传回同一个循环外的值
+    };
+    Kind kind = Kind::UNCHANGED;
+    Polynomial increment;
+};
+
+// 如果循环只是在累加归纳变量的多项式, 把整个循环替换为闭式, 返回是否替换
+static bool replace_with_closed_form(koopa_raw_function_t func, const CountedLoop &counted, const DominatorTree &dom_tree)
+{
+    if (counted.iv.step != 1 && counted.iv.step != -1)
+    {
+        return false;
+    }
+    for (auto bb : counted.blocks)
+    {
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag == KOOPA_RVT_STORE || inst->kind.tag == KOOPA_RVT_CALL)
+            {
+                return false;
+            }
+        }
+    }
+
+    koopa_raw_basic_block_t header = counted.loop->header;
+    std::vector<koopa_raw_value_t> params = get_values(header->params);
+    std::vector<ClosedForm> forms(params.size());
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        koopa_raw_value_t next = counted.back_args[i];
+        ClosedForm &form = forms[i];
+        if (i == counted.iv.index)
+        {
+            form.kind = ClosedForm::Kind::INDUCTION;
+            continue;
+        }
+        if (next == params[i])
+        {
+            form.kind = ClosedForm::Kind::UNCHANGED;
+            continue;
+        }
+        if (!counted.defined.count(next))
+        {
+            form.kind = ClosedForm::Kind::INVARIANT;
+            continue;
+        }
+        // 每次迭代 s = s + c * iv * iv + a * iv + b
+        if (!as_polynomial(next, counted, params[i], form.increment) || form.increment.s != 1)
+        {
+            return false;
+        }
+        form.kind = ClosedForm::Kind::ACCUMULATOR;
+    }
+
+    // 新的基本块接收原来循环头的参数, 计算循环次数和每个参数最后的值, 然后跳到出口
+    std::string prefix = "scev_" + std::to_string(scev_counter++) + "_";
+    koopa_raw_basic_block_data_t *closed_bb = ir_builder.new_basic_block("%" + prefix + "closed");
+    std::vector<koopa_raw_value_t> closed_params;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        closed_params.push_back(ir_builder.new_block_arg(i, "%" + prefix + std::to_string(i)));
+    }
+    closed_bb->params = ir_builder.new_slice(std::vector<const void *>(closed_params.begin(), closed_params.end()), KOOPA_RSIK_VALUE);
+
+    std::vector<koopa_raw_value_t> insts;
+    Emitter emitter(insts);
+    koopa_raw_value_t init = closed_params[counted.iv.index];
+    bool increasing = counted.iv.step > 0;
+    bool strict = counted.op == KOOPA_RBO_LT || counted.op == KOOPA_RBO_GT;
+
+    // 循环已经被旋转, 进入循环体时至少执行一次: 次数 = init op bound ? |bound - init| (非严格比较再加 1) : 1
+    koopa_raw_value_t distance = increasing ? emitter.emit(KOOPA_RBO_SUB, counted.bound, init) : emitter.emit(KOOPA_RBO_SUB, init, counted.bound);
+    if (strict)
+    {
+        distance = emitter.emit(KOOPA_RBO_SUB, distance, emitter.integer(1));
+    }
+    koopa_raw_value_t enter = emitter.emit(counted.op, init, counted.bound);
+    koopa_raw_value_t trip_count = emitter.emit(KOOPA_RBO_ADD, emitter.emit(KOOPA_RBO_MUL, distance, enter), emitter.integer(1));
+
+    // 0 + 1 + ... + (T - 1) = T * (T - 1) / 2, 在 32 位回绕下写成 (T >> 1) * ((T - 1) | 1), 两个因子中的偶数已经除以 2
+    koopa_raw_value_t triangle = nullptr;
+    auto get_triangle = [&]()
+    {
+        if (!triangle)
+        {
+            koopa_raw_value_t half = emitter.emit(KOOPA_RBO_SHR, trip_count, emitter.integer(1));
+            koopa_raw_value_t odd = emitter.emit(KOOPA_RBO_OR, emitter.emit(KOOPA_RBO_SUB, trip_count, emitter.integer(1)), emitter.integer(1));
+            triangle = emitter.emit(KOOPA_RBO_MUL, half, odd);
+        }
+        return triangle;
+    };
+
+    // 0^2 + 1^2 + ... + (T - 1)^2 = T * (T - 1) / 2 * (2T - 1) / 3, 整数结果能被 3 整除, 所以除以 3 可以写成乘 3 在模 2^32 下的逆元
+    koopa_raw_value_t square_sum = nullptr;
+    auto get_square_sum = [&]()
+    {
+        if (!square_sum)
+        {
+            koopa_raw_value_t odd = emitter.emit(KOOPA_RBO_SUB, emitter.emit(KOOPA_RBO_MUL, trip_count, emitter.integer(2)), emitter.integer(1));
+            square_sum = emitter.emit(KOOPA_RBO_MUL, emitter.emit(KOOPA_RBO_MUL, get_triangle(), odd), emitter.integer(0xaaaaaaabu));
+        }
+        return square_sum;
+    };
+
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> final_values;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        const ClosedForm &form = forms[i];
+        koopa_raw_value_t final_value = nullptr;
+        switch (form.kind)
+        {
+        case ClosedForm::Kind::INDUCTION:
+            final_value = emitter.emit(increasing ? KOOPA_RBO_ADD : KOOPA_RBO_SUB, init, trip_count);
+            break;
+        case ClosedForm::Kind::UNCHANGED:
+            final_value = closed_params[i];
+            break;
+        case ClosedForm::Kind::INVARIANT:
+            final_value = counted.back_args[i];
+            break;
+        case ClosedForm::Kind::ACCUMULATOR:
+        {
+            // 第 k 次迭代 iv = init + step * k, step * step = 1, 所以
+            // sum(c * iv^2 + a * iv + b) = T * (c * init^2 + a * init + b) + step * (2c * init + a) * sum(k) + c * sum(k^2)
+            const Polynomial &e = form.increment;
+            uint32_t step = (uint32_t)counted.iv.step;
+            koopa_raw_value_t first = emitter.emit(KOOPA_RBO_ADD, emitter.emit(KOOPA_RBO_MUL, init, emitter.integer(e.a)), emitter.integer(e.b));
+            if (e.c != 0)
+            {
+                koopa_raw_value_t square = emitter.emit(KOOPA_RBO_MUL, init, init);
+                first = emitter.emit(KOOPA_RBO_ADD, first, emitter.emit(KOOPA_RBO_MUL, square, emitter.integer(e.c)));
+            }
+            koopa_raw_value_t sum = emitter.emit(KOOPA_RBO_MUL, trip_count, first);
+            koopa_raw_value_t slope = emitter.emit(KOOPA_RBO_ADD, emitter.emit(KOOPA_RBO_MUL, init, emitter.integer(2 * e.c * step)), emitter.integer(e.a * step));
+            if (!is_integer(slope) || slope->kind.data.integer.value != 0)
+            {
+                sum = emitter.emit(KOOPA_RBO_ADD, sum, emitter.emit(KOOPA_RBO_MUL, get_triangle(), slope));
+            }
+            if (e.c != 0)
+            {
+                sum = emitter.emit(KOOPA_RBO_ADD, sum, emitter.emit(KOOPA_RBO_MUL, get_square_sum(), emitter.integer(e.c)));
+            }
+            final_value = emitter.emit(KOOPA_RBO_ADD, closed_params[i], sum);
+            break;
+        }
+        }
+        final_values[counted.back_args[i]] = final_value;
+    }
+
+    std::vector<koopa_raw_value_t> exit_args;
+    for (auto arg : counted.exit_args)
+    {
+        auto it = final_values.find(arg);
+        exit_args.push_back(it == final_values.end() ? arg : it->second);
+    }
+    koopa_raw_value_t jump = ir_builder.new_jump(counted.exit);
+    set_successor_args(jump, 0, exit_args);
+    insts.push_back(jump);
+    set_insts(closed_bb, insts);
+
+    // 循环外的前驱改为跳到新的基本块, 原来的循环变成不可达的; 有 profile 时新的基本块的计数是进入循环的次数
+    std::vector<koopa_raw_basic_block_t> outside_preds;
+    for (auto pred : dom_tree.predecessors(header))
+    {
+        if (!counted.loop->contains(pred))
+        {
+            outside_preds.push_back(pred);
+        }
+    }
+    long long entry_count = estimate_entry_count(func, header, outside_preds);
+    if (entry_count >= 0)
+    {
+        profile_manager.set_count(ProfileManager::block_key(func->name + 1, closed_bb->name + 1), entry_count);
+    }
+    for (auto pred : outside_preds)
+    {
+        koopa_raw_value_t terminator = get_terminator(pred);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            if (succs[k] == header)
+            {
+                set_successor(terminator, k, closed_bb);
+            }
+        }
+    }
+    std::vector<koopa_raw_basic_block_t> bbs;
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (bb == header)
+        {
+            bbs.push_back(closed_bb);
+        }
+        bbs.push_back(bb);
+    }
+    set_basic_blocks(func, bbs);
+    remove_unreachable_blocks(func);
+    return true;
+}
+
+// 对一个函数中的计数循环做闭式替换, 返回替换的循环数量
+static int replace_loops_with_closed_forms(koopa_raw_function_t func)
+{
+    remove_unreachable_blocks(func);
+    int replaced = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            CountedLoop counted;
+            if (analyze_counted_loop(func, *loop, loop_info, dom_tree, counted) && replace_with_closed_form(func, counted, dom_tree))
+            {
+                ++replaced;
+                changed = true;
+                break;
+            }
+        }
+        if (changed)
+        {
+            analysis_manager.invalidate(func);
+        }
+    }
+    return replaced;
+}
+
+int replace_loops_with_closed_forms(koopa_raw_program_t &program)
+{
+    int replaced = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            replaced += replace_loops_with_closed_forms(func);
+        }
+    }
+    return replaced;
+}
+
+// 是否是 2 的幂, 这样的乘法可以直接变成移位, 不需要强度削减
+static bool is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+// 在基本块的结尾 (terminator 前面) 插入指令
+static void insert_before_terminator(koopa_raw_basic_block_t bb, koopa_raw_value_t inst)
+{
+    std::vector<koopa_raw_value_t> insts = get_insts(bb);
+    insts.insert(insts.end() - 1, inst);
+    set_insts(bb, insts);
+}
+
+// 对一个循环做归纳变量的强度削减, 把 iv * k 换成每次迭代加上 step * k 的新参数, 返回削减的乘法数量
+static int strength_reduce_loop(koopa_raw_function_t func, const Loop &loop, const DominatorTree &dom_tree)
+{
+    std::vector<InductionVariable> ivs = find_induction_variables(loop);
+    if (ivs.empty())
+    {
+        return 0;
+    }
+    std::unordered_set<koopa_raw_value_t> defined;
+    for (auto bb : loop.blocks)
+    {
+        for (auto param : get_values(bb->params))
+        {
+            defined.insert(param);
+        }
+        for (auto inst : get_insts(bb))
+        {
+            defined.insert(inst);
+        }
+    }
+
+    // (归纳变量, 乘数) -> 所有这样的乘法, 按照第一次出现的顺序排列
+    std::vector<std::pair<std::pair<size_t, koopa_raw_value_t>, std::vector<koopa_raw_value_t>>> groups;
+    std::map<std::pair<size_t, koopa_raw_value_t>, size_t> group_index;
+    std::unordered_map<int, koopa_raw_value_t> constant_factors;
+    for (auto bb : dom_tree.rpo())
+    {
+        if (!loop.contains(bb))
+        {
+            continue;
+        }
+        for (auto inst : get_insts(bb))
+        {
+            if (inst->kind.tag != KOOPA_RVT_BINARY || inst->kind.data.binary.op != KOOPA_RBO_MUL)
+            {
+                continue;
+            }
+            for (size_t k = 0; k < ivs.size(); ++k)
+            {
+                koopa_raw_value_t lhs = inst->kind.data.binary.lhs;
+                koopa_raw_value_t rhs = inst->kind.data.binary.rhs;
+                if (rhs == ivs[k].param)
+                {
+                    std::swap(lhs, rhs);
+                }
+                if (lhs != ivs[k].param)
+                {
+                    continue;
+                }
+                // 乘常数时除了 0, 1 和 2 的幂都削减; 乘循环不变量时只有步长为 ±1 才能不用乘法算出新的步长
+                if (is_integer(rhs))
+                {
+                    int factor = rhs->kind.data.integer.value;
+                    if (factor == 0 || factor == -1 || is_power_of_two(factor))
+                    {
+                        continue;
+                    }
+                    // 相同的立即数合并成一组
+                    if (!constant_factors.count(factor))
+                    {
+                        constant_factors[factor] = rhs;
+                    }
+                    rhs = constant_factors[factor];
+                }
+                else if (defined.count(rhs) || (ivs[k].step != 1 && ivs[k].step != -1))
+                {
+                    continue;
+                }
+                auto key = std::make_pair(k, rhs);
+                if (!group_index.count(key))
+                {
+                    group_index[key] = groups.size();
+                    groups.push_back({key, {}});
+                }
+                groups[group_index[key]].second.push_back(inst);
+                break;
+            }
+        }
+    }
+
+    int reduced = 0;
+    koopa_raw_basic_block_t header = loop.header;
+    for (auto &group : groups)
+    {
+        const InductionVariable &iv = ivs[group.first.first];
+        koopa_raw_value_t factor = group.first.second;
+
+        // 新的参数接在循环头已有的参数后面
+        std::vector<koopa_raw_value_t> params = get_values(header->params);
+        koopa_raw_value_t product = ir_builder.new_block_arg(params.size(), "%scev_" + std::to_string(scev_counter++));
+        params.push_back(product);
+        as_mutable(header)->params = ir_builder.new_slice(std::vector<const void *>(params.begin(), params.end()), KOOPA_RSIK_VALUE);
+
+        for (auto pred : dom_tree.predecessors(header))
+        {
+            koopa_raw_value_t terminator = get_terminator(pred);
+            std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+            for (size_t k = 0; k < succs.size(); ++k)
+            {
+                if (succs[k] != header)
+                {
+                    continue;
+                }
+                std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+                koopa_raw_value_t value;
+                if (loop.contains(pred))
+                {
+                    // 回边: product + step * factor
+                    if (is_integer(factor))
+                    {
+                        value = ir_builder.new_binary(KOOPA_RBO_ADD, product, ir_builder.new_integer((int32_t)((uint32_t)iv.step * (uint32_t)factor->kind.data.integer.value)));
+                    }
+                    else
+                    {
+                        value = ir_builder.new_binary(iv.step > 0 ? KOOPA_RBO_ADD : KOOPA_RBO_SUB, product, factor);
+                    }
+                    insert_before_terminator(pred, value);
+                }
+                else
+                {
+                    // 进入循环: init * factor, 乘数在循环外定义, 支配循环外的前驱
+                    koopa_raw_value_t init = args[iv.index];
+                    int result;
+                    if (is_integer(init) && is_integer(factor) && fold_binary(KOOPA_RBO_MUL, init->kind.data.integer.value, factor->kind.data.integer.value, result))
+                    {
+                        value = ir_builder.new_integer(result);
+                    }
+                    else
+                    {
+                        value = ir_builder.new_binary(KOOPA_RBO_MUL, init, factor);
+                        insert_before_terminator(pred, value);
+                    }
+                }
+                args.push_back(value);
+                set_successor_args(terminator, k, args);
+            }
+        }
+        // 乘法的结果和新参数在每次迭代中都相等, 新参数在循环头定义, 支配乘法的所有使用
+        for (auto mul : group.second)
+        {
+            replace_all_uses(func, mul, product);
+            ++reduced;
+        }
+    }
+    return reduced;
+}
+
+int strength_reduce_induction_variables(koopa_raw_program_t &program)
+{
+    int reduced = 0;
+    for (auto func : get_functions(program))
+    {
+        if (!is_function_defined(func))
+        {
+            continue;
+        }
+        remove_unreachable_blocks(func);
+        // 只添加参数和指令, 不修改控制流, 支配树和循环可以一直使用
+        const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            reduced += strength_reduce_loop(func, *loop, dom_tree);
+        }
+    }
+    return reduced;
+}
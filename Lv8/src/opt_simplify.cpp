@@ -0,0 +1,550 @@
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 一条指令最多连续应用多少次规则, 防止规则之间来回改写
+    const int max_rewrites_per_inst = 8;
+
+    // 判断一个值是否只可能是 0 或 1 时的递归深度上限
+    const int max_boolean_depth = 8;
+
+    bool is_associative(koopa_raw_binary_op_t op)
+    {
+        switch (op)
+        {
+        case KOOPA_RBO_ADD:
+        case KOOPA_RBO_MUL:
+        case KOOPA_RBO_AND:
+        case KOOPA_RBO_OR:
+        case KOOPA_RBO_XOR:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool is_commutative(koopa_raw_binary_op_t op)
+    {
+        return is_associative(op) || op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ;
+    }
+
+    /**
+     * @brief 单个函数的代数化简, 按逆后序访问指令, 操作数总是先于使用者被化简
+     * @note 每一轮开始时计算支配树, 哪些基本块参数是布尔值, 以及每条分支边确定的条件
+     * @date 2026-10-18
+     */
+    class Simplifier
+    {
+    private:
+        koopa_raw_function_t func;
+        const DominatorTree &dom_tree;
+
+        // 每个值被多少条指令使用
+        std::unordered_map<koopa_raw_value_t, int> use_count;
+
+        // 只可能是 0 或 1 的基本块参数
+        std::unordered_set<koopa_raw_value_t> boolean_params;
+
+        // 唯一前驱的分支边确定的值: 进入这个基本块时 value == constant, 在它支配的基本块中都成立
+        std::unordered_map<koopa_raw_basic_block_t, std::vector<std::pair<koopa_raw_value_t, int>>> edge_facts;
+        std::unordered_set<koopa_raw_value_t> fact_values;
+
+        // 被化简掉的指令 -> 代替它的值
+        std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replacement;
+
+        // 重写当前指令时新建的指令, 放在当前指令前面
+        std::vector<koopa_raw_value_t> inserted;
+
+        int changed = 0;
+
+        koopa_raw_value_t resolve(koopa_raw_value_t value) const
+        {
+            auto it = replacement.find(value);
+            while (it != replacement.end())
+            {
+                value = it->second;
+                it = replacement.find(value);
+            }
+            return value;
+        }
+
+        bool is_boolean(koopa_raw_value_t value, int depth = 0) const
+        {
+            if (is_integer(value))
+            {
+                return value->kind.data.integer.value == 0 || value->kind.data.integer.value == 1;
+            }
+            if (value->kind.tag == KOOPA_RVT_BLOCK_ARG_REF)
+            {
+                return boolean_params.count(value) > 0;
+            }
+            if (value->kind.tag != KOOPA_RVT_BINARY || depth > max_boolean_depth)
+            {
+                return false;
+            }
+            const auto &binary = value->kind.data.binary;
+            if (is_comparison(binary.op))
+            {
+                return true;
+            }
+            switch (binary.op)
+            {
+            case KOOPA_RBO_AND:
+                return is_boolean(binary.lhs, depth + 1) || is_boolean(binary.rhs, depth + 1);
+            case KOOPA_RBO_OR:
+            case KOOPA_RBO_XOR:
+                return is_boolean(binary.lhs, depth + 1) && is_boolean(binary.rhs, depth + 1);
+            default:
+                return false;
+            }
+        }
+
+        // 乐观地假设所有基本块参数都是布尔值, 去掉有非布尔实参的, 直到不动点
+        void compute_boolean_params()
+        {
+            std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>> incoming;
+            for (auto bb : dom_tree.rpo())
+            {
+                for (auto param : get_values(bb->params))
+                {
+                    boolean_params.insert(param);
+                }
+                koopa_raw_value_t terminator = get_terminator(bb);
+                std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+                for (size_t k = 0; k < succs.size(); ++k)
+                {
+                    std::vector<koopa_raw_value_t> params = get_values(succs[k]->params);
+                    std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+                    for (size_t i = 0; i < params.size() && i < args.size(); ++i)
+                    {
+                        incoming.push_back({params[i], args[i]});
+                    }
+                }
+            }
+            bool removed = true;
+            while (removed)
+            {
+                removed = false;
+                for (auto &item : incoming)
+                {
+                    if (boolean_params.count(item.first) && !is_boolean(item.second))
+                    {
+                        boolean_params.erase(item.first);
+                        removed = true;
+                    }
+                }
+            }
+        }
+
+        // 只有一个前驱, 并且前驱以两个目标不同的 branch 结束时, 这条边确定了条件的值
+        void compute_edge_facts()
+        {
+            for (auto bb : dom_tree.rpo())
+            {
+                const auto &preds = dom_tree.predecessors(bb);
+                if (preds.size() != 1)
+                {
+                    continue;
+                }
+                koopa_raw_value_t terminator = get_terminator(preds[0]);
+                if (terminator->kind.tag != KOOPA_RVT_BRANCH)
+                {
+                    continue;
+                }
+                const auto &branch = terminator->kind.data.branch;
+                if (branch.true_bb == branch.false_bb)
+                {
+                    continue;
+                }
+                bool taken = branch.true_bb == bb;
+                std::vector<std::pair<koopa_raw_value_t, int>> facts;
+                // 走假边时条件一定是 0, 走真边时只有布尔值才一定是 1
+                if (!taken)
+                {
+                    facts.push_back({branch.cond, 0});
+                }
+                else if (is_boolean(branch.cond))
+                {
+                    facts.push_back({branch.cond, 1});
+                }
+                // x == c 成立 (或者 x != c 不成立) 时, x 就是 c
+                if (branch.cond->kind.tag == KOOPA_RVT_BINARY && is_integer(branch.cond->kind.data.binary.rhs) && !is_integer(branch.cond->kind.data.binary.lhs))
+                {
+                    const auto &binary = branch.cond->kind.data.binary;
+                    if ((binary.op == KOOPA_RBO_EQ && taken) || (binary.op == KOOPA_RBO_NOT_EQ && !taken))
+                    {
+                        facts.push_back({binary.lhs, binary.rhs->kind.data.integer.value});
+                    }
+                }
+                for (auto &fact : facts)
+                {
+                    fact_values.insert(fact.first);
+                }
+                edge_facts[bb] = facts;
+            }
+        }
+
+        // 在 bb 中 value 是否由支配它的分支边确定
+        koopa_raw_value_t lookup_fact(koopa_raw_value_t value, koopa_raw_basic_block_t bb) const
+        {
+            if (!fact_values.count(value))
+            {
+                return value;
+            }
+            for (; bb != nullptr; bb = dom_tree.idom(bb))
+            {
+                auto it = edge_facts.find(bb);
+                if (it == edge_facts.end())
+                {
+                    continue;
+                }
+                for (auto &fact : it->second)
+                {
+                    if (fact.first == value)
+                    {
+                        return ir_builder.new_integer(fact.second);
+                    }
+                }
+            }
+            return value;
+        }
+
+        void set_binary(koopa_raw_value_t inst, koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs)
+        {
+            auto &binary = as_mutable(inst)->kind.data.binary;
+            binary.op = op;
+            binary.lhs = lhs;
+            binary.rhs = rhs;
+        }
+
+        // 化简一次, 返回代替 inst 的值; 原地修改了 inst 时返回 inst, 没有可以应用的规则时返回 nullptr
+        koopa_raw_value_t simplify_once(koopa_raw_value_t inst)
+        {
+            const auto &binary = inst->kind.data.binary;
+            koopa_raw_binary_op_t op = binary.op;
+            koopa_raw_value_t lhs = binary.lhs;
+            koopa_raw_value_t rhs = binary.rhs;
+
+            // 常量折叠
+            if (is_integer(lhs) && is_integer(rhs))
+            {
+                int result;
+                if (fold_binary(op, lhs->kind.data.integer.value, rhs->kind.data.integer.value, result))
+                {
+                    return ir_builder.new_integer(result);
+                }
+                return nullptr;
+            }
+
+            // 规范化: 常数放在右边, 减去常数改为加上它的相反数
+            if (is_integer(lhs) && (is_commutative(op) || is_comparison(op)))
+            {
+                set_binary(inst, swap_comparison(op), rhs, lhs);
+                return inst;
+            }
+            if (op == KOOPA_RBO_SUB && is_integer(rhs) && rhs->kind.data.integer.value != 0)
+            {
+                set_binary(inst, KOOPA_RBO_ADD, lhs, ir_builder.new_integer((int)(0u - (uint32_t)rhs->kind.data.integer.value)));
+                return inst;
+            }
+
+            // 两个操作数相同
+            if (lhs == rhs)
+            {
+                switch (op)
+                {
+                case KOOPA_RBO_SUB:
+                case KOOPA_RBO_XOR:
+                case KOOPA_RBO_NOT_EQ:
+                case KOOPA_RBO_LT:
+                case KOOPA_RBO_GT:
+                    return ir_builder.new_integer(0);
+                case KOOPA_RBO_EQ:
+                case KOOPA_RBO_LE:
+                case KOOPA_RBO_GE:
+                    return ir_builder.new_integer(1);
+                case KOOPA_RBO_AND:
+                case KOOPA_RBO_OR:
+                    return lhs;
+                default:
+                    break;
+                }
+            }
+
+            if (is_integer(rhs))
+            {
+                koopa_raw_value_t simplified = simplify_with_constant(inst, op, lhs, rhs->kind.data.integer.value);
+                if (simplified)
+                {
+                    return simplified;
+                }
+            }
+
+            // 重结合: (y op c) op z 改为 (y op z) op c, 把常数移到链的外面, 之后可以和外面的常数合并
+            if (is_associative(op) && !is_integer(lhs) && !is_integer(rhs))
+            {
+                koopa_raw_value_t inner = lhs, other = rhs;
+                if (!(inner->kind.tag == KOOPA_RVT_BINARY && inner->kind.data.binary.op == op && is_integer(inner->kind.data.binary.rhs)))
+                {
+                    std::swap(inner, other);
+                }
+                if (inner->kind.tag == KOOPA_RVT_BINARY && inner->kind.data.binary.op == op && is_integer(inner->kind.data.binary.rhs) && use_count[inner] == 1)
+                {
+                    koopa_raw_value_t combined = ir_builder.new_binary(op, inner->kind.data.binary.lhs, other);
+                    inserted.push_back(combined);
+                    set_binary(inst, op, combined, inner->kind.data.binary.rhs);
+                    return inst;
+                }
+            }
+            return nullptr;
+        }
+
+        // 右操作数是常数 c 时的规则
+        koopa_raw_value_t simplify_with_constant(koopa_raw_value_t inst, koopa_raw_binary_op_t op, koopa_raw_value_t lhs, int c)
+        {
+            // 单位元和零元
+            switch (op)
+            {
+            case KOOPA_RBO_ADD:
+            case KOOPA_RBO_OR:
+            case KOOPA_RBO_XOR:
+            case KOOPA_RBO_SHL:
+            case KOOPA_RBO_SHR:
+            case KOOPA_RBO_SAR:
+                if (c == 0)
+                {
+                    return lhs;
+                }
+                break;
+            case KOOPA_RBO_MUL:
+            case KOOPA_RBO_DIV:
+                if (c == 1)
+                {
+                    return lhs;
+                }
+                if (c == 0 && op == KOOPA_RBO_MUL)
+                {
+                    return ir_builder.new_integer(0);
+                }
+                if (c == -1)
+                {
+                    // INT_MIN / -1 在 RISC-V 上是 INT_MIN, 和 0 - INT_MIN 一样
+                    set_binary(inst, KOOPA_RBO_SUB, ir_builder.new_integer(0), lhs);
+                    return inst;
+                }
+                break;
+            case KOOPA_RBO_MOD:
+                if (c == 1 || c == -1)
+                {
+                    return ir_builder.new_integer(0);
+                }
+                break;
+            case KOOPA_RBO_AND:
+                if (c == 0)
+                {
+                    return ir_builder.new_integer(0);
+                }
+                if (c == -1 || (c == 1 && is_boolean(lhs)))
+                {
+                    return lhs;
+                }
+                break;
+            default:
+                break;
+            }
+            if (op == KOOPA_RBO_OR && (c == -1 || (c == 1 && is_boolean(lhs))))
+            {
+                return ir_builder.new_integer(c);
+            }
+
+            // 比较的结果在常数是最值时确定
+            if ((op == KOOPA_RBO_LT && c == INT_MIN) || (op == KOOPA_RBO_GT && c == INT_MAX))
+            {
+                return ir_builder.new_integer(0);
+            }
+            if ((op == KOOPA_RBO_GE && c == INT_MIN) || (op == KOOPA_RBO_LE && c == INT_MAX))
+            {
+                return ir_builder.new_integer(1);
+            }
+
+            // 布尔值的规范化: `!` 生成 eq x, 0, 短路求值生成 ne x, 0
+            if (is_boolean(lhs))
+            {
+                if ((op == KOOPA_RBO_NOT_EQ && c == 0) || (op == KOOPA_RBO_EQ && c == 1))
+                {
+                    return lhs;
+                }
+                if ((op == KOOPA_RBO_EQ && c == 0) || (op == KOOPA_RBO_NOT_EQ && c == 1) || (op == KOOPA_RBO_XOR && c == 1))
+                {
+                    // 比较直接取反, 其他布尔值和 1 异或
+                    if (lhs->kind.tag == KOOPA_RVT_BINARY && is_comparison(lhs->kind.data.binary.op))
+                    {
+                        const auto &cmp = lhs->kind.data.binary;
+                        set_binary(inst, negate_comparison(cmp.op), cmp.lhs, cmp.rhs);
+                        return inst;
+                    }
+                    if (op != KOOPA_RBO_XOR)
+                    {
+                        set_binary(inst, KOOPA_RBO_XOR, lhs, ir_builder.new_integer(1));
+                        return inst;
+                    }
+                }
+                if ((op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ) && c != 0 && c != 1)
+                {
+                    return ir_builder.new_integer(op == KOOPA_RBO_NOT_EQ);
+                }
+            }
+
+            if (lhs->kind.tag != KOOPA_RVT_BINARY)
+            {
+                return nullptr;
+            }
+            const auto &inner = lhs->kind.data.binary;
+
+            // x - y 和 x ^ y 是否为 0 就是 x 和 y 是否相等
+            if ((op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ) && c == 0 && (inner.op == KOOPA_RBO_SUB || inner.op == KOOPA_RBO_XOR))
+            {
+                set_binary(inst, op, inner.lhs, inner.rhs);
+                return inst;
+            }
+
+            if (!is_integer(inner.rhs))
+            {
+                // (c1 - y) + c 改为 (c1 + c) - y
+                if (op == KOOPA_RBO_ADD && inner.op == KOOPA_RBO_SUB && is_integer(inner.lhs))
+                {
+                    int sum = (int)((uint32_t)inner.lhs->kind.data.integer.value + (uint32_t)c);
+                    set_binary(inst, KOOPA_RBO_SUB, ir_builder.new_integer(sum), inner.rhs);
+                    return inst;
+                }
+                return nullptr;
+            }
+            int c1 = inner.rhs->kind.data.integer.value;
+
+            // (y op c1) op c 改为 y op (c1 op c)
+            if (inner.op == op && is_associative(op))
+            {
+                int result;
+                fold_binary(op, c1, c, result);
+                set_binary(inst, op, inner.lhs, ir_builder.new_integer(result));
+                return inst;
+            }
+
+            // (y + c1) == c 改为 y == c - c1, 在回绕的意义下等价
+            if ((op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ) && (inner.op == KOOPA_RBO_ADD || inner.op == KOOPA_RBO_XOR))
+            {
+                int result;
+                fold_binary(inner.op == KOOPA_RBO_ADD ? KOOPA_RBO_SUB : KOOPA_RBO_XOR, c, c1, result);
+                set_binary(inst, op, inner.lhs, ir_builder.new_integer(result));
+                return inst;
+            }
+            return nullptr;
+        }
+
+    public:
+        Simplifier(koopa_raw_function_t func) : func(func), dom_tree(analysis_manager.dominator_tree(func))
+        {
+            for (auto bb : dom_tree.rpo())
+            {
+                for (auto inst : get_insts(bb))
+                {
+                    for (auto operand : get_operands(inst))
+                    {
+                        ++use_count[operand];
+                    }
+                }
+            }
+            compute_boolean_params();
+            compute_edge_facts();
+        }
+
+        // 运行一轮, 返回应用规则的次数
+        int run()
+        {
+            for (auto bb : dom_tree.rpo())
+            {
+                std::vector<koopa_raw_value_t> insts;
+                bool modified = false;
+                for (auto inst : get_insts(bb))
+                {
+                    // 先替换已经被化简掉的操作数, 以及被分支确定的操作数
+                    for (auto operand : get_operands(inst))
+                    {
+                        koopa_raw_value_t value = lookup_fact(resolve(operand), bb);
+                        if (value != operand)
+                        {
+                            replace_operand(inst, operand, value);
+                            modified = true;
+                        }
+                    }
+                    if (inst->kind.tag != KOOPA_RVT_BINARY)
+                    {
+                        insts.push_back(inst);
+                        continue;
+                    }
+                    koopa_raw_value_t simplified = nullptr;
+                    for (int i = 0; i < max_rewrites_per_inst; ++i)
+                    {
+                        simplified = simplify_once(inst);
+                        if (simplified == nullptr || simplified != inst)
+                        {
+                            break;
+                        }
+                        ++changed;
+                        modified = true;
+                    }
+                    insts.insert(insts.end(), inserted.begin(), inserted.end());
+                    inserted.clear();
+                    if (simplified != nullptr && simplified != inst)
+                    {
+                        replacement[inst] = simplified;
+                        ++changed;
+                        modified = true;
+                        continue;
+                    }
+                    insts.push_back(inst);
+                }
+                if (modified)
+                {
+                    set_insts(bb, insts);
+                }
+            }
+            if (!replacement.empty())
+            {
+                replace_uses_with_map(func, replacement);
+            }
+            return changed;
+        }
+    };
+}
+
+int simplify_instructions(koopa_raw_program_t &program)
+{
+    int changed = 0;
+    for (auto func : get_functions(program))
+    {
+        if (!is_function_defined(func))
+        {
+            continue;
+        }
+        remove_unreachable_blocks(func);
+        // 一轮的化简可能让布尔值和分支条件的分析得到更多结果, 重复直到没有变化
+        for (int round = 0; round < 4; ++round)
+        {
+            int round_changed = Simplifier(func).run();
+            changed += round_changed;
+            if (round_changed == 0)
+            {
+                break;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 基本块是否以自身的尾调用结束, 即 `%r = call @f(...)` 紧跟着 `ret %r`, 或者 `call @f(...)` 紧跟着 `ret`
+static bool ends_with_self_tail_call(koopa_raw_function_t func, koopa_raw_basic_block_t bb)
+{
+    if (bb->insts.len < 2)
+    {
+        return false;
+    }
+    auto call = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 2]);
+    auto ret = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[bb->insts.len - 1]);
+    if (call->kind.tag != KOOPA_RVT_CALL || call->kind.data.call.callee != func || ret->kind.tag != KOOPA_RVT_RETURN)
+    {
+        return false;
+    }
+    if (call->ty->tag == KOOPA_RTT_UNIT)
+    {
+        return ret->kind.data.ret.value == nullptr;
+    }
+    return ret->kind.data.ret.value == call;
+}
+
+// 把一个函数中的自身尾调用改写成跳回函数开头的循环, 返回改写的调用数量
+static int eliminate_tail_recursion(koopa_raw_function_t func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    std::vector<koopa_raw_basic_block_t> tail_bbs;
+    for (auto bb : bbs)
+    {
+        if (ends_with_self_tail_call(func, bb))
+        {
+            tail_bbs.push_back(bb);
+        }
+    }
+    if (tail_bbs.empty())
+    {
+        return 0;
+    }
+
+    // 有 profile 时, 新的 entry 只在从外面调用时执行, 计数是原来 entry 的计数减去尾调用的次数
+    std::string function_name = func->name + 1;
+    long long entry_count = profile_manager.count(ProfileManager::block_key(function_name, bbs[0]->name + 1));
+    for (auto bb : tail_bbs)
+    {
+        // 尾调用是基本块中的最后一条 call 指令
+        int index = 0;
+        for (size_t i = 0; i + 2 < bb->insts.len; ++i)
+        {
+            index += reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i])->kind.tag == KOOPA_RVT_CALL;
+        }
+        long long tail_count = profile_manager.count(ProfileManager::call_edge_key(function_name, bb->name + 1, index, function_name));
+        if (entry_count >= 0 && tail_count >= 0)
+        {
+            entry_count = std::max(entry_count - tail_count, 0LL);
+        }
+    }
+
+    // 原来的 entry 改名成为循环头, 新建一个 entry 把参数保存到 alloc 中, 然后进入循环头; 循环头继承原来 entry 的计数
+    koopa_raw_basic_block_t loop_bb = bbs[0];
+    std::string old_entry_name = loop_bb->name + 1;
+    as_mutable(loop_bb)->name = ir_builder.new_name("%tre_loop_" + function_name);
+    koopa_raw_basic_block_t entry_bb = ir_builder.new_basic_block("%entry");
+    profile_manager.copy_block_count(function_name, old_entry_name, function_name, loop_bb->name + 1);
+    if (entry_count >= 0)
+    {
+        profile_manager.set_count(ProfileManager::block_key(function_name, entry_bb->name + 1), entry_count);
+    }
+
+    // 原来 entry 中的 alloc 移到新的 entry 中, 循环头开头重新从 alloc 中读出参数, 替换原来对参数的使用
+    std::vector<koopa_raw_value_t> entry_insts;
+    std::vector<koopa_raw_value_t> loop_insts;
+    std::vector<koopa_raw_value_t> param_slots;
+    std::vector<koopa_raw_value_t> params = get_values(func->params);
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        koopa_raw_value_t slot = ir_builder.new_alloc("@tre_" + function_name + "_arg_" + std::to_string(i));
+        param_slots.push_back(slot);
+        entry_insts.push_back(slot);
+    }
+    for (auto inst : get_insts(loop_bb))
+    {
+        if (inst->kind.tag == KOOPA_RVT_ALLOC)
+        {
+            entry_insts.push_back(inst);
+        }
+        else
+        {
+            loop_insts.push_back(inst);
+        }
+    }
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        entry_insts.push_back(ir_builder.new_store(params[i], param_slots[i]));
+    }
+    entry_insts.push_back(ir_builder.new_jump(loop_bb));
+
+    std::vector<koopa_raw_value_t> param_loads;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        param_loads.push_back(ir_builder.new_load(param_slots[i]));
+    }
+    loop_insts.insert(loop_insts.begin(), param_loads.begin(), param_loads.end());
+    set_insts(loop_bb, loop_insts);
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        replace_all_uses(func, params[i], param_loads[i]);
+    }
+
+    // 尾调用改为把实参存到参数的 alloc 中, 然后跳回循环头, 实参都已经算好了, 所以存储的顺序无关紧要
+    for (auto bb : tail_bbs)
+    {
+        std::vector<koopa_raw_value_t> insts = get_insts(bb);
+        koopa_raw_value_t call = insts[insts.size() - 2];
+        insts.resize(insts.size() - 2);
+        std::vector<koopa_raw_value_t> args = get_values(call->kind.data.call.args);
+        for (size_t i = 0; i < args.size(); ++i)
+        {
+            insts.push_back(ir_builder.new_store(args[i], param_slots[i]));
+        }
+        insts.push_back(ir_builder.new_jump(loop_bb));
+        set_insts(bb, insts);
+    }
+
+    bbs.insert(bbs.begin(), entry_bb);
+    set_insts(entry_bb, entry_insts);
+    set_basic_blocks(func, bbs);
+    analysis_manager.invalidate(func);
+    return tail_bbs.size();
+}
+
+int eliminate_tail_recursion(koopa_raw_program_t &program)
+{
+    int eliminated = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            eliminated += eliminate_tail_recursion(func);
+        }
+    }
+    return eliminated;
+}
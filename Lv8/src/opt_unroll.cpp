@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/opt.hpp"
+#include "include/analysis.hpp"
+
+// 部分展开的次数, 1 表示不做部分展开
+static int unroll_factor = 4;
+
+// 完全展开之后循环体的指令总数上限
+static const size_t max_full_unroll_size = 256;
+
+// 完全展开的最大迭代次数
+static const int64_t max_full_unroll_trip_count = 64;
+
+// 部分展开之后循环体的指令总数上限
+static const size_t max_partial_unroll_size = 256;
+
+// 展开的循环数量, 用于给新的基本块起唯一的名字
+static int unroll_counter = 0;
+
+void set_unroll_factor(int factor)
+{
+    if (factor < 1)
+    {
+        throw std::runtime_error("set_unroll_factor: unroll factor must be positive");
+    }
+    unroll_factor = factor;
+}
+
+// 拷贝一次循环中的所有基本块, value_map 中预先放好循环头参数对应的值; 两个操作数都是立即数的 binary 直接折叠, 返回基本块的映射
+static std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> clone_loop_body(const CountedLoop &counted, const std::string &prefix, std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &value_map)
+{
+    std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> bb_map;
+    for (auto bb : counted.blocks)
+    {
+        koopa_raw_basic_block_data_t *cloned_bb = ir_builder.new_basic_block("%" + prefix + strip_prefix(bb->name));
+        bb_map[bb] = cloned_bb;
+        // 循环头的参数已经在 value_map 中, 循环内部汇合处的参数需要拷贝
+        if (bb == counted.loop->header)
+        {
+            continue;
+        }
+        std::vector<koopa_raw_value_t> params;
+        for (auto param : get_values(bb->params))
+        {
+            koopa_raw_value_t cloned = ir_builder.new_block_arg(params.size(), "%" + prefix + strip_prefix(param->name));
+            value_map[param] = cloned;
+            params.push_back(cloned);
+        }
+        cloned_bb->params = ir_builder.new_slice(std::vector<const void *>(params.begin(), params.end()), KOOPA_RSIK_VALUE);
+    }
+
+    // 最内层循环除了回边没有环, 按照逆后序拷贝时操作数的定义总是先被拷贝
+    for (auto bb : counted.blocks)
+    {
+        std::vector<koopa_raw_value_t> insts;
+        for (auto inst : get_insts(bb))
+        {
+            koopa_raw_value_t cloned = ir_builder.clone_value(inst, nullptr);
+            for (auto operand : get_operands(inst))
+            {
+                auto it = value_map.find(operand);
+                if (it != value_map.end())
+                {
+                    replace_operand(cloned, operand, it->second);
+                }
+            }
+            for (auto succ : get_successors_of_terminator(inst))
+            {
+                auto it = bb_map.find(succ);
+                if (it != bb_map.end())
+                {
+                    replace_successor(cloned, succ, it->second);
+                }
+            }
+            int result;
+            if (cloned->kind.tag == KOOPA_RVT_BINARY && is_integer(cloned->kind.data.binary.lhs) && is_integer(cloned->kind.data.binary.rhs) &&
+                fold_binary(cloned->kind.data.binary.op, cloned->kind.data.binary.lhs->kind.data.integer.value, cloned->kind.data.binary.rhs->kind.data.integer.value, result))
+            {
+                value_map[inst] = ir_builder.new_integer(result);
+                continue;
+            }
+            value_map[inst] = cloned;
+            insts.push_back(cloned);
+        }
+        set_insts(bb_map[bb], insts);
+    }
+    return bb_map;
+}
+
+// 把拷贝出来的 latch 的结尾换成 terminator, 前面可以插入一些指令
+static void replace_latch_terminator(koopa_raw_basic_block_t latch, const std::vector<koopa_raw_value_t> &extra, koopa_raw_value_t terminator)
+{
+    std::vector<koopa_raw_value_t> insts = get_insts(latch);
+    insts.pop_back();
+    insts.insert(insts.end(), extra.begin(), extra.end());
+    insts.push_back(terminator);
+    set_insts(latch, insts);
+}
+
+// 按照 value_map 映射一组值
+static std::vector<koopa_raw_value_t> map_values(const std::vector<koopa_raw_value_t> &values, const std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> &value_map)
+{
+    std::vector<koopa_raw_value_t> mapped;
+    for (auto value : values)
+    {
+        auto it = value_map.find(value);
+        mapped.push_back(it == value_map.end() ? value : it->second);
+    }
+    return mapped;
+}
+
+// 把新建的基本块放在循环头前面
+static void insert_blocks_before(koopa_raw_function_t func, koopa_raw_basic_block_t header, const std::vector<koopa_raw_basic_block_t> &new_bbs)
+{
+    std::vector<koopa_raw_basic_block_t> bbs;
+    for (auto bb : get_basic_blocks(func))
+    {
+        if (bb == header)
+        {
+            bbs.insert(bbs.end(), new_bbs.begin(), new_bbs.end());
+        }
+        bbs.push_back(bb);
+    }
+    set_basic_blocks(func, bbs);
+}
+
+// 按照 op 比较两个 64 位整数
+static bool compare(koopa_raw_binary_op_t op, int64_t lhs, int64_t rhs)
+{
+    switch (op)
+    {
+    case KOOPA_RBO_LT:
+        return lhs < rhs;
+    case KOOPA_RBO_LE:
+        return lhs <= rhs;
+    case KOOPA_RBO_GT:
+        return lhs > rhs;
+    default:
+        return lhs >= rhs;
+    }
+}
+
+// 迭代次数是常数时返回迭代次数, 否则返回 -1; entry_args 是唯一的循环外前驱传给循环头的实参
+static int64_t constant_trip_count(const CountedLoop &counted, const std::vector<koopa_raw_value_t> &entry_args)
+{
+    koopa_raw_value_t init = entry_args[counted.iv.index];
+    if (!is_integer(init) || !is_integer(counted.bound))
+    {
+        return -1;
+    }
+    int64_t iv = init->kind.data.integer.value;
+    int64_t bound = counted.bound->kind.data.integer.value;
+    // 循环已经被旋转, 进入循环头时循环体至少执行一次
+    for (int64_t trip_count = 1; trip_count <= max_full_unroll_trip_count; ++trip_count)
+    {
+        iv += counted.iv.step;
+        if (iv < INT_MIN || iv > INT_MAX)
+        {
+            return -1;
+        }
+        if (!compare(counted.op, iv, bound))
+        {
+            return trip_count;
+        }
+    }
+    return -1;
+}
+
+// 完全展开: 把循环体拷贝 trip_count 次串起来, 最后一次跳到出口
+static void fully_unroll(koopa_raw_function_t func, const CountedLoop &counted, koopa_raw_basic_block_t entry_pred, int64_t trip_count)
+{
+    std::string prefix = "unroll_" + std::to_string(unroll_counter++) + "_";
+    // 有 profile 时每份拷贝分到原来计数的 1 / trip_count
+    std::string function_name = strip_prefix(func->name);
+    koopa_raw_basic_block_t header = counted.loop->header;
+    std::vector<koopa_raw_value_t> params = get_values(header->params);
+
+    koopa_raw_value_t entry_terminator = get_terminator(entry_pred);
+    std::vector<koopa_raw_basic_block_t> entry_succs = get_successors_of_terminator(entry_terminator);
+    size_t entry_index = entry_succs[0] == header ? 0 : 1;
+    std::vector<koopa_raw_value_t> args = get_successor_args(entry_terminator, entry_index);
+
+    std::vector<koopa_raw_basic_block_t> new_bbs;
+    koopa_raw_basic_block_t prev_latch = nullptr;
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    for (int64_t k = 0; k < trip_count; ++k)
+    {
+        // 上一次迭代跳回循环头的实参直接作为这一次的参数
+        value_map.clear();
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            value_map[params[i]] = args[i];
+        }
+        auto bb_map = clone_loop_body(counted, prefix + std::to_string(k) + "_", value_map);
+        for (auto bb : counted.blocks)
+        {
+            new_bbs.push_back(bb_map[bb]);
+            profile_manager.copy_block_count(function_name, strip_prefix(bb->name), function_name, strip_prefix(bb_map[bb]->name), 1.0 / trip_count);
+        }
+        koopa_raw_basic_block_t copy_header = bb_map[header];
+        if (prev_latch)
+        {
+            replace_latch_terminator(prev_latch, {}, ir_builder.new_jump(copy_header));
+        }
+        else
+        {
+            set_successor(entry_terminator, entry_index, copy_header);
+            set_successor_args(entry_terminator, entry_index, {});
+        }
+        prev_latch = bb_map[counted.latch];
+        args = map_values(counted.back_args, value_map);
+    }
+    koopa_raw_value_t jump = ir_builder.new_jump(counted.exit);
+    set_successor_args(jump, 0, map_values(counted.exit_args, value_map));
+    replace_latch_terminator(prev_latch, {}, jump);
+
+    insert_blocks_before(func, header, new_bbs);
+    remove_unreachable_blocks(func);
+}
+
+// 部分展开: 剩余迭代次数足够时进入展开 factor 次的循环, 不再检查中间的退出条件; 不够时由原来的循环处理剩余的迭代
+static bool partially_unroll(koopa_raw_function_t func, const CountedLoop &counted, const DominatorTree &dom_tree, int factor)
+{
+    // 还能连续执行 factor 次的条件: iv + (factor - 1) * step op bound, 改写为 iv op bound - (factor - 1) * step, 需要保证减法不溢出
+    int64_t distance = (int64_t)(factor - 1) * counted.iv.step;
+    if (distance < INT_MIN || distance > INT_MAX)
+    {
+        return false;
+    }
+    koopa_raw_value_t limit = nullptr;
+    koopa_raw_value_t no_overflow = nullptr;
+    std::vector<koopa_raw_value_t> check_insts;
+    if (is_integer(counted.bound))
+    {
+        int64_t value = (int64_t)counted.bound->kind.data.integer.value - distance;
+        if (value < INT_MIN || value > INT_MAX)
+        {
+            return false;
+        }
+        limit = ir_builder.new_integer(value);
+    }
+    else
+    {
+        limit = ir_builder.new_binary(KOOPA_RBO_SUB, counted.bound, ir_builder.new_integer(distance));
+        check_insts.push_back(limit);
+        if (distance > 0)
+        {
+            no_overflow = ir_builder.new_binary(KOOPA_RBO_GT, counted.bound, ir_builder.new_integer(INT_MIN + distance - 1));
+        }
+        else
+        {
+            no_overflow = ir_builder.new_binary(KOOPA_RBO_LT, counted.bound, ir_builder.new_integer(INT_MAX + distance + 1));
+        }
+        check_insts.push_back(no_overflow);
+    }
+
+    std::string prefix = "unroll_" + std::to_string(unroll_counter++) + "_";
+    koopa_raw_basic_block_t header = counted.loop->header;
+    std::vector<koopa_raw_value_t> params = get_values(header->params);
+    auto new_params = [&](koopa_raw_basic_block_data_t *bb)
+    {
+        std::vector<koopa_raw_value_t> cloned;
+        for (auto param : params)
+        {
+            cloned.push_back(ir_builder.new_block_arg(cloned.size(), "%" + strip_prefix(bb->name) + "_" + strip_prefix(param->name)));
+        }
+        bb->params = ir_builder.new_slice(std::vector<const void *>(cloned.begin(), cloned.end()), KOOPA_RSIK_VALUE);
+        return cloned;
+    };
+
+    // 有 profile 时, 展开的循环分到大部分迭代, 每份拷贝按 1 / factor 估计; 检查块和剩余块每次进入循环执行一次, 原来的循环每次进入最多执行 factor - 1 次
+    std::string function_name = strip_prefix(func->name);
+    std::vector<koopa_raw_basic_block_t> outside_preds;
+    for (auto pred : dom_tree.predecessors(header))
+    {
+        if (!counted.loop->contains(pred))
+        {
+            outside_preds.push_back(pred);
+        }
+    }
+    long long entry_count = estimate_entry_count(func, header, outside_preds);
+
+    // 检查块: 循环外的前驱改为跳到这里
+    koopa_raw_basic_block_data_t *check_bb = ir_builder.new_basic_block("%" + prefix + "check");
+    std::vector<koopa_raw_value_t> check_params = new_params(check_bb);
+    koopa_raw_value_t room = ir_builder.new_binary(counted.op, check_params[counted.iv.index], limit);
+    check_insts.push_back(room);
+    if (no_overflow)
+    {
+        room = ir_builder.new_binary(KOOPA_RBO_AND, room, no_overflow);
+        check_insts.push_back(room);
+    }
+
+    // 展开的循环: 第一份拷贝的循环头有参数, 后面的拷贝直接使用上一份的值
+    std::vector<koopa_raw_basic_block_t> new_bbs = {check_bb};
+    koopa_raw_basic_block_t unrolled_header = nullptr;
+    koopa_raw_basic_block_t prev_latch = nullptr;
+    std::vector<koopa_raw_value_t> args;
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> value_map;
+    for (int k = 0; k < factor; ++k)
+    {
+        value_map.clear();
+        std::vector<koopa_raw_value_t> unrolled_params;
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            if (k == 0)
+            {
+                unrolled_params.push_back(ir_builder.new_block_arg(i, "%" + prefix + "0_" + strip_prefix(params[i]->name)));
+                value_map[params[i]] = unrolled_params.back();
+            }
+            else
+            {
+                value_map[params[i]] = args[i];
+            }
+        }
+        auto bb_map = clone_loop_body(counted, prefix + std::to_string(k) + "_", value_map);
+        for (auto bb : counted.blocks)
+        {
+            new_bbs.push_back(bb_map[bb]);
+            profile_manager.copy_block_count(function_name, strip_prefix(bb->name), function_name, strip_prefix(bb_map[bb]->name), 1.0 / factor);
+        }
+        if (k == 0)
+        {
+            unrolled_header = bb_map[header];
+            as_mutable(unrolled_header)->params = ir_builder.new_slice(std::vector<const void *>(unrolled_params.begin(), unrolled_params.end()), KOOPA_RSIK_VALUE);
+        }
+        else
+        {
+            replace_latch_terminator(prev_latch, {}, ir_builder.new_jump(bb_map[header]));
+        }
+        prev_latch = bb_map[counted.latch];
+        args = map_values(counted.back_args, value_map);
+    }
+
+    // 剩余块: 展开的循环结束之后, 按原来的退出条件决定进入原来的循环还是直接退出
+    koopa_raw_basic_block_data_t *remainder_bb = ir_builder.new_basic_block("%" + prefix + "remainder");
+    std::vector<koopa_raw_value_t> remainder_params = new_params(remainder_bb);
+    new_bbs.push_back(remainder_bb);
+
+    koopa_raw_value_t again = ir_builder.new_binary(counted.op, args[counted.iv.index], limit);
+    koopa_raw_value_t back_branch = ir_builder.new_branch(again, unrolled_header, remainder_bb);
+    set_successor_args(back_branch, 0, args);
+    set_successor_args(back_branch, 1, args);
+    replace_latch_terminator(prev_latch, {again}, back_branch);
+
+    koopa_raw_value_t more = ir_builder.new_binary(counted.op, remainder_params[counted.iv.index], counted.bound);
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> exit_map;
+    for (size_t i = 0; i < counted.back_args.size(); ++i)
+    {
+        exit_map[counted.back_args[i]] = remainder_params[i];
+    }
+    koopa_raw_value_t remainder_branch = ir_builder.new_branch(more, header, counted.exit);
+    set_successor_args(remainder_branch, 0, remainder_params);
+    set_successor_args(remainder_branch, 1, map_values(counted.exit_args, exit_map));
+    set_insts(remainder_bb, {more, remainder_branch});
+
+    koopa_raw_value_t check_branch = ir_builder.new_branch(room, unrolled_header, header);
+    set_successor_args(check_branch, 0, check_params);
+    set_successor_args(check_branch, 1, check_params);
+    check_insts.push_back(check_branch);
+    set_insts(check_bb, check_insts);
+
+    for (auto pred : outside_preds)
+    {
+        koopa_raw_value_t terminator = get_terminator(pred);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            if (succs[k] == header)
+            {
+                set_successor(terminator, k, check_bb);
+            }
+        }
+    }
+    if (entry_count >= 0)
+    {
+        profile_manager.set_count(ProfileManager::block_key(function_name, strip_prefix(check_bb->name)), entry_count);
+        profile_manager.set_count(ProfileManager::block_key(function_name, strip_prefix(remainder_bb->name)), entry_count);
+        for (auto bb : counted.blocks)
+        {
+            long long count = profile_manager.count(ProfileManager::block_key(function_name, strip_prefix(bb->name)));
+            if (count >= 0)
+            {
+                profile_manager.set_count(ProfileManager::block_key(function_name, strip_prefix(bb->name)), std::min(count, entry_count * (factor - 1)));
+            }
+        }
+    }
+    insert_blocks_before(func, header, new_bbs);
+    return true;
+}
+
+// 对一个函数做循环展开, 返回展开的循环数量
+static int unroll_loops(koopa_raw_function_t func)
+{
+    remove_unreachable_blocks(func);
+
+    // 展开一个循环之后控制流改变, 重新计算循环; 每个原来的循环头只处理一次, 展开产生的新循环不再展开
+    std::unordered_set<koopa_raw_basic_block_t> candidates;
+    {
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            candidates.insert(loop->header);
+        }
+    }
+    int unrolled = 0;
+    bool changed = true;
+    while (changed && !candidates.empty())
+    {
+        changed = false;
+        const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+        const LoopInfo &loop_info = analysis_manager.loop_info(func);
+        for (auto loop : loop_info.loops())
+        {
+            if (!candidates.count(loop->header))
+            {
+                continue;
+            }
+            candidates.erase(loop->header);
+            CountedLoop counted;
+            if (!analyze_counted_loop(func, *loop, loop_info, dom_tree, counted))
+            {
+                continue;
+            }
+
+            std::vector<koopa_raw_basic_block_t> entry_preds;
+            for (auto pred : dom_tree.predecessors(loop->header))
+            {
+                if (!loop->contains(pred))
+                {
+                    entry_preds.push_back(pred);
+                }
+            }
+            if (entry_preds.size() == 1)
+            {
+                koopa_raw_value_t terminator = get_terminator(entry_preds[0]);
+                std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+                // 两个目标都是循环头时实参可能不同, 不做完全展开
+                if (succs.size() == 1 || succs[0] != succs[1])
+                {
+                    size_t index = succs[0] == loop->header ? 0 : 1;
+                    int64_t trip_count = constant_trip_count(counted, get_successor_args(terminator, index));
+                    if (trip_count > 0 && trip_count * counted.size <= max_full_unroll_size)
+                    {
+                        fully_unroll(func, counted, entry_preds[0], trip_count);
+                        ++unrolled;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+            if (unroll_factor > 1 && counted.size * unroll_factor <= max_partial_unroll_size && partially_unroll(func, counted, dom_tree, unroll_factor))
+            {
+                ++unrolled;
+                changed = true;
+                break;
+            }
+        }
+        if (changed)
+        {
+            analysis_manager.invalidate(func);
+        }
+    }
+    return unrolled;
+}
+
+int unroll_loops(koopa_raw_program_t &program)
+{
+    int unrolled = 0;
+    for (auto func : get_functions(program))
+    {
+        if (is_function_defined(func))
+        {
+            unrolled += unroll_loops(func);
+        }
+    }
+    return unrolled;
+}
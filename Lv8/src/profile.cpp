@@ -0,0 +1,111 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "include/profile.hpp"
+
+ProfileManager profile_manager;
+
+void ProfileManager::enable_generate()
+{
+    mode = Mode::GENERATE;
+}
+
+void ProfileManager::load_profile(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("ProfileManager::load_profile: cannot open profile file " + path);
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        // 程序本身的输出可能没有以换行结尾, 所以 `#prof ` 不一定在行首
+        size_t pos = line.find("#prof ");
+        if (pos == std::string::npos)
+        {
+            continue;
+        }
+        std::istringstream line_stream(line.substr(pos + 6));
+        std::string name;
+        long long count;
+        if (line_stream >> name >> count)
+        {
+            // 同一个名字出现多次 (比如多次运行的输出拼接在一起) 就累加
+            _counts[name] += count;
+        }
+    }
+    mode = Mode::USE;
+}
+
+bool ProfileManager::is_generating() const
+{
+    return mode == Mode::GENERATE;
+}
+
+bool ProfileManager::has_profile() const
+{
+    return mode == Mode::USE;
+}
+
+int ProfileManager::new_counter(const std::string &name)
+{
+    _counter_names.push_back(name);
+    return _counter_names.size() - 1;
+}
+
+const std::vector<std::string> &ProfileManager::counter_names() const
+{
+    return _counter_names;
+}
+
+long long ProfileManager::count(const std::string &name) const
+{
+    auto it = _counts.find(name);
+    if (it == _counts.end())
+    {
+        return -1;
+    }
+    return it->second;
+}
+
+void ProfileManager::set_count(const std::string &name, long long count)
+{
+    if (mode == Mode::USE)
+    {
+        _counts[name] = count;
+    }
+}
+
+void ProfileManager::copy_block_count(const std::string &from_function, const std::string &from_bb, const std::string &to_function, const std::string &to_bb, double scale)
+{
+    if (mode != Mode::USE || !_counts.count(block_key(from_function, from_bb)))
+    {
+        return;
+    }
+    // 调用边的名字以 `函数:基本块#` 开头, 先收集起来再插入, 避免遍历时修改哈希表
+    std::string from_prefix = block_key(from_function, from_bb) + "#";
+    std::vector<std::pair<std::string, long long>> copied = {{block_key(to_function, to_bb), (long long)(_counts[block_key(from_function, from_bb)] * scale)}};
+    for (const auto &[name, count] : _counts)
+    {
+        if (name.compare(0, from_prefix.size(), from_prefix) == 0)
+        {
+            copied.emplace_back(block_key(to_function, to_bb) + "#" + name.substr(from_prefix.size()), (long long)(count * scale));
+        }
+    }
+    for (const auto &[name, count] : copied)
+    {
+        _counts[name] = count;
+    }
+}
+
+std::string ProfileManager::block_key(const std::string &function_name, const std::string &bb_name)
+{
+    return function_name + ":" + bb_name;
+}
+
+std::string ProfileManager::call_edge_key(const std::string &function_name, const std::string &bb_name, int index, const std::string &callee_name)
+{
+    return function_name + ":" + bb_name + "#" + std::to_string(index) + "->" + callee_name;
+}
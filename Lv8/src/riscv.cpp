@@ -6,6 +6,21 @@ RISCVContextManager riscv_context_manager;
 // 所有代码共用的 RISC-V 汇编打印器
 RISCVPrinter riscv_printer;
 
+// 当前正在访问的基本块, 用于生成 profile 计数器的名字
+koopa_raw_basic_block_t current_bb = nullptr;
+
+// 排布顺序中紧跟在当前基本块后面的基本块, 跳转到它的 j 指令可以省略, 直接 fall through
+koopa_raw_basic_block_t next_bb = nullptr;
+
+// 当前函数中基本块参数并行拷贝的中转位置
+int block_arg_scratch_offset = 0;
+
+// 为带参数的分支边新建的标签数量, 用于生成唯一的标签名
+int branch_edge_count = 0;
+
+// 当前基本块中已经访问过的 call 指令的数量, 用于区分同一个基本块中的多条调用边
+int current_bb_call_count = 0;
+
 int backend(const char *koopa_str)
 {
     // 解析字符串 str, 得到 Koopa IR 程序
@@ -19,8 +34,43 @@ int backend(const char *koopa_str)
     // 释放 Koopa IR 程序占用的内存
     koopa_delete_program(program);
 
-    // 处理 raw program
-    visit(raw);
+    // libkoopa 生成的 raw program 不允许修改, 拷贝一份之后在拷贝上做中端优化
+    koopa_raw_program_t optimized = ir_builder.copy_program(raw);
+    optimize(optimized);
+
+    // 机器 IR 的大小, 用于 pass 的统计
+    MModule &module = riscv_printer.module();
+    auto machine_size = [&]()
+    {
+        IRSize size;
+        for (const auto &section : module.sections)
+        {
+            for (const auto &block : section.func.blocks)
+            {
+                size.insts += block.insts.size();
+                ++size.blocks;
+            }
+        }
+        return size;
+    };
+
+    // 处理 raw program, 指令选择的结果放在机器 IR 中; 寄存器分配和基本块排布在指令选择中按函数进行
+    pass_manager.run_timed("isel", [&]()
+                           { visit(optimized); }, machine_size);
+
+    // 在机器 IR 上做窥孔优化
+    if (pass_manager.is_enabled("peephole"))
+    {
+        pass_manager.run_timed("peephole", [&]()
+                               { peephole(module); }, machine_size);
+    }
+
+    // 把机器 IR 输出成汇编文本
+    pass_manager.run_timed("emit", [&]()
+                           { emit_module(module, std::cout); }, machine_size);
+
+    // 输出优化统计
+    print_opt_statistics(std::cerr);
 
     // 处理完成, 释放 raw program builder 占用的内存
     // 注意, raw program 中所有的指针指向的内存均为 raw program builder 的内存
@@ -66,6 +116,12 @@ void visit(const koopa_raw_program_t &program)
 
     // 访问所有函数
     visit(program.funcs);
+
+    // 插桩模式下, 输出计数器和程序退出时输出计数的函数
+    if (profile_manager.is_generating())
+    {
+        emit_profile_runtime();
+    }
 }
 
 // 访问函数
@@ -80,19 +136,21 @@ void visit(const koopa_raw_function_t &func)
     // 获得函数名
     std::string function_name = func->name + 1;
 
-    // 输出 RISC-V 的 prologue
-    riscv_printer.text();
-    riscv_printer.globl(function_name);
-    riscv_printer.label(function_name);
+    // 开始输出这个函数
+    riscv_printer.begin_function(function_name);
 
     // 计算栈帧大小
     // 如何判断一个指令存在返回值呢 ? 你也许还记得 Koopa IR 是强类型 IR, 所有指令都是有类型的.如果指令的类型为 unit(类似 C / C++ 中的 void), 则这条指令不存在返回值. 在 C / C++ 中, 每个 koopa_raw_value_t 都有一个名叫 ty 的字段, 它的类型是 koopa_raw_type_t.koopa_raw_type_t 中有一个字段叫做 tag, 存储了这个类型具体是何种类型.如果它的值为 KOOPA_RTT_UNIT, 说明这个类型是 unit 类型.或者你实在懒得判断的话,给所有指令都分配栈空间也不是不行, 只不过这样会浪费一些栈空间.
     int num_stack_frame_byte = 0;
     int func_call_arg_on_stack = 0;
+    int max_scratch_args = 0;
+    bool has_call = false;
     for (size_t i = 0; i < func->bbs.len; ++i)
     {
         auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
         num_stack_frame_byte += bb->insts.len;
+        // 基本块参数也保存在栈上
+        num_stack_frame_byte += bb->params.len;
         for (size_t j = 0; j < bb->insts.len; ++j)
         {
             auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
@@ -106,15 +164,52 @@ void visit(const koopa_raw_function_t &func)
             // 如果指令是 call 指令, 则需要额外计算变量表所需空间
             if (inst->kind.tag == KOOPA_RVT_CALL)
             {
+                has_call = true;
                 int args = inst->kind.data.call.args.len;
                 // 除了八个在寄存器中的参数, 其他的参数都放在栈中
                 func_call_arg_on_stack = std::max(func_call_arg_on_stack, args - 8);
             }
+
+            // 基本块参数的并行拷贝需要中转时, 预留和这条边的参数数量一样多的位置
+            std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(inst);
+            for (size_t k = 0; k < succs.size(); ++k)
+            {
+                std::vector<koopa_raw_value_t> args = get_successor_args(inst, k);
+                if (block_args_conflict(succs[k], args))
+                {
+                    max_scratch_args = std::max(max_scratch_args, (int)args.size());
+                }
+            }
         }
     }
+    // 插桩模式下 main 返回前要调用 __prof_dump, 也不是叶子函数
+    bool is_leaf = !has_call && !(profile_manager.is_generating() && function_name == "main");
 
-    // 多分配一条 store 指令来存储 ra 寄存器, ra 是调用者保存寄存器, 调用者把它的 ra 存在每个栈帧的最上面, 修改这个寄存器为 call 的下一条指令, 然后进入下一个函数, 代表调用者的下一条指令
-    num_stack_frame_byte += 1;
+    // 值尽量放在寄存器中: 跨过 call 仍然活跃的值放在 callee-saved 寄存器中, 其他的值放在 a0 - a7 中, 它们都不需要栈上的位置, 但是用到的 callee-saved 寄存器要在 prologue 中保存
+    // 不开启寄存器分配时所有的值都放在栈上
+    std::unordered_map<koopa_raw_value_t, std::string> home_regs;
+    if (pass_manager.is_enabled("regalloc"))
+    {
+        home_regs = allocate_home_registers(func);
+    }
+    std::vector<std::string> callee_saved_regs;
+    for (auto &item : home_regs)
+    {
+        if (item.second[0] == 's' && std::find(callee_saved_regs.begin(), callee_saved_regs.end(), item.second) == callee_saved_regs.end())
+        {
+            callee_saved_regs.push_back(item.second);
+        }
+    }
+    std::sort(callee_saved_regs.begin(), callee_saved_regs.end(), [](const std::string &a, const std::string &b)
+              { return std::stoi(a.substr(1)) < std::stoi(b.substr(1)); });
+    num_stack_frame_byte += (int)callee_saved_regs.size() - (int)home_regs.size();
+
+    // 前八个参数在 prologue 中保存到栈上, 因为 a0 - a7 在函数调用之后会被覆盖, 而内联之后参数可能在任意位置被使用
+    num_stack_frame_byte += std::min((int)func->params.len, 8);
+    // 基本块参数的并行拷贝的中转位置
+    num_stack_frame_byte += max_scratch_args;
+    // 不是叶子函数时多分配一条 store 指令来存储 ra 寄存器, ra 是调用者保存寄存器, 调用者把它的 ra 存在每个栈帧的最上面, 修改这个寄存器为 call 的下一条指令, 然后进入下一个函数, 代表调用者的下一条指令
+    num_stack_frame_byte += is_leaf ? 0 : 1;
     // 额外分配存在栈上的参数
     num_stack_frame_byte += func_call_arg_on_stack;
     // 计算栈帧大小
@@ -125,25 +220,145 @@ void visit(const koopa_raw_function_t &func)
     // 初始化栈管理器
     riscv_context_manager.init_stack_manager_for_one_function(function_name, num_stack_frame_byte, func_call_arg_on_stack);
 
-    // 输出 RISC-V 的 prologue, 将 sp 减去栈帧大小, 保存 ra 寄存器
-    riscv_printer.addi("sp", "sp", -num_stack_frame_byte, riscv_context_manager);  // 开辟栈帧
-    riscv_printer.sw("ra", "sp", num_stack_frame_byte - 4, riscv_context_manager); // 保存 ra 寄存器
+    // 提前给所有有返回值的指令分配栈上的位置, 因为基本块重新排布之后, 一个值的使用可能先于它的定义被访问到
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    stack_manager.set_save_ra(!is_leaf);
+    for (auto &item : home_regs)
+    {
+        stack_manager.assign_home_reg(item.first, item.second);
+        // 放着值的 a0 - a7 在整个函数中都不能再作为临时寄存器使用
+        if (item.second[0] == 'a')
+        {
+            riscv_context_manager.set_reg_reserved(item.second, true);
+        }
+    }
+    for (size_t i = 0; i < func->bbs.len; ++i)
+    {
+        auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+        for (size_t j = 0; j < bb->params.len; ++j)
+        {
+            stack_manager.save_value_to_stack(reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[j]));
+        }
+        for (size_t j = 0; j < bb->insts.len; ++j)
+        {
+            auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+            if (inst->ty->tag != KOOPA_RTT_UNIT)
+            {
+                stack_manager.save_value_to_stack(inst);
+            }
+        }
+    }
+    block_arg_scratch_offset = stack_manager.save_scratch_to_stack(max_scratch_args);
+    stack_manager.save_callee_saved_regs(callee_saved_regs);
+
+    // 决定哪些基本块在 prologue 之前执行, 不需要栈帧的入口部分 (比如提前返回的路径) 不输出 prologue
+    plan_frame(func);
+    if (!is_frameless(reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0])))
+    {
+        emit_prologue();
+    }
+
+    // 按照排布顺序访问所有基本块
+    std::vector<koopa_raw_basic_block_t> layout = pass_manager.is_enabled("layout") ? layout_basic_blocks(func) : get_basic_blocks(func);
+    for (size_t i = 0; i < layout.size(); ++i)
+    {
+        next_bb = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+        visit(layout[i]);
+    }
+    next_bb = nullptr;
 
-    // 访问所有基本块
-    visit(func->bbs);
+    // 所有需要栈帧的 ret 共用一个 epilogue
+    emit_epilogue();
+    for (auto &item : home_regs)
+    {
+        if (item.second[0] == 'a')
+        {
+            riscv_context_manager.set_reg_reserved(item.second, false);
+        }
+    }
 }
 
 // 访问基本块
 void visit(const koopa_raw_basic_block_t &bb)
 {
+    current_bb = bb;
+    current_bb_call_count = 0;
+
     // 输出基本块名
     std::string bb_name = bb->name + 1;
     if (bb_name != "entry") // 忽略 entry 基本块, 因为会造成不同函数重复定义 entry 跳转标签
     {
-        std::cout << bb_name << ":" << std::endl;
+        riscv_printer.label(bb_name);
+    }
+
+    // 插桩模式下, 基本块开头给这个基本块的计数器加一
+    if (profile_manager.is_generating())
+    {
+        emit_profile_counter(ProfileManager::block_key(riscv_context_manager.get_current_function_name(), bb_name));
+    }
+
+    // 访问所有指令, 紧跟着 ret 的 call 是尾调用, 直接拆掉栈帧跳转过去, 被调用者返回时直接返回到当前函数的调用者
+    for (size_t i = 0; i < bb->insts.len; ++i)
+    {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+        if (i + 1 < bb->insts.len && is_tail_call(inst, reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i + 1])))
+        {
+            visit_tail_call(inst->kind.data.call);
+            break;
+        }
+        visit(inst);
+    }
+}
+
+// 判断 call 是否可以作为尾调用
+bool is_tail_call(const koopa_raw_value_t &call, const koopa_raw_value_t &ret)
+{
+    if (call->kind.tag != KOOPA_RVT_CALL || ret->kind.tag != KOOPA_RVT_RETURN)
+    {
+        return false;
+    }
+    // 返回的必须正好是这次调用的结果
+    if (ret->kind.data.ret.value != (call->ty->tag == KOOPA_RTT_UNIT ? nullptr : call))
+    {
+        return false;
+    }
+    // 超过 8 个参数时要用当前栈帧传参, 不能在调用前拆掉栈帧
+    if (call->kind.data.call.args.len > 8)
+    {
+        return false;
+    }
+    // 插桩模式下 main 返回前还要输出计数器
+    if (profile_manager.is_generating() && riscv_context_manager.get_current_function_name() == "main")
+    {
+        return false;
     }
-    // 访问所有指令
-    visit(bb->insts);
+    return true;
+}
+
+// 访问尾调用
+void visit_tail_call(const koopa_raw_call_t &call)
+{
+    // 插桩模式下, 和普通调用一样给这条调用边的计数器加一
+    if (profile_manager.is_generating())
+    {
+        std::string key = ProfileManager::call_edge_key(riscv_context_manager.get_current_function_name(), current_bb->name + 1, current_bb_call_count, call.callee->name + 1);
+        emit_profile_counter(key);
+    }
+    current_bb_call_count++;
+
+    // 参数加载到 a0 - a7 寄存器中
+    for (size_t i = 0; i < call.args.len; i++)
+    {
+        auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
+        load_value_to_reg(arg, "a" + std::to_string(i));
+    }
+
+    // 已经建立了栈帧时, 恢复 callee-saved 寄存器和 ra 寄存器, 恢复栈帧, 然后跳转到被调用者
+    if (!is_frameless(current_bb))
+    {
+        emit_frame_teardown();
+    }
+    riscv_printer.tail(call.callee->name + 1);
 }
 
 // 访问指令
@@ -228,66 +443,41 @@ void visit(const koopa_raw_global_alloc_t &global_alloc, const koopa_raw_value_t
 // 访问 call 指令
 void visit(const koopa_raw_call_t &call, const koopa_raw_value_t &value)
 {
+    // 插桩模式下, 给这条调用边的计数器加一, 此时还没有加载参数, 所有寄存器都是空闲的
+    if (profile_manager.is_generating())
+    {
+        std::string key = ProfileManager::call_edge_key(riscv_context_manager.get_current_function_name(), current_bb->name + 1, current_bb_call_count, call.callee->name + 1);
+        emit_profile_counter(key);
+    }
+    current_bb_call_count++;
+
     // 调用函数的参数数量
     int args = call.args.len;
-    // 调用函数
+    // 前八个参数直接加载到 a0 - a7 寄存器中, 当前函数的参数都已经保存在栈上了, 所以覆盖 a0 - a7 不会影响后面参数的加载
     for (int i = 0; i < std::min(args, 8); i++)
     {
-        // 前八个参数存储在 a0 - a7 寄存器中
         auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
-        auto target = "a" + std::to_string(i);
-        // 判断是否为立即数
-        if (arg->kind.tag == KOOPA_RVT_INTEGER)
-        {
-            riscv_printer.li(target, arg->kind.data.integer.value);
-        }
-        else
-        {
-            // 从栈中加载数据到寄存器
-            StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-            riscv_context_manager.allocate_reg(arg);
-            std::string temp_reg_name = riscv_context_manager.value_to_reg_string(arg);
-            riscv_printer.lw(temp_reg_name, "sp", stack_manager.get_value_stack_offset(arg), riscv_context_manager);
-            riscv_printer.mv(target, temp_reg_name);
-            riscv_context_manager.set_reg_free(arg);
-        }
+        load_value_to_reg(arg, "a" + std::to_string(i));
     }
     // 处理超过 8 个参数的情况, 此时需要将参数存到栈上
     for (int i = 8; i < args; i++)
     {
         auto arg = reinterpret_cast<koopa_raw_value_t>(call.args.buffer[i]);
         int target = (i - 8) * 4;
-        if (arg->kind.tag == KOOPA_RVT_INTEGER)
-        {
-            // 分配一个临时寄存器
-            riscv_context_manager.allocate_reg(arg);
-            std::string temp_reg_name = riscv_context_manager.value_to_reg_string(arg);
-            // 将立即数存储到栈上
-            riscv_printer.li(temp_reg_name, arg->kind.data.integer.value);
-            riscv_printer.sw(temp_reg_name, "sp", target, riscv_context_manager);
-            // 释放临时寄存器
-            riscv_context_manager.set_reg_free(arg);
-        }
-        else
-        {
-            // 从栈中加载数据到寄存器
-            riscv_context_manager.allocate_reg(arg);
-            std::string temp_reg_name = riscv_context_manager.value_to_reg_string(arg);
-            riscv_printer.lw(temp_reg_name, "sp", target, riscv_context_manager);
-            // 将数据存储到栈上
-            riscv_printer.sw(temp_reg_name, "sp", target, riscv_context_manager);
-            // 释放临时寄存器
-            riscv_context_manager.set_reg_free(arg);
-        }
+        // 分配一个临时寄存器, 加载参数之后存储到栈上
+        riscv_context_manager.allocate_reg(arg);
+        std::string temp_reg_name = riscv_context_manager.value_to_reg_string(arg);
+        load_value_to_reg(arg, temp_reg_name);
+        riscv_printer.sw(temp_reg_name, "sp", target, riscv_context_manager);
+        // 释放临时寄存器
+        riscv_context_manager.set_reg_free(arg);
     }
     riscv_printer.call(call.callee->name + 1);
 
     // 判断是否需要存储返回值
     if (value->ty->tag != KOOPA_RTT_UNIT)
     {
-        StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-        stack_manager.save_value_to_stack(value);
-        riscv_printer.sw("a0", "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+        save_value(value, "a0");
     }
 }
 
@@ -299,38 +489,66 @@ void visit(const koopa_raw_branch_t &branch, const koopa_raw_value_t &value)
     // 给中间结果分配一个寄存器
     riscv_context_manager.allocate_reg(value);
     std::string temp_reg_name = riscv_context_manager.value_to_reg_string(value);
-    // 使用立即数或从栈中加载数据到寄存器
-    if (branch.cond->kind.tag == KOOPA_RVT_INTEGER)
+    // 条件放在寄存器中时直接使用, 否则使用立即数或从栈中加载数据到寄存器
+    if (stack_manager.has_home_reg(branch.cond))
     {
-        riscv_printer.li(temp_reg_name, branch.cond->kind.data.integer.value);
+        temp_reg_name = stack_manager.get_home_reg(branch.cond);
     }
-    // 运算数为函数参数
-    else if (branch.cond->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+    else
     {
-        // 获取参数的索引
-        auto index = branch.cond->kind.data.func_arg_ref.index;
-        // 前 8 个参数放在 a0 - a7 寄存器中
-        if (index < 8)
+        load_value_to_reg(branch.cond, temp_reg_name);
+    }
+    // 有基本块参数或者要在这条边上建立栈帧时, 每条边在跳转之前要先输出自己的代码
+    bool true_edge = branch.true_args.len > 0 || edge_needs_prologue(branch.true_bb);
+    bool false_edge = branch.false_args.len > 0 || edge_needs_prologue(branch.false_bb);
+    if (true_edge || false_edge)
+    {
+        // 只有 false 边有代码时, 先处理 true 边
+        if (!true_edge)
         {
-            riscv_printer.mv(temp_reg_name, "a" + std::to_string(index));
+            riscv_printer.bnez(temp_reg_name, branch.true_bb->name + 1);
+            riscv_context_manager.set_reg_free(value);
+            emit_edge(branch.false_bb, branch.false_args);
+            if (branch.false_bb != next_bb)
+            {
+                riscv_printer.jump(branch.false_bb->name + 1);
+            }
+            return;
         }
-        // 后面的参数要从栈上找
-        else
+        // false 边没有代码时直接跳过去, 否则跳到一个新的标签输出 false 边的代码
+        std::string false_label = !false_edge ? std::string(branch.false_bb->name + 1) : "branch_edge_" + std::to_string(branch_edge_count++);
+        riscv_printer.beqz(temp_reg_name, false_label);
+        riscv_context_manager.set_reg_free(value);
+        emit_edge(branch.true_bb, branch.true_args);
+        if (false_edge || branch.true_bb != next_bb)
         {
-            // 先获取当前栈帧大小
-            int stack_size = stack_manager.get_num_stack_frame_byte();
-            int offset = 4 * (index - 8);
-            // 从上一个栈帧中获取
-            riscv_printer.lw(temp_reg_name, "sp", stack_size + offset, riscv_context_manager);
+            riscv_printer.jump(branch.true_bb->name + 1);
+        }
+        if (false_edge)
+        {
+            riscv_printer.label(false_label);
+            emit_edge(branch.false_bb, branch.false_args);
+            if (branch.false_bb != next_bb)
+            {
+                riscv_printer.jump(branch.false_bb->name + 1);
+            }
         }
+        return;
+    }
+    // 访问 branch 指令, 如果某个目标紧跟在当前基本块后面, 就直接 fall through 过去, 省掉一条 j 指令
+    if (branch.false_bb == next_bb)
+    {
+        riscv_printer.bnez(temp_reg_name, branch.true_bb->name + 1);
+    }
+    else if (branch.true_bb == next_bb)
+    {
+        riscv_printer.beqz(temp_reg_name, branch.false_bb->name + 1);
     }
     else
     {
-        riscv_printer.lw(temp_reg_name, "sp", stack_manager.get_value_stack_offset(branch.cond), riscv_context_manager);
+        riscv_printer.bnez(temp_reg_name, branch.true_bb->name + 1);
+        riscv_printer.jump(branch.false_bb->name + 1);
     }
-    // 访问 branch 指令
-    riscv_printer.bnez(temp_reg_name, branch.true_bb->name + 1);
-    riscv_printer.jump(branch.false_bb->name + 1);
     // 当前操作数所在的寄存器已经被使用过了, 释放
     riscv_context_manager.set_reg_free(value);
 }
@@ -338,8 +556,13 @@ void visit(const koopa_raw_branch_t &branch, const koopa_raw_value_t &value)
 // 访问 jump 指令
 void visit(const koopa_raw_jump_t &jump)
 {
-    // 访问 jump 指令
-    riscv_printer.jump(jump.target->name + 1);
+    // 先把参数拷贝到目标基本块的参数中
+    emit_edge(jump.target, jump.args);
+    // 访问 jump 指令, 跳转目标紧跟在当前基本块后面时省略
+    if (jump.target != next_bb)
+    {
+        riscv_printer.jump(jump.target->name + 1);
+    }
 }
 
 // 访问 load 指令, load 的输入和输出都必然是内存
@@ -364,9 +587,8 @@ void visit(const koopa_raw_load_t &load, const koopa_raw_value_t &value)
         // 从栈中加载数据到寄存器
         riscv_printer.lw(temp_reg_name, "sp", stack_manager.get_value_stack_offset(load.src), riscv_context_manager);
     }
-    // 将数据保存到栈中, 同时输出 sw 指令
-    stack_manager.save_value_to_stack(value);
-    riscv_printer.sw(temp_reg_name, "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+    // 将数据保存到栈中或者它所在的寄存器中
+    save_value(value, temp_reg_name);
     // 当前操作数所在的寄存器已经被使用过了, 释放
     riscv_context_manager.set_reg_free(value);
 }
@@ -380,47 +602,8 @@ void visit(const koopa_raw_store_t &store, const koopa_raw_value_t &value)
     riscv_context_manager.allocate_reg(value);
     std::string temp_src_reg_name = riscv_context_manager.value_to_reg_string(value);
 
-    // 判断 store.value 是什么类型的
-    // 如果是函数参数
-    if (store.value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
-    {
-        // 获取参数的索引
-        auto index = store.value->kind.data.func_arg_ref.index;
-        // 前 8 个参数放在 a0 - a7 寄存器中
-        if (index < 8)
-        {
-            riscv_printer.mv(temp_src_reg_name, "a" + std::to_string(index));
-        }
-        // 后面的参数要从栈上找
-        else
-        {
-            // 先获取当前栈帧大小
-            int stack_size = stack_manager.get_num_stack_frame_byte();
-            int offset = 4 * (index - 8);
-            // 从上一个栈帧中获取
-            riscv_printer.lw(temp_src_reg_name, "sp", stack_size + offset, riscv_context_manager);
-        }
-    }
-    // 如果是函数返回值
-    else if (store.value->kind.tag == KOOPA_RVT_CALL)
-    {
-        // 从栈中加载数据到寄存器
-        riscv_printer.lw(temp_src_reg_name, "sp", stack_manager.get_value_stack_offset(store.value), riscv_context_manager);
-    }
-    // 如果是立即数, 则需要先分配一个临时寄存器, 如果是内存, 则从内存中 lw 出来
-    else if (store.value->kind.tag == KOOPA_RVT_INTEGER)
-    {
-        riscv_printer.li(temp_src_reg_name, store.value->kind.data.integer.value);
-    }
-    // 如果是二元运算结果, 是栈上变量, 则从栈中加载数据到寄存器
-    else if (store.value->kind.tag == KOOPA_RVT_BINARY)
-    {
-        riscv_printer.lw(temp_src_reg_name, "sp", stack_manager.get_value_stack_offset(store.value), riscv_context_manager);
-    }
-    else
-    {
-        throw std::runtime_error("visit: invalid store instruction, store.value->kind.tag = " + std::to_string(store.value->kind.tag));
-    }
+    // 加载要存储的值, 可能是立即数, 函数参数或者任意有返回值的指令的结果
+    load_value_to_reg(store.value, temp_src_reg_name);
 
     // 判断 store.dest 是什么类型的
     // 如果是全局变量, 则需要先获取地址, 再存储
@@ -453,19 +636,8 @@ void visit(const koopa_raw_return_t &ret)
     // 根据 ret 的 value 类型判断后续需要如何访问
     if (ret.value)
     {
-        // 如果是立即数, 则直接赋值给 a0 寄存器, 跳过访问 value 的过程
-        if (ret.value->kind.tag == KOOPA_RVT_INTEGER)
-        {
-            riscv_printer.li("a0", ret.value->kind.data.integer.value);
-        }
-        // 否则, 访问这个值, 然后把这个值存储在的内存移动给 a0 寄存器, 注意不是 li
-        else if (ret.value->kind.tag == KOOPA_RVT_BINARY || ret.value->kind.tag == KOOPA_RVT_LOAD || ret.value->kind.tag == KOOPA_RVT_CALL)
-        {
-            // 当前函数的 StackManager
-            StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-            // 将 ret.value 的值从栈中加载到 a0 寄存器
-            riscv_printer.lw("a0", "sp", stack_manager.get_value_stack_offset(ret.value), riscv_context_manager);
-        }
+        // 把返回值加载到 a0 寄存器, 立即数直接 li, 其他的值从栈中加载
+        load_value_to_reg(ret.value, "a0");
     }
     // 如果 ret 的 value 为空, 则直接赋值 0 给 a0 寄存器, 然后返回
     else
@@ -473,94 +645,75 @@ void visit(const koopa_raw_return_t &ret)
         riscv_printer.li("a0", 0);
     }
 
-    // 当前函数的 StackManager
-    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-    // 读取 ra 寄存器
-    riscv_printer.lw("ra", "sp", stack_manager.get_num_stack_frame_byte() - 4, riscv_context_manager);
-    // 恢复栈帧
-    riscv_printer.addi("sp", "sp", stack_manager.get_num_stack_frame_byte(), riscv_context_manager);
-    // 返回
-    riscv_printer.ret();
+    // 插桩模式下, main 返回就是程序退出, 在这里输出所有计数器, __prof_dump 会保留 a0 中的返回值
+    if (profile_manager.is_generating() && riscv_context_manager.get_current_function_name() == "main")
+    {
+        riscv_printer.call("__prof_dump");
+    }
+
+    // 还没有建立栈帧时直接返回, 否则跳到共用的 epilogue, 最后一个基本块直接 fall through 到 epilogue
+    if (is_frameless(current_bb))
+    {
+        riscv_printer.ret();
+    }
+    else
+    {
+        emit_jump_to_epilogue(next_bb == nullptr);
+    }
 }
 
 // 访问 binary 指令
 void visit(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value)
 {
-    // 当前函数的 StackManager
-    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-    // 判断 lhs 是立即数还是内存, 如果是立即数就 li, 否则就 lw
-    riscv_context_manager.allocate_reg(binary.lhs);
-    std::string lhs = riscv_context_manager.value_to_reg_string(binary.lhs);
-    if (binary.lhs->kind.tag == KOOPA_RVT_INTEGER)
+    // 乘除常数时尝试换成更便宜的指令序列
+    if (visit_binary_with_constant(binary, value))
     {
-        riscv_printer.li(lhs, binary.lhs->kind.data.integer.value);
+        return;
     }
-    else if (binary.lhs->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+    // 当前函数的 StackManager
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    // 放在寄存器中的操作数直接使用这个寄存器, 其他的分配一个寄存器, 如果是立即数就 li, 否则就 lw
+    auto load_operand = [&](const koopa_raw_value_t &operand)
     {
-        // 获取参数的索引
-        auto index = binary.lhs->kind.data.func_arg_ref.index;
-        // 前 8 个参数放在 a0 - a7 寄存器中
-        if (index < 8)
+        if (stack_manager.has_home_reg(operand))
         {
-            riscv_printer.mv(lhs, "a" + std::to_string(index));
+            return stack_manager.get_home_reg(operand);
         }
-        // 后面的参数要从栈上找
-        else
+        riscv_context_manager.allocate_reg(operand);
+        std::string reg = riscv_context_manager.value_to_reg_string(operand);
+        load_value_to_reg(operand, reg);
+        return reg;
+    };
+    auto free_operand = [&](const koopa_raw_value_t &operand)
+    {
+        if (!stack_manager.has_home_reg(operand))
         {
-            // 先获取当前栈帧大小
-            int stack_size = stack_manager.get_num_stack_frame_byte();
-            int offset = 4 * (index - 8);
-            // 从上一个栈帧中获取
-            riscv_printer.lw(lhs, "sp", stack_size + offset, riscv_context_manager);
+            riscv_context_manager.set_reg_free(operand);
         }
-    }
-    else
-    {
-        // 当前函数的 StackManager
-        StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-        // 从栈中加载数据到寄存器
-        riscv_printer.lw(lhs, "sp", stack_manager.get_value_stack_offset(binary.lhs), riscv_context_manager);
-    }
-    // 判断 rhs 是立即数还是内存, 如果是立即数就 li, 否则就 lw
-    riscv_context_manager.allocate_reg(binary.rhs);
-    std::string rhs = riscv_context_manager.value_to_reg_string(binary.rhs);
-    if (binary.rhs->kind.tag == KOOPA_RVT_INTEGER)
+    };
+    // 加载 lhs
+    std::string lhs = load_operand(binary.lhs);
+    // 加载 rhs, 如果 rhs 和 lhs 是同一个值 (比如内联或者优化之后的 add %0, %0), 直接复用 lhs 的寄存器
+    std::string rhs = binary.rhs != binary.lhs ? load_operand(binary.rhs) : lhs;
+
+    // 给结果分配一个寄存器, 分配之前可以先释放掉 lhs 和 rhs 对应的寄存器, 因为他们相当于已经加载进来了, 一会使用的时候可以覆盖, 比如 add t0, t0, t1
+    free_operand(binary.lhs);
+    if (binary.rhs != binary.lhs)
     {
-        riscv_printer.li(rhs, binary.rhs->kind.data.integer.value);
+        free_operand(binary.rhs);
     }
-    else if (binary.rhs->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+    // 结果放在寄存器中时直接写到这个寄存器, 每种运算都先读完操作数再写结果, 所以和操作数是同一个寄存器也没关系
+    std::string cur;
+    if (stack_manager.has_home_reg(value))
     {
-        // 获取参数的索引
-        auto index = binary.rhs->kind.data.func_arg_ref.index;
-        // 前 8 个参数放在 a0 - a7 寄存器中
-        if (index < 8)
-        {
-            riscv_printer.mv(rhs, "a" + std::to_string(index));
-        }
-        // 后面的参数要从栈上找
-        else
-        {
-            // 先获取当前栈帧大小
-            int stack_size = stack_manager.get_num_stack_frame_byte();
-            int offset = 4 * (index - 8);
-            // 从上一个栈帧中获取
-            riscv_printer.lw(rhs, "sp", stack_size + offset, riscv_context_manager);
-        }
+        cur = stack_manager.get_home_reg(value);
     }
     else
     {
-        // 当前函数的 StackManager
-        StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
-        // 从栈中加载数据到寄存器
-        riscv_printer.lw(rhs, "sp", stack_manager.get_value_stack_offset(binary.rhs), riscv_context_manager);
+        riscv_context_manager.allocate_reg(value);
+        cur = riscv_context_manager.value_to_reg_string(value);
     }
 
-    // 给结果分配一个寄存器, 分配之前可以先释放掉 lhs 和 rhs 对应的寄存器, 因为他们相当于已经加载进来了, 一会使用的时候可以覆盖, 比如 add t0, t0, t1
-    riscv_context_manager.set_reg_free(binary.lhs);
-    riscv_context_manager.set_reg_free(binary.rhs);
-    riscv_context_manager.allocate_reg(value);
-    std::string cur = riscv_context_manager.value_to_reg_string(value);
-
     // 根据二元运算符的类型进行处理
     switch (binary.op)
     {
@@ -607,12 +760,258 @@ void visit(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value)
     case KOOPA_RBO_OR:
         riscv_printer.or_(cur, lhs, rhs);
         break;
+    case KOOPA_RBO_XOR:
+        riscv_printer.xor_(cur, lhs, rhs);
+        break;
+    case KOOPA_RBO_SHL:
+        riscv_printer.sll(cur, lhs, rhs);
+        break;
+    case KOOPA_RBO_SHR:
+        riscv_printer.srl(cur, lhs, rhs);
+        break;
+    case KOOPA_RBO_SAR:
+        riscv_printer.sra(cur, lhs, rhs);
+        break;
     default:
         throw std::runtime_error("visit: invalid binary operator");
     }
     // 把结果存回栈中
-    stack_manager.save_value_to_stack(value);
-    riscv_printer.sw(cur, "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+    save_value(value, cur);
     // 当前结果所在的寄存器已经被使用过了, 释放
-    riscv_context_manager.set_reg_free(value);
+    free_operand(value);
+}
+
+// 把一个值加载到指定的寄存器中
+void load_value_to_reg(const koopa_raw_value_t &value, const std::string &reg)
+{
+    // 当前函数的 StackManager
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    // 立即数
+    if (value->kind.tag == KOOPA_RVT_INTEGER)
+    {
+        riscv_printer.li(reg, value->kind.data.integer.value);
+    }
+    // 放在寄存器中的值
+    else if (stack_manager.has_home_reg(value))
+    {
+        if (stack_manager.get_home_reg(value) != reg)
+        {
+            riscv_printer.mv(reg, stack_manager.get_home_reg(value));
+        }
+    }
+    // 函数参数
+    else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF)
+    {
+        // 获取参数的索引
+        auto index = value->kind.data.func_arg_ref.index;
+        // 前 8 个参数在 prologue 中已经保存到栈上了
+        if (index < 8)
+        {
+            riscv_printer.lw(reg, "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+        }
+        // 后面的参数要从上一个栈帧中获取
+        else
+        {
+            int stack_size = stack_manager.get_num_stack_frame_byte();
+            int offset = 4 * (index - 8);
+            riscv_printer.lw(reg, "sp", stack_size + offset, riscv_context_manager);
+        }
+    }
+    // 其他有返回值的指令的结果都保存在栈上
+    else
+    {
+        riscv_printer.lw(reg, "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+    }
+}
+
+// 把寄存器 reg 中的值保存到 value 的位置
+void save_value(const koopa_raw_value_t &value, const std::string &reg)
+{
+    // 当前函数的 StackManager
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    if (stack_manager.has_home_reg(value))
+    {
+        if (stack_manager.get_home_reg(value) != reg)
+        {
+            riscv_printer.mv(stack_manager.get_home_reg(value), reg);
+        }
+        return;
+    }
+    stack_manager.save_value_to_stack(value);
+    riscv_printer.sw(reg, "sp", stack_manager.get_value_stack_offset(value), riscv_context_manager);
+}
+
+// 按顺序拷贝一条边上的参数是否会覆盖还没有读取的参数
+bool block_args_conflict(const koopa_raw_basic_block_t &target, const std::vector<koopa_raw_value_t> &args)
+{
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        for (size_t j = 0; j < target->params.len; ++j)
+        {
+            if (args[i] == reinterpret_cast<koopa_raw_value_t>(target->params.buffer[j]) && i != j)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// 输出一条边上跳转之前的代码: 从不需要栈帧的基本块进入需要栈帧的基本块时先输出 prologue, 然后拷贝参数
+void emit_edge(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args)
+{
+    if (edge_needs_prologue(target))
+    {
+        emit_prologue();
+    }
+    emit_block_args(target, args);
+}
+
+// 这条从当前基本块出发的边是否要建立栈帧
+bool edge_needs_prologue(const koopa_raw_basic_block_t &target)
+{
+    return is_frameless(current_bb) && !is_frameless(target);
+}
+
+// 把跳转的参数拷贝到目标基本块的参数中
+void emit_block_args(const koopa_raw_basic_block_t &target, const koopa_raw_slice_t &args)
+{
+    if (args.len == 0)
+    {
+        return;
+    }
+    // 当前函数的 StackManager
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    auto param_at = [&](size_t i)
+    {
+        return reinterpret_cast<koopa_raw_value_t>(target->params.buffer[i]);
+    };
+    auto arg_at = [&](size_t i)
+    {
+        return reinterpret_cast<koopa_raw_value_t>(args.buffer[i]);
+    };
+    // 把 value 加载到一个临时寄存器, 再存储到 offset 处
+    auto copy_to_stack = [&](koopa_raw_value_t value, int offset)
+    {
+        riscv_context_manager.allocate_reg(value);
+        std::string reg = riscv_context_manager.value_to_reg_string(value);
+        load_value_to_reg(value, reg);
+        riscv_printer.sw(reg, "sp", offset, riscv_context_manager);
+        riscv_context_manager.set_reg_free(value);
+    };
+
+    // 并行拷贝: 如果某个参数用到了目标基本块的另一个参数 (比如循环中交换两个变量), 按顺序拷贝会先覆盖它, 这时先把所有参数拷贝到中转位置
+    bool conflict = block_args_conflict(target, get_values(args));
+    // 参数在寄存器中时直接加载到这个寄存器
+    auto copy_to_param = [&](koopa_raw_value_t value, koopa_raw_value_t param)
+    {
+        if (stack_manager.has_home_reg(param))
+        {
+            load_value_to_reg(value, stack_manager.get_home_reg(param));
+        }
+        else
+        {
+            copy_to_stack(value, stack_manager.get_value_stack_offset(param));
+        }
+    };
+    if (!conflict)
+    {
+        for (size_t i = 0; i < args.len; ++i)
+        {
+            if (arg_at(i) != param_at(i))
+            {
+                copy_to_param(arg_at(i), param_at(i));
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < args.len; ++i)
+    {
+        copy_to_stack(arg_at(i), block_arg_scratch_offset + 4 * i);
+    }
+    for (size_t i = 0; i < args.len; ++i)
+    {
+        riscv_context_manager.allocate_reg(param_at(i));
+        std::string reg = riscv_context_manager.value_to_reg_string(param_at(i));
+        riscv_printer.lw(reg, "sp", block_arg_scratch_offset + 4 * i, riscv_context_manager);
+        save_value(param_at(i), reg);
+        riscv_context_manager.set_reg_free(param_at(i));
+    }
+}
+
+// 输出一个 profile 计数器加一的代码, 调用的时候不能有被占用的寄存器
+void emit_profile_counter(const std::string &name)
+{
+    int index = profile_manager.new_counter(name);
+    riscv_printer.la("t0", "__prof_counter_" + std::to_string(index));
+    riscv_printer.lw("t1", "t0", 0, riscv_context_manager);
+    riscv_printer.addi("t1", "t1", 1, riscv_context_manager);
+    riscv_printer.sw("t1", "t0", 0, riscv_context_manager);
+}
+
+// 输出所有 profile 计数器, 以及程序退出时按照 `#prof <名字> <计数>` 的格式输出计数器的 __prof_dump 函数
+void emit_profile_runtime()
+{
+    const std::vector<std::string> &names = profile_manager.counter_names();
+
+    // 计数器是连续的 .word, 每个计数器有自己的标签, 方便插桩代码直接用 la 取地址
+    riscv_printer.data();
+    riscv_printer.label("__prof_counters");
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        riscv_printer.label("__prof_counter_" + std::to_string(i));
+        riscv_printer.word(0);
+    }
+    // 计数器的名字是连续的以 0 结尾的字符串
+    riscv_printer.label("__prof_names");
+    for (const auto &name : names)
+    {
+        riscv_printer.asciz(name);
+    }
+
+    // __prof_dump: s0 指向当前计数器, s1 指向当前名字, s2 是剩余计数器的数量, 这三个寄存器和 a0 都需要保存
+    riscv_printer.begin_function("__prof_dump", false);
+    riscv_printer.addi("sp", "sp", -32, riscv_context_manager);
+    riscv_printer.sw("ra", "sp", 28, riscv_context_manager);
+    riscv_printer.sw("s0", "sp", 24, riscv_context_manager);
+    riscv_printer.sw("s1", "sp", 20, riscv_context_manager);
+    riscv_printer.sw("s2", "sp", 16, riscv_context_manager);
+    riscv_printer.sw("a0", "sp", 12, riscv_context_manager);
+    riscv_printer.la("s0", "__prof_counters");
+    riscv_printer.la("s1", "__prof_names");
+    riscv_printer.li("s2", names.size());
+    // 先输出一个换行, 避免和程序本身没有换行结尾的输出连在一起
+    riscv_printer.li("a0", '\n');
+    riscv_printer.call("putch");
+    riscv_printer.label("__prof_dump_loop");
+    riscv_printer.beqz("s2", "__prof_dump_end");
+    for (char c : std::string("#prof "))
+    {
+        riscv_printer.li("a0", c);
+        riscv_printer.call("putch");
+    }
+    riscv_printer.label("__prof_dump_name");
+    riscv_printer.lbu("a0", "s1", 0);
+    riscv_printer.addi("s1", "s1", 1, riscv_context_manager);
+    riscv_printer.beqz("a0", "__prof_dump_count");
+    riscv_printer.call("putch");
+    riscv_printer.jump("__prof_dump_name");
+    riscv_printer.label("__prof_dump_count");
+    riscv_printer.li("a0", ' ');
+    riscv_printer.call("putch");
+    riscv_printer.lw("a0", "s0", 0, riscv_context_manager);
+    riscv_printer.call("putint");
+    riscv_printer.li("a0", '\n');
+    riscv_printer.call("putch");
+    riscv_printer.addi("s0", "s0", 4, riscv_context_manager);
+    riscv_printer.addi("s2", "s2", -1, riscv_context_manager);
+    riscv_printer.jump("__prof_dump_loop");
+    riscv_printer.label("__prof_dump_end");
+    riscv_printer.lw("a0", "sp", 12, riscv_context_manager);
+    riscv_printer.lw("s2", "sp", 16, riscv_context_manager);
+    riscv_printer.lw("s1", "sp", 20, riscv_context_manager);
+    riscv_printer.lw("s0", "sp", 24, riscv_context_manager);
+    riscv_printer.lw("ra", "sp", 28, riscv_context_manager);
+    riscv_printer.addi("sp", "sp", 32, riscv_context_manager);
+    riscv_printer.ret();
 }
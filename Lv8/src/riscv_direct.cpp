@@ -0,0 +1,909 @@
+#include <deque>
+#include <optional>
+#include <stack>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "include/koopa.hpp"
+#include "include/riscv.hpp"
+
+// -O0 的快速路径: 一次遍历抽象语法树, 直接把 RISC-V 汇编文本追加到输出缓冲区中, 不生成 Koopa IR, 也不调用 libkoopa
+// 栈帧的约定和 riscv.cpp 在不开启寄存器分配时相同: 每个局部变量和每个计算结果都有自己的 4 字节栈位置, 用相对 sp 的偏移量访问, ra 保存在栈帧的最上面
+// 表达式的值先读到 t0 和 t1 中计算, 结果立刻写回新的栈位置, 所以任意两个表达式之间不会共用寄存器, 调用函数时也没有需要保存的寄存器
+
+namespace
+{
+    /**
+     * @brief 直接翻译时符号表中的一个名字
+     * @date 2026-10-18
+     */
+    struct DirectSymbol
+    {
+        enum class Kind
+        {
+            CONST,  // 常量, val 是常量的值
+            LOCAL,  // 局部变量或者函数参数, val 是栈位置相对 sp 的偏移量
+            GLOBAL, // 全局变量, val 是第几个全局变量, 和 riscv.cpp 一样输出成 global_var_<val>
+        };
+        Kind kind;
+        int val;
+    };
+
+    /**
+     * @brief 直接翻译的上下文, 对应 Koopa 输出时的 KoopaContextManager 和后端的 StackManager
+     * @date 2026-10-18
+     */
+    struct RISCVDirectContext
+    {
+        // 作用域的栈, 第一个是全局作用域
+        std::vector<std::unordered_map<std::string, DirectSymbol>> symbol_tables = {{}};
+
+        // 函数是否有返回值
+        std::unordered_map<std::string, bool> func_has_return_value;
+
+        // 第一次进入函数的 block 时要加入符号表的函数参数, 以及它们的栈位置
+        std::deque<std::string> *func_formal_params = nullptr;
+        std::vector<int> func_param_offsets;
+
+        // 当前函数的名字和已经分配的栈位置的字节数
+        std::string function_name;
+        int stack_used_byte = 0;
+
+        // 准备栈上的调用参数时 sp 临时下移的字节数, 这期间访问栈位置要加上它
+        int sp_shift = 0;
+
+        int global_var_count = 0;
+
+        // 标签的编号, 和 Koopa 输出时的计数方式相同, 整个程序中不重复
+        int total_if_else_statement_count = 0;
+        int total_while_statement_count = 0;
+        int total_and_statement_count = 0;
+        int total_or_statement_count = 0;
+        std::stack<int> while_statement_stack;
+
+        // 在当前作用域中加入一个名字
+        void insert_symbol(const std::string &name, DirectSymbol symbol)
+        {
+            symbol_tables.back()[name] = symbol;
+        }
+
+        // 从最内层的作用域开始查找一个名字
+        DirectSymbol name_to_symbol(const std::string &name) const
+        {
+            for (size_t i = symbol_tables.size(); i-- > 0;)
+            {
+                auto it = symbol_tables[i].find(name);
+                if (it != symbol_tables[i].end())
+                {
+                    return it->second;
+                }
+            }
+            throw std::runtime_error("RISCVDirectContext::name_to_symbol: identifier " + name + " does not exist");
+        }
+
+        // 分配一个新的栈位置, 返回它相对 sp 的偏移量
+        int new_stack_slot()
+        {
+            int offset = stack_used_byte;
+            stack_used_byte += 4;
+            return offset;
+        }
+    };
+
+    RISCVDirectContext direct_context;
+
+    // 值在栈位置 offset 中
+    Result stack_value(int offset)
+    {
+        Result result;
+        result.type = Result::Type::REG;
+        result.val = offset;
+        return result;
+    }
+
+    // 12 位有符号立即数的范围
+    bool fits_imm12(int value)
+    {
+        return value >= -2048 && value <= 2047;
+    }
+
+    // op reg, offset(sp), 偏移量超出立即数范围时先用 t3 算出地址
+    void emit_stack_access(std::string &output, const char *op, const std::string &reg, int offset)
+    {
+        if (fits_imm12(offset))
+        {
+            output += "\t" + std::string(op) + " " + reg + ", " + std::to_string(offset) + "(sp)\n";
+            return;
+        }
+        output += "\tli t3, " + std::to_string(offset) + "\n\tadd t3, t3, sp\n";
+        output += "\t" + std::string(op) + " " + reg + ", 0(t3)\n";
+    }
+
+    // sp = sp + delta
+    void emit_adjust_sp(std::string &output, int delta)
+    {
+        if (fits_imm12(delta))
+        {
+            output += "\taddi sp, sp, " + std::to_string(delta) + "\n";
+            return;
+        }
+        output += "\tli t3, " + std::to_string(delta) + "\n\tadd sp, sp, t3\n";
+    }
+
+    // 把一个值读到寄存器 reg 中
+    void load_to_reg(std::string &output, const Result &value, const std::string &reg)
+    {
+        if (value.type == Result::Type::IMM)
+        {
+            output += "\tli " + reg + ", " + std::to_string(value.val) + "\n";
+            return;
+        }
+        emit_stack_access(output, "lw", reg, value.val + direct_context.sp_shift);
+    }
+
+    // 把寄存器 reg 写到新的栈位置中, 返回这个值
+    Result save_to_new_slot(std::string &output, const std::string &reg)
+    {
+        int offset = direct_context.new_stack_slot();
+        emit_stack_access(output, "sw", reg, offset);
+        return stack_value(offset);
+    }
+
+    /**
+     * @brief 输出一个双目运算, 两个操作数分别读到 t0 和 t1 中, 结果写到新的栈位置
+     * @param[in] output 汇编缓冲区
+     * @param[in] op Koopa 中的运算名, 比如 add, lt, ne
+     * @param[in] lhs 左操作数
+     * @param[in] rhs 右操作数
+     * @return 结果
+     */
+    Result emit_binary(std::string &output, const std::string &op, const Result &lhs, const Result &rhs)
+    {
+        load_to_reg(output, lhs, "t0");
+        load_to_reg(output, rhs, "t1");
+        if (op == "add" || op == "sub" || op == "mul" || op == "div")
+        {
+            output += "\t" + op + " t0, t0, t1\n";
+        }
+        else if (op == "mod")
+        {
+            output += "\trem t0, t0, t1\n";
+        }
+        else if (op == "lt")
+        {
+            output += "\tslt t0, t0, t1\n";
+        }
+        else if (op == "gt")
+        {
+            output += "\tsgt t0, t0, t1\n";
+        }
+        else if (op == "le")
+        {
+            output += "\tsgt t0, t0, t1\n\txori t0, t0, 1\n";
+        }
+        else if (op == "ge")
+        {
+            output += "\tslt t0, t0, t1\n\txori t0, t0, 1\n";
+        }
+        else if (op == "eq")
+        {
+            output += "\txor t0, t0, t1\n\tseqz t0, t0\n";
+        }
+        else if (op == "ne")
+        {
+            output += "\txor t0, t0, t1\n\tsnez t0, t0\n";
+        }
+        else
+        {
+            throw std::runtime_error("emit_binary: invalid operator " + op);
+        }
+        return save_to_new_slot(output, "t0");
+    }
+
+    // 把一个值转换成 0 或 1, 写到栈位置 offset 中, 结果留在 t0 中
+    void store_boolean(std::string &output, const Result &value, int offset)
+    {
+        load_to_reg(output, value, "t0");
+        output += "\tsnez t0, t0\n";
+        emit_stack_access(output, "sw", "t0", offset);
+    }
+}
+
+int direct_backend(const BaseAST &ast, std::ostream &out)
+{
+    std::string output;
+    output.reserve(1 << 16);
+    ast.emit_riscv(output);
+    out.write(output.data(), output.size());
+    out.flush();
+    return 0;
+}
+
+//////////////////////////////////////////
+// Program Unit
+//////////////////////////////////////////
+
+Result ProgramAST::emit_riscv(std::string &output) const
+{
+    // 库函数
+    for (const char *name : {"getint", "getch", "getarray"})
+    {
+        direct_context.func_has_return_value[name] = true;
+    }
+    for (const char *name : {"putint", "putch", "putarray", "starttime", "stoptime"})
+    {
+        direct_context.func_has_return_value[name] = false;
+    }
+    for (auto &comp_unit : comp_units)
+    {
+        comp_unit->emit_riscv(output);
+    }
+    return Result();
+}
+
+Result FuncDefAST::emit_riscv(std::string &output) const
+{
+    // 先把 ra 之外的栈帧翻译到 body 中, 翻译完成之后才知道栈帧大小, 再输出 prologue
+    direct_context.func_has_return_value[ident] = func_type == FuncType::INT;
+    direct_context.function_name = ident;
+    direct_context.stack_used_byte = 0;
+    direct_context.func_formal_params = func_formal_params;
+    direct_context.func_param_offsets.clear();
+    for (size_t i = 0; i < func_formal_params->size(); ++i)
+    {
+        direct_context.func_param_offsets.push_back(direct_context.new_stack_slot());
+    }
+
+    std::string body;
+    Result result = block->emit_riscv(body);
+    // 没有显式的 return 时返回 0, 直接执行到 epilogue
+    if (!result.control_flow_returned && func_type == FuncType::INT)
+    {
+        body += "\tli a0, 0\n";
+    }
+
+    // ra 在栈帧的最上面, 栈帧大小对齐到 16 字节
+    int frame_size = (direct_context.stack_used_byte + 4 + 15) / 16 * 16;
+    output += "\n\t.text\n\t.globl " + ident + "\n" + ident + ":\n";
+    emit_adjust_sp(output, -frame_size);
+    emit_stack_access(output, "sw", "ra", frame_size - 4);
+    // 前八个参数在 a0 - a7 中, 其余的在调用者的栈帧底部
+    for (size_t i = 0; i < func_formal_params->size(); ++i)
+    {
+        int offset = direct_context.func_param_offsets[i];
+        if (i < 8)
+        {
+            emit_stack_access(output, "sw", "a" + std::to_string(i), offset);
+        }
+        else
+        {
+            emit_stack_access(output, "lw", "t0", frame_size + 4 * (int)(i - 8));
+            emit_stack_access(output, "sw", "t0", offset);
+        }
+    }
+    output += body;
+    output += "epilogue_" + ident + ":\n";
+    emit_stack_access(output, "lw", "ra", frame_size - 4);
+    emit_adjust_sp(output, frame_size);
+    output += "\tret\n";
+    return Result();
+}
+
+Result BlockAST::emit_riscv(std::string &output) const
+{
+    direct_context.symbol_tables.emplace_back();
+
+    // 函数的第一个 block 中加入函数参数
+    if (direct_context.func_formal_params)
+    {
+        for (size_t i = 0; i < direct_context.func_formal_params->size(); ++i)
+        {
+            direct_context.insert_symbol(direct_context.func_formal_params->at(i), {DirectSymbol::Kind::LOCAL, direct_context.func_param_offsets[i]});
+        }
+        direct_context.func_formal_params = nullptr;
+    }
+
+    // 和 Koopa 输出一样, 返回或者打断循环之后的语句不再翻译
+    for (const auto &item : block_items)
+    {
+        Result result = item->emit_riscv(output);
+        if (result.control_flow_returned || result.control_flow_while_interrupted)
+        {
+            direct_context.symbol_tables.pop_back();
+            return result;
+        }
+    }
+    direct_context.symbol_tables.pop_back();
+    return Result();
+}
+
+Result BlockItemAST::emit_riscv(std::string &output) const
+{
+    if (stmt && !decl)
+    {
+        return (*stmt)->emit_riscv(output);
+    }
+    else if (!stmt && decl)
+    {
+        return (*decl)->emit_riscv(output);
+    }
+    else
+    {
+        throw std::runtime_error("BlockItemAST::emit_riscv: invalid block item");
+    }
+}
+
+Result StmtAST::emit_riscv(std::string &output) const
+{
+    if (stmt_type == StmtType::Assign)
+    {
+        if (!lval || !exp || block)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid assign statement");
+        }
+        std::string symbol_name = ((LValAST *)(*lval).get())->left_value_symbol;
+        Result value = (*exp)->emit_riscv(output);
+        DirectSymbol symbol = direct_context.name_to_symbol(symbol_name);
+        load_to_reg(output, value, "t0");
+        if (symbol.kind == DirectSymbol::Kind::LOCAL)
+        {
+            emit_stack_access(output, "sw", "t0", symbol.val);
+        }
+        else if (symbol.kind == DirectSymbol::Kind::GLOBAL)
+        {
+            output += "\tla t1, global_var_" + std::to_string(symbol.val) + "\n\tsw t0, 0(t1)\n";
+        }
+        else
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: assign to a constant");
+        }
+        return Result();
+    }
+    else if (stmt_type == StmtType::Return)
+    {
+        if (lval || block)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid return statement");
+        }
+        if (exp)
+        {
+            load_to_reg(output, (*exp)->emit_riscv(output), "a0");
+        }
+        output += "\tj epilogue_" + direct_context.function_name + "\n";
+        Result result;
+        result.control_flow_returned = true;
+        return result;
+    }
+    else if (stmt_type == StmtType::Expression)
+    {
+        if (lval || block)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid expression statement");
+        }
+        if (exp)
+        {
+            (*exp)->emit_riscv(output);
+        }
+        return Result();
+    }
+    else if (stmt_type == StmtType::Block)
+    {
+        if (lval || exp || !block)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid block statement");
+        }
+        return (*block)->emit_riscv(output);
+    }
+    else if (stmt_type == StmtType::If)
+    {
+        if (!inside_if_stmt)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid if statement, there's no if");
+        }
+        int index = ++direct_context.total_if_else_statement_count;
+        std::string then_label = "then_" + std::to_string(index);
+        std::string else_label = "else_" + std::to_string(index);
+        std::string end_label = "end_" + std::to_string(index);
+
+        load_to_reg(output, (*exp)->emit_riscv(output), "t0");
+        output += "\tbeqz t0, " + (inside_else_stmt ? else_label : end_label) + "\n";
+        output += then_label + ":\n";
+        Result result_if = (*inside_if_stmt)->emit_riscv(output);
+        bool if_exits = result_if.control_flow_returned || result_if.control_flow_while_interrupted;
+        if (!if_exits)
+        {
+            output += "\tj " + end_label + "\n";
+        }
+
+        Result result_else;
+        if (inside_else_stmt)
+        {
+            output += else_label + ":\n";
+            result_else = (*inside_else_stmt)->emit_riscv(output);
+        }
+        bool else_exits = result_else.control_flow_returned || result_else.control_flow_while_interrupted;
+        // 两边都离开了时没有控制流到达 end, 和 Koopa 输出一样不输出这个标签
+        if (!(if_exits && else_exits))
+        {
+            output += end_label + ":\n";
+        }
+
+        Result result;
+        result.control_flow_returned = result_if.control_flow_returned && result_else.control_flow_returned;
+        result.control_flow_while_interrupted = result_if.control_flow_while_interrupted && result_else.control_flow_while_interrupted;
+        return result;
+    }
+    else if (stmt_type == StmtType::While)
+    {
+        if (!exp || !inside_while_stmt)
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: invalid while statement");
+        }
+        int index = ++direct_context.total_while_statement_count;
+        direct_context.while_statement_stack.push(index);
+        std::string while_entry_label = "while_entry_" + std::to_string(index);
+        std::string while_body_label = "while_body_" + std::to_string(index);
+        std::string while_end_label = "while_end_" + std::to_string(index);
+
+        output += while_entry_label + ":\n";
+        load_to_reg(output, (*exp)->emit_riscv(output), "t0");
+        output += "\tbeqz t0, " + while_end_label + "\n";
+        output += while_body_label + ":\n";
+        Result result = (*inside_while_stmt)->emit_riscv(output);
+        if (!result.control_flow_returned && !result.control_flow_while_interrupted)
+        {
+            output += "\tj " + while_entry_label + "\n";
+        }
+        output += while_end_label + ":\n";
+        direct_context.while_statement_stack.pop();
+
+        // 循环体可能一次都不执行, 所以循环之后的代码仍然可达
+        return Result();
+    }
+    else if (stmt_type == StmtType::Break || stmt_type == StmtType::Continue)
+    {
+        if (direct_context.while_statement_stack.empty())
+        {
+            throw std::runtime_error("StmtAST::emit_riscv: break or continue statement not in a while statement");
+        }
+        std::string target = stmt_type == StmtType::Break ? "while_end_" : "while_entry_";
+        output += "\tj " + target + std::to_string(direct_context.while_statement_stack.top()) + "\n";
+        Result result;
+        result.control_flow_while_interrupted = true;
+        return result;
+    }
+    else
+    {
+        throw std::runtime_error("StmtAST::emit_riscv: invalid statement");
+    }
+}
+
+Result DeclAST::emit_riscv(std::string &output) const
+{
+    if (const_decl)
+    {
+        (*const_decl)->emit_riscv(output);
+    }
+    else if (var_decl)
+    {
+        (*var_decl)->emit_riscv(output);
+    }
+    else
+    {
+        throw std::runtime_error("DeclAST::emit_riscv: invalid declaration");
+    }
+    return Result();
+}
+
+//////////////////////////////////////////
+// Declaration
+//////////////////////////////////////////
+
+Result BTypeAST::emit_riscv(std::string &) const
+{
+    return Result();
+}
+
+Result ConstDeclAST::emit_riscv(std::string &output) const
+{
+    for (const auto &item : const_defs)
+    {
+        item->emit_riscv(output);
+    }
+    return Result();
+}
+
+Result ConstDefAST::emit_riscv(std::string &output) const
+{
+    Result value = const_init_val->emit_riscv(output);
+    if (value.type != Result::Type::IMM)
+    {
+        throw std::runtime_error("ConstDefAST::emit_riscv: initializer of " + const_symbol + " is not a constant");
+    }
+    direct_context.insert_symbol(const_symbol, {DirectSymbol::Kind::CONST, value.val});
+    return Result();
+}
+
+Result ConstInitValAST::emit_riscv(std::string &output) const
+{
+    return const_exp->emit_riscv(output);
+}
+
+Result VarDeclAST::emit_riscv(std::string &output) const
+{
+    for (const auto &item : var_defs)
+    {
+        item->emit_riscv(output);
+    }
+    return Result();
+}
+
+Result VarDefAST::emit_riscv(std::string &output) const
+{
+    // 和 Koopa 输出一样, 先计算初始值再加入符号表, 初始值中的同名变量是外层的变量
+    std::optional<Result> value;
+    if (var_init_val)
+    {
+        value = (*var_init_val)->emit_riscv(output);
+    }
+
+    if (direct_context.symbol_tables.size() == 1)
+    {
+        if (value && value->type != Result::Type::IMM)
+        {
+            throw std::runtime_error("VarDefAST::emit_riscv: initializer of global " + var_symbol + " is not a constant");
+        }
+        int index = direct_context.global_var_count++;
+        std::string name = "global_var_" + std::to_string(index);
+        output += "\n\t.data\n\t.globl " + name + "\n" + name + ":\n";
+        output += value ? "\t.word " + std::to_string(value->val) + "\n" : "\t.zero 4\n";
+        direct_context.insert_symbol(var_symbol, {DirectSymbol::Kind::GLOBAL, index});
+        return Result();
+    }
+
+    // 每个声明都有自己的栈位置
+    int offset = direct_context.new_stack_slot();
+    if (value)
+    {
+        load_to_reg(output, *value, "t0");
+        emit_stack_access(output, "sw", "t0", offset);
+    }
+    direct_context.insert_symbol(var_symbol, {DirectSymbol::Kind::LOCAL, offset});
+    return Result();
+}
+
+Result InitValAST::emit_riscv(std::string &output) const
+{
+    return exp->emit_riscv(output);
+}
+
+//////////////////////////////////////////
+// Expression and Left Value
+//////////////////////////////////////////
+
+Result ExpAST::emit_riscv(std::string &output) const
+{
+    return left_or_exp->emit_riscv(output);
+}
+
+Result ConstExpAST::emit_riscv(std::string &output) const
+{
+    return exp->emit_riscv(output);
+}
+
+Result LValAST::emit_riscv(std::string &output) const
+{
+    DirectSymbol symbol = direct_context.name_to_symbol(left_value_symbol);
+    if (symbol.kind == DirectSymbol::Kind::CONST)
+    {
+        return Result(Result::Type::IMM, symbol.val);
+    }
+    if (symbol.kind == DirectSymbol::Kind::LOCAL)
+    {
+        // 局部变量只能被赋值语句修改, 在一个表达式求值的过程中不会变化, 直接使用它的栈位置
+        return stack_value(symbol.val);
+    }
+    // 全局变量可能被表达式中调用的函数修改, 先读出当前的值
+    output += "\tla t0, global_var_" + std::to_string(symbol.val) + "\n\tlw t0, 0(t0)\n";
+    return save_to_new_slot(output, "t0");
+}
+
+Result PrimaryExpAST::emit_riscv(std::string &output) const
+{
+    if (exp && !number && !lval)
+    {
+        return (*exp)->emit_riscv(output);
+    }
+    else if (!exp && number && !lval)
+    {
+        return Result(Result::Type::IMM, *number);
+    }
+    else if (!exp && !number && lval)
+    {
+        return (*lval)->emit_riscv(output);
+    }
+    else
+    {
+        throw std::runtime_error("PrimaryExpAST::emit_riscv: invalid primary expression");
+    }
+}
+
+Result UnaryExpAST::emit_riscv(std::string &output) const
+{
+    if (primary_exp && !op && !unary_exp && !func_name && !func_real_params)
+    {
+        return (*primary_exp)->emit_riscv(output);
+    }
+    else if (!primary_exp && op && unary_exp && !func_name && !func_real_params)
+    {
+        Result operand = (*unary_exp)->emit_riscv(output);
+        if (*op != "+" && *op != "-" && *op != "!")
+        {
+            throw std::runtime_error("UnaryExpAST::emit_riscv: invalid unary operator");
+        }
+        if (operand.type == Result::Type::IMM)
+        {
+            int val = *op == "+" ? operand.val : *op == "-" ? -operand.val
+                                                            : !operand.val;
+            return Result(Result::Type::IMM, val);
+        }
+        if (*op == "+")
+        {
+            return operand;
+        }
+        load_to_reg(output, operand, "t0");
+        output += *op == "-" ? "\tneg t0, t0\n" : "\tseqz t0, t0\n";
+        return save_to_new_slot(output, "t0");
+    }
+    else if (!primary_exp && !op && !unary_exp && func_name && func_real_params)
+    {
+        std::vector<Result> args;
+        for (const auto &param : *(*func_real_params))
+        {
+            args.push_back(param->emit_riscv(output));
+        }
+        auto it = direct_context.func_has_return_value.find(*func_name);
+        if (it == direct_context.func_has_return_value.end())
+        {
+            throw std::runtime_error("UnaryExpAST::emit_riscv: function " + *func_name + " is not defined");
+        }
+
+        // 第八个之后的参数放在栈底, 调用期间临时下移 sp 给它们腾出对齐的空间
+        int num_stack_args = args.size() > 8 ? (int)args.size() - 8 : 0;
+        int stack_args_byte = (num_stack_args * 4 + 15) / 16 * 16;
+        if (stack_args_byte > 0)
+        {
+            emit_adjust_sp(output, -stack_args_byte);
+            direct_context.sp_shift = stack_args_byte;
+        }
+        for (size_t i = 8; i < args.size(); ++i)
+        {
+            load_to_reg(output, args[i], "t0");
+            output += "\tsw t0, " + std::to_string(4 * (i - 8)) + "(sp)\n";
+        }
+        for (size_t i = 0; i < args.size() && i < 8; ++i)
+        {
+            load_to_reg(output, args[i], "a" + std::to_string(i));
+        }
+        direct_context.sp_shift = 0;
+        output += "\tcall " + *func_name + "\n";
+        if (stack_args_byte > 0)
+        {
+            emit_adjust_sp(output, stack_args_byte);
+        }
+        return it->second ? save_to_new_slot(output, "a0") : Result();
+    }
+    else
+    {
+        throw std::runtime_error("UnaryExpAST::emit_riscv: invalid unary expression");
+    }
+}
+
+Result MulExpAST::emit_riscv(std::string &output) const
+{
+    if (!mul_exp && !op && unary_exp)
+    {
+        return (*unary_exp)->emit_riscv(output);
+    }
+    if (!mul_exp || !op || !unary_exp)
+    {
+        throw std::runtime_error("MulExpAST::emit_riscv: invalid mul expression");
+    }
+    Result lhs = (*mul_exp)->emit_riscv(output);
+    Result rhs = (*unary_exp)->emit_riscv(output);
+    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM)
+    {
+        // 和 Koopa 输出一样在编译期计算
+        if (*op == "*")
+        {
+            return Result(Result::Type::IMM, lhs.val * rhs.val);
+        }
+        else if (*op == "/")
+        {
+            return Result(Result::Type::IMM, lhs.val / rhs.val);
+        }
+        else if (*op == "%")
+        {
+            return Result(Result::Type::IMM, lhs.val % rhs.val);
+        }
+        throw std::runtime_error("MulExpAST::emit_riscv: invalid mul operator");
+    }
+    if (*op == "*")
+    {
+        return emit_binary(output, "mul", lhs, rhs);
+    }
+    else if (*op == "/")
+    {
+        return emit_binary(output, "div", lhs, rhs);
+    }
+    else if (*op == "%")
+    {
+        return emit_binary(output, "mod", lhs, rhs);
+    }
+    throw std::runtime_error("MulExpAST::emit_riscv: invalid mul operator");
+}
+
+Result AddExpAST::emit_riscv(std::string &output) const
+{
+    if (!add_exp && !op && mul_exp)
+    {
+        return (*mul_exp)->emit_riscv(output);
+    }
+    if (!add_exp || !op || !mul_exp)
+    {
+        throw std::runtime_error("AddExpAST::emit_riscv: invalid add expression");
+    }
+    Result lhs = (*add_exp)->emit_riscv(output);
+    Result rhs = (*mul_exp)->emit_riscv(output);
+    if (*op != "+" && *op != "-")
+    {
+        throw std::runtime_error("AddExpAST::emit_riscv: invalid add operator");
+    }
+    if (lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM)
+    {
+        return Result(Result::Type::IMM, *op == "+" ? lhs.val + rhs.val : lhs.val - rhs.val);
+    }
+    return emit_binary(output, *op == "+" ? "add" : "sub", lhs, rhs);
+}
+
+Result RelExpAST::emit_riscv(std::string &output) const
+{
+    if (!rel_exp && !op && add_exp)
+    {
+        return (*add_exp)->emit_riscv(output);
+    }
+    if (!rel_exp || !op || !add_exp)
+    {
+        throw std::runtime_error("RelExpAST::emit_riscv: invalid relational expression");
+    }
+    Result lhs = (*rel_exp)->emit_riscv(output);
+    Result rhs = (*add_exp)->emit_riscv(output);
+    bool both_imm = lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM;
+    if (*op == "<")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val < rhs.val) : emit_binary(output, "lt", lhs, rhs);
+    }
+    else if (*op == ">")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val > rhs.val) : emit_binary(output, "gt", lhs, rhs);
+    }
+    else if (*op == "<=")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val <= rhs.val) : emit_binary(output, "le", lhs, rhs);
+    }
+    else if (*op == ">=")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val >= rhs.val) : emit_binary(output, "ge", lhs, rhs);
+    }
+    throw std::runtime_error("RelExpAST::emit_riscv: invalid relational operator");
+}
+
+Result EqExpAST::emit_riscv(std::string &output) const
+{
+    if (!eq_exp && !op && rel_exp)
+    {
+        return (*rel_exp)->emit_riscv(output);
+    }
+    if (!eq_exp || !op || !rel_exp)
+    {
+        throw std::runtime_error("EqExpAST::emit_riscv: invalid equality expression");
+    }
+    Result lhs = (*eq_exp)->emit_riscv(output);
+    Result rhs = (*rel_exp)->emit_riscv(output);
+    bool both_imm = lhs.type == Result::Type::IMM && rhs.type == Result::Type::IMM;
+    if (*op == "==")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val == rhs.val) : emit_binary(output, "eq", lhs, rhs);
+    }
+    else if (*op == "!=")
+    {
+        return both_imm ? Result(Result::Type::IMM, lhs.val != rhs.val) : emit_binary(output, "ne", lhs, rhs);
+    }
+    throw std::runtime_error("EqExpAST::emit_riscv: invalid equality operator");
+}
+
+Result LAndExpAST::emit_riscv(std::string &output) const
+{
+    if (!left_and_exp && !op && eq_exp)
+    {
+        return (*eq_exp)->emit_riscv(output);
+    }
+    if (!left_and_exp || !op || !eq_exp)
+    {
+        throw std::runtime_error("LAndExpAST::emit_riscv: invalid logical AND expression");
+    }
+    Result lhs = (*left_and_exp)->emit_riscv(output);
+
+    // 短路求值, 第一个操作数是立即数时在编译期完成
+    if (lhs.type == Result::Type::IMM && lhs.val == 0)
+    {
+        return Result(Result::Type::IMM, 0);
+    }
+    if (lhs.type == Result::Type::IMM)
+    {
+        Result rhs = (*eq_exp)->emit_riscv(output);
+        if (rhs.type == Result::Type::IMM)
+        {
+            return Result(Result::Type::IMM, rhs.val != 0);
+        }
+        int offset = direct_context.new_stack_slot();
+        store_boolean(output, rhs, offset);
+        return stack_value(offset);
+    }
+
+    // 第一个操作数为 0 时结果就是 0, 跳过第二个操作数
+    int index = ++direct_context.total_and_statement_count;
+    std::string and_second_operator_label = "and_second_operator_" + std::to_string(index);
+    std::string and_end_label = "and_end_" + std::to_string(index);
+    int offset = direct_context.new_stack_slot();
+    store_boolean(output, lhs, offset);
+    output += "\tbeqz t0, " + and_end_label + "\n";
+    output += and_second_operator_label + ":\n";
+    store_boolean(output, (*eq_exp)->emit_riscv(output), offset);
+    output += and_end_label + ":\n";
+    return stack_value(offset);
+}
+
+Result LOrExpAST::emit_riscv(std::string &output) const
+{
+    if (!left_or_exp && !op && left_and_exp)
+    {
+        return (*left_and_exp)->emit_riscv(output);
+    }
+    if (!left_or_exp || !op || !left_and_exp)
+    {
+        throw std::runtime_error("LOrExpAST::emit_riscv: invalid logical OR expression");
+    }
+    Result lhs = (*left_or_exp)->emit_riscv(output);
+
+    // 短路求值, 第一个操作数是立即数时在编译期完成
+    if (lhs.type == Result::Type::IMM && lhs.val != 0)
+    {
+        return Result(Result::Type::IMM, 1);
+    }
+    if (lhs.type == Result::Type::IMM)
+    {
+        Result rhs = (*left_and_exp)->emit_riscv(output);
+        if (rhs.type == Result::Type::IMM)
+        {
+            return Result(Result::Type::IMM, rhs.val != 0);
+        }
+        int offset = direct_context.new_stack_slot();
+        store_boolean(output, rhs, offset);
+        return stack_value(offset);
+    }
+
+    // 第一个操作数不为 0 时结果就是 1, 跳过第二个操作数
+    int index = ++direct_context.total_or_statement_count;
+    std::string or_second_operator_label = "or_second_operator_" + std::to_string(index);
+    std::string or_end_label = "or_end_" + std::to_string(index);
+    int offset = direct_context.new_stack_slot();
+    store_boolean(output, lhs, offset);
+    output += "\tbnez t0, " + or_end_label + "\n";
+    output += or_second_operator_label + ":\n";
+    store_boolean(output, (*left_and_exp)->emit_riscv(output), offset);
+    output += or_end_label + ":\n";
+    return stack_value(offset);
+}
@@ -0,0 +1,213 @@
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/riscv.hpp"
+
+// 当前函数
+static koopa_raw_function_t frame_func = nullptr;
+
+// 当前函数中在建立栈帧之前执行的基本块
+static std::unordered_set<koopa_raw_basic_block_t> frameless_bbs;
+
+// 当前函数共用的 epilogue 的标签, 以及是否有 ret 跳到这里
+static std::string epilogue_label;
+static bool epilogue_used = false;
+
+// 基本块是否需要栈帧: 访问栈上的值, 使用 callee-saved 寄存器, 调用其他函数, 或者拷贝参数时需要中转
+static bool needs_frame(const koopa_raw_basic_block_t &bb, StackManager &stack_manager)
+{
+    // 值的位置是否在栈帧中
+    auto in_frame = [&](koopa_raw_value_t value)
+    {
+        switch (value->kind.tag)
+        {
+        case KOOPA_RVT_INTEGER:
+        case KOOPA_RVT_ZERO_INIT:
+        case KOOPA_RVT_GLOBAL_ALLOC:
+            return false;
+        case KOOPA_RVT_ALLOC:
+            return true;
+        case KOOPA_RVT_FUNC_ARG_REF:
+            // 后面的参数相对于 sp 寻址, 建立栈帧之后 sp 才是确定的
+            if (value->kind.data.func_arg_ref.index >= 8)
+            {
+                return true;
+            }
+            break;
+        default:
+            if (value->ty->tag == KOOPA_RTT_UNIT)
+            {
+                return false;
+            }
+            break;
+        }
+        return !stack_manager.has_home_reg(value) || stack_manager.get_home_reg(value)[0] == 's';
+    };
+
+    for (auto param : get_values(bb->params))
+    {
+        if (in_frame(param))
+        {
+            return true;
+        }
+    }
+    std::vector<koopa_raw_value_t> insts = get_insts(bb);
+    for (size_t i = 0; i < insts.size(); ++i)
+    {
+        koopa_raw_value_t inst = insts[i];
+        // 尾调用不需要栈帧, 没有建立栈帧时直接跳转过去; 其他调用都要保存 ra
+        if (inst->kind.tag == KOOPA_RVT_CALL && !(i + 1 < insts.size() && is_tail_call(inst, insts[i + 1])))
+        {
+            return true;
+        }
+        // 插桩模式下 main 返回前要调用 __prof_dump
+        if (inst->kind.tag == KOOPA_RVT_RETURN && profile_manager.is_generating() && riscv_context_manager.get_current_function_name() == "main")
+        {
+            return true;
+        }
+        if (in_frame(inst))
+        {
+            return true;
+        }
+        for (auto operand : get_operands(inst))
+        {
+            if (in_frame(operand))
+            {
+                return true;
+            }
+        }
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(inst);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            if (block_args_conflict(succs[k], get_successor_args(inst, k)))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void plan_frame(const koopa_raw_function_t &func)
+{
+    frame_func = func;
+    frameless_bbs.clear();
+    epilogue_label = std::string("epilogue_") + (func->name + 1);
+    epilogue_used = false;
+
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    // 没有栈帧的函数所有基本块都不需要建立栈帧
+    if (stack_manager.get_num_stack_frame_byte() == 0)
+    {
+        frameless_bbs.insert(bbs.begin(), bbs.end());
+        return;
+    }
+
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t>> preds;
+    for (auto bb : bbs)
+    {
+        for (auto succ : get_successors(bb))
+        {
+            preds[succ].push_back(bb);
+        }
+        if (!needs_frame(bb, stack_manager))
+        {
+            frameless_bbs.insert(bb);
+        }
+    }
+    // 只有所有前驱都没有建立栈帧的基本块才能在 prologue 之前执行, 否则进入它的时候可能已经有栈帧了
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto bb : bbs)
+        {
+            if (!frameless_bbs.count(bb))
+            {
+                continue;
+            }
+            for (auto pred : preds[bb])
+            {
+                if (!frameless_bbs.count(pred))
+                {
+                    frameless_bbs.erase(bb);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    // entry 需要栈帧时, prologue 就在函数开头, 所有基本块都在它之后执行
+    if (!frameless_bbs.count(bbs[0]))
+    {
+        frameless_bbs.clear();
+    }
+}
+
+bool is_frameless(const koopa_raw_basic_block_t &bb)
+{
+    return frameless_bbs.count(bb) > 0;
+}
+
+void emit_prologue()
+{
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    int frame_size = stack_manager.get_num_stack_frame_byte();
+    // 开辟栈帧, 保存 ra 寄存器和用到的 callee-saved 寄存器
+    riscv_printer.addi("sp", "sp", -frame_size, riscv_context_manager);
+    if (stack_manager.get_save_ra())
+    {
+        riscv_printer.sw("ra", "sp", frame_size - 4, riscv_context_manager);
+    }
+    const std::vector<std::string> &regs = stack_manager.get_callee_saved_regs();
+    for (size_t i = 0; i < regs.size(); ++i)
+    {
+        riscv_printer.sw(regs[i], "sp", stack_manager.get_callee_saved_offset(i), riscv_context_manager);
+    }
+    // 不在到达时所在的寄存器中的参数, 保存到栈上或者它的 callee-saved 寄存器中; 在此之前 ai 不会被覆盖
+    for (size_t i = 0; i < std::min((size_t)frame_func->params.len, (size_t)8); ++i)
+    {
+        auto param = reinterpret_cast<koopa_raw_value_t>(frame_func->params.buffer[i]);
+        save_value(param, "a" + std::to_string(i));
+    }
+}
+
+void emit_frame_teardown()
+{
+    StackManager &stack_manager = riscv_context_manager.get_current_function_stack_manager();
+    int frame_size = stack_manager.get_num_stack_frame_byte();
+    const std::vector<std::string> &regs = stack_manager.get_callee_saved_regs();
+    for (size_t i = 0; i < regs.size(); ++i)
+    {
+        riscv_printer.lw(regs[i], "sp", stack_manager.get_callee_saved_offset(i), riscv_context_manager);
+    }
+    if (stack_manager.get_save_ra())
+    {
+        riscv_printer.lw("ra", "sp", frame_size - 4, riscv_context_manager);
+    }
+    riscv_printer.addi("sp", "sp", frame_size, riscv_context_manager);
+}
+
+void emit_jump_to_epilogue(bool fall_through)
+{
+    epilogue_used = true;
+    if (!fall_through)
+    {
+        riscv_printer.jump(epilogue_label);
+    }
+}
+
+void emit_epilogue()
+{
+    if (!epilogue_used)
+    {
+        return;
+    }
+    riscv_printer.label(epilogue_label);
+    emit_frame_teardown();
+    riscv_printer.ret();
+    epilogue_used = false;
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "include/riscv.hpp"
+#include "include/analysis.hpp"
+
+namespace
+{
+    // 静态估计时, 每层循环把执行频率放大的倍数
+    const double loop_scale = 8;
+
+    // 静态估计的分支概率 (Ball-Larus 启发式): 回边和留在循环中的边通常被走, 直接返回的边通常不被走
+    const double back_edge_probability = 0.88;
+    const double loop_stay_probability = 0.8;
+    const double return_probability = 0.28;
+
+    /**
+     * @brief 控制流图上的一条边, 权重是估计的执行次数
+     * @date 2026-10-18
+     */
+    struct LayoutEdge
+    {
+        koopa_raw_basic_block_t from;
+        koopa_raw_basic_block_t to;
+        double weight;
+    };
+
+    // 基本块是否以 ret 结尾
+    bool ends_with_return(koopa_raw_basic_block_t bb)
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        return terminator && terminator->kind.tag == KOOPA_RVT_RETURN;
+    }
+}
+
+/**
+ * @brief 没有 profile 时估计 branch 走向 true 一边的概率
+ * @param[in] bb 以 branch 结尾的基本块
+ * @param[in] dom_tree 函数的支配树
+ * @param[in] loop_info 函数的循环信息
+ * @return true 一边的概率
+ */
+static double static_true_probability(koopa_raw_basic_block_t bb, const DominatorTree &dom_tree, const LoopInfo &loop_info)
+{
+    const koopa_raw_branch_t &branch = get_terminator(bb)->kind.data.branch;
+    koopa_raw_basic_block_t succs[2] = {branch.true_bb, branch.false_bb};
+    // 回边: 跳回支配当前基本块的循环头
+    bool back[2], stays[2], returns[2];
+    Loop *loop = loop_info.loop_of(bb);
+    for (int k = 0; k < 2; ++k)
+    {
+        back[k] = dom_tree.dominates(succs[k], bb);
+        stays[k] = loop && loop->contains(succs[k]);
+        returns[k] = ends_with_return(succs[k]);
+    }
+    if (back[0] != back[1])
+    {
+        return back[0] ? back_edge_probability : 1 - back_edge_probability;
+    }
+    if (loop && stays[0] != stays[1])
+    {
+        return stays[0] ? loop_stay_probability : 1 - loop_stay_probability;
+    }
+    if (returns[0] != returns[1])
+    {
+        return returns[0] ? return_probability : 1 - return_probability;
+    }
+    return 0.5;
+}
+
+/**
+ * @brief 统计按照 layout 输出时需要的无条件跳转数量: jump 的目标不是下一个基本块, 或者 branch 的两个目标都不是下一个基本块
+ * @note 不算带参数的分支边额外需要的跳转和跳到 epilogue 的跳转
+ * @param[in] layout 基本块的输出顺序
+ * @return 无条件跳转的数量
+ */
+static int count_static_jumps(const std::vector<koopa_raw_basic_block_t> &layout)
+{
+    int jumps = 0;
+    for (size_t i = 0; i < layout.size(); ++i)
+    {
+        koopa_raw_basic_block_t next = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+        koopa_raw_value_t terminator = get_terminator(layout[i]);
+        if (!terminator)
+        {
+            continue;
+        }
+        if (terminator->kind.tag == KOOPA_RVT_JUMP && terminator->kind.data.jump.target != next)
+        {
+            ++jumps;
+        }
+        else if (terminator->kind.tag == KOOPA_RVT_BRANCH && terminator->kind.data.branch.true_bb != next && terminator->kind.data.branch.false_bb != next)
+        {
+            ++jumps;
+        }
+    }
+    return jumps;
+}
+
+std::vector<koopa_raw_basic_block_t> layout_basic_blocks(const koopa_raw_function_t &func)
+{
+    std::vector<koopa_raw_basic_block_t> original = get_basic_blocks(func);
+
+    const DominatorTree &dom_tree = analysis_manager.dominator_tree(func);
+    const LoopInfo &loop_info = analysis_manager.loop_info(func);
+    std::string function_name = func->name + 1;
+    bool use_profile = profile_manager.has_profile();
+    auto profile_count = [&](koopa_raw_basic_block_t bb)
+    {
+        return use_profile ? profile_manager.count(ProfileManager::block_key(function_name, bb->name + 1)) : -1;
+    };
+
+    // 每条边走的概率: 有 profile 时用两个目标的计数估计, 否则用静态启发式
+    std::vector<LayoutEdge> edges;
+    for (auto bb : dom_tree.rpo())
+    {
+        koopa_raw_value_t terminator = get_terminator(bb);
+        if (!terminator)
+        {
+            continue;
+        }
+        if (terminator->kind.tag == KOOPA_RVT_JUMP)
+        {
+            edges.push_back({bb, terminator->kind.data.jump.target, 1});
+        }
+        else if (terminator->kind.tag == KOOPA_RVT_BRANCH)
+        {
+            const koopa_raw_branch_t &branch = terminator->kind.data.branch;
+            long long true_count = profile_count(branch.true_bb), false_count = profile_count(branch.false_bb);
+            double p = true_count >= 0 && false_count >= 0 && true_count + false_count > 0 ? (double)true_count / (true_count + false_count) : static_true_probability(bb, dom_tree, loop_info);
+            edges.push_back({bb, branch.true_bb, p});
+            edges.push_back({bb, branch.false_bb, 1 - p});
+        }
+    }
+
+    // 基本块的执行频率: 有 profile 时用计数; 否则按逆后序沿着前向边传播, 进入循环头的频率再放大 loop_scale 倍
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<const LayoutEdge *>> in_edges;
+    for (const auto &edge : edges)
+    {
+        in_edges[edge.to].push_back(&edge);
+    }
+    std::unordered_map<koopa_raw_basic_block_t, double> freq;
+    std::unordered_map<koopa_raw_basic_block_t, bool> cold;
+    for (auto bb : dom_tree.rpo())
+    {
+        long long count = profile_count(bb);
+        // 计数为 0 的基本块在 profile 中从来没有执行过, 是冷的, 统一放到函数末尾; entry 必须放在最前面
+        cold[bb] = count == 0 && bb != original[0];
+        if (count >= 0)
+        {
+            freq[bb] = count;
+            continue;
+        }
+        double f = bb == original[0] ? 1 : 0;
+        for (auto edge : in_edges[bb])
+        {
+            if (!dom_tree.dominates(bb, edge->from))
+            {
+                f += freq[edge->from] * edge->weight;
+            }
+        }
+        Loop *loop = loop_info.loop_of(bb);
+        freq[bb] = loop && loop->header == bb ? f * loop_scale : f;
+    }
+    // 边的权重是估计的执行次数
+    for (auto &edge : edges)
+    {
+        edge.weight *= freq[edge.from];
+    }
+
+    // 自底向上把基本块连成链 (Pettis-Hansen): 按权重从大到小, 边的两端分别是一条链的末尾和另一条链的开头时合并, 合并之后这条边就是 fall through
+    std::unordered_map<koopa_raw_basic_block_t, std::vector<koopa_raw_basic_block_t> *> chain_of;
+    std::vector<std::vector<koopa_raw_basic_block_t>> chains(original.size());
+    for (size_t i = 0; i < original.size(); ++i)
+    {
+        chains[i].push_back(original[i]);
+        chain_of[original[i]] = &chains[i];
+    }
+    std::unordered_map<koopa_raw_basic_block_t, size_t> original_index;
+    for (size_t i = 0; i < original.size(); ++i)
+    {
+        original_index[original[i]] = i;
+    }
+    auto falls_through = [&](const LayoutEdge &edge)
+    {
+        return original_index[edge.to] == original_index[edge.from] + 1;
+    };
+    // 权重相同时优先保留原来顺序中的 fall through, 再按原来的顺序
+    std::vector<LayoutEdge> sorted = edges;
+    std::stable_sort(sorted.begin(), sorted.end(), [&](const LayoutEdge &a, const LayoutEdge &b)
+                     {
+                         if (a.weight != b.weight)
+                         {
+                             return a.weight > b.weight;
+                         }
+                         return falls_through(a) && !falls_through(b); });
+    for (const auto &edge : sorted)
+    {
+        auto *from = chain_of[edge.from], *to = chain_of[edge.to];
+        // 回边不合并, 循环头留在链的开头, 从循环外面进入时可以 fall through
+        if (from == to || from->back() != edge.from || to->front() != edge.to || edge.to == original[0] || cold[edge.from] != cold[edge.to] || dom_tree.dominates(edge.to, edge.from))
+        {
+            continue;
+        }
+        from->insert(from->end(), to->begin(), to->end());
+        for (auto bb : *to)
+        {
+            chain_of[bb] = from;
+        }
+        to->clear();
+    }
+
+    // 链的顺序: entry 所在的链最先, 然后按照进入链开头的最重的边排列, 冷的链放到最后, 其余按原来的顺序
+    std::unordered_map<std::vector<koopa_raw_basic_block_t> *, double> priority;
+    for (const auto &edge : edges)
+    {
+        auto *to = chain_of[edge.to];
+        if (chain_of[edge.from] != to && to->front() == edge.to)
+        {
+            priority[to] = std::max(priority[to], edge.weight);
+        }
+    }
+    std::vector<std::vector<koopa_raw_basic_block_t> *> order;
+    for (auto &chain : chains)
+    {
+        if (!chain.empty() && chain.front() != original[0])
+        {
+            order.push_back(&chain);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::vector<koopa_raw_basic_block_t> *a, std::vector<koopa_raw_basic_block_t> *b)
+                     {
+                         if (cold[a->front()] != cold[b->front()])
+                         {
+                             return !cold[a->front()];
+                         }
+                         return priority[a] > priority[b]; });
+
+    std::vector<koopa_raw_basic_block_t> layout = *chain_of[original[0]];
+    for (auto *chain : order)
+    {
+        layout.insert(layout.end(), chain->begin(), chain->end());
+    }
+
+    add_opt_statistic("layout.static-jumps-before", count_static_jumps(original));
+    add_opt_statistic("layout.static-jumps-after", count_static_jumps(layout));
+    return layout;
+}
@@ -0,0 +1,412 @@
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "include/riscv.hpp"
+
+// 各个核心的大致延迟, 单位是周期; 顺序执行的核心上一串相互依赖的指令的代价近似为延迟之和
+static const RISCVCostModel cost_models[] = {
+    // 名字, alu, mul, mulh, div, branch_miss
+    {"generic", 1, 4, 4, 34, 6},
+    {"rocket", 1, 8, 8, 33, 3},
+    {"sifive-e31", 1, 2, 3, 33, 3},
+    // 没有硬件乘法器, 乘除法都是逐位迭代的; 没有分支预测, 跳转的分支总是要多等几个周期
+    {"picorv32", 1, 40, 40, 40, 3},
+};
+
+// 当前使用的代价表, 默认是 generic
+static const RISCVCostModel *cost_model = &cost_models[0];
+
+void set_target_core(const std::string &core)
+{
+    for (const auto &model : cost_models)
+    {
+        if (core == model.name)
+        {
+            cost_model = &model;
+            return;
+        }
+    }
+    throw std::runtime_error("set_target_core: unknown core " + core);
+}
+
+const RISCVCostModel &get_target_cost_model()
+{
+    return *cost_model;
+}
+
+// 目标是否支持 Zicond 扩展
+static bool has_zicond = false;
+
+void set_target_arch(const std::string &arch)
+{
+    const std::string base = "rv32im";
+    if (arch.compare(0, base.size(), base) != 0)
+    {
+        throw std::runtime_error("set_target_arch: unsupported base isa " + arch);
+    }
+    has_zicond = false;
+    size_t pos = base.size();
+    while (pos < arch.size())
+    {
+        if (arch[pos] != '_')
+        {
+            throw std::runtime_error("set_target_arch: malformed isa string " + arch);
+        }
+        size_t next = arch.find('_', pos + 1);
+        std::string ext = arch.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+        if (ext == "zicond")
+        {
+            has_zicond = true;
+        }
+        else
+        {
+            throw std::runtime_error("set_target_arch: unsupported extension " + ext);
+        }
+        pos = next == std::string::npos ? arch.size() : next;
+    }
+}
+
+bool target_has_zicond()
+{
+    return has_zicond;
+}
+
+// li 一个立即数的代价, 超出 12 位时是 lui + addi 两条指令
+static int li_cost(int32_t imm)
+{
+    return (imm >= -2048 && imm < 2048 ? 1 : 2) * cost_model->alu;
+}
+
+// 是否是 2 的幂, 返回幂次; 按无符号数看, 所以 INT_MIN 是 2^31
+static int log2_exact(uint32_t value)
+{
+    if (value == 0 || (value & (value - 1)) != 0)
+    {
+        return -1;
+    }
+    int k = 0;
+    while ((value >> k) != 1)
+    {
+        ++k;
+    }
+    return k;
+}
+
+// 常数的非相邻形式 (NAF), 每一位是 +1 或 -1, 返回 (移位数, 符号), 模 2^32 意义下和原来的常数相等
+static std::vector<std::pair<int, int>> non_adjacent_form(uint32_t value)
+{
+    std::vector<std::pair<int, int>> digits;
+    uint64_t n = value;
+    for (int i = 0; n != 0 && i < 32; ++i, n >>= 1)
+    {
+        if (n & 1)
+        {
+            int digit = (n & 3) == 1 ? 1 : -1;
+            digits.push_back({i, digit});
+            n -= digit;
+        }
+    }
+    return digits;
+}
+
+// 移位加减的第一项: 移位最多的正项, 这样不需要 neg; 没有正项时就是第一项
+static size_t first_shift_add_term(const std::vector<std::pair<int, int>> &digits)
+{
+    size_t first = 0;
+    for (size_t i = 0; i < digits.size(); ++i)
+    {
+        if (digits[i].second > 0 && (digits[first].second < 0 || digits[i].first > digits[first].first))
+        {
+            first = i;
+        }
+    }
+    return first;
+}
+
+// 移位加减实现乘常数的指令数, 和 emit_mul_by_shift_add 输出的指令对应
+static int shift_add_count(const std::vector<std::pair<int, int>> &digits)
+{
+    if (digits.empty())
+    {
+        return 1;
+    }
+    size_t first = first_shift_add_term(digits);
+    int count = 1 + (digits[first].second < 0);
+    for (size_t i = 0; i < digits.size(); ++i)
+    {
+        if (i != first)
+        {
+            count += (digits[i].first != 0) + 1;
+        }
+    }
+    return count;
+}
+
+// 输出 cur = x * c, 使用 x, cur 和 temp 三个互不相同的寄存器
+static void emit_mul_by_shift_add(const std::string &cur, const std::string &x, const std::string &temp, const std::vector<std::pair<int, int>> &digits)
+{
+    if (digits.empty())
+    {
+        riscv_printer.li(cur, 0);
+        return;
+    }
+    size_t first = first_shift_add_term(digits);
+    if (digits[first].first == 0)
+    {
+        riscv_printer.mv(cur, x);
+    }
+    else
+    {
+        riscv_printer.slli(cur, x, digits[first].first);
+    }
+    if (digits[first].second < 0)
+    {
+        riscv_printer.neg(cur, cur);
+    }
+    for (size_t i = 0; i < digits.size(); ++i)
+    {
+        if (i == first)
+        {
+            continue;
+        }
+        std::string term = x;
+        if (digits[i].first != 0)
+        {
+            riscv_printer.slli(temp, x, digits[i].first);
+            term = temp;
+        }
+        if (digits[i].second > 0)
+        {
+            riscv_printer.add(cur, cur, term);
+        }
+        else
+        {
+            riscv_printer.sub(cur, cur, term);
+        }
+    }
+}
+
+// 有符号除以常数 d (2 <= |d| < 2^31, 不是 2 的幂) 的魔数, 参考 Hacker's Delight 10-1 节
+static void signed_magic(int32_t d, int32_t &magic, int &shift)
+{
+    const uint32_t two31 = 0x80000000u;
+    uint32_t ad = d < 0 ? -(uint32_t)d : (uint32_t)d;
+    uint32_t t = two31 + ((uint32_t)d >> 31);
+    uint32_t anc = t - 1 - t % ad;
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+    do
+    {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    magic = (int32_t)(q2 + 1);
+    if (d < 0)
+    {
+        magic = -magic;
+    }
+    shift = p - 32;
+}
+
+// 魔数除法的代价, 和 emit_div_by_magic 输出的指令对应
+static int magic_div_cost(int32_t d)
+{
+    int32_t magic;
+    int shift;
+    signed_magic(d, magic, shift);
+    int cost = li_cost(magic) + cost_model->mulh + 2 * cost_model->alu;
+    cost += ((d > 0 && magic < 0) || (d < 0 && magic > 0)) ? cost_model->alu : 0;
+    cost += shift > 0 ? cost_model->alu : 0;
+    return cost;
+}
+
+// 输出 cur = x / d, 向零取整: 商的近似值取高 32 位, 修正之后再加上符号位, 使负数的商向零取整
+static void emit_div_by_magic(const std::string &cur, const std::string &x, const std::string &temp, int32_t d)
+{
+    int32_t magic;
+    int shift;
+    signed_magic(d, magic, shift);
+    riscv_printer.li(temp, magic);
+    riscv_printer.mulh(cur, x, temp);
+    if (d > 0 && magic < 0)
+    {
+        riscv_printer.add(cur, cur, x);
+    }
+    else if (d < 0 && magic > 0)
+    {
+        riscv_printer.sub(cur, cur, x);
+    }
+    if (shift > 0)
+    {
+        riscv_printer.srai(cur, cur, shift);
+    }
+    riscv_printer.srli(temp, cur, 31);
+    riscv_printer.add(cur, cur, temp);
+}
+
+// 输出 cur = x + (x < 0 ? 2^k - 1 : 0), 之后算术右移 k 位就是向零取整的除以 2^k
+static void emit_round_toward_zero_bias(const std::string &cur, const std::string &x, const std::string &temp, int k)
+{
+    if (k == 1)
+    {
+        riscv_printer.srli(temp, x, 31);
+    }
+    else
+    {
+        riscv_printer.srai(temp, x, 31);
+        riscv_printer.srli(temp, temp, 32 - k);
+    }
+    riscv_printer.add(cur, x, temp);
+}
+
+// 用常数的非零操作数做乘法, 除法或取模时, 输出更便宜的指令序列, 返回是否处理了这条指令
+bool visit_binary_with_constant(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value)
+{
+    koopa_raw_value_t x = binary.lhs;
+    koopa_raw_value_t constant = binary.rhs;
+    if (binary.op == KOOPA_RBO_MUL && x->kind.tag == KOOPA_RVT_INTEGER && constant->kind.tag != KOOPA_RVT_INTEGER)
+    {
+        std::swap(x, constant);
+    }
+    if (constant->kind.tag != KOOPA_RVT_INTEGER || x == constant)
+    {
+        return false;
+    }
+    int32_t c = constant->kind.data.integer.value;
+    // 除以 0 的结果由硬件决定, 保持原样
+    if (c == 0 && binary.op != KOOPA_RBO_MUL)
+    {
+        return false;
+    }
+
+    // 先决定怎么输出, 比原来的指令慢就不处理
+    std::vector<std::pair<int, int>> digits;
+    int k = log2_exact(c < 0 ? -(uint32_t)c : (uint32_t)c);
+    int magic_cost = 0;
+    switch (binary.op)
+    {
+    case KOOPA_RBO_MUL:
+        digits = non_adjacent_form((uint32_t)c);
+        if (shift_add_count(digits) * cost_model->alu >= li_cost(c) + cost_model->mul)
+        {
+            return false;
+        }
+        add_opt_statistic("riscv.mul-by-constant", 1);
+        break;
+    case KOOPA_RBO_DIV:
+        if (k < 0)
+        {
+            magic_cost = magic_div_cost(c);
+            if (magic_cost >= li_cost(c) + cost_model->div)
+            {
+                return false;
+            }
+        }
+        add_opt_statistic("riscv.div-by-constant", 1);
+        break;
+    case KOOPA_RBO_MOD:
+        if (k < 0)
+        {
+            magic_cost = magic_div_cost(c) + li_cost(c) + cost_model->mul + cost_model->alu;
+            if (magic_cost >= li_cost(c) + cost_model->div)
+            {
+                return false;
+            }
+        }
+        add_opt_statistic("riscv.mod-by-constant", 1);
+        break;
+    default:
+        return false;
+    }
+
+    // 加载 x, 在输出结束之前不释放, 这样结果和中转寄存器都和 x 不同
+    riscv_context_manager.allocate_reg(x);
+    std::string lhs = riscv_context_manager.value_to_reg_string(x);
+    load_value_to_reg(x, lhs);
+    riscv_context_manager.allocate_reg(value);
+    std::string cur = riscv_context_manager.value_to_reg_string(value);
+    std::string temp = riscv_context_manager.new_temp_reg();
+
+    if (binary.op == KOOPA_RBO_MUL)
+    {
+        emit_mul_by_shift_add(cur, lhs, temp, digits);
+    }
+    else if (binary.op == KOOPA_RBO_DIV)
+    {
+        if (c == 1 || c == -1)
+        {
+            // 除以 -1 就是取相反数, INT_MIN 的结果和 div 一样还是 INT_MIN
+            riscv_printer.mv(cur, lhs);
+        }
+        else if (k > 0)
+        {
+            emit_round_toward_zero_bias(cur, lhs, temp, k);
+            riscv_printer.srai(cur, cur, k);
+        }
+        else
+        {
+            emit_div_by_magic(cur, lhs, temp, c);
+        }
+        if (c < 0 && k >= 0)
+        {
+            riscv_printer.neg(cur, cur);
+        }
+    }
+    else
+    {
+        // 余数的符号和被除数相同, 与除数的符号无关
+        if (c == 1 || c == -1)
+        {
+            riscv_printer.li(cur, 0);
+        }
+        else if (k > 0)
+        {
+            // x - ((x + bias) & -2^k)
+            emit_round_toward_zero_bias(cur, lhs, temp, k);
+            int32_t mask = (int32_t)(~0u << k);
+            if (mask >= -2048)
+            {
+                riscv_printer.andi(cur, cur, mask);
+            }
+            else
+            {
+                riscv_printer.li(temp, mask);
+                riscv_printer.and_(cur, cur, temp);
+            }
+            riscv_printer.sub(cur, lhs, cur);
+        }
+        else
+        {
+            // x - (x / d) * d
+            emit_div_by_magic(cur, lhs, temp, c);
+            riscv_printer.li(temp, c);
+            riscv_printer.mul(cur, cur, temp);
+            riscv_printer.sub(cur, lhs, cur);
+        }
+    }
+
+    riscv_context_manager.set_reg_free(x);
+    // 把结果存回栈中或者它所在的寄存器中
+    save_value(value, cur);
+    // 当前结果所在的寄存器已经被使用过了, 释放
+    riscv_context_manager.set_reg_free(value);
+    return true;
+}
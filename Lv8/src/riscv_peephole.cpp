@@ -0,0 +1,610 @@
+#include <string>
+#include <vector>
+
+#include "include/riscv.hpp"
+
+/**
+ * @brief 窥孔规则看到的上下文: 当前函数, 当前基本块, 以及基本块中每条指令之后活跃的寄存器
+ * @note 规则只改写当前基本块内部的指令, 不增删基本块, 所以函数级的活跃性在一轮中一直有效
+ */
+struct PeepholeContext
+{
+    MFunction &func;
+    const MLiveness &liveness;
+    size_t block;
+    std::vector<MRegSet> live_after;
+
+    std::vector<MInst> &insts()
+    {
+        return func.blocks[block].insts;
+    }
+
+    // 第 i 条指令之后 reg 是否不再被使用
+    bool dead_after(size_t i, MReg reg) const
+    {
+        return (live_after[i] & reg_bit(reg)) == 0;
+    }
+
+    // 当前基本块末尾是否会直接执行到 label, 中间只隔着空的基本块
+    bool falls_into(int32_t label) const
+    {
+        for (size_t k = block + 1; k < func.blocks.size(); ++k)
+        {
+            if (func.blocks[k].label == label)
+            {
+                return true;
+            }
+            if (!func.blocks[k].insts.empty())
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @brief 一条窥孔规则: 以第 i 条指令开头的窗口匹配时就地改写, 返回是否改写了
+ */
+struct PeepholeRule
+{
+    const char *name;
+    bool (*apply)(PeepholeContext &ctx, size_t i);
+};
+
+// 只写 rd, 读 rs1/rs2 的普通指令, 可以直接换掉它的目的寄存器
+static bool is_simple_def(MOp op)
+{
+    switch (op)
+    {
+    case MOp::SW:
+    case MOp::BEQZ:
+    case MOp::BNEZ:
+    case MOp::J:
+    case MOp::CALL:
+    case MOp::TAIL:
+    case MOp::RET:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool is_control(MOp op)
+{
+    return op == MOp::BEQZ || op == MOp::BNEZ || op == MOp::J || op == MOp::CALL || op == MOp::TAIL || op == MOp::RET;
+}
+
+static bool fits_imm12(int64_t imm)
+{
+    return imm >= -2048 && imm < 2048;
+}
+
+static MInst make_mv(MReg rd, MReg rs)
+{
+    MInst inst{MOp::MV};
+    inst.rd = rd;
+    inst.rs1 = rs;
+    return inst;
+}
+
+// 窗口内向后看的最大指令数
+static const size_t peephole_window = 4;
+
+/**
+ * sw rX, off(base); ...; lw rY, off(base) => mv rY, rX
+ * 中间不能写 rX 和 base, 不能有调用和跳转; 中间的 sw 只有都相对 sp 且偏移不同时才一定不会写到同一个位置
+ */
+static bool rule_load_after_store(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    const MInst &store = insts[i];
+    if (store.op != MOp::SW)
+    {
+        return false;
+    }
+    MReg base = store.rs1, value = store.rs2;
+    MRegSet clobber = reg_bit(base) | reg_bit(value);
+    for (size_t j = i + 1; j < insts.size() && j <= i + peephole_window; ++j)
+    {
+        MInst &inst = insts[j];
+        if (inst.op == MOp::LW && inst.rs1 == base && inst.imm == store.imm)
+        {
+            if (inst.rd == value)
+            {
+                insts.erase(insts.begin() + j);
+            }
+            else
+            {
+                inst = make_mv(inst.rd, value);
+            }
+            return true;
+        }
+        if (is_control(inst.op))
+        {
+            return false;
+        }
+        if (inst.op == MOp::SW && !(base == reg_from_name("sp") && inst.rs1 == base && inst.imm != store.imm))
+        {
+            return false;
+        }
+        MRegSet defs, uses;
+        get_inst_regs(inst, defs, uses);
+        if (defs & clobber)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// lw rY, off(base); sw rY, off(base) => lw rY, off(base), 写回的就是刚读出来的值
+static bool rule_store_after_load(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    const MInst &load = insts[i], &store = insts[i + 1];
+    if (load.op != MOp::LW || store.op != MOp::SW || load.rd == load.rs1)
+    {
+        return false;
+    }
+    if (store.rs2 != load.rd || store.rs1 != load.rs1 || store.imm != load.imm)
+    {
+        return false;
+    }
+    insts.erase(insts.begin() + i + 1);
+    return true;
+}
+
+// mv r, r => (删除)
+static bool rule_self_move(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (insts[i].op != MOp::MV || insts[i].rd != insts[i].rs1)
+    {
+        return false;
+    }
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// op rD, ..., rD 之后不再使用 => (删除)
+static bool rule_dead_def(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    const MInst &inst = insts[i];
+    if (!is_simple_def(inst.op) || inst.rd == 0 || !ctx.dead_after(i, inst.rd))
+    {
+        return false;
+    }
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// mv rD, rS; op ..., rD => op ..., rS, rD 之后不再使用或者被 op 重新写入
+static bool rule_copy_forward(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    const MInst &move = insts[i];
+    MInst &inst = insts[i + 1];
+    if (move.op != MOp::MV || move.rd == move.rs1 || (inst.rs1 != move.rd && inst.rs2 != move.rd))
+    {
+        return false;
+    }
+    if (inst.rd != move.rd && !ctx.dead_after(i + 1, move.rd))
+    {
+        return false;
+    }
+    if (inst.rs1 == move.rd)
+    {
+        inst.rs1 = move.rs1;
+    }
+    if (inst.rs2 == move.rd)
+    {
+        inst.rs2 = move.rs1;
+    }
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// op rT, ...; mv rD, rT => op rD, ..., rT 之后不再使用
+static bool rule_move_coalesce(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    MInst &def = insts[i];
+    const MInst &move = insts[i + 1];
+    if (!is_simple_def(def.op) || move.op != MOp::MV || move.rs1 != def.rd || move.rd == def.rd)
+    {
+        return false;
+    }
+    if (def.rd == 0 || !ctx.dead_after(i + 1, def.rd))
+    {
+        return false;
+    }
+    def.rd = move.rd;
+    insts.erase(insts.begin() + i + 1);
+    return true;
+}
+
+// li rT, c; op rD, rA, rT => opi rD, rA, c, rT 之后不再使用且 c 是 12 位立即数
+static bool rule_fold_immediate(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    const MInst &li = insts[i];
+    MInst &inst = insts[i + 1];
+    MReg t = li.rd;
+    if (li.op != MOp::LI || t == 0 || (inst.rd != t && !ctx.dead_after(i + 1, t)))
+    {
+        return false;
+    }
+    int64_t c = li.imm;
+    MInst folded = inst;
+    folded.rs2 = no_reg;
+    switch (inst.op)
+    {
+    case MOp::ADD:
+    case MOp::AND:
+        // 可交换, 常数在哪一边都可以
+        if (inst.rs1 == t && inst.rs2 != t)
+        {
+            folded.rs1 = inst.rs2;
+        }
+        else if (inst.rs2 != t || inst.rs1 == t)
+        {
+            return false;
+        }
+        folded.op = inst.op == MOp::ADD ? MOp::ADDI : MOp::ANDI;
+        break;
+    case MOp::SUB:
+        if (inst.rs2 != t || inst.rs1 == t)
+        {
+            return false;
+        }
+        folded.op = MOp::ADDI;
+        c = -c;
+        break;
+    case MOp::SLL:
+    case MOp::SRL:
+    case MOp::SRA:
+        if (inst.rs2 != t || inst.rs1 == t)
+        {
+            return false;
+        }
+        folded.op = inst.op == MOp::SLL ? MOp::SLLI : inst.op == MOp::SRL ? MOp::SRLI : MOp::SRAI;
+        // 移位只看低 5 位
+        c &= 31;
+        break;
+    default:
+        return false;
+    }
+    if (!fits_imm12(c))
+    {
+        return false;
+    }
+    folded.imm = c;
+    inst = folded;
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// li rT, 0; 下一条指令读 rT => 改成读 x0, rT 之后不再使用时删除 li
+static bool rule_zero_register(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    const MInst &li = insts[i];
+    MInst &inst = insts[i + 1];
+    if (li.op != MOp::LI || li.imm != 0 || li.rd == 0 || is_control(inst.op))
+    {
+        return false;
+    }
+    MReg t = li.rd;
+    if (inst.rs1 != t && inst.rs2 != t)
+    {
+        return false;
+    }
+    if (inst.rs1 == t)
+    {
+        inst.rs1 = 0;
+    }
+    if (inst.rs2 == t)
+    {
+        inst.rs2 = 0;
+    }
+    // 下一条指令重新写了 rT, 或者之后不再使用, li 就没用了
+    if (inst.rd == t || ctx.dead_after(i + 1, t))
+    {
+        insts.erase(insts.begin() + i);
+    }
+    return true;
+}
+
+// add rD, rA, x0 / addi rD, rA, 0 / mv rD, x0 / sub rD, x0, rA => mv rD, rA / li rD, 0 / neg rD, rA
+static bool rule_add_zero(PeepholeContext &ctx, size_t i)
+{
+    MInst &inst = ctx.insts()[i];
+    MReg src;
+    if ((inst.op == MOp::ADD || inst.op == MOp::OR || inst.op == MOp::XOR) && (inst.rs1 == 0 || inst.rs2 == 0))
+    {
+        src = inst.rs1 == 0 ? inst.rs2 : inst.rs1;
+    }
+    else if (inst.op == MOp::SUB && inst.rs2 == 0)
+    {
+        src = inst.rs1;
+    }
+    else if (inst.op == MOp::SUB && inst.rs1 == 0)
+    {
+        inst.op = MOp::NEG;
+        inst.rs1 = inst.rs2;
+        inst.rs2 = no_reg;
+        return true;
+    }
+    else if ((inst.op == MOp::ADDI || inst.op == MOp::SLLI || inst.op == MOp::SRLI || inst.op == MOp::SRAI) && inst.imm == 0)
+    {
+        src = inst.rs1;
+    }
+    else if (inst.op == MOp::MV && inst.rs1 == 0)
+    {
+        MInst li{MOp::LI};
+        li.rd = inst.rd;
+        li.imm = 0;
+        inst = li;
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+    inst = make_mv(inst.rd, src);
+    return true;
+}
+
+// seqz/snez rT, rX; bnez/beqz rT, L => beqz/bnez rX, L, rT 之后不再使用
+static bool rule_branch_on_set(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 1 >= insts.size())
+    {
+        return false;
+    }
+    const MInst &set = insts[i];
+    MInst &branch = insts[i + 1];
+    if ((set.op != MOp::SEQZ && set.op != MOp::SNEZ) || (branch.op != MOp::BEQZ && branch.op != MOp::BNEZ))
+    {
+        return false;
+    }
+    if (branch.rs1 != set.rd || !ctx.dead_after(i + 1, set.rd))
+    {
+        return false;
+    }
+    // seqz 把条件取反, snez 保持条件
+    if (set.op == MOp::SEQZ)
+    {
+        branch.op = branch.op == MOp::BEQZ ? MOp::BNEZ : MOp::BEQZ;
+    }
+    branch.rs1 = set.rs1;
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// 结果只可能是 0 或 1 的指令
+static bool is_boolean_def(const MInst &inst)
+{
+    return inst.op == MOp::SLT || inst.op == MOp::SGT || inst.op == MOp::SEQZ || inst.op == MOp::SNEZ || (inst.op == MOp::ANDI && inst.imm == 1);
+}
+
+// 基本块中第 i 条指令之前最后一条写 reg 的指令的下标, 没有时返回 -1
+static int last_def_before(const std::vector<MInst> &insts, size_t i, MReg reg)
+{
+    for (size_t j = i; j-- > 0;)
+    {
+        MRegSet defs, uses;
+        get_inst_regs(insts[j], defs, uses);
+        if (defs & reg_bit(reg))
+        {
+            return j;
+        }
+    }
+    return -1;
+}
+
+// neg rM, rT; ...; and rD, rA, rM => czero.eqz rD, rA, rT, rT 只可能是 0 或 1, rM 之后不再使用; 只在目标支持 Zicond 时使用
+static bool rule_zicond_mask(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    const MInst &neg = insts[i];
+    if (!target_has_zicond() || neg.op != MOp::NEG || neg.rs1 == 0)
+    {
+        return false;
+    }
+    MReg m = neg.rd, t = neg.rs1;
+    int def = last_def_before(insts, i, t);
+    if (def < 0 || !is_boolean_def(insts[def]))
+    {
+        return false;
+    }
+    for (size_t j = i + 1; j < insts.size() && j <= i + peephole_window; ++j)
+    {
+        MInst &inst = insts[j];
+        if (inst.rs1 == m || inst.rs2 == m)
+        {
+            // rM 的第一个使用者必须是 and, 而且之后不再使用 rM; rM 和 rT 是同一个寄存器时, 删掉 neg 之后这里读到的就是 rT
+            if (inst.op != MOp::AND || inst.rs1 == inst.rs2 || (inst.rd != m && !ctx.dead_after(j, m)))
+            {
+                return false;
+            }
+            MInst czero = inst;
+            czero.op = MOp::CZERO_EQZ;
+            czero.rs1 = inst.rs1 == m ? inst.rs2 : inst.rs1;
+            czero.rs2 = t;
+            inst = czero;
+            insts.erase(insts.begin() + i);
+            return true;
+        }
+        MRegSet defs, uses;
+        get_inst_regs(inst, defs, uses);
+        if (is_control(inst.op) || (defs & (reg_bit(m) | reg_bit(t))))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+// snez/seqz rT, rC; ...; czero.eqz/nez rD, rA, rT => czero.eqz/nez rD, rA, rC, czero 本身就是在判断是否为 0
+static bool rule_czero_test(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    MInst &czero = insts[i];
+    if (czero.op != MOp::CZERO_EQZ && czero.op != MOp::CZERO_NEZ)
+    {
+        return false;
+    }
+    int def = last_def_before(insts, i, czero.rs2);
+    if (def < 0 || i - (size_t)def > peephole_window || (insts[def].op != MOp::SNEZ && insts[def].op != MOp::SEQZ))
+    {
+        return false;
+    }
+    MReg c = insts[def].rs1;
+    if (c == czero.rs2 || last_def_before(insts, i, c) > def)
+    {
+        return false;
+    }
+    if (insts[def].op == MOp::SEQZ)
+    {
+        czero.op = czero.op == MOp::CZERO_EQZ ? MOp::CZERO_NEZ : MOp::CZERO_EQZ;
+    }
+    czero.rs2 = c;
+    return true;
+}
+
+// 基本块的最后一条 j L / beqz rX, L / bnez rX, L, L 就是接下来执行的基本块 => (删除)
+static bool rule_jump_to_next(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    const MInst &inst = insts[i];
+    if (i + 1 != insts.size() || (inst.op != MOp::J && inst.op != MOp::BEQZ && inst.op != MOp::BNEZ))
+    {
+        return false;
+    }
+    if (!ctx.falls_into(inst.sym))
+    {
+        return false;
+    }
+    insts.erase(insts.begin() + i);
+    return true;
+}
+
+// beqz rX, L1; j L2; L1: => bnez rX, L2; L1:
+static bool rule_branch_inversion(PeepholeContext &ctx, size_t i)
+{
+    std::vector<MInst> &insts = ctx.insts();
+    if (i + 2 != insts.size())
+    {
+        return false;
+    }
+    MInst &branch = insts[i];
+    const MInst &jump = insts[i + 1];
+    if ((branch.op != MOp::BEQZ && branch.op != MOp::BNEZ) || jump.op != MOp::J || !ctx.falls_into(branch.sym))
+    {
+        return false;
+    }
+    branch.op = branch.op == MOp::BEQZ ? MOp::BNEZ : MOp::BEQZ;
+    branch.sym = jump.sym;
+    insts.pop_back();
+    return true;
+}
+
+// 所有规则, 按顺序在每个位置上尝试; 先做会减少后面匹配机会的化简
+static const PeepholeRule peephole_rules[] = {
+    {"load-after-store", rule_load_after_store},
+    {"store-after-load", rule_store_after_load},
+    {"self-move", rule_self_move},
+    {"dead-def", rule_dead_def},
+    {"move-coalesce", rule_move_coalesce},
+    {"copy-forward", rule_copy_forward},
+    {"fold-immediate", rule_fold_immediate},
+    {"zero-register", rule_zero_register},
+    {"add-zero", rule_add_zero},
+    {"branch-on-set", rule_branch_on_set},
+    {"zicond-mask", rule_zicond_mask},
+    {"czero-test", rule_czero_test},
+    {"jump-to-next", rule_jump_to_next},
+    {"branch-inversion", rule_branch_inversion},
+};
+
+static const size_t num_peephole_rules = sizeof(peephole_rules) / sizeof(peephole_rules[0]);
+
+// 对一个函数反复应用规则直到没有变化, hits 累加每条规则的命中次数
+static void peephole_function(MFunction &func, std::vector<int> &hits)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        MLiveness liveness(func);
+        for (size_t b = 0; b < func.blocks.size(); ++b)
+        {
+            PeepholeContext ctx{func, liveness, b, liveness.live_after(b)};
+            for (size_t i = 0; i < ctx.insts().size();)
+            {
+                bool applied = false;
+                for (size_t r = 0; r < num_peephole_rules; ++r)
+                {
+                    if (peephole_rules[r].apply(ctx, i))
+                    {
+                        ++hits[r];
+                        applied = true;
+                        break;
+                    }
+                }
+                if (!applied)
+                {
+                    ++i;
+                    continue;
+                }
+                // 改写之后重新计算基本块内的活跃性, 回退一条指令, 让前面的指令和新的指令组成窗口
+                changed = true;
+                ctx.live_after = liveness.live_after(b);
+                i = i > 0 ? i - 1 : 0;
+            }
+        }
+    }
+}
+
+void peephole(MModule &module)
+{
+    std::vector<int> hits(num_peephole_rules, 0);
+    for (auto &section : module.sections)
+    {
+        if (section.is_text)
+        {
+            peephole_function(section.func, hits);
+        }
+    }
+    for (size_t r = 0; r < num_peephole_rules; ++r)
+    {
+        if (hits[r] > 0)
+        {
+            add_opt_statistic(std::string("peephole.") + peephole_rules[r].name, hits[r]);
+        }
+    }
+}
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "include/riscv.hpp"
+#include "include/analysis.hpp"
+
+// 可以使用的 callee-saved 寄存器 s0 - s11 的数量
+static const int num_callee_saved_regs = 12;
+
+// 可以使用的参数寄存器 a0 - a7 的数量
+static const int num_arg_regs = 8;
+
+// 每多嵌套一层循环, 使用次数的权重乘以这个数
+static const long long loop_weight_factor = 10;
+
+// 新使用一个 callee-saved 寄存器需要在 prologue 和 epilogue 中各访存一次, 权重不超过这个数的值不值得占用新的寄存器
+static const long long new_reg_cost = 2;
+
+// 是否是需要分析活跃性的值: 基本块参数, 前 8 个函数参数, 以及除了 alloc 之外有返回值的指令
+static bool is_tracked(koopa_raw_value_t value)
+{
+    switch (value->kind.tag)
+    {
+    case KOOPA_RVT_BLOCK_ARG_REF:
+        return true;
+    case KOOPA_RVT_FUNC_ARG_REF:
+        return value->kind.data.func_arg_ref.index < 8;
+    case KOOPA_RVT_INTEGER:
+    case KOOPA_RVT_ZERO_INIT:
+    case KOOPA_RVT_ALLOC:
+    case KOOPA_RVT_GLOBAL_ALLOC:
+        return false;
+    default:
+        return value->ty->tag != KOOPA_RTT_UNIT;
+    }
+}
+
+std::unordered_map<koopa_raw_value_t, std::string> allocate_home_registers(const koopa_raw_function_t &func)
+{
+    std::vector<koopa_raw_basic_block_t> bbs = get_basic_blocks(func);
+    std::vector<koopa_raw_value_t> func_params;
+    for (auto param : get_values(func->params))
+    {
+        if (is_tracked(param))
+        {
+            func_params.push_back(param);
+        }
+    }
+
+    // 活跃性分析: 跳转的实参是前驱末尾的使用, 基本块参数是后继开头的定义
+    std::unordered_map<koopa_raw_basic_block_t, std::unordered_set<koopa_raw_value_t>> live_in, live_out;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto it = bbs.rbegin(); it != bbs.rend(); ++it)
+        {
+            koopa_raw_basic_block_t bb = *it;
+            std::unordered_set<koopa_raw_value_t> live;
+            for (auto succ : get_successors(bb))
+            {
+                live.insert(live_in[succ].begin(), live_in[succ].end());
+            }
+            live_out[bb] = live;
+            std::vector<koopa_raw_value_t> insts = get_insts(bb);
+            for (auto inst = insts.rbegin(); inst != insts.rend(); ++inst)
+            {
+                live.erase(*inst);
+                for (auto operand : get_operands(*inst))
+                {
+                    if (is_tracked(operand))
+                    {
+                        live.insert(operand);
+                    }
+                }
+            }
+            for (auto param : get_values(bb->params))
+            {
+                live.erase(param);
+            }
+            if (live.size() != live_in[bb].size())
+            {
+                live_in[bb] = live;
+                changed = true;
+            }
+        }
+    }
+
+    // 基本块的权重, 有 profile 时是每次调用平均执行的次数 (和 new_reg_cost 的单位一致), 没有计数时按循环越深越重估计
+    const LoopInfo &loop_info = analysis_manager.loop_info(func);
+    std::string function_name = func->name + 1;
+    long long entry_count = profile_manager.count(ProfileManager::block_key(function_name, bbs[0]->name + 1));
+    auto block_weight = [&](koopa_raw_basic_block_t bb)
+    {
+        long long count = profile_manager.count(ProfileManager::block_key(function_name, bb->name + 1));
+        if (entry_count > 0 && count >= 0)
+        {
+            return (count + entry_count - 1) / entry_count;
+        }
+        long long weight = 1;
+        Loop *loop = loop_info.loop_of(bb);
+        for (int depth = loop ? loop->depth : 0; depth > 0; --depth)
+        {
+            weight *= loop_weight_factor;
+        }
+        return weight;
+    };
+
+    // 统计每个值的使用和定义的权重, 同时找出跨过 call 仍然活跃的值和 call 的参数
+    std::vector<koopa_raw_value_t> values = func_params;
+    std::unordered_set<koopa_raw_value_t> across_call, call_operand;
+    std::unordered_map<koopa_raw_value_t, long long> weight;
+    for (auto param : func_params)
+    {
+        weight[param] += 1;
+    }
+    for (auto bb : bbs)
+    {
+        long long w = block_weight(bb);
+        std::unordered_set<koopa_raw_value_t> live = live_out[bb];
+        std::vector<koopa_raw_value_t> insts = get_insts(bb);
+        for (auto inst = insts.rbegin(); inst != insts.rend(); ++inst)
+        {
+            if (is_tracked(*inst))
+            {
+                live.erase(*inst);
+                weight[*inst] += w;
+            }
+            if ((*inst)->kind.tag == KOOPA_RVT_CALL)
+            {
+                across_call.insert(live.begin(), live.end());
+            }
+            for (auto operand : get_operands(*inst))
+            {
+                if (is_tracked(operand))
+                {
+                    live.insert(operand);
+                    weight[operand] += w;
+                    if ((*inst)->kind.tag == KOOPA_RVT_CALL)
+                    {
+                        call_operand.insert(operand);
+                    }
+                }
+            }
+        }
+        for (auto param : get_values(bb->params))
+        {
+            weight[param] += w;
+            values.push_back(param);
+        }
+        for (auto inst : insts)
+        {
+            if (is_tracked(inst))
+            {
+                values.push_back(inst);
+            }
+        }
+    }
+
+    // 跨过 call 的值只能放在 callee-saved 寄存器中; 其他的值放在 a0 - a7 中, 但是 call 的参数除外, 因为加载参数的时候会覆盖 a0 - a7
+    std::unordered_set<koopa_raw_value_t> s_candidates, a_candidates;
+    for (auto value : values)
+    {
+        if (across_call.count(value))
+        {
+            s_candidates.insert(value);
+        }
+        else if (!call_operand.count(value))
+        {
+            a_candidates.insert(value);
+        }
+    }
+    auto same_class = [&](koopa_raw_value_t a, koopa_raw_value_t b)
+    {
+        return (s_candidates.count(a) && s_candidates.count(b)) || (a_candidates.count(a) && a_candidates.count(b));
+    };
+
+    // 候选值之间的冲突图: 一个值定义的时候另一个值活跃, 它们就不能使用同一个寄存器
+    std::unordered_map<koopa_raw_value_t, std::unordered_set<koopa_raw_value_t>> interference;
+    auto add_interference = [&](koopa_raw_value_t a, koopa_raw_value_t b)
+    {
+        if (a != b && same_class(a, b))
+        {
+            interference[a].insert(b);
+            interference[b].insert(a);
+        }
+    };
+    for (auto bb : bbs)
+    {
+        std::unordered_set<koopa_raw_value_t> live = live_out[bb];
+        std::vector<koopa_raw_value_t> insts = get_insts(bb);
+        for (auto inst = insts.rbegin(); inst != insts.rend(); ++inst)
+        {
+            // 结果没有被使用的值也会写寄存器, 同样和定义处活跃的值冲突
+            if (is_tracked(*inst))
+            {
+                live.erase(*inst);
+                for (auto value : live)
+                {
+                    add_interference(*inst, value);
+                }
+            }
+            for (auto operand : get_operands(*inst))
+            {
+                if (is_tracked(operand))
+                {
+                    live.insert(operand);
+                }
+            }
+        }
+        // 基本块参数 (entry 还有函数参数) 在基本块开头同时定义, 互相冲突
+        std::vector<koopa_raw_value_t> params = get_values(bb->params);
+        if (bb == bbs[0])
+        {
+            params.insert(params.end(), func_params.begin(), func_params.end());
+        }
+        live.insert(params.begin(), params.end());
+        for (auto param : params)
+        {
+            for (auto value : live)
+            {
+                add_interference(param, value);
+            }
+        }
+        // 跳转时按顺序拷贝参数, 第 i 个形参不能覆盖其他位置还没有读取的实参
+        koopa_raw_value_t terminator = get_terminator(bb);
+        std::vector<koopa_raw_basic_block_t> succs = get_successors_of_terminator(terminator);
+        for (size_t k = 0; k < succs.size(); ++k)
+        {
+            std::vector<koopa_raw_value_t> args = get_successor_args(terminator, k);
+            std::vector<koopa_raw_value_t> targets = get_values(succs[k]->params);
+            for (size_t i = 0; i < targets.size(); ++i)
+            {
+                for (size_t j = 0; j < args.size(); ++j)
+                {
+                    if (i != j && is_tracked(args[j]))
+                    {
+                        add_interference(targets[i], args[j]);
+                    }
+                }
+            }
+        }
+    }
+
+    // 按照权重从大到小贪心着色, 权重相同时按照出现的顺序
+    auto by_weight = [&](const std::unordered_set<koopa_raw_value_t> &candidates)
+    {
+        std::vector<koopa_raw_value_t> order;
+        for (auto value : values)
+        {
+            if (candidates.count(value))
+            {
+                order.push_back(value);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](koopa_raw_value_t a, koopa_raw_value_t b)
+                         { return weight[a] > weight[b]; });
+        return order;
+    };
+    std::unordered_map<koopa_raw_value_t, int> color;
+    auto first_free_color = [&](koopa_raw_value_t value, std::vector<bool> forbidden)
+    {
+        for (auto other : interference[value])
+        {
+            auto it = color.find(other);
+            if (it != color.end())
+            {
+                forbidden[it->second] = true;
+            }
+        }
+        int reg = 0;
+        while (reg < (int)forbidden.size() && forbidden[reg])
+        {
+            ++reg;
+        }
+        return reg;
+    };
+
+    std::unordered_map<koopa_raw_value_t, std::string> home_regs;
+    int used_regs = 0;
+    for (auto value : by_weight(s_candidates))
+    {
+        int reg = first_free_color(value, std::vector<bool>(num_callee_saved_regs, false));
+        if (reg == num_callee_saved_regs || (reg == used_regs && weight[value] <= new_reg_cost))
+        {
+            continue;
+        }
+        color[value] = reg;
+        used_regs = std::max(used_regs, reg + 1);
+        home_regs[value] = "s" + std::to_string(reg);
+    }
+
+    // 第 i 个参数到达时在 ai 中, 直接把 ai 作为它的位置; 参数不放在 ai 中时, prologue 还要从 ai 读取它, 这个寄存器不能给其他值使用
+    color.clear();
+    std::vector<bool> reserved(num_arg_regs, false);
+    for (size_t i = 0; i < func_params.size(); ++i)
+    {
+        if (a_candidates.count(func_params[i]))
+        {
+            color[func_params[i]] = i;
+            home_regs[func_params[i]] = "a" + std::to_string(i);
+        }
+        else
+        {
+            reserved[i] = true;
+        }
+    }
+    for (auto value : by_weight(a_candidates))
+    {
+        if (color.count(value))
+        {
+            continue;
+        }
+        int reg = first_free_color(value, reserved);
+        if (reg == num_arg_regs)
+        {
+            continue;
+        }
+        color[value] = reg;
+        home_regs[value] = "a" + std::to_string(reg);
+    }
+    return home_regs;
+}
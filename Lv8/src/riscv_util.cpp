@@ -8,6 +8,11 @@
 
 void StackManager::save_value_to_stack(const koopa_raw_value_t &value)
 {
+    // 放在寄存器中的值不需要栈上的位置
+    if (has_home_reg(value))
+    {
+        return;
+    }
     // 如果 value 不在 value_to_stack_offset 中, 则需要分配新的空间
     if (value_to_stack_offset.find(value) == value_to_stack_offset.end())
     {
@@ -24,6 +29,17 @@ void StackManager::save_value_to_stack(const koopa_raw_value_t &value)
     }
 }
 
+int StackManager::save_scratch_to_stack(int count)
+{
+    int offset = stack_used_byte;
+    stack_used_byte += 4 * count;
+    if (stack_used_byte > stack_size)
+    {
+        throw std::runtime_error("save_scratch_to_stack: stack overflow");
+    }
+    return offset;
+}
+
 int StackManager::get_stack_used_byte() const
 {
     return stack_used_byte;
@@ -43,6 +59,56 @@ int StackManager::get_value_stack_offset(const koopa_raw_value_t &value)
     return value_to_stack_offset[value];
 }
 
+void StackManager::assign_home_reg(const koopa_raw_value_t &value, const std::string &reg)
+{
+    if (value_to_stack_offset.find(value) != value_to_stack_offset.end())
+    {
+        throw std::runtime_error("assign_home_reg: value already has a stack slot");
+    }
+    value_to_home_reg[value] = reg;
+}
+
+bool StackManager::has_home_reg(const koopa_raw_value_t &value) const
+{
+    return value_to_home_reg.find(value) != value_to_home_reg.end();
+}
+
+std::string StackManager::get_home_reg(const koopa_raw_value_t &value) const
+{
+    auto it = value_to_home_reg.find(value);
+    if (it == value_to_home_reg.end())
+    {
+        throw std::runtime_error("get_home_reg: value is not in a register");
+    }
+    return it->second;
+}
+
+void StackManager::save_callee_saved_regs(const std::vector<std::string> &regs)
+{
+    callee_saved_regs = regs;
+    callee_saved_offset = save_scratch_to_stack(regs.size());
+}
+
+const std::vector<std::string> &StackManager::get_callee_saved_regs() const
+{
+    return callee_saved_regs;
+}
+
+int StackManager::get_callee_saved_offset(int index) const
+{
+    return callee_saved_offset + 4 * index;
+}
+
+void StackManager::set_save_ra(bool save)
+{
+    save_ra = save;
+}
+
+bool StackManager::get_save_ra() const
+{
+    return save_ra;
+}
+
 ////////////////////////////////////////////////////
 // RISCVContextManager
 ////////////////////////////////////////////////////
@@ -134,6 +200,11 @@ std::string RISCVContextManager::new_temp_reg()
     throw std::runtime_error("new_temp_reg: no free register found");
 }
 
+void RISCVContextManager::set_reg_reserved(const std::string &reg, bool reserved)
+{
+    _reg_is_used[reg] = reserved;
+}
+
 std::string RISCVContextManager::value_to_reg_string(const koopa_raw_value_t &value)
 {
     if (_value_to_reg_string.find(value) == _value_to_reg_string.end())
@@ -171,38 +242,114 @@ void RISCVContextManager::init_stack_manager_for_one_function(const std::string
     current_function_name = function_name;
 }
 
+std::string RISCVContextManager::get_current_function_name() const
+{
+    return current_function_name;
+}
+
 ////////////////////////////////////////////////////
 // RISCV 语句
 ////////////////////////////////////////////////////
 
+MBlock &RISCVPrinter::_current_block()
+{
+    if (_module.sections.empty() || !_module.sections.back().is_text)
+    {
+        throw std::runtime_error("RISCVPrinter: instruction outside of a function");
+    }
+    return _module.sections.back().func.blocks.back();
+}
+
+void RISCVPrinter::_append(MOp op, MReg rd, MReg rs1, MReg rs2, int32_t imm, int32_t sym)
+{
+    MInst inst;
+    inst.op = op;
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    inst.imm = imm;
+    inst.sym = sym;
+    _current_block().insts.push_back(inst);
+}
+
+void RISCVPrinter::_binary(MOp op, const std::string &rd, const std::string &rs1, const std::string &rs2)
+{
+    _append(op, reg_from_name(rd), reg_from_name(rs1), reg_from_name(rs2));
+}
+
+void RISCVPrinter::_binary_imm(MOp op, const std::string &rd, const std::string &rs1, int32_t imm)
+{
+    _append(op, reg_from_name(rd), reg_from_name(rs1), no_reg, imm);
+}
+
+void RISCVPrinter::_unary(MOp op, const std::string &rd, const std::string &rs1)
+{
+    _append(op, reg_from_name(rd), reg_from_name(rs1), no_reg);
+}
+
 void RISCVPrinter::data()
 {
-    std::cout << "\n\t.data" << std::endl;
+    MSection section;
+    section.is_text = false;
+    _module.sections.push_back(std::move(section));
+}
+
+void RISCVPrinter::begin_function(const std::string &name, bool global)
+{
+    MSection section;
+    section.is_text = true;
+    section.func.name = _module.symbols.intern(name);
+    section.func.global = global;
+    section.func.blocks.emplace_back();
+    _module.sections.push_back(std::move(section));
 }
 
-void RISCVPrinter::text()
+MModule &RISCVPrinter::module()
 {
-    std::cout << "\n\t.text" << std::endl;
+    return _module;
 }
 
 void RISCVPrinter::globl(const std::string &name)
 {
-    std::cout << "\t.globl " << name << std::endl;
+    if (_module.sections.empty() || _module.sections.back().is_text)
+    {
+        throw std::runtime_error("RISCVPrinter::globl: not in a data section");
+    }
+    _module.sections.back().directives.push_back({MDirective::GLOBL, _module.symbols.intern(name)});
 }
 
 void RISCVPrinter::word(const int &value)
 {
-    std::cout << "\t.word " << value << std::endl;
+    _module.sections.back().directives.push_back({MDirective::WORD, value});
 }
 
 void RISCVPrinter::zero(const int &len)
 {
-    std::cout << "\t.zero " << len << std::endl;
+    _module.sections.back().directives.push_back({MDirective::ZERO, len});
 }
 
 void RISCVPrinter::label(const std::string &name)
 {
-    std::cout << name << ":" << std::endl;
+    if (_module.sections.empty())
+    {
+        throw std::runtime_error("RISCVPrinter::label: no section");
+    }
+    MSection &section = _module.sections.back();
+    // 代码段中的标签开始一个新的基本块
+    if (section.is_text)
+    {
+        section.func.blocks.emplace_back();
+        section.func.blocks.back().label = _module.symbols.intern(name);
+    }
+    else
+    {
+        section.directives.push_back({MDirective::LABEL, _module.symbols.intern(name)});
+    }
+}
+
+void RISCVPrinter::asciz(const std::string &str)
+{
+    _module.sections.back().directives.push_back({MDirective::ASCIZ, _module.symbols.intern(str)});
 }
 
 ////////////////////////////////////////////////////
@@ -211,12 +358,17 @@ void RISCVPrinter::label(const std::string &name)
 
 void RISCVPrinter::call(const std::string &func_name)
 {
-    std::cout << "\tcall " << func_name << std::endl;
+    _append(MOp::CALL, no_reg, no_reg, no_reg, 0, _module.symbols.intern(func_name));
+}
+
+void RISCVPrinter::tail(const std::string &func_name)
+{
+    _append(MOp::TAIL, no_reg, no_reg, no_reg, 0, _module.symbols.intern(func_name));
 }
 
 void RISCVPrinter::ret()
 {
-    std::cout << "\tret" << std::endl;
+    _append(MOp::RET, no_reg, no_reg, no_reg);
 }
 
 ////////////////////////////////////////////////////
@@ -225,12 +377,17 @@ void RISCVPrinter::ret()
 
 void RISCVPrinter::seqz(const std::string &rd, const std::string &rs1)
 {
-    std::cout << "\tseqz " << rd << ", " << rs1 << std::endl;
+    _unary(MOp::SEQZ, rd, rs1);
 }
 
 void RISCVPrinter::snez(const std::string &rd, const std::string &rs1)
 {
-    std::cout << "\tsnez " << rd << ", " << rs1 << std::endl;
+    _unary(MOp::SNEZ, rd, rs1);
+}
+
+void RISCVPrinter::neg(const std::string &rd, const std::string &rs1)
+{
+    _unary(MOp::NEG, rd, rs1);
 }
 
 ////////////////////////////////////////////////////
@@ -239,66 +396,106 @@ void RISCVPrinter::snez(const std::string &rd, const std::string &rs1)
 
 void RISCVPrinter::or_(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tor " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::OR, rd, rs1, rs2);
 }
 
 void RISCVPrinter::and_(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tand " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::AND, rd, rs1, rs2);
 }
 
 void RISCVPrinter::xor_(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\txor " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::XOR, rd, rs1, rs2);
 }
 
 void RISCVPrinter::add(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tadd " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::ADD, rd, rs1, rs2);
 }
 
 void RISCVPrinter::addi(const std::string &rd, const std::string &rs1, const int &imm, RISCVContextManager &context_manager)
 {
     if (imm >= -2048 && imm < 2048)
     {
-        std::cout << "\taddi " << rd << ", " << rs1 << ", " << imm << std::endl;
+        _binary_imm(MOp::ADDI, rd, rs1, imm);
     }
     else
     {
         std::string reg = context_manager.new_temp_reg();
         li(reg, imm);
-        std::cout << "\tadd " << rd << ", " << rs1 << ", " << reg << std::endl;
+        add(rd, rs1, reg);
     }
 }
 
 void RISCVPrinter::sub(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tsub " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::SUB, rd, rs1, rs2);
 }
 
 void RISCVPrinter::mul(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tmul " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::MUL, rd, rs1, rs2);
 }
 
 void RISCVPrinter::div(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tdiv " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::DIV, rd, rs1, rs2);
 }
 
 void RISCVPrinter::rem(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\trem " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::REM, rd, rs1, rs2);
+}
+
+void RISCVPrinter::sll(const std::string &rd, const std::string &rs1, const std::string &rs2)
+{
+    _binary(MOp::SLL, rd, rs1, rs2);
+}
+
+void RISCVPrinter::srl(const std::string &rd, const std::string &rs1, const std::string &rs2)
+{
+    _binary(MOp::SRL, rd, rs1, rs2);
+}
+
+void RISCVPrinter::sra(const std::string &rd, const std::string &rs1, const std::string &rs2)
+{
+    _binary(MOp::SRA, rd, rs1, rs2);
+}
+
+void RISCVPrinter::mulh(const std::string &rd, const std::string &rs1, const std::string &rs2)
+{
+    _binary(MOp::MULH, rd, rs1, rs2);
+}
+
+void RISCVPrinter::andi(const std::string &rd, const std::string &rs1, const int &imm)
+{
+    _binary_imm(MOp::ANDI, rd, rs1, imm);
+}
+
+void RISCVPrinter::slli(const std::string &rd, const std::string &rs1, const int &shamt)
+{
+    _binary_imm(MOp::SLLI, rd, rs1, shamt);
+}
+
+void RISCVPrinter::srli(const std::string &rd, const std::string &rs1, const int &shamt)
+{
+    _binary_imm(MOp::SRLI, rd, rs1, shamt);
+}
+
+void RISCVPrinter::srai(const std::string &rd, const std::string &rs1, const int &shamt)
+{
+    _binary_imm(MOp::SRAI, rd, rs1, shamt);
 }
 
 void RISCVPrinter::sgt(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tsgt " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::SGT, rd, rs1, rs2);
 }
 
 void RISCVPrinter::slt(const std::string &rd, const std::string &rs1, const std::string &rs2)
 {
-    std::cout << "\tslt " << rd << ", " << rs1 << ", " << rs2 << std::endl;
+    _binary(MOp::SLT, rd, rs1, rs2);
 }
 
 ////////////////////////////////////////////////////
@@ -307,17 +504,17 @@ void RISCVPrinter::slt(const std::string &rd, const std::string &rs1, const std:
 
 void RISCVPrinter::li(const std::string &rd, const int &imm)
 {
-    std::cout << "\tli " << rd << ", " << imm << std::endl;
+    _append(MOp::LI, reg_from_name(rd), no_reg, no_reg, imm);
 }
 
 void RISCVPrinter::mv(const std::string &rd, const std::string &rs1)
 {
-    std::cout << "\tmv " << rd << ", " << rs1 << std::endl;
+    _unary(MOp::MV, rd, rs1);
 }
 
 void RISCVPrinter::la(const std::string &rd, const std::string &rs1)
 {
-    std::cout << "\tla " << rd << ", " << rs1 << std::endl;
+    _append(MOp::LA, reg_from_name(rd), no_reg, no_reg, 0, _module.symbols.intern(rs1));
 }
 
 void RISCVPrinter::lw(const std::string &rd, const std::string &base, const int &bias, RISCVContextManager &context_manager)
@@ -325,30 +522,35 @@ void RISCVPrinter::lw(const std::string &rd, const std::string &base, const int
     // 检查偏移量是否在 12 位立即数范围内
     if (bias >= -2048 && bias < 2048)
     {
-        std::cout << "\tlw " << rd << ", " << bias << "(" << base << ")" << std::endl;
+        _binary_imm(MOp::LW, rd, base, bias);
     }
     else
     {
         std::string reg = context_manager.new_temp_reg();
         li(reg, bias);
         add(reg, reg, base);
-        std::cout << "\tlw " << rd << ", " << "(" << reg << ")" << std::endl;
+        _binary_imm(MOp::LW, rd, reg, 0);
     }
 }
 
+void RISCVPrinter::lbu(const std::string &rd, const std::string &base, const int &bias)
+{
+    _binary_imm(MOp::LBU, rd, base, bias);
+}
+
 void RISCVPrinter::sw(const std::string &rs1, const std::string &base, const int &bias, RISCVContextManager &context_manager)
 {
-    // 检查偏移量是否在 12 位立即数范围内
+    // 检查偏移量是否在 12 位立即数范围内, 机器 IR 中 sw 的基址是 rs1, 要存储的值是 rs2
     if (bias >= -2048 && bias < 2048)
     {
-        std::cout << "\tsw " << rs1 << ", " << bias << "(" << base << ")" << std::endl;
+        _append(MOp::SW, no_reg, reg_from_name(base), reg_from_name(rs1), bias);
     }
     else
     {
         std::string reg = context_manager.new_temp_reg();
         li(reg, bias);
         add(reg, reg, base);
-        std::cout << "\tsw " << rs1 << ", " << "(" << reg << ")" << std::endl;
+        _append(MOp::SW, no_reg, reg_from_name(reg), reg_from_name(rs1), 0);
     }
 }
 
@@ -358,15 +560,15 @@ void RISCVPrinter::sw(const std::string &rs1, const std::string &base, const int
 
 void RISCVPrinter::bnez(const std::string &cond, const std::string &label)
 {
-    std::cout << "\tbnez " << cond << ", " << label << std::endl;
+    _append(MOp::BNEZ, no_reg, reg_from_name(cond), no_reg, 0, _module.symbols.intern(label));
 }
 
 void RISCVPrinter::beqz(const std::string &cond, const std::string &label)
 {
-    std::cout << "\tbeqz " << cond << ", " << label << std::endl;
+    _append(MOp::BEQZ, no_reg, reg_from_name(cond), no_reg, 0, _module.symbols.intern(label));
 }
 
 void RISCVPrinter::jump(const std::string &label)
 {
-    std::cout << "\tj " << label << std::endl;
+    _append(MOp::J, no_reg, no_reg, no_reg, 0, _module.symbols.intern(label));
 }
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""检查增量前端 (-incremental) 的结果和完整编译一致.
+
+用法: check_incremental.py <compiler> <源文件...> [--seed N] [--rounds N]
+
+对每个源文件生成一个随机的编辑脚本: 先 open 整个源码, 然后随机做三种修改:
+"删掉一段再原样插回", "插入 `}` / `int` 制造语法错误再删掉", 以及把一个整数字面量改成另一个值.
+前两种成对出现, 中间会出现语法错误和签名变化, 每对修改之后源码恢复原样;
+第三种会改变常量的值, 用到这个常量但是没有被重新解析的 CompUnit 也必须重新输出.
+每对修改和每次改字面量之后是一个检查点, 执行到检查点为止的脚本, 把 Koopa IR 和当时的源码经过
+`-koopa --passes=` 的完整编译结果比较; 标签和变量名中的计数在增量会话中只增不减, 所以按第一次出现的顺序统一改名之后再比较.
+"""
+import argparse
+import random
+import re
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+
+def edit_commands(source, rng, rounds):
+    """返回编辑命令, 以及每个检查点之前的命令数量和当时的源码"""
+    commands = [("open", 0, 0, source)]
+    checkpoints = [(1, source)]
+    for _ in range(rounds):
+        kind = rng.randrange(3)
+        if kind == 0:
+            offset = rng.randrange(len(source))
+            length = rng.randrange(min(40, len(source) - offset) + 1)
+            commands.append(("edit", offset, length, ""))
+            commands.append(("edit", offset, 0, source[offset:offset + length]))
+        elif kind == 1:
+            offset = rng.randrange(len(source))
+            junk = rng.choice(["}", "int"])
+            commands.append(("edit", offset, 0, junk))
+            commands.append(("edit", offset, len(junk), ""))
+        else:
+            # 只改不在标识符中的十进制字面量, 新的值不为 0, 避免除以 0 和长度为 0 的数组
+            literals = list(re.finditer(r"(?<![A-Za-z0-9_])[1-9][0-9]*(?![A-Za-z0-9_])", source))
+            if not literals:
+                continue
+            literal = rng.choice(literals)
+            value = str(rng.randrange(1, 10))
+            commands.append(("edit", literal.start(), len(literal.group(0)), value))
+            source = source[:literal.start()] + value + source[literal.end():]
+        checkpoints.append((len(commands), source))
+    return commands, checkpoints
+
+
+def edit_script(commands):
+    lines = []
+    for command, offset, length, text in commands:
+        data = text.encode()
+        header = f"open {len(data)}" if command == "open" else f"edit {offset} {length} {len(data)}"
+        lines.append(header.encode() + b"\n" + data + b"\n")
+    return b"".join(lines)
+
+
+def normalize(koopa):
+    # 按第一次出现的顺序给 % 和 @ 开头的名字重新编号
+    names = {}
+    return re.sub(r"[%@][A-Za-z0-9_]+", lambda m: names.setdefault(m.group(0), m.group(0)[0] + str(len(names))), koopa)
+
+
+def check_point(compiler, commands, source, work_dir):
+    script = work_dir / "edits.txt"
+    script.write_bytes(edit_script(commands))
+    incremental = subprocess.run([compiler, "-incremental", str(script), "-o", str(work_dir / "inc.koopa")],
+                                 capture_output=True, text=True)
+    if incremental.returncode != 0:
+        return f"-incremental failed: {incremental.stderr.strip()}"
+    last_log = incremental.stderr.rstrip().split("\n")[-1]
+    if "error" in last_log:
+        return f"errors remain: {last_log}"
+
+    full_path = work_dir / "full.c"
+    full_path.write_text(source)
+    full = subprocess.run([compiler, "-koopa", str(full_path), "-o", str(work_dir / "full.koopa"), "--passes="],
+                          capture_output=True, text=True)
+    if full.returncode != 0:
+        return f"full compilation failed: {full.stderr.strip()}"
+    if normalize((work_dir / "inc.koopa").read_text()) != normalize((work_dir / "full.koopa").read_text()):
+        return "Koopa IR differs from the full compilation"
+    return None
+
+
+def check(compiler, path, seed, rounds, work_dir):
+    commands, checkpoints = edit_commands(path.read_text(), random.Random(seed), rounds)
+    for count, source in checkpoints:
+        error = check_point(compiler, commands[:count], source, work_dir)
+        if error:
+            return f"after {count} commands: {error}"
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("compiler")
+    parser.add_argument("sources", nargs="+", type=Path)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--rounds", type=int, default=30)
+    args = parser.parse_args()
+
+    failed = 0
+    with tempfile.TemporaryDirectory() as work_dir:
+        for i, path in enumerate(args.sources):
+            error = check(args.compiler, path, args.seed + i, args.rounds, Path(work_dir))
+            print(f"{path}: {error or 'ok'}")
+            failed += error is not None
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()